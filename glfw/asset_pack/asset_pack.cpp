@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "../common/asset_archive.h"
+#include "../common/virtual_texture_file.h"
+
+// Compressed entries are only kept if they save at least this fraction of the size
+#define MIN_COMPRESSION_SAVING 0.125
+
+/*
+ * A structure for storing a file to be packed
+ */
+typedef struct {
+    std::string name;
+    std::vector<uint8_t> contents;
+    AssetArchiveEntry entry;
+} PackedFile;
+
+/*
+ * Read a complete file into memory. Returns FALSE if the file can not be read.
+ */
+int readFile(const char *filename, std::vector<uint8_t> &contents) {
+
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+        return 0;
+
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    contents.resize(fileSize > 0 ? fileSize : 0);
+    int success = fileSize >= 0 && fread(contents.data(), 1, contents.size(), file) == contents.size();
+    fclose(file);
+
+    return success;
+
+}
+
+/*
+ * Check whether a file is an image that should be stored decoded
+ */
+int isImageFile(const std::string &name) {
+
+    const char *extensions[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp", ".psd", ".gif" };
+    for (int e=0; e<7; ++e) {
+        size_t length = strlen(extensions[e]);
+        if (name.length() > length) {
+            std::string extension = name.substr(name.length() - length);
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if (extension == extensions[e])
+                return 1;
+        }
+    }
+
+    return 0;
+
+}
+
+/*
+ * Get the name a file is looked up by, relative to the working directory with forward slashes
+ */
+std::string getArchiveName(const char *filename) {
+
+    while (filename[0] == '.' && (filename[1] == '/' || filename[1] == '\\'))
+        filename += 2;
+
+    std::string name = filename;
+    std::replace(name.begin(), name.end(), '\\', '/');
+    return name;
+
+}
+
+/*
+ * Load a file and prepare its contents for the archive, decoding images and compressing the
+ * contents if that is enabled and worthwhile. Returns FALSE if the file can not be read.
+ */
+int packFile(const char *filename, int compress, PackedFile *file) {
+
+    file->name = getArchiveName(filename);
+    memset(&file->entry, 0, sizeof(AssetArchiveEntry));
+    if (!readFile(filename, file->contents)) {
+        printf("Unable to read %s\n", filename);
+        return 0;
+    }
+
+    // Images are stored decoded with their own number of channels, the loader converts them
+    file->entry.type = ASSET_FILE;
+    if (isImageFile(file->name)) {
+        int width, height, channels;
+        stbi_uc *pixels = stbi_load_from_memory(file->contents.data(), (int)file->contents.size(), &width, &height, &channels, STBI_default);
+        if (pixels) {
+            file->contents.assign(pixels, pixels + (size_t)width * height * channels);
+            stbi_image_free(pixels);
+            file->entry.type = ASSET_IMAGE;
+            file->entry.width = width;
+            file->entry.height = height;
+            file->entry.channels = channels;
+        } else
+            printf("Unable to decode %s, it is stored as a file\n", filename);
+    }
+    file->entry.size = file->contents.size();
+
+    file->entry.compression = ASSET_STORED;
+    if (compress) {
+        std::vector<uint8_t> compressed;
+        compressLz4(file->contents.data(), file->contents.size(), compressed);
+        if (compressed.size() <= file->contents.size() * (1.0 - MIN_COMPRESSION_SAVING)) {
+            file->contents.swap(compressed);
+            file->entry.compression = ASSET_LZ4;
+        }
+    }
+    file->entry.storedSize = file->contents.size();
+
+    return 1;
+
+}
+
+/*
+ * Write the archive. The table of contents is followed by the blobs, each starting at a multiple of
+ * the alignment. Returns FALSE if the archive can not be written.
+ */
+int writeArchive(const char *filename, std::vector<PackedFile> &files) {
+
+    // Lay out the names and the blobs
+    std::string names;
+    for (size_t f=0; f<files.size(); ++f) {
+        files[f].entry.nameOffset = names.length();
+        files[f].entry.nameLength = files[f].name.length();
+        names += files[f].name;
+    }
+
+    AssetArchiveHeader header;
+    header.magic = ASSET_ARCHIVE_MAGIC;
+    header.version = ASSET_ARCHIVE_VERSION;
+    header.numEntries = files.size();
+    header.namesSize = names.length();
+
+    uint64_t offset = sizeof(AssetArchiveHeader) + files.size() * sizeof(AssetArchiveEntry) + names.length();
+    for (size_t f=0; f<files.size(); ++f) {
+        offset = alignArchiveOffset(offset);
+        files[f].entry.offset = offset;
+        offset += files[f].entry.storedSize;
+    }
+
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        printf("Unable to write %s\n", filename);
+        return 0;
+    }
+
+    fwrite(&header, sizeof(AssetArchiveHeader), 1, file);
+    for (size_t f=0; f<files.size(); ++f)
+        fwrite(&files[f].entry, sizeof(AssetArchiveEntry), 1, file);
+    fwrite(names.data(), 1, names.length(), file);
+
+    // Pad up to every blob with zeros
+    std::vector<char> padding(ASSET_ARCHIVE_ALIGNMENT, 0);
+    for (size_t f=0; f<files.size(); ++f) {
+        long position = ftell(file);
+        fwrite(padding.data(), 1, files[f].entry.offset - position, file);
+        fwrite(files[f].contents.data(), 1, files[f].contents.size(), file);
+    }
+
+    int success = !ferror(file);
+    fclose(file);
+    if (!success)
+        printf("Unable to write %s\n", filename);
+
+    return success;
+
+}
+
+/*
+ * Copy a tile of a level of a virtual texture together with its border, the texels past the edges
+ * of the level repeating from the opposite edge
+ */
+void copyVirtualTile(const stbi_uc *level, int levelSize, int tileX, int tileY, std::vector<uint8_t> &tile) {
+
+    int left = tileX * VIRTUAL_TILE_SIZE - VIRTUAL_TILE_BORDER, top = tileY * VIRTUAL_TILE_SIZE - VIRTUAL_TILE_BORDER;
+    for (int y=0; y<VIRTUAL_TILE_STRIDE; ++y) {
+        int sourceY = ((top + y) % levelSize + levelSize) % levelSize;
+        for (int x=0; x<VIRTUAL_TILE_STRIDE; ++x) {
+            int sourceX = ((left + x) % levelSize + levelSize) % levelSize;
+            memcpy(&tile[(y * VIRTUAL_TILE_STRIDE + x) * 4], &level[((size_t)sourceY * levelSize + sourceX) * 4], 4);
+        }
+    }
+
+}
+
+/*
+ * Cut an image into the tiles of a virtual texture, see virtual_texture_file.h. The levels are made
+ * by averaging blocks of 2x2 texels of the previous level. Returns FALSE if the image can not be
+ * read or is not square with a power of two size, or the file can not be written.
+ */
+int tileImage(const char *imageName, const char *filename, int compress) {
+
+    int size, height, channels;
+    stbi_uc *pixels = stbi_load(imageName, &size, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        printf("Unable to read %s\n", imageName);
+        return 0;
+    }
+    if (size != height || size < VIRTUAL_TILE_SIZE || (size & (size - 1)) || size / VIRTUAL_TILE_SIZE > VIRTUAL_TEXTURE_MAX_TILES) {
+        printf("%s is %dx%d, a virtual texture must be square with a power of two size from %d to %d\n", imageName, size, height,
+                VIRTUAL_TILE_SIZE, VIRTUAL_TILE_SIZE * VIRTUAL_TEXTURE_MAX_TILES);
+        stbi_image_free(pixels);
+        return 0;
+    }
+
+    VirtualTextureHeader header;
+    memset(&header, 0, sizeof(VirtualTextureHeader));
+    header.magic = VIRTUAL_TEXTURE_MAGIC;
+    header.version = VIRTUAL_TEXTURE_VERSION;
+    header.size = size;
+    header.levels = getVirtualTextureLevels(size);
+    header.numTiles = getVirtualLevelFirstTile(size, header.levels);
+    header.tileSize = VIRTUAL_TILE_SIZE;
+    header.border = VIRTUAL_TILE_BORDER;
+
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        printf("Unable to write %s\n", filename);
+        stbi_image_free(pixels);
+        return 0;
+    }
+
+    // The table is written once the tiles are, its place being kept after the header
+    std::vector<VirtualTileEntry> entries(header.numTiles);
+    uint64_t offset = sizeof(VirtualTextureHeader) + header.numTiles * sizeof(VirtualTileEntry);
+    fwrite(&header, sizeof(VirtualTextureHeader), 1, file);
+    fwrite(entries.data(), sizeof(VirtualTileEntry), entries.size(), file);
+
+    std::vector<uint8_t> level(pixels, pixels + (size_t)size * size * 4), nextLevel;
+    std::vector<uint8_t> tile(VIRTUAL_TILE_BYTES), compressed;
+    stbi_image_free(pixels);
+
+    uint64_t totalStored = 0;
+    for (int l=0; l<(int)header.levels; ++l) {
+
+        int levelSize = size >> l, tiles = getVirtualTilesPerSide(size, l), first = getVirtualLevelFirstTile(size, l);
+        for (int y=0; y<tiles; ++y)
+            for (int x=0; x<tiles; ++x) {
+
+                VirtualTileEntry *entry = &entries[first + y * tiles + x];
+                copyVirtualTile(level.data(), levelSize, x, y, tile);
+                const std::vector<uint8_t> *stored = &tile;
+                entry->compression = ASSET_STORED;
+                if (compress) {
+                    compressLz4(tile.data(), tile.size(), compressed);
+                    if (compressed.size() <= tile.size() * (1.0 - MIN_COMPRESSION_SAVING)) {
+                        stored = &compressed;
+                        entry->compression = ASSET_LZ4;
+                    }
+                }
+                entry->offset = offset;
+                entry->storedSize = stored->size();
+                fwrite(stored->data(), 1, stored->size(), file);
+                offset += stored->size();
+                totalStored += stored->size();
+
+            }
+
+        // Average blocks of 2x2 texels for the next level
+        int nextSize = levelSize / 2;
+        nextLevel.resize((size_t)nextSize * nextSize * 4);
+        for (int y=0; y<nextSize; ++y)
+            for (int x=0; x<nextSize; ++x)
+                for (int c=0; c<4; ++c) {
+                    const uint8_t *block = &level[((size_t)(2 * y) * levelSize + 2 * x) * 4 + c];
+                    int sum = block[0] + block[4] + block[levelSize * 4] + block[levelSize * 4 + 4];
+                    nextLevel[((size_t)y * nextSize + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+                }
+        level.swap(nextLevel);
+
+    }
+
+    fseek(file, sizeof(VirtualTextureHeader), SEEK_SET);
+    fwrite(entries.data(), sizeof(VirtualTileEntry), entries.size(), file);
+
+    int success = !ferror(file);
+    fclose(file);
+    if (!success) {
+        printf("Unable to write %s\n", filename);
+        return 0;
+    }
+
+    printf("Tiled %s into %s: %dx%d, %u levels, %u tiles, %.2f MiB stored\n", imageName, filename, size, size, header.levels, header.numTiles,
+            totalStored / 1048576.0);
+
+    return 1;
+
+}
+
+int main(int nargs, const char **argv) {
+
+    // Ensure that there is an archive and at least one file, or an image and the file it is tiled
+    // into after -tile, optionally preceded by -lz4
+    int compress = nargs > 1 && strcmp(argv[1], "-lz4") == 0;
+    int firstArgument = compress ? 2 : 1;
+    if (nargs == firstArgument + 3 && strcmp(argv[firstArgument], "-tile") == 0)
+        exit(tileImage(argv[firstArgument + 1], argv[firstArgument + 2], compress) ? EXIT_SUCCESS : EXIT_FAILURE);
+    if (nargs < firstArgument + 2) {
+        printf("Usage: %s [-lz4] <archive> <file>...\n", argv[0]);
+        printf("       %s [-lz4] -tile <image> <tiles>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    const char *archiveName = argv[firstArgument];
+
+    std::vector<PackedFile> files(nargs - firstArgument - 1);
+    for (size_t f=0; f<files.size(); ++f)
+        if (!packFile(argv[firstArgument + 1 + f], compress, &files[f]))
+            exit(EXIT_FAILURE);
+
+    // The table of contents is sorted by name for the binary search, see findArchiveEntry
+    std::sort(files.begin(), files.end(), [](const PackedFile &a, const PackedFile &b) { return a.name < b.name; });
+    for (size_t f=1; f<files.size(); ++f)
+        if (files[f].name == files[f-1].name) {
+            printf("%s is given more than once\n", files[f].name.c_str());
+            exit(EXIT_FAILURE);
+        }
+
+    if (!writeArchive(archiveName, files))
+        exit(EXIT_FAILURE);
+
+    // Print the contents
+    uint64_t totalSize = 0, totalStored = 0;
+    for (size_t f=0; f<files.size(); ++f) {
+        const AssetArchiveEntry *entry = &files[f].entry;
+        if (entry->type == ASSET_IMAGE)
+            printf("%s: image %ux%u, %u channels, ", files[f].name.c_str(), entry->width, entry->height, entry->channels);
+        else
+            printf("%s: file, ", files[f].name.c_str());
+        printf("%llu bytes", (unsigned long long)entry->size);
+        if (entry->compression == ASSET_LZ4)
+            printf(", %llu compressed (%.1f%%)", (unsigned long long)entry->storedSize, 100.0 * entry->storedSize / entry->size);
+        printf("\n");
+        totalSize += entry->size;
+        totalStored += entry->storedSize;
+    }
+    uint64_t archiveSize = files.empty() ? 0 : files.back().entry.offset + files.back().entry.storedSize;
+    printf("Packed %d files in %s, %.2f MiB stored as %.2f MiB, archive %.2f MiB\n", (int)files.size(), archiveName, totalSize / 1048576.0,
+            totalStored / 1048576.0, archiveSize / 1048576.0);
+
+    exit(EXIT_SUCCESS);
+
+}
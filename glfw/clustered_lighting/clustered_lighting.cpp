@@ -0,0 +1,1008 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include "../common/program_builder.h"
+#include "../common/asset_io.h"
+#include "../common/frame_pacer.h"
+
+#define DEFAULT_WIDTH 1024
+#define DEFAULT_HEIGHT 768
+
+// Vertex Buffer Identifiers
+#define GLOBAL_MATRICES 0
+#define MODEL_MATRIX 1
+#define MATERIAL_PROPERTIES 2
+#define CAMERA_PROPERTIES 3
+#define CLUSTER_PROPERTIES 4
+#define LIGHTS 5
+#define CLUSTER_COUNTS 6
+#define CLUSTER_INDICES 7
+#define INVERSE_MATRICES 8
+
+// Vertex Array attributes
+#define POSITION 0
+#define NORMAL 1
+#define UV 2
+
+// Vertex Array binding points
+#define STREAM0 0
+
+// GLSL Uniform indices
+#define TRANSFORM0 0
+#define TRANSFORM1 1
+#define MATERIAL 3
+#define CAMERA 4
+#define CLUSTERS 5
+#define INVERSE_TRANSFORM 6
+
+// GLSL Shader storage indices
+#define LIGHT_STORAGE 0
+#define COUNT_STORAGE 1
+#define INDEX_STORAGE 2
+
+// Dimensions of the cluster grid (froxels)
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+#define NUM_CLUSTERS (CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z)
+#define MAX_LIGHTS_PER_CLUSTER 256
+
+// Work group size of the light culling shader (BATCH_SIZE in light_culling.comp)
+#define CULLING_GROUP_SIZE 128
+
+// Number of point lights
+#define MIN_LIGHTS 16
+#define MAX_LIGHTS 4096
+
+// Near and far planes, also used to divide the depth into cluster slices
+#define Z_NEAR 1.0f
+#define Z_FAR 500.0f
+
+// Shading modes
+#define SHADING_CLUSTERED 0
+#define SHADING_ALL_LIGHTS 1
+#define SHADING_HEAT_MAP 2
+#define NUM_SHADING_MODES 3
+
+// Renderers
+#define RENDERER_FORWARD 0
+#define RENDERER_DEFERRED 1
+
+// G-buffer attachments, also used as texture units in the lighting pass
+#define GBUFFER_ALBEDO 0
+#define GBUFFER_NORMAL 1
+#define GBUFFER_SPECULAR 2
+#define GBUFFER_DEPTH 3
+
+// Copies of the model placed behind each other to increase the depth complexity
+#define MAX_COPIES 16
+#define COPY_SPACING 25.0f
+
+// Timer queries
+#define CULLING_TIMER 0
+#define SHADING_TIMER 1
+#define LIGHTING_TIMER 2
+#define NUM_TIMERS 3
+
+// Frames rendered for every configuration of the renderer comparison
+#define COMPARISON_WARMUP_FRAMES 20
+#define COMPARISON_FRAMES 60
+
+/*
+ * A structure for storing mesh data
+ */
+typedef struct {
+    GLuint bufferName;
+    GLuint arrayName;
+    GLuint textureName;
+    GLsizei numVertices;
+} Mesh;
+
+/*
+ * A structure for storing a point light (std430, see clustered_lighting.frag)
+ */
+typedef struct {
+    // Position and radius of influence
+    GLfloat position[4];
+    GLfloat color[4];
+} PointLight;
+
+/*
+ * A structure for storing the light buffer (std430, see clustered_lighting.frag)
+ */
+typedef struct {
+    GLfloat ambient[4];
+    GLuint numLights;
+    GLuint padding[3];
+    PointLight lights[MAX_LIGHTS];
+} LightStorage;
+
+/*
+ * A structure for storing the cluster grid properties (std140, see light_culling.comp)
+ */
+typedef struct {
+    GLuint gridSize[4];
+    GLfloat screenSize[2];
+    GLfloat zNear;
+    GLfloat zFar;
+    GLuint shadingMode;
+} ClusterProperties;
+
+/*
+ * A structure for storing the animation of a light orbiting the scene
+ */
+typedef struct {
+    float orbitRadius;
+    float height;
+    float speed;
+    float phase;
+} LightAnimation;
+
+// A vector of mesh instances
+std::vector<Mesh> meshes;
+
+GLfloat materialProperties[] = {
+    // Shininess color
+    1.0f, 1.0f, 1.0f, 1.0f,
+    // Shininess
+    32.0f
+};
+
+// Camera properties
+GLfloat cameraProperties[] {
+    // Position
+    0.0f, 10.0f, 90.0f
+};
+
+ClusterProperties clusterProperties = {
+    { CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, MAX_LIGHTS_PER_CLUSTER },
+    { DEFAULT_WIDTH, DEFAULT_HEIGHT },
+    Z_NEAR, Z_FAR,
+    SHADING_CLUSTERED
+};
+
+// Animation of every light and the number of lights in use
+LightAnimation lightAnimations[MAX_LIGHTS];
+int numLights = 1024;
+
+// The active renderer and the number of copies of the model
+int renderer = RENDERER_FORWARD;
+int numCopies = 1;
+
+// Pointers for updating GPU data
+GLfloat *projectionMatrixPtr;
+GLfloat *viewMatrixPtr;
+GLubyte *modelMatricesPtr;
+GLfloat *inverseProjectionMatrixPtr;
+GLfloat *inverseViewMatrixPtr;
+LightStorage *lightStoragePtr;
+
+// Distance between the model matrices of the copies, respecting the uniform buffer alignment
+GLint modelMatrixStride;
+
+// Names
+GLuint programName;
+GLuint cullingProgramName;
+GLuint gbufferProgramName;
+GLuint lightingProgramName;
+GLuint vertexBufferNames[9];
+GLuint timerQueryNames[2][NUM_TIMERS];
+GLuint gbufferName;
+GLuint gbufferTextureNames[4];
+GLuint emptyArrayName;
+
+// Builder for compiling the shader programs in parallel with the loading
+ProgramBuilder programBuilder;
+int programIndex;
+int cullingProgramIndex;
+int gbufferProgramIndex;
+int lightingProgramIndex;
+
+// Frame statistics
+int frameCount;
+double culledTime, shadedTime, litTime, statisticsTime;
+
+/*
+ * Load a texture from the specified image file. Returns the texture name or 0 if the image could
+ * not be loaded.
+ */
+GLuint loadTexture(const char *filename) {
+
+    // Read the texture image
+    int width, height, channels;
+    GLubyte *imageData = loadImageAsset(filename, &width, &height, &channels, STBI_default);
+    if (!imageData)
+        return 0;
+
+    if (channels != 3 && channels != 4) {
+        stbi_image_free(imageData);
+        return 0;
+    }
+
+    // Generate a new texture name and activate it
+    GLuint textureName;
+    glGenTextures(1, &textureName);
+    glBindTexture(GL_TEXTURE_2D, textureName);
+
+    // Set sampler properties
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    if (channels == 3)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData);
+
+    // Generate mip map images
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    // Deactivate the texture and free the image data
+    glBindTexture(GL_TEXTURE_2D, 0);
+    stbi_image_free(imageData);
+
+    return textureName;
+
+}
+
+/*
+ * Load a model from the specified obj-file. The material library and textures are expected in the
+ * same directory as the obj-file. WARNING This function will cause memory leaks on the GPU if
+ * called multiple times.
+ */
+int loadObj(const char *filename) {
+
+    // Variables for storing the data in the OBJ-data
+    tinyobj::attrib_t attributes;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+
+    // String used to return an error message from tiny_obj_loader
+    std::string errorString;
+
+    // Find the directory of the obj-file
+    std::string directory = filename;
+    size_t separator = directory.find_last_of("/\\");
+    directory = separator == std::string::npos ? "./" : directory.substr(0, separator + 1);
+
+    // Load the file, or return FALSE if an error occured
+    if (!loadObjAsset(&attributes, &shapes, &materials, &errorString, filename, directory.c_str()))
+        return 0;
+
+    // Loop through all the shapes in the OBJ-data
+    for(int m=0; m<shapes.size(); ++m) {
+
+        // Create a new Mesh instance and store a local ponter for easy access
+        meshes.push_back(Mesh());
+        Mesh *mesh = &meshes[meshes.size()-1];
+
+        // Store a pointer to the mesh of the current shape
+        tinyobj::mesh_t *objMesh = &shapes[m].mesh;
+
+        // Load the texture of the first face in the mesh. This is used for the entire mesh.
+        std::string textureFilename = directory + materials[objMesh->material_ids[0]].diffuse_texname;
+        if (!(mesh->textureName = loadTexture(textureFilename.c_str())))
+            return 0;
+
+        // Store the number of vertices in the mesh
+        int numVertices = mesh->numVertices = objMesh->indices.size();
+
+        // Create a vector for storing the vertex data (POSITION NORMAL UV)
+        std::vector<GLfloat> vertices;
+        vertices.reserve(numVertices * 8);
+        for (int v=0; v<numVertices; ++v) {
+            tinyobj::index_t idx = objMesh->indices[v];
+            vertices.push_back(attributes.vertices[idx.vertex_index*3]);
+            vertices.push_back(attributes.vertices[idx.vertex_index*3+1]);
+            vertices.push_back(attributes.vertices[idx.vertex_index*3+2]);
+            vertices.push_back(attributes.normals[idx.normal_index*3]);
+            vertices.push_back(attributes.normals[idx.normal_index*3+1]);
+            vertices.push_back(attributes.normals[idx.normal_index*3+2]);
+            vertices.push_back(attributes.texcoords[idx.texcoord_index*2]);
+            vertices.push_back(1.0f - attributes.texcoords[idx.texcoord_index*2+1]);
+        }
+
+        // Create a vertex buffer with the vertex data
+        glCreateBuffers(1, &mesh->bufferName);
+        glNamedBufferStorage(mesh->bufferName, vertices.size() * sizeof(GLfloat), &vertices[0], 0);
+
+        // Create and initialize a vertex array object
+        glCreateVertexArrays(1, &mesh->arrayName);
+
+        // Associate vertex attributes with the binding point (POSITION NORMAL UV)
+        glVertexArrayAttribBinding(mesh->arrayName, POSITION, STREAM0);
+        glVertexArrayAttribBinding(mesh->arrayName, NORMAL, STREAM0);
+        glVertexArrayAttribBinding(mesh->arrayName, UV, STREAM0);
+        // Enable the attributes
+        glEnableVertexArrayAttrib(mesh->arrayName, POSITION);
+        glEnableVertexArrayAttrib(mesh->arrayName, NORMAL);
+        glEnableVertexArrayAttrib(mesh->arrayName, UV);
+
+        // Specify the format of the attributes
+        glVertexArrayAttribFormat(mesh->arrayName, POSITION, 3, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribFormat(mesh->arrayName, NORMAL, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GL_FLOAT));
+        glVertexArrayAttribFormat(mesh->arrayName, UV, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GL_FLOAT));
+
+        // Bind the vertex data buffer to the vertex array
+        glVertexArrayVertexBuffer(mesh->arrayName, STREAM0, mesh->bufferName, 0, 8 * sizeof(GLfloat));
+
+    }
+
+    return 1;
+
+}
+
+/*
+ * Get a random number between min and max
+ */
+float randomRange(float min, float max) {
+
+    return min + (max - min) * (float)rand() / RAND_MAX;
+
+}
+
+/*
+ * Give every light a random orbit around the scene and a random saturated color
+ */
+void initLights() {
+
+    srand(21219);
+
+    lightStoragePtr->ambient[0] = lightStoragePtr->ambient[1] = lightStoragePtr->ambient[2] = 0.05f;
+    lightStoragePtr->ambient[3] = 1.0f;
+
+    for (int l=0; l<MAX_LIGHTS; ++l) {
+
+        lightAnimations[l].orbitRadius = randomRange(5.0f, 70.0f);
+        lightAnimations[l].height = randomRange(-20.0f, 50.0f);
+        lightAnimations[l].speed = randomRange(-0.5f, 0.5f);
+        lightAnimations[l].phase = randomRange(0.0f, 6.28f);
+
+        PointLight *light = &lightStoragePtr->lights[l];
+        light->position[3] = randomRange(4.0f, 10.0f);
+        float hue = randomRange(0.0f, 6.0f);
+        light->color[0] = glm::clamp(fabsf(hue - 3.0f) - 1.0f, 0.0f, 1.0f);
+        light->color[1] = glm::clamp(2.0f - fabsf(hue - 2.0f), 0.0f, 1.0f);
+        light->color[2] = glm::clamp(2.0f - fabsf(hue - 4.0f), 0.0f, 1.0f);
+        light->color[3] = 1.0f;
+
+    }
+
+}
+
+/*
+ * Move the lights along their orbits
+ */
+void updateLights(float time) {
+
+    lightStoragePtr->numLights = numLights;
+
+    for (int l=0; l<numLights; ++l) {
+        float angle = lightAnimations[l].phase + time * lightAnimations[l].speed;
+        lightStoragePtr->lights[l].position[0] = cosf(angle) * lightAnimations[l].orbitRadius;
+        lightStoragePtr->lights[l].position[1] = lightAnimations[l].height + sinf(time + lightAnimations[l].phase) * 2.0f;
+        lightStoragePtr->lights[l].position[2] = sinf(angle) * lightAnimations[l].orbitRadius;
+    }
+
+}
+
+// Pacer of the main loop
+FramePacer framePacer;
+
+/*
+ * Callback function for OpenGL debug messages
+ */
+void glDebugCallback(GLenum sources, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *msg, const void *userParam) {
+    printf("DEBUG: %s\n", msg);
+}
+
+/*
+ * Initialize OpenGL
+ */
+int initGL() {
+
+    // Register the debug callback function
+    glDebugMessageCallback(glDebugCallback, NULL);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+    // Create and initialize buffer names
+    glCreateBuffers(9, vertexBufferNames);
+
+    // Every copy of the model has its own model matrix, bound as a range of a single buffer
+    GLint uniformBufferAlignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferAlignment);
+    modelMatrixStride = (16 * sizeof(GLfloat) + uniformBufferAlignment - 1) / uniformBufferAlignment * uniformBufferAlignment;
+
+    // Allocate storage for the transformation matrices and retrieve their addresses
+    glNamedBufferStorage(vertexBufferNames[GLOBAL_MATRICES], 16 * sizeof(GLfloat) * 2, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    glNamedBufferStorage(vertexBufferNames[MODEL_MATRIX], modelMatrixStride * MAX_COPIES, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    glNamedBufferStorage(vertexBufferNames[INVERSE_MATRICES], 16 * sizeof(GLfloat) * 2, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+
+    // Allocate storage for the buffers used for lighting calculations
+    glNamedBufferStorage(vertexBufferNames[MATERIAL_PROPERTIES], 5 * sizeof(GLfloat), materialProperties, 0);
+    glNamedBufferStorage(vertexBufferNames[CAMERA_PROPERTIES], 3 * sizeof(GLfloat), cameraProperties, 0);
+    glNamedBufferStorage(vertexBufferNames[CLUSTER_PROPERTIES], sizeof(ClusterProperties), &clusterProperties, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage(vertexBufferNames[LIGHTS], sizeof(LightStorage), NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+
+    // Allocate storage for the light lists of the clusters, only ever accessed by the GPU
+    glNamedBufferStorage(vertexBufferNames[CLUSTER_COUNTS], NUM_CLUSTERS * sizeof(GLuint), NULL, 0);
+    glNamedBufferStorage(vertexBufferNames[CLUSTER_INDICES], NUM_CLUSTERS * MAX_LIGHTS_PER_CLUSTER * sizeof(GLuint), NULL, 0);
+
+    // Get a pointer to the global matrices data
+    GLfloat *globalMatricesPtr = (GLfloat *)glMapNamedBufferRange(vertexBufferNames[GLOBAL_MATRICES], 0, 16 * sizeof(GLfloat) * 2,
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    projectionMatrixPtr = globalMatricesPtr;
+    viewMatrixPtr = globalMatricesPtr + 16;
+
+    // Get a pointer to the model matrix data
+    modelMatricesPtr = (GLubyte *)glMapNamedBufferRange(vertexBufferNames[MODEL_MATRIX], 0, modelMatrixStride * MAX_COPIES,
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    // Get a pointer to the inverse matrices used for reconstructing positions in the lighting pass
+    GLfloat *inverseMatricesPtr = (GLfloat *)glMapNamedBufferRange(vertexBufferNames[INVERSE_MATRICES], 0, 16 * sizeof(GLfloat) * 2,
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    inverseProjectionMatrixPtr = inverseMatricesPtr;
+    inverseViewMatrixPtr = inverseMatricesPtr + 16;
+
+    // Get a pointer to the lights
+    lightStoragePtr = (LightStorage *)glMapNamedBufferRange(vertexBufferNames[LIGHTS], 0, sizeof(LightStorage),
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    initLights();
+
+    // Create the timer queries for measuring the passes of two frames
+    glCreateQueries(GL_TIME_ELAPSED, 2 * NUM_TIMERS, &timerQueryNames[0][0]);
+
+    // The fullscreen triangle of the lighting pass has no vertex attributes, but a vertex array
+    // must still be bound when drawing
+    glCreateVertexArrays(1, &emptyArrayName);
+
+    // Initialize the program builder
+    initProgramBuilder(&programBuilder);
+
+    // Load the shader sources and issue the compilation and linking of the programs. The results
+    // are collected after the OBJ-file has been loaded, allowing the driver to compile in parallel.
+    AssetView vertexSource, fragmentSource, computeSource, gbufferSource, lightingVertexSource, lightingFragmentSource;
+    if (!openAsset("clustered_lighting.vert", &vertexSource) ||
+            !openAsset("clustered_lighting.frag", &fragmentSource) ||
+            !openAsset("light_culling.comp", &computeSource) ||
+            !openAsset("gbuffer.frag", &gbufferSource) ||
+            !openAsset("deferred_lighting.vert", &lightingVertexSource) ||
+            !openAsset("deferred_lighting.frag", &lightingFragmentSource)) {
+        printf("ERROR Unable to read the shader sources\n");
+        return 0;
+    }
+    ShaderSource sources[] = {
+        { GL_VERTEX_SHADER, vertexSource.data, (GLint)vertexSource.size },
+        { GL_FRAGMENT_SHADER, fragmentSource.data, (GLint)fragmentSource.size }
+    };
+    ShaderSource cullingSources[] = {
+        { GL_COMPUTE_SHADER, computeSource.data, (GLint)computeSource.size }
+    };
+    ShaderSource gbufferSources[] = {
+        { GL_VERTEX_SHADER, vertexSource.data, (GLint)vertexSource.size },
+        { GL_FRAGMENT_SHADER, gbufferSource.data, (GLint)gbufferSource.size }
+    };
+    ShaderSource lightingSources[] = {
+        { GL_VERTEX_SHADER, lightingVertexSource.data, (GLint)lightingVertexSource.size },
+        { GL_FRAGMENT_SHADER, lightingFragmentSource.data, (GLint)lightingFragmentSource.size }
+    };
+    programIndex = addProgram(&programBuilder, sources, 2);
+    cullingProgramIndex = addProgram(&programBuilder, cullingSources, 1);
+    gbufferProgramIndex = addProgram(&programBuilder, gbufferSources, 2);
+    lightingProgramIndex = addProgram(&programBuilder, lightingSources, 2);
+    closeAsset(&vertexSource);
+    closeAsset(&fragmentSource);
+    closeAsset(&computeSource);
+    closeAsset(&gbufferSource);
+    closeAsset(&lightingVertexSource);
+    closeAsset(&lightingFragmentSource);
+
+    // Enable depth buffer testing
+    glEnable(GL_DEPTH_TEST);
+
+    return 1;
+
+}
+
+/*
+ * Accumulate the GPU time of the passes of a frame and print the averages once every second
+ */
+void updateStatistics(GLuint *queryNames) {
+
+    GLuint64 cullingTime = 0, shadingTime = 0, lightingTime = 0;
+    glGetQueryObjectui64v(queryNames[CULLING_TIMER], GL_QUERY_RESULT, &cullingTime);
+    glGetQueryObjectui64v(queryNames[SHADING_TIMER], GL_QUERY_RESULT, &shadingTime);
+    glGetQueryObjectui64v(queryNames[LIGHTING_TIMER], GL_QUERY_RESULT, &lightingTime);
+    culledTime += cullingTime * 1e-6;
+    shadedTime += shadingTime * 1e-6;
+    litTime += lightingTime * 1e-6;
+    frameCount++;
+
+    double time = glfwGetTime();
+    if (time - statisticsTime < 1.0)
+        return;
+
+    const char *modeNames[] = { "clustered", "all lights", "heat map" };
+    if (renderer == RENDERER_FORWARD)
+        printf("%4d lights, %2d copies (forward, %s): culling %.3f ms, shading %.3f ms, frame %.3f ms\n", numLights, numCopies,
+                modeNames[clusterProperties.shadingMode], culledTime / frameCount, shadedTime / frameCount,
+                (time - statisticsTime) * 1000.0 / frameCount);
+    else
+        printf("%4d lights, %2d copies (deferred, %s): culling %.3f ms, G-buffer %.3f ms, lighting %.3f ms, frame %.3f ms\n", numLights,
+                numCopies, modeNames[clusterProperties.shadingMode], culledTime / frameCount, shadedTime / frameCount,
+                litTime / frameCount, (time - statisticsTime) * 1000.0 / frameCount);
+
+    culledTime = shadedTime = litTime = 0.0;
+    frameCount = 0;
+    statisticsTime = time;
+
+}
+
+/*
+ * Draw every copy of the model with the active program. The copies are drawn from back to front,
+ * so every fragment of a copy further away is later covered by a nearer one.
+ */
+void drawModel() {
+
+    for (int c=numCopies-1; c>=0; --c) {
+
+        // Bind the model matrix of the copy
+        glBindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM1, vertexBufferNames[MODEL_MATRIX], c * modelMatrixStride, 16 * sizeof(GLfloat));
+
+        // Loop through all the meshes loaded from the OBJ-file
+        for (int m=0; m<meshes.size(); ++m) {
+
+            // Bind the vertex array and texture of the mesh
+            glBindVertexArray(meshes[m].arrayName);
+            glBindTextureUnit(0, meshes[m].textureName);
+
+            // Draw the vertex array
+            glDrawArrays(GL_TRIANGLES, 0, meshes[m].numVertices);
+
+        }
+
+    }
+
+}
+
+/*
+ * Draw OpenGL screne
+ */
+void drawGLScene() {
+
+    // The queries of this frame were last used two frames ago and are read before being reused
+    static int frame = 0;
+    GLuint *queryNames = timerQueryNames[frame % 2];
+    if (frame >= 2)
+        updateStatistics(queryNames);
+    frame++;
+
+    // Set the view matrix
+    glm::mat4 view = glm::mat4(1.0f);
+    view = glm::translate(view, glm::vec3(-cameraProperties[0], -cameraProperties[1], -cameraProperties[2]));
+    memcpy(viewMatrixPtr, &view[0][0], 16 * sizeof(GLfloat));
+    glm::mat4 inverseView = glm::inverse(view);
+    memcpy(inverseViewMatrixPtr, &inverseView[0][0], 16 * sizeof(GLfloat));
+
+    // Set the model matrix of every copy, each placed further away from the camera
+    for (int c=0; c<numCopies; ++c) {
+        glm::mat4 model = glm::mat4(1.0);
+        model = glm::translate(model, glm::vec3(0.0f, -20.0f, -c * COPY_SPACING));
+        memcpy(modelMatricesPtr + c * modelMatrixStride, &model[0][0], 16 * sizeof(GLfloat));
+    }
+
+    // Animate the lights
+    updateLights((float)glfwGetTime());
+
+    // Bind buffers to GLSL uniform and shader storage indices
+    glBindBufferBase(GL_UNIFORM_BUFFER, TRANSFORM0, vertexBufferNames[GLOBAL_MATRICES]);
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL, vertexBufferNames[MATERIAL_PROPERTIES]);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA, vertexBufferNames[CAMERA_PROPERTIES]);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CLUSTERS, vertexBufferNames[CLUSTER_PROPERTIES]);
+    glBindBufferBase(GL_UNIFORM_BUFFER, INVERSE_TRANSFORM, vertexBufferNames[INVERSE_MATRICES]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_STORAGE, vertexBufferNames[LIGHTS]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNT_STORAGE, vertexBufferNames[CLUSTER_COUNTS]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDEX_STORAGE, vertexBufferNames[CLUSTER_INDICES]);
+
+    // Assign the lights to the clusters they overlap
+    glBeginQuery(GL_TIME_ELAPSED, queryNames[CULLING_TIMER]);
+    glUseProgram(cullingProgramName);
+    glDispatchCompute((NUM_CLUSTERS + CULLING_GROUP_SIZE - 1) / CULLING_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glEndQuery(GL_TIME_ELAPSED);
+
+    if (renderer == RENDERER_FORWARD) {
+
+        // Shade every fragment as it is drawn
+        glBeginQuery(GL_TIME_ELAPSED, queryNames[SHADING_TIMER]);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glUseProgram(programName);
+        drawModel();
+        glEndQuery(GL_TIME_ELAPSED);
+
+        // The lighting pass is part of the shading pass, but the query must still have a result
+        glBeginQuery(GL_TIME_ELAPSED, queryNames[LIGHTING_TIMER]);
+        glEndQuery(GL_TIME_ELAPSED);
+
+    } else {
+
+        // Write the surface properties of the nearest fragments to the G-buffer
+        glBeginQuery(GL_TIME_ELAPSED, queryNames[SHADING_TIMER]);
+        glBindFramebuffer(GL_FRAMEBUFFER, gbufferName);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glUseProgram(gbufferProgramName);
+        drawModel();
+        glEndQuery(GL_TIME_ELAPSED);
+
+        // Shade every pixel once with a fullscreen triangle reading the G-buffer
+        glBeginQuery(GL_TIME_ELAPSED, queryNames[LIGHTING_TIMER]);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glDisable(GL_DEPTH_TEST);
+        glUseProgram(lightingProgramName);
+        for (int t=0; t<4; ++t)
+            glBindTextureUnit(t, gbufferTextureNames[t]);
+        glBindVertexArray(emptyArrayName);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
+        glEndQuery(GL_TIME_ELAPSED);
+
+        for (int t=1; t<4; ++t)
+            glBindTextureUnit(t, 0);
+
+    }
+
+    // Disable
+    glBindVertexArray(0);
+    glBindTextureUnit(0, 0);
+    glUseProgram(0);
+
+}
+
+/*
+ * Create the G-buffer textures and framebuffer for the given size, replacing any previous ones
+ */
+int createGBuffer(int width, int height) {
+
+    glDeleteFramebuffers(1, &gbufferName);
+    glDeleteTextures(4, gbufferTextureNames);
+
+    // Albedo, octahedral normal, specular color and shininess, and depth
+    GLenum formats[] = { GL_RGBA8, GL_RG16F, GL_RGBA8, GL_DEPTH_COMPONENT32F };
+    glCreateTextures(GL_TEXTURE_2D, 4, gbufferTextureNames);
+    for (int t=0; t<4; ++t) {
+        glTextureStorage2D(gbufferTextureNames[t], 1, formats[t], width, height);
+        glTextureParameteri(gbufferTextureNames[t], GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(gbufferTextureNames[t], GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    // Attach the textures to a framebuffer
+    glCreateFramebuffers(1, &gbufferName);
+    glNamedFramebufferTexture(gbufferName, GL_COLOR_ATTACHMENT0, gbufferTextureNames[GBUFFER_ALBEDO], 0);
+    glNamedFramebufferTexture(gbufferName, GL_COLOR_ATTACHMENT1, gbufferTextureNames[GBUFFER_NORMAL], 0);
+    glNamedFramebufferTexture(gbufferName, GL_COLOR_ATTACHMENT2, gbufferTextureNames[GBUFFER_SPECULAR], 0);
+    glNamedFramebufferTexture(gbufferName, GL_DEPTH_ATTACHMENT, gbufferTextureNames[GBUFFER_DEPTH], 0);
+    GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glNamedFramebufferDrawBuffers(gbufferName, 3, drawBuffers);
+
+    if (glCheckNamedFramebufferStatus(gbufferName, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("G-buffer framebuffer is incomplete\n");
+        return 0;
+    }
+
+    return 1;
+
+}
+
+void resizeGL(int width, int height) {
+
+    // Prevent division by zero
+    if (height == 0)
+        height = 1;
+
+    // Change the projection matrix
+    glm::mat4 proj = glm::perspective(3.14f/2.0f, (float)width/height, Z_NEAR, Z_FAR);
+    memcpy(projectionMatrixPtr, &proj[0][0], 16 * sizeof(GLfloat));
+    glm::mat4 inverseProj = glm::inverse(proj);
+    memcpy(inverseProjectionMatrixPtr, &inverseProj[0][0], 16 * sizeof(GLfloat));
+
+    // The clusters divide the screen into tiles
+    clusterProperties.screenSize[0] = width;
+    clusterProperties.screenSize[1] = height;
+    glNamedBufferSubData(vertexBufferNames[CLUSTER_PROPERTIES], 0, sizeof(ClusterProperties), &clusterProperties);
+
+    // The G-buffer follows the size of the window
+    if (width > 0)
+        createGBuffer(width, height);
+
+    // Set the OpenGL viewport
+    glViewport(0, 0, width, height);
+
+}
+
+/*
+ * Render a number of frames and return the average frame time in milliseconds. The GPU is drained
+ * before and after, so the time includes all the work queued by the frames. The events are polled
+ * every frame so the window stays responsive, and the measurement stops early, returning 0, if the
+ * window is to be closed.
+ */
+double measureFrames(GLFWwindow *window) {
+
+    for (int f=0; f<COMPARISON_WARMUP_FRAMES; ++f) {
+        drawGLScene();
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+        if (glfwWindowShouldClose(window))
+            return 0.0;
+    }
+    glFinish();
+
+    double startTime = glfwGetTime();
+    for (int f=0; f<COMPARISON_FRAMES; ++f) {
+        drawGLScene();
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+        if (glfwWindowShouldClose(window))
+            return 0.0;
+    }
+    glFinish();
+
+    return (glfwGetTime() - startTime) * 1000.0 / COMPARISON_FRAMES;
+
+}
+
+// Set while the renderers are compared, the keys changing the scene being ignored
+int comparisonRunning = 0;
+
+/*
+ * Compare the frame time of the forward and deferred renderers for increasing numbers of lights
+ * and depth complexity, using the active shading mode
+ */
+void compareRenderers(GLFWwindow *window) {
+
+    int lightCounts[] = { 256, 1024, 4096 };
+    int copyCounts[] = { 1, 4, 16 };
+
+    int previousLights = numLights, previousCopies = numCopies, previousRenderer = renderer;
+    comparisonRunning = 1;
+
+    printf("\nlights copies  forward (ms)  deferred (ms)\n");
+    for (int l=0; l<3 && !glfwWindowShouldClose(window); ++l)
+        for (int c=0; c<3 && !glfwWindowShouldClose(window); ++c) {
+
+            numLights = lightCounts[l];
+            numCopies = copyCounts[c];
+
+            renderer = RENDERER_FORWARD;
+            double forwardTime = measureFrames(window);
+            renderer = RENDERER_DEFERRED;
+            double deferredTime = measureFrames(window);
+            if (glfwWindowShouldClose(window))
+                break;
+
+            printf("%6d %6d %13.3f %14.3f\n", numLights, numCopies, forwardTime, deferredTime);
+
+        }
+    printf("\n");
+
+    numLights = previousLights;
+    numCopies = previousCopies;
+    renderer = previousRenderer;
+    comparisonRunning = 0;
+
+    // Restart the statistics, they include the frames of the comparison
+    culledTime = shadedTime = litTime = 0.0;
+    frameCount = 0;
+    statisticsTime = glfwGetTime();
+
+}
+
+/*
+ * Error callback function for GLFW
+ */
+static void glfwErrorCallback(int error, const char* description) {
+    fprintf(stderr, "Error: %s\n", description);
+}
+
+// Set by the key callback, the comparison is run by the main loop
+int comparisonRequested = 0;
+
+/*
+ * Input event callback function for GLFW
+ */
+static void glfwKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+
+    if (action != GLFW_PRESS)
+        return;
+
+    if (key == GLFW_KEY_ESCAPE)
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+    // The events are polled during the comparison, which measures a scene of its own
+    else if (comparisonRunning)
+        return;
+
+    // Double or halve the number of lights
+    else if (key == GLFW_KEY_UP && numLights < MAX_LIGHTS)
+        numLights *= 2;
+    else if (key == GLFW_KEY_DOWN && numLights > MIN_LIGHTS)
+        numLights /= 2;
+
+    // Double or halve the number of copies of the model
+    else if (key == GLFW_KEY_RIGHT && numCopies < MAX_COPIES)
+        numCopies *= 2;
+    else if (key == GLFW_KEY_LEFT && numCopies > 1)
+        numCopies /= 2;
+
+    // Switch between clustered shading, shading every light and the heat map
+    else if (key == GLFW_KEY_M) {
+        clusterProperties.shadingMode = (clusterProperties.shadingMode + 1) % NUM_SHADING_MODES;
+        glNamedBufferSubData(vertexBufferNames[CLUSTER_PROPERTIES], 0, sizeof(ClusterProperties), &clusterProperties);
+    }
+
+    // Switch between the forward and deferred renderer
+    else if (key == GLFW_KEY_R)
+        renderer = renderer == RENDERER_FORWARD ? RENDERER_DEFERRED : RENDERER_FORWARD;
+
+    // Measure both renderers at increasing numbers of lights and copies
+    else if (key == GLFW_KEY_C)
+        comparisonRequested = 1;
+
+    // Cycle through the frame pacing modes
+    else if (key == GLFW_KEY_F)
+        cycleFramePacingMode(&framePacer);
+
+}
+
+/*
+ * Window size changed callback function for GLFW
+ */
+void glfwWindowSizeCallback(GLFWwindow* window, int width, int height) {
+
+    resizeGL(width, height);
+
+}
+
+/*
+ * Program entry function
+ */
+int main(int nargs, const char **argv) {
+
+    // Ensure that there is one argument (besides the program name)
+    if (nargs != 2) {
+        printf("Usage: %s <obj-file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Set error callback
+    glfwSetErrorCallback(glfwErrorCallback);
+
+    // Initialize GLFW
+    if (!glfwInit()) {
+        printf("Failed to initialize GLFW\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Specify minimum OpenGL version
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+
+    // Create window
+    GLFWwindow* window = glfwCreateWindow(DEFAULT_WIDTH, DEFAULT_HEIGHT, "Clustered Lighting", NULL, NULL);
+    if (!window) {
+        printf("Failed to create GLFW window\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Set input key event callback
+    glfwSetKeyCallback(window, glfwKeyCallback);
+
+    // Set window resize callback
+    glfwSetWindowSizeCallback(window, glfwWindowSizeCallback);
+
+    // Make the context current
+    glfwMakeContextCurrent(window);
+
+    // Initialize GLEW
+    if (glewInit() != GLEW_OK) {
+        printf("Failed to initialize GLEW\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Make GLFW swap buffers directly
+    glfwSwapInterval(0);
+
+    // Initialize OpenGL
+    if (!initGL()) {
+        printf("Failed to initialize OpenGL\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Load the OBJ-file
+    if (!loadObj(argv[1])) {
+        printf("Failed to load %s.\n", argv[1]);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Wait for the shader programs that have been compiling while the OBJ-file was loaded
+    while (!pollPrograms(&programBuilder))
+        glfwWaitEventsTimeout(0.001);
+    if (!finishPrograms(&programBuilder)) {
+        printf("Failed to build shader programs\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    programName = getProgram(&programBuilder, programIndex);
+    cullingProgramName = getProgram(&programBuilder, cullingProgramIndex);
+    gbufferProgramName = getProgram(&programBuilder, gbufferProgramIndex);
+    lightingProgramName = getProgram(&programBuilder, lightingProgramIndex);
+
+    // Initialize OpenGL view
+    resizeGL(DEFAULT_WIDTH, DEFAULT_HEIGHT);
+
+    printf("UP/DOWN changes the number of lights, LEFT/RIGHT the number of copies of the model\n");
+    printf("M switches between clustered, all lights and heat map, R between forward and deferred\n");
+    printf("C compares the frame time of the forward and deferred renderers\n");
+    statisticsTime = glfwGetTime();
+
+    // Pace the frames to the refresh rate of the monitor
+    initFramePacer(&framePacer, PACING_JUST_IN_TIME);
+    printf("F cycles through the frame pacing modes\n");
+
+    // Run a loop until the window is closed
+    while (!glfwWindowShouldClose(window)) {
+
+        // Wait for the next frame and poll for input events
+        beginPacedFrame(&framePacer);
+
+        // Run the renderer comparison when requested
+        if (comparisonRequested) {
+            compareRenderers(window);
+            comparisonRequested = 0;
+        }
+
+        // Draw OpenGL screne
+        drawGLScene();
+
+        // Swap buffers
+        glfwSwapBuffers(window);
+
+        // Issue the fence and timestamp of the frame
+        endPacedFrame(&framePacer);
+
+    }
+
+    // Print the statistics of the last pacing mode
+    destroyFramePacer(&framePacer);
+
+    // Shutdown GLFW
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    // Exit
+    exit(EXIT_SUCCESS);
+
+}
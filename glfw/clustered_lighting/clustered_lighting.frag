@@ -0,0 +1,135 @@
+#version 450
+
+// Incoming interpolated (between vertices) values
+layout (location = 0) in Block
+{
+    vec2 UV;
+    vec3 N;
+    vec3 worldVertex;
+    float viewDepth;
+};
+
+struct PointLight
+{
+    // Position in world space and radius of influence in w
+    vec4 position;
+    vec4 color;
+};
+
+layout (std140, binding = 3) uniform Material
+{
+    vec4 shininessColor;
+    float shininess;
+};
+
+layout (std140, binding = 4) uniform Camera
+{
+    vec3 cameraPos;
+};
+
+// Dimensions of the cluster grid
+layout (binding = 5, std140) uniform Clusters
+{
+    // Number of clusters along x, y and z, and the maximum number of lights in a cluster
+    uvec4 gridSize;
+    vec2 screenSize;
+    float zNear;
+    float zFar;
+    // 0 shades the lights of the cluster, 1 shades every light, 2 shows the number of lights
+    uint shadingMode;
+};
+
+layout (binding = 0, std430) readonly buffer Lights
+{
+    vec4 ambient;
+    uint numLights;
+    PointLight lights[];
+};
+
+layout (binding = 1, std430) readonly buffer ClusterCounts
+{
+    uint lightCounts[];
+};
+
+layout (binding = 2, std430) readonly buffer ClusterIndices
+{
+    uint lightIndices[];
+};
+
+// Outgoing final color.
+layout (location = 0) out vec4 outputColor;
+
+// Texture sampler
+layout (binding = 0) uniform sampler2D textureSampler;
+
+// Vectors
+vec3 NN;
+vec3 V;
+
+// Colors
+vec4 color;
+
+/*
+ * Calculate the diffuse and specular light from a single point light
+ */
+vec3 shadePointLight(PointLight light) {
+
+    vec3 toLight = light.position.xyz - worldVertex;
+    float distance = length(toLight);
+    if (distance >= light.position.w)
+        return vec3(0.0);
+
+    // Smooth falloff reaching zero at the radius of the light
+    float falloff = 1.0 - (distance * distance) / (light.position.w * light.position.w);
+    float attenuation = falloff * falloff;
+
+    vec3 L = toLight / distance;
+    vec3 R = reflect(-L, NN);
+    vec3 diffuse = max(dot(L, NN), 0.0) * light.color.rgb * color.rgb;
+    vec3 specular = pow(max(dot(R, V), 0.0), shininess) * light.color.rgb * shininessColor.rgb;
+
+    return (diffuse + specular) * attenuation;
+
+}
+
+void main()
+{
+    color = texture(textureSampler, UV).rgba;
+
+    // Normalize the interpolated normal to ensure unit length
+    NN = normalize(N);
+
+    // Find the unit length normal giving the direction from the vertex to the camera
+    V = normalize(cameraPos - worldVertex);
+
+    // Find the cluster containing the fragment
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / screenSize * vec2(gridSize.xy)), gridSize.xy - 1);
+    float slice = log(viewDepth / zNear) / log(zFar / zNear) * float(gridSize.z);
+    uint z = min(uint(max(slice, 0.0)), gridSize.z - 1);
+    uint clusterIndex = tile.x + gridSize.x * (tile.y + gridSize.y * z);
+    uint count = lightCounts[clusterIndex];
+
+    vec3 light = ambient.rgb * color.rgb;
+    if (shadingMode == 0) {
+
+        // Only the lights overlapping the cluster are considered
+        for (uint l = 0; l < count; ++l)
+            light += shadePointLight(lights[lightIndices[clusterIndex * gridSize.w + l]]);
+
+    } else if (shadingMode == 1) {
+
+        // Brute force reference, every light is considered for every fragment
+        for (uint l = 0; l < numLights; ++l)
+            light += shadePointLight(lights[l]);
+
+    } else {
+
+        // Heat map of the number of lights in the cluster, blue is none and red is 64 or more
+        float heat = clamp(float(count) / 64.0, 0.0, 1.0);
+        light = mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), heat) * (0.5 + 0.5 * max(dot(NN, V), 0.0));
+
+    }
+
+    outputColor = vec4(light, color.a);
+
+}
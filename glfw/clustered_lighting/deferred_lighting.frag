@@ -0,0 +1,156 @@
+#version 450
+
+struct PointLight
+{
+    // Position in world space and radius of influence in w
+    vec4 position;
+    vec4 color;
+};
+
+layout (std140, binding = 4) uniform Camera
+{
+    vec3 cameraPos;
+};
+
+// Dimensions of the cluster grid
+layout (binding = 5, std140) uniform Clusters
+{
+    // Number of clusters along x, y and z, and the maximum number of lights in a cluster
+    uvec4 gridSize;
+    vec2 screenSize;
+    float zNear;
+    float zFar;
+    // 0 shades the lights of the cluster, 1 shades every light, 2 shows the number of lights
+    uint shadingMode;
+};
+
+// Inverse projection and view matrices for reconstructing the position from depth
+layout (binding = 6, std140) uniform InverseTransform
+{
+    mat4 invProj;
+    mat4 invView;
+};
+
+layout (binding = 0, std430) readonly buffer Lights
+{
+    vec4 ambient;
+    uint numLights;
+    PointLight lights[];
+};
+
+layout (binding = 1, std430) readonly buffer ClusterCounts
+{
+    uint lightCounts[];
+};
+
+layout (binding = 2, std430) readonly buffer ClusterIndices
+{
+    uint lightIndices[];
+};
+
+// Outgoing final color.
+layout (location = 0) out vec4 outputColor;
+
+// G-buffer samplers
+layout (binding = 0) uniform sampler2D albedoSampler;
+layout (binding = 1) uniform sampler2D normalSampler;
+layout (binding = 2) uniform sampler2D specularSampler;
+layout (binding = 3) uniform sampler2D depthSampler;
+
+// Surface properties read from the G-buffer
+vec3 worldVertex;
+vec3 NN;
+vec3 V;
+vec4 color;
+vec3 shininessColor;
+float shininess;
+
+/*
+ * Decode a normal stored with the octahedral mapping
+ */
+vec3 decodeNormal(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+/*
+ * Calculate the diffuse and specular light from a single point light
+ */
+vec3 shadePointLight(PointLight light) {
+
+    vec3 toLight = light.position.xyz - worldVertex;
+    float distance = length(toLight);
+    if (distance >= light.position.w)
+        return vec3(0.0);
+
+    // Smooth falloff reaching zero at the radius of the light
+    float falloff = 1.0 - (distance * distance) / (light.position.w * light.position.w);
+    float attenuation = falloff * falloff;
+
+    vec3 L = toLight / distance;
+    vec3 R = reflect(-L, NN);
+    vec3 diffuse = max(dot(L, NN), 0.0) * light.color.rgb * color.rgb;
+    vec3 specular = pow(max(dot(R, V), 0.0), shininess) * light.color.rgb * shininessColor;
+
+    return (diffuse + specular) * attenuation;
+
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+
+    // Nothing was drawn to the pixel
+    float depth = texelFetch(depthSampler, texel, 0).r;
+    if (depth == 1.0)
+        discard;
+
+    // Reconstruct the view and world space positions from the depth
+    vec4 ndc = vec4(gl_FragCoord.xy / screenSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 viewVertex = invProj * ndc;
+    viewVertex /= viewVertex.w;
+    worldVertex = vec3(invView * viewVertex);
+    float viewDepth = -viewVertex.z;
+
+    color = texelFetch(albedoSampler, texel, 0);
+    NN = decodeNormal(texelFetch(normalSampler, texel, 0).rg);
+    vec4 specular = texelFetch(specularSampler, texel, 0);
+    shininessColor = specular.rgb;
+    shininess = specular.a * 256.0;
+
+    // Find the unit length normal giving the direction from the vertex to the camera
+    V = normalize(cameraPos - worldVertex);
+
+    // Find the cluster containing the pixel
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / screenSize * vec2(gridSize.xy)), gridSize.xy - 1);
+    float slice = log(viewDepth / zNear) / log(zFar / zNear) * float(gridSize.z);
+    uint z = min(uint(max(slice, 0.0)), gridSize.z - 1);
+    uint clusterIndex = tile.x + gridSize.x * (tile.y + gridSize.y * z);
+    uint count = lightCounts[clusterIndex];
+
+    vec3 light = ambient.rgb * color.rgb;
+    if (shadingMode == 0) {
+
+        // Only the lights overlapping the cluster are considered
+        for (uint l = 0; l < count; ++l)
+            light += shadePointLight(lights[lightIndices[clusterIndex * gridSize.w + l]]);
+
+    } else if (shadingMode == 1) {
+
+        // Brute force reference, every light is considered for every pixel
+        for (uint l = 0; l < numLights; ++l)
+            light += shadePointLight(lights[l]);
+
+    } else {
+
+        // Heat map of the number of lights in the cluster, blue is none and red is 64 or more
+        float heat = clamp(float(count) / 64.0, 0.0, 1.0);
+        light = mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), heat) * (0.5 + 0.5 * max(dot(NN, V), 0.0));
+
+    }
+
+    outputColor = vec4(light, color.a);
+
+}
@@ -0,0 +1,44 @@
+#version 450
+
+// Incoming interpolated (between vertices) values
+layout (location = 0) in Block
+{
+    vec2 UV;
+    vec3 N;
+    vec3 worldVertex;
+    float viewDepth;
+};
+
+layout (std140, binding = 3) uniform Material
+{
+    vec4 shininessColor;
+    float shininess;
+};
+
+// Outgoing G-buffer values. Depth is written to the depth attachment.
+layout (location = 0) out vec4 outputAlbedo;
+layout (location = 1) out vec2 outputNormal;
+layout (location = 2) out vec4 outputSpecular;
+
+// Texture sampler
+layout (binding = 0) uniform sampler2D textureSampler;
+
+/*
+ * Encode a unit length normal with the octahedral mapping, storing it in two components
+ */
+vec2 encodeNormal(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e;
+}
+
+void main()
+{
+    outputAlbedo = texture(textureSampler, UV).rgba;
+    outputNormal = encodeNormal(normalize(N));
+
+    // The shininess exponent is stored divided by 256 to fit a normalized channel
+    outputSpecular = vec4(shininessColor.rgb, shininess / 256.0);
+}
@@ -0,0 +1,293 @@
+#ifndef ASSET_ARCHIVE_H
+#define ASSET_ARCHIVE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/*
+ * Packed asset archive holding the shader sources, models and textures of an example in a single
+ * file, so that loading them takes one mapping and one sequential read instead of an open, stat
+ * and read of every file. The archive starts with a header followed by a table of contents sorted
+ * by name and the names themselves. Every file is stored in a blob aligned to 4 KiB, so each one
+ * starts on its own page, optionally compressed with LZ4. Images are stored decoded, so the
+ * examples upload the pixels without running the PNG or JPEG decoder.
+ *
+ * The archives are built with asset_pack and read through asset_io.h. All values are little endian.
+ */
+
+// "ITFA" read as a little endian integer
+#define ASSET_ARCHIVE_MAGIC 0x41465449
+#define ASSET_ARCHIVE_VERSION 1
+#define ASSET_ARCHIVE_ALIGNMENT 4096
+
+// Compression of an entry
+#define ASSET_STORED 0
+#define ASSET_LZ4 1
+
+// Contents of an entry
+#define ASSET_FILE 0
+#define ASSET_IMAGE 1
+
+// LZ4 block format limits. The last match must start 12 bytes before the end of the block and be
+// followed by at least 5 literals.
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 16
+
+/*
+ * A structure for storing the archive header, followed by the entries and the names
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numEntries;
+    uint32_t namesSize;
+} AssetArchiveHeader;
+
+/*
+ * A structure for storing an entry of the table of contents
+ */
+typedef struct {
+    // Position of the blob in the archive, its size there and the size of the contents
+    uint64_t offset;
+    uint64_t storedSize;
+    uint64_t size;
+    // Name relative to the working directory, as an offset into the names following the entries
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t compression;
+    uint32_t type;
+    // Dimensions of the decoded pixels of an image
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t padding;
+} AssetArchiveEntry;
+
+/*
+ * Round an offset up to the alignment of the blobs
+ */
+inline uint64_t alignArchiveOffset(uint64_t offset) {
+
+    return (offset + ASSET_ARCHIVE_ALIGNMENT - 1) / ASSET_ARCHIVE_ALIGNMENT * ASSET_ARCHIVE_ALIGNMENT;
+
+}
+
+/*
+ * Check that the header and the table of contents are consistent and that every blob lies within
+ * the archive. Returns FALSE if the archive is truncated or not an archive.
+ */
+inline int validateAssetArchive(const char *archive, size_t size) {
+
+    if (size < sizeof(AssetArchiveHeader))
+        return 0;
+
+    const AssetArchiveHeader *header = (const AssetArchiveHeader *)archive;
+    if (header->magic != ASSET_ARCHIVE_MAGIC || header->version != ASSET_ARCHIVE_VERSION)
+        return 0;
+
+    uint64_t tocSize = sizeof(AssetArchiveHeader) + (uint64_t)header->numEntries * sizeof(AssetArchiveEntry) + header->namesSize;
+    if (tocSize > size)
+        return 0;
+
+    const AssetArchiveEntry *entries = (const AssetArchiveEntry *)(archive + sizeof(AssetArchiveHeader));
+    for (uint32_t e=0; e<header->numEntries; ++e) {
+        const AssetArchiveEntry *entry = &entries[e];
+        if ((uint64_t)entry->nameOffset + entry->nameLength > header->namesSize)
+            return 0;
+        if (entry->offset < tocSize || entry->offset > size || entry->storedSize > size - entry->offset)
+            return 0;
+        if (entry->compression == ASSET_STORED && entry->storedSize != entry->size)
+            return 0;
+    }
+
+    return 1;
+
+}
+
+/*
+ * Find an entry by name with a binary search of the table of contents. Returns NULL if the archive
+ * does not contain the file.
+ */
+inline const AssetArchiveEntry *findArchiveEntry(const char *archive, const char *name, size_t nameLength) {
+
+    const AssetArchiveHeader *header = (const AssetArchiveHeader *)archive;
+    const AssetArchiveEntry *entries = (const AssetArchiveEntry *)(archive + sizeof(AssetArchiveHeader));
+    const char *names = (const char *)(entries + header->numEntries);
+
+    uint32_t low = 0, high = header->numEntries;
+    while (low < high) {
+
+        uint32_t middle = (low + high) / 2;
+        const AssetArchiveEntry *entry = &entries[middle];
+
+        // Shorter names sort before longer names with the same prefix
+        size_t length = entry->nameLength < nameLength ? entry->nameLength : nameLength;
+        int order = memcmp(names + entry->nameOffset, name, length);
+        if (order == 0)
+            order = entry->nameLength < nameLength ? -1 : entry->nameLength > nameLength ? 1 : 0;
+
+        if (order == 0)
+            return entry;
+        if (order < 0)
+            low = middle + 1;
+        else
+            high = middle;
+
+    }
+
+    return NULL;
+
+}
+
+/*
+ * Decompress an LZ4 block. Returns FALSE if the block is corrupt or does not decompress to exactly
+ * the given size.
+ */
+inline int decompressLz4(const uint8_t *source, size_t sourceSize, uint8_t *destination, size_t destinationSize) {
+
+    const uint8_t *in = source, *inEnd = source + sourceSize;
+    uint8_t *out = destination, *outEnd = destination + destinationSize;
+
+    while (in < inEnd) {
+
+        // The token holds the number of literals in the high and the match length in the low bits,
+        // the value 15 being continued by bytes of 255
+        uint8_t token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t b;
+            do {
+                if (in == inEnd)
+                    return 0;
+                b = *in++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > (size_t)(inEnd - in) || literals > (size_t)(outEnd - out))
+            return 0;
+        memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+
+        // The block ends with literals
+        if (in == inEnd)
+            break;
+
+        if (inEnd - in < 2)
+            return 0;
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (offset == 0 || offset > (size_t)(out - destination))
+            return 0;
+
+        size_t matchLength = (token & 15) + LZ4_MIN_MATCH;
+        if ((token & 15) == 15) {
+            uint8_t b;
+            do {
+                if (in == inEnd)
+                    return 0;
+                b = *in++;
+                matchLength += b;
+            } while (b == 255);
+        }
+        if (matchLength > (size_t)(outEnd - out))
+            return 0;
+
+        // The match may overlap the bytes it produces, repeating a short pattern
+        const uint8_t *match = out - offset;
+        if (offset >= matchLength)
+            memcpy(out, match, matchLength);
+        else
+            for (size_t i=0; i<matchLength; ++i)
+                out[i] = match[i];
+        out += matchLength;
+
+    }
+
+    return out == outEnd;
+
+}
+
+/*
+ * Write a length continued by bytes of 255 as in the LZ4 token
+ */
+inline void writeLz4Length(std::vector<uint8_t> &out, size_t length) {
+
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back((uint8_t)length);
+
+}
+
+/*
+ * Write a sequence of literals followed by a match, or only the literals ending the block when the
+ * match length is 0
+ */
+inline void writeLz4Sequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t numLiterals, size_t offset, size_t matchLength) {
+
+    size_t matchCode = matchLength ? matchLength - LZ4_MIN_MATCH : 0;
+    out.push_back((uint8_t)(((numLiterals < 15 ? numLiterals : 15) << 4) | (matchCode < 15 ? matchCode : 15)));
+    if (numLiterals >= 15)
+        writeLz4Length(out, numLiterals - 15);
+    out.insert(out.end(), literals, literals + numLiterals);
+
+    if (matchLength) {
+        out.push_back((uint8_t)(offset & 0xff));
+        out.push_back((uint8_t)(offset >> 8));
+        if (matchCode >= 15)
+            writeLz4Length(out, matchCode - 15);
+    }
+
+}
+
+/*
+ * Compress data into an LZ4 block with a greedy search of 4-byte matches through a hash table. The
+ * result is meant for archives built ahead of time, so it favours simplicity over compression speed.
+ */
+inline void compressLz4(const uint8_t *source, size_t size, std::vector<uint8_t> &out) {
+
+    out.clear();
+    std::vector<int64_t> table((size_t)1 << LZ4_HASH_BITS, -1);
+
+    size_t anchor = 0, position = 0;
+    if (size > LZ4_MATCH_LIMIT) {
+
+        size_t matchEnd = size - LZ4_LAST_LITERALS;
+        size_t searchEnd = size - LZ4_MATCH_LIMIT;
+        while (position < searchEnd) {
+
+            uint32_t sequence;
+            memcpy(&sequence, source + position, 4);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+            int64_t candidate = table[hash];
+            table[hash] = position;
+
+            if (candidate < 0 || position - candidate > LZ4_MAX_OFFSET || memcmp(source + candidate, source + position, 4) != 0) {
+                position++;
+                continue;
+            }
+
+            // Extend the match as far as the last literals allow
+            size_t length = LZ4_MIN_MATCH;
+            while (position + length < matchEnd && source[candidate + length] == source[position + length])
+                length++;
+
+            writeLz4Sequence(out, source + anchor, position - anchor, position - candidate, length);
+            position += length;
+            anchor = position;
+
+        }
+
+    }
+
+    writeLz4Sequence(out, source + anchor, size - anchor, 0, 0);
+
+}
+
+#endif
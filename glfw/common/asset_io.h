@@ -0,0 +1,719 @@
+#ifndef ASSET_IO_H
+#define ASSET_IO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <string>
+#include <streambuf>
+#include <istream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "asset_archive.h"
+
+/*
+ * Read-only access to asset files through memory mapping. A file is opened as a view of its mapped
+ * pages, so shader sources are handed to the driver and OBJ, MTL and image files are parsed without
+ * copying them to the heap first. The views are not zero terminated, the size must be used.
+ *
+ * Mappings are kept in a cache after the last view is closed, so files opened repeatedly (shared
+ * shader sources, reloaded programs, textures used by several materials) are only mapped once. The
+ * cache is bounded by the number of files and the mapped bytes, evicting the least recently used
+ * files no longer in use. A file that has changed on disk since it was mapped is mapped again.
+ * On Windows a mapped file can not be truncated, which would stop an editor from saving a shader
+ * source, so the mappings are released when the last view is closed.
+ *
+ * When the working directory holds an archive built with asset_pack (see asset_archive.h), it is
+ * mapped once on first use and the files it contains are served from it instead. A loose file
+ * modified after the archive was built is opened instead of its archived copy, so edited shaders
+ * and models are used without rebuilding the archive, and a message tells which files are loose.
+ * Stored files are views of the archive, compressed files are decompressed to the heap. The shader
+ * reloader opens the loose files directly, as those are the ones being edited.
+ *
+ * The cache is shared by all threads. A file must not be truncated while a view of it is open, as
+ * reading the pages past the new end of the file is an error. Include the header after stb_image.h
+ * and tiny_obj_loader.h to get the functions loading images and OBJ-files from mapped files.
+ */
+
+// Largest number of files in the cache
+#define ASSET_CACHE_ENTRIES 64
+
+// Largest number of bytes mapped by the files in the cache that are not in use
+#define ASSET_CACHE_BYTES (256 * 1024 * 1024)
+
+// Archive mounted on first use if it exists in the working directory
+#define ASSET_ARCHIVE_NAME "assets.pak"
+
+// Views that are not held by an entry of the cache
+#define ASSET_UNCACHED -1
+#define ASSET_ARCHIVED -2
+#define ASSET_DECOMPRESSED -3
+
+/*
+ * A structure for storing a view of a file
+ */
+typedef struct {
+    const char *data;
+    size_t size;
+    // Entry of the cache holding the mapping, or one of the values above
+    int entry;
+} AssetView;
+
+/*
+ * A structure for storing a mapped file
+ */
+typedef struct {
+    std::string filename;
+    const char *data;
+    size_t size;
+    // Identity of the mapped version of the file
+    long long modified;
+    long long inode;
+    // Number of open views and the time of the last use
+    int references;
+    unsigned long lastUse;
+    // Set when the file has changed while views were open, the mapping is released when they close
+    int stale;
+} AssetEntry;
+
+/*
+ * A structure for storing the state of the cache
+ */
+typedef struct {
+    std::mutex mutex;
+    AssetEntry entries[ASSET_CACHE_ENTRIES];
+    unsigned long useCounter;
+    // Mapping of the mounted archive, kept until the application exits
+    int archiveChecked;
+    const char *archiveData;
+    size_t archiveSize;
+    long long archiveModified;
+    // Statistics
+    int hits;
+    int misses;
+    int archived;
+} AssetCache;
+
+/*
+ * Get the cache shared by all users of the header
+ */
+inline AssetCache *getAssetCache() {
+
+    static AssetCache cache;
+    return &cache;
+
+}
+
+/*
+ * Get the size and identity of a file. Returns FALSE if the file does not exist.
+ */
+inline int getAssetIdentity(const char *filename, size_t *size, long long *modified, long long *inode) {
+
+    struct stat fileStat;
+    if (stat(filename, &fileStat) != 0)
+        return 0;
+
+    *size = (size_t)fileStat.st_size;
+    *inode = (long long)fileStat.st_ino;
+#ifdef __linux__
+    *modified = (long long)fileStat.st_mtim.tv_sec * 1000000000LL + fileStat.st_mtim.tv_nsec;
+#else
+    *modified = (long long)fileStat.st_mtime;
+#endif
+
+    return 1;
+
+}
+
+/*
+ * Map a file to memory, an empty file gives an empty string. Returns NULL on failure.
+ */
+inline const char *mapAssetFile(const char *filename, size_t size) {
+
+    if (size == 0)
+        return "";
+
+#ifdef _WIN32
+    // The handles can be closed right away, the view keeps the file open
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return NULL;
+    const char *data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    CloseHandle(mapping);
+    return data;
+#else
+    // The descriptor can be closed right away, the mapping keeps the file open
+    int file = open(filename, O_RDONLY);
+    if (file < 0)
+        return NULL;
+    void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    return data == MAP_FAILED ? NULL : (const char *)data;
+#endif
+
+}
+
+/*
+ * Release a mapping made by mapAssetFile
+ */
+inline void unmapAssetFile(const char *data, size_t size) {
+
+    if (size == 0)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap((void *)data, size);
+#endif
+
+}
+
+/*
+ * Release the mapping of a cache entry
+ */
+inline void releaseAssetEntry(AssetEntry *entry) {
+
+    unmapAssetFile(entry->data, entry->size);
+    entry->filename.clear();
+    entry->data = NULL;
+    entry->size = 0;
+    entry->stale = 0;
+
+}
+
+/*
+ * Evict the least recently used entries that are not in use until the mapped bytes of those are
+ * within the bound. The entry to keep is never evicted.
+ */
+inline void evictAssetEntries(AssetCache *cache, int keep) {
+
+    for (;;) {
+
+        size_t unusedBytes = 0;
+        int oldest = -1;
+        for (int e=0; e<ASSET_CACHE_ENTRIES; ++e) {
+            AssetEntry *entry = &cache->entries[e];
+            if (!entry->data || entry->references > 0)
+                continue;
+            unusedBytes += entry->size;
+            if (e != keep && (oldest < 0 || entry->lastUse < cache->entries[oldest].lastUse))
+                oldest = e;
+        }
+
+        if (unusedBytes <= ASSET_CACHE_BYTES || oldest < 0)
+            return;
+        releaseAssetEntry(&cache->entries[oldest]);
+
+    }
+
+}
+
+/*
+ * Open a read-only view of a loose file, bypassing the archive. Returns FALSE if the file can not
+ * be opened, which is expected while an editor is in the middle of replacing the file.
+ */
+inline int openAssetFile(const char *filename, AssetView *view) {
+
+    AssetCache *cache = getAssetCache();
+    std::lock_guard<std::mutex> lock(cache->mutex);
+
+    size_t size;
+    long long modified, inode;
+    if (!getAssetIdentity(filename, &size, &modified, &inode))
+        return 0;
+
+    // Use the cached mapping if the file is unchanged, changed files are mapped again
+    int slot = -1;
+    for (int e=0; e<ASSET_CACHE_ENTRIES; ++e) {
+
+        AssetEntry *entry = &cache->entries[e];
+        if (!entry->data) {
+            if (slot < 0)
+                slot = e;
+            continue;
+        }
+        if (entry->stale || entry->filename != filename)
+            continue;
+
+        if (entry->size == size && entry->modified == modified && entry->inode == inode) {
+            entry->references++;
+            entry->lastUse = ++cache->useCounter;
+            cache->hits++;
+            view->data = entry->data;
+            view->size = entry->size;
+            view->entry = e;
+            return 1;
+        }
+
+        if (entry->references > 0)
+            entry->stale = 1;
+        else {
+            releaseAssetEntry(entry);
+            if (slot < 0 || e < slot)
+                slot = e;
+        }
+
+    }
+
+    // Make room for the file by evicting the least recently used entry not in use
+    if (slot < 0) {
+        for (int e=0; e<ASSET_CACHE_ENTRIES; ++e) {
+            AssetEntry *entry = &cache->entries[e];
+            if (entry->references == 0 && (slot < 0 || entry->lastUse < cache->entries[slot].lastUse))
+                slot = e;
+        }
+        if (slot >= 0)
+            releaseAssetEntry(&cache->entries[slot]);
+    }
+
+    const char *data = mapAssetFile(filename, size);
+    if (!data)
+        return 0;
+    cache->misses++;
+
+    view->data = data;
+    view->size = size;
+    view->entry = slot;
+
+    // The file is still usable when every entry is in use, it is released when closed
+    if (slot < 0) {
+        view->entry = ASSET_UNCACHED;
+        return 1;
+    }
+
+    AssetEntry *entry = &cache->entries[slot];
+    entry->filename = filename;
+    entry->data = data;
+    entry->size = size;
+    entry->modified = modified;
+    entry->inode = inode;
+    entry->references = 1;
+    entry->lastUse = ++cache->useCounter;
+    entry->stale = 0;
+
+    evictAssetEntries(cache, slot);
+
+    return 1;
+
+}
+
+/*
+ * Map an archive with the cache locked
+ */
+inline int mapAssetArchive(AssetCache *cache, const char *filename) {
+
+    cache->archiveChecked = 1;
+
+    size_t size;
+    long long modified, inode;
+    if (cache->archiveData || !getAssetIdentity(filename, &size, &modified, &inode))
+        return 0;
+
+    const char *data = mapAssetFile(filename, size);
+    if (!data)
+        return 0;
+    if (!validateAssetArchive(data, size)) {
+        printf("ERROR %s is not a valid asset archive\n", filename);
+        unmapAssetFile(data, size);
+        return 0;
+    }
+
+    // Ask for the complete file in one sequential read instead of faulting in a page at a time
+#ifndef _WIN32
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+    madvise((void *)data, size, MADV_WILLNEED);
+#endif
+
+    cache->archiveData = data;
+    cache->archiveSize = size;
+    cache->archiveModified = modified;
+    printf("Mounted %s, %u files (%.2f MiB)\n", filename, ((const AssetArchiveHeader *)data)->numEntries, size / 1048576.0);
+
+    return 1;
+
+}
+
+/*
+ * Map an archive built with asset_pack and serve the files it contains from it. The whole archive
+ * is read ahead at once, so loading the assets afterwards does not wait for the disk. Returns FALSE
+ * if the file does not exist, is not a valid archive or another archive is mounted.
+ */
+inline int mountAssetArchive(const char *filename) {
+
+    AssetCache *cache = getAssetCache();
+    std::lock_guard<std::mutex> lock(cache->mutex);
+
+    return mapAssetArchive(cache, filename);
+
+}
+
+/*
+ * Find a file in the mounted archive, mounting ASSET_ARCHIVE_NAME on first use. The names are
+ * stored relative to the working directory with forward slashes. Returns NULL if there is no
+ * archive, it does not contain the file or the loose file is newer than the archive.
+ */
+inline const AssetArchiveEntry *findArchivedAsset(const char *filename) {
+
+    // The archive is never unmapped, so it can be searched once the cache is unlocked
+    AssetCache *cache = getAssetCache();
+    const char *archive;
+    {
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        if (!cache->archiveChecked)
+            mapAssetArchive(cache, ASSET_ARCHIVE_NAME);
+        archive = cache->archiveData;
+    }
+    if (!archive)
+        return NULL;
+
+    while (filename[0] == '.' && (filename[1] == '/' || filename[1] == '\\'))
+        filename += 2;
+    std::string name = filename;
+    for (size_t c=0; c<name.length(); ++c)
+        if (name[c] == '\\')
+            name[c] = '/';
+
+    const AssetArchiveEntry *entry = findArchiveEntry(archive, name.c_str(), name.length());
+    if (!entry)
+        return NULL;
+
+    size_t size;
+    long long modified, inode;
+    if (getAssetIdentity(filename, &size, &modified, &inode) && modified > cache->archiveModified) {
+        printf("Using %s, the loose file is newer than the archive\n", filename);
+        return NULL;
+    }
+
+    return entry;
+
+}
+
+/*
+ * Open a read-only view of a file, from the archive if it contains the file. Returns FALSE if the
+ * file can not be opened or a compressed file is corrupt.
+ */
+inline int openAsset(const char *filename, AssetView *view) {
+
+    const AssetArchiveEntry *entry = findArchivedAsset(filename);
+    if (!entry)
+        return openAssetFile(filename, view);
+
+    AssetCache *cache = getAssetCache();
+    const char *blob = cache->archiveData + entry->offset;
+    if (entry->compression == ASSET_STORED) {
+        view->data = blob;
+        view->size = entry->size;
+        view->entry = ASSET_ARCHIVED;
+    } else {
+        char *data = (char *)malloc(entry->size ? entry->size : 1);
+        if (!decompressLz4((const uint8_t *)blob, entry->storedSize, (uint8_t *)data, entry->size)) {
+            printf("ERROR %s is corrupt in the asset archive\n", filename);
+            free(data);
+            return 0;
+        }
+        view->data = data;
+        view->size = entry->size;
+        view->entry = ASSET_DECOMPRESSED;
+    }
+
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    cache->archived++;
+
+    return 1;
+
+}
+
+/*
+ * Close a view opened by openAsset or openAssetFile
+ */
+inline void closeAsset(AssetView *view) {
+
+    // Views of the archive stay valid as long as the archive is mounted
+    if (view->entry == ASSET_ARCHIVED || view->entry == ASSET_DECOMPRESSED) {
+        if (view->entry == ASSET_DECOMPRESSED)
+            free((void *)view->data);
+        view->data = NULL;
+        view->size = 0;
+        return;
+    }
+
+    AssetCache *cache = getAssetCache();
+    std::lock_guard<std::mutex> lock(cache->mutex);
+
+    if (view->entry == ASSET_UNCACHED)
+        unmapAssetFile(view->data, view->size);
+    else {
+        AssetEntry *entry = &cache->entries[view->entry];
+        entry->references--;
+#ifdef _WIN32
+        if (entry->references == 0)
+            releaseAssetEntry(entry);
+#else
+        if (entry->references == 0 && entry->stale)
+            releaseAssetEntry(entry);
+        else
+            evictAssetEntries(cache, -1);
+#endif
+    }
+
+    view->data = NULL;
+    view->size = 0;
+
+}
+
+/*
+ * Print the number of files opened from the archive, from the cache and mapped, and the bytes
+ * currently mapped
+ */
+inline void printAssetStatistics() {
+
+    AssetCache *cache = getAssetCache();
+    std::lock_guard<std::mutex> lock(cache->mutex);
+
+    size_t mappedBytes = 0;
+    int mappedFiles = 0;
+    for (int e=0; e<ASSET_CACHE_ENTRIES; ++e)
+        if (cache->entries[e].data) {
+            mappedBytes += cache->entries[e].size;
+            mappedFiles++;
+        }
+
+    printf("Assets: %d opened from the archive, %d from the cache, %d mapped, %d files (%.2f MiB) mapped now\n", cache->archived,
+            cache->hits, cache->misses, mappedFiles, mappedBytes / 1048576.0);
+
+}
+
+/*
+ * A read-only stream buffer over a view, letting parsers using std::istream read the mapped pages
+ */
+class AssetStreamBuffer : public std::streambuf {
+public:
+    AssetStreamBuffer(const AssetView *view) {
+        char *begin = (char *)view->data;
+        setg(begin, begin, begin + view->size);
+    }
+};
+
+#endif
+
+// The loaders are defined once the libraries have been included, even if the header was included
+// before them
+#if defined(STBI_INCLUDE_STB_IMAGE_H) && !defined(ASSET_IO_IMAGE)
+#define ASSET_IO_IMAGE
+
+/*
+ * Convert decoded pixels to another number of channels the way stb_image does, averaging the color
+ * to gray with the weights of stbi__compute_y and adding an opaque alpha. The JPEG decoder of
+ * stb_image takes gray directly from the luma, which may differ by a few levels.
+ */
+inline void convertImageChannels(const stbi_uc *source, int sourceChannels, stbi_uc *destination, int destinationChannels, size_t numPixels) {
+
+    for (size_t p=0; p<numPixels; ++p) {
+
+        const stbi_uc *in = source + p * sourceChannels;
+        stbi_uc *out = destination + p * destinationChannels;
+
+        stbi_uc rgba[4];
+        if (sourceChannels < 3) {
+            rgba[0] = rgba[1] = rgba[2] = in[0];
+            rgba[3] = sourceChannels == 2 ? in[1] : 255;
+        } else {
+            rgba[0] = in[0];
+            rgba[1] = in[1];
+            rgba[2] = in[2];
+            rgba[3] = sourceChannels == 4 ? in[3] : 255;
+        }
+
+        if (destinationChannels < 3) {
+            out[0] = sourceChannels < 3 ? rgba[0] : (stbi_uc)((rgba[0] * 77 + rgba[1] * 150 + rgba[2] * 29) >> 8);
+            if (destinationChannels == 2)
+                out[1] = rgba[3];
+        } else
+            for (int c=0; c<destinationChannels; ++c)
+                out[c] = rgba[c];
+
+    }
+
+}
+
+/*
+ * Load the decoded pixels of an image in the archive. The pixels are copied, or decompressed, to
+ * memory that is freed with stbi_image_free like the images decoded by stb_image.
+ */
+inline stbi_uc *loadArchivedImage(const AssetArchiveEntry *entry, int *width, int *height, int *channels, int desiredChannels) {
+
+    AssetCache *cache = getAssetCache();
+    const stbi_uc *decoded = (const stbi_uc *)cache->archiveData + entry->offset;
+    size_t numPixels = (size_t)entry->width * entry->height;
+    int outputChannels = desiredChannels ? desiredChannels : entry->channels;
+    if (entry->size != numPixels * entry->channels)
+        return NULL;
+    stbi_uc *pixels = (stbi_uc *)malloc(numPixels * outputChannels);
+
+    // Compressed pixels are decompressed directly to the output unless the channels are converted
+    stbi_uc *buffer = NULL;
+    if (entry->compression == ASSET_LZ4) {
+        buffer = (int)entry->channels == outputChannels ? pixels : (stbi_uc *)malloc(entry->size);
+        if (!decompressLz4(decoded, entry->storedSize, buffer, entry->size)) {
+            if (buffer != pixels)
+                free(buffer);
+            free(pixels);
+            return NULL;
+        }
+        decoded = buffer;
+    }
+
+    if ((int)entry->channels != outputChannels)
+        convertImageChannels(decoded, entry->channels, pixels, outputChannels, numPixels);
+    else if (decoded != pixels)
+        memcpy(pixels, decoded, entry->size);
+    if (buffer && buffer != pixels)
+        free(buffer);
+
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    cache->archived++;
+
+    *width = entry->width;
+    *height = entry->height;
+    *channels = entry->channels;
+    return pixels;
+
+}
+
+/*
+ * Load an image, decoding it directly from the mapped file. Returns NULL on failure, the image is
+ * freed with stbi_image_free.
+ */
+inline stbi_uc *loadImageAsset(const char *filename, int *width, int *height, int *channels, int desiredChannels) {
+
+    // Images in the archive are already decoded
+    const AssetArchiveEntry *entry = findArchivedAsset(filename);
+    if (entry && entry->type == ASSET_IMAGE)
+        return loadArchivedImage(entry, width, height, channels, desiredChannels);
+
+    AssetView view;
+    if (!openAsset(filename, &view))
+        return NULL;
+
+    stbi_uc *imageData = stbi_load_from_memory((const stbi_uc *)view.data, (int)view.size, width, height, channels, desiredChannels);
+    closeAsset(&view);
+
+    return imageData;
+
+}
+
+/*
+ * Get the size and channels of an image without decoding it. Returns FALSE if the file can not be
+ * opened or is not an image.
+ */
+inline int getImageAssetInfo(const char *filename, int *width, int *height, int *channels) {
+
+    const AssetArchiveEntry *entry = findArchivedAsset(filename);
+    if (entry && entry->type == ASSET_IMAGE) {
+        *width = entry->width;
+        *height = entry->height;
+        *channels = entry->channels;
+        return 1;
+    }
+
+    AssetView view;
+    if (!openAsset(filename, &view))
+        return 0;
+
+    int success = stbi_info_from_memory((const stbi_uc *)view.data, (int)view.size, width, height, channels);
+    closeAsset(&view);
+
+    return success;
+
+}
+
+#endif
+
+#if defined(TINY_OBJ_LOADER_H_) && !defined(ASSET_IO_OBJ)
+#define ASSET_IO_OBJ
+
+/*
+ * A material reader parsing MTL-files from mapped files, relative to the directory of the OBJ-file
+ */
+class AssetMaterialReader : public tinyobj::MaterialReader {
+public:
+    AssetMaterialReader(const std::string &directory) : directory(directory) {}
+    virtual bool operator()(const std::string &materialName, std::vector<tinyobj::material_t> *materials,
+            std::map<std::string, int> *materialMap, std::string *error) {
+
+        std::string filename = directory + materialName;
+        AssetView view;
+        if (!openAsset(filename.c_str(), &view)) {
+            if (error)
+                *error += "WARN: Material file [ " + filename + " ] not found.\n";
+            return false;
+        }
+
+        AssetStreamBuffer buffer(&view);
+        std::istream stream(&buffer);
+        std::string warning;
+        tinyobj::LoadMtl(materialMap, materials, &stream, &warning);
+        closeAsset(&view);
+
+        if (error)
+            *error += warning;
+        return true;
+
+    }
+private:
+    std::string directory;
+};
+
+/*
+ * Load an OBJ-file and its MTL-files, parsing them directly from the mapped files. Takes the same
+ * arguments as tinyobj::LoadObj.
+ */
+inline bool loadObjAsset(tinyobj::attrib_t *attributes, std::vector<tinyobj::shape_t> *shapes, std::vector<tinyobj::material_t> *materials,
+        std::string *error, const char *filename, const char *materialDirectory) {
+
+    AssetView view;
+    if (!openAsset(filename, &view)) {
+        if (error)
+            *error = std::string("Cannot open file [") + filename + "]\n";
+        return false;
+    }
+
+    std::string directory = materialDirectory ? materialDirectory : "";
+#ifdef _WIN32
+    if (!directory.empty() && directory[directory.length() - 1] != '\\')
+        directory += '\\';
+#else
+    if (!directory.empty() && directory[directory.length() - 1] != '/')
+        directory += '/';
+#endif
+
+    AssetStreamBuffer buffer(&view);
+    std::istream stream(&buffer);
+    AssetMaterialReader materialReader(directory);
+    bool success = tinyobj::LoadObj(attributes, shapes, materials, error, &stream, &materialReader);
+    closeAsset(&view);
+
+    return success;
+
+}
+
+#endif
@@ -0,0 +1,394 @@
+#ifndef BATCH_TRANSFORM_H
+#define BATCH_TRANSFORM_H
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BATCH_TRANSFORM_SSE
+#include <immintrin.h>
+#endif
+
+// The AVX path is compiled for AVX on its own, the rest of the program not requiring it. MSVC
+// compiles AVX intrinsics anywhere, GCC and Clang in functions targeting AVX.
+#if defined(BATCH_TRANSFORM_SSE) && defined(_MSC_VER)
+#define BATCH_TRANSFORM_AVX
+#define BATCH_TRANSFORM_TARGET_AVX
+#include <intrin.h>
+#elif defined(BATCH_TRANSFORM_SSE) && defined(__GNUC__)
+#define BATCH_TRANSFORM_AVX
+#define BATCH_TRANSFORM_TARGET_AVX __attribute__((target("avx")))
+#endif
+
+/*
+ * Batch composition of model matrices from translations, rotation quaternions and scales. The
+ * components are stored as structure of arrays, so a vector register holds the same component of
+ * 4 (SSE) or 8 (AVX) transforms and the matrices of all of them are composed with one instruction
+ * per operation. The matrices are transposed to one matrix per record only when written, and are
+ * written with non-temporal stores that go straight to memory without first reading the cache
+ * lines, which is what a write-combined mapping of a buffer wants.
+ *
+ * Besides the model matrix, the normal matrix is written as three columns padded to four values,
+ * the rotation divided by the scale, which is the inverse transpose of the upper 3x3 of the model
+ * matrix.
+ *
+ * The AVX path is only used when the processor supports it, checked when running, so the program
+ * runs on processors without AVX using SSE. Platforms without SSE use scalar code.
+ */
+
+// Transforms composed at once by the widest path compiled in
+#if defined(BATCH_TRANSFORM_AVX)
+#define TRANSFORM_BATCH_WIDTH 8
+#elif defined(BATCH_TRANSFORM_SSE)
+#define TRANSFORM_BATCH_WIDTH 4
+#else
+#define TRANSFORM_BATCH_WIDTH 1
+#endif
+
+// Paths for composing a batch
+#define TRANSFORM_PATH_SCALAR 0
+#define TRANSFORM_PATH_SSE 1
+#define TRANSFORM_PATH_AVX 2
+#define NUM_TRANSFORM_PATHS 3
+
+/*
+ * A structure for storing the components of a batch of transforms. The arrays are padded with
+ * identity transforms, so a full register can be loaded at any index below the capacity.
+ */
+typedef struct {
+    int count;
+    std::vector<float> tx, ty, tz;
+    std::vector<float> qx, qy, qz, qw;
+    std::vector<float> sx, sy, sz;
+} TransformBatch;
+
+/*
+ * Get the name of a path for printing
+ */
+inline const char *getTransformPathName(int path) {
+
+    switch (path) {
+    case TRANSFORM_PATH_SSE:
+        return "SSE";
+    case TRANSFORM_PATH_AVX:
+        return "AVX";
+    default:
+        return "scalar";
+    }
+
+}
+
+/*
+ * Get whether the processor and the operating system support AVX
+ */
+inline int isAvxSupported() {
+
+#if defined(BATCH_TRANSFORM_AVX) && defined(_MSC_VER)
+    // AVX is supported and the operating system saves the AVX registers (OSXSAVE), which it has
+    // enabled in XCR0
+    int info[4];
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 28)) == 0 || (info[2] & (1 << 27)) == 0)
+        return 0;
+    return (_xgetbv(0) & 6) == 6;
+#elif defined(BATCH_TRANSFORM_AVX)
+    // The features may be asked for before the constructors of the runtime have found them
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx") != 0;
+#else
+    return 0;
+#endif
+
+}
+
+/*
+ * Get whether a path has been compiled in and is supported by the processor
+ */
+inline int isTransformPathAvailable(int path) {
+
+#ifndef BATCH_TRANSFORM_SSE
+    if (path == TRANSFORM_PATH_SSE)
+        return 0;
+#endif
+    if (path == TRANSFORM_PATH_AVX && !isAvxSupported())
+        return 0;
+
+    return path >= 0 && path < NUM_TRANSFORM_PATHS;
+
+}
+
+/*
+ * Get the widest path available
+ */
+inline int getDefaultTransformPath() {
+
+    if (isTransformPathAvailable(TRANSFORM_PATH_AVX))
+        return TRANSFORM_PATH_AVX;
+#if defined(BATCH_TRANSFORM_SSE)
+    return TRANSFORM_PATH_SSE;
+#else
+    return TRANSFORM_PATH_SCALAR;
+#endif
+
+}
+
+/*
+ * Initialize a batch holding up to the given number of transforms, all of them identities
+ */
+inline void initTransformBatch(TransformBatch *batch, int capacity) {
+
+    size_t size = (size_t)(capacity + 7) / 8 * 8 + 8;
+    batch->count = 0;
+    batch->tx.assign(size, 0.0f);
+    batch->ty.assign(size, 0.0f);
+    batch->tz.assign(size, 0.0f);
+    batch->qx.assign(size, 0.0f);
+    batch->qy.assign(size, 0.0f);
+    batch->qz.assign(size, 0.0f);
+    batch->qw.assign(size, 1.0f);
+    batch->sx.assign(size, 1.0f);
+    batch->sy.assign(size, 1.0f);
+    batch->sz.assign(size, 1.0f);
+
+}
+
+/*
+ * Set a transform of a batch from a translation, a unit rotation quaternion and a scale
+ */
+inline void setBatchTransform(TransformBatch *batch, int index, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale) {
+
+    batch->tx[index] = translation.x;
+    batch->ty[index] = translation.y;
+    batch->tz[index] = translation.z;
+    batch->qx[index] = rotation.x;
+    batch->qy[index] = rotation.y;
+    batch->qz[index] = rotation.z;
+    batch->qw[index] = rotation.w;
+    batch->sx[index] = scale.x;
+    batch->sy[index] = scale.y;
+    batch->sz[index] = scale.z;
+
+}
+
+/*
+ * Compose a single transform, used by the scalar path and for the transforms a batch ends with
+ */
+inline void composeTransform(const TransformBatch *batch, int i, float *model, float *normal) {
+
+    float x = batch->qx[i], y = batch->qy[i], z = batch->qz[i], w = batch->qw[i];
+    float r[9] = {
+        1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y),
+        2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x),
+        2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y) };
+    float s[3] = { batch->sx[i], batch->sy[i], batch->sz[i] };
+
+    for (int c=0; c<3; ++c) {
+        for (int e=0; e<3; ++e)
+            model[c * 4 + e] = r[c * 3 + e] * s[c];
+        model[c * 4 + 3] = 0.0f;
+    }
+    model[12] = batch->tx[i];
+    model[13] = batch->ty[i];
+    model[14] = batch->tz[i];
+    model[15] = 1.0f;
+
+    if (normal)
+        for (int c=0; c<3; ++c) {
+            for (int e=0; e<3; ++e)
+                normal[c * 4 + e] = r[c * 3 + e] / s[c];
+            normal[c * 4 + 3] = 0.0f;
+        }
+
+}
+
+#ifdef BATCH_TRANSFORM_SSE
+
+/*
+ * Write a column of 4 transforms, held as one register per element, to the records of the first
+ * count of them
+ */
+inline void storeBatchColumn(__m128 e0, __m128 e1, __m128 e2, __m128 e3, int count, float *destination, size_t stride, int streaming) {
+
+    _MM_TRANSPOSE4_PS(e0, e1, e2, e3);
+    __m128 columns[4] = { e0, e1, e2, e3 };
+
+    for (int l=0; l<count; ++l) {
+        if (streaming)
+            _mm_stream_ps(destination + l * stride, columns[l]);
+        else
+            _mm_storeu_ps(destination + l * stride, columns[l]);
+    }
+
+}
+
+/*
+ * Write the model and normal matrices of 4 transforms, held as one register per element
+ */
+inline void storeBatchMatrices(const __m128 *m, const __m128 *n, int count, float *model, float *normal, size_t stride, int streaming) {
+
+    for (int c=0; c<4; ++c)
+        storeBatchColumn(m[c * 4], m[c * 4 + 1], m[c * 4 + 2], m[c * 4 + 3], count, model + c * 4, stride, streaming);
+
+    if (normal) {
+        __m128 zero = _mm_setzero_ps();
+        for (int c=0; c<3; ++c)
+            storeBatchColumn(n[c * 3], n[c * 3 + 1], n[c * 3 + 2], zero, count, normal + c * 4, stride, streaming);
+    }
+
+}
+
+/*
+ * Compose 4 transforms starting at index i with SSE, each element of the matrices in a register
+ */
+inline void composeBatchSSE(const TransformBatch *batch, int i, __m128 *m, __m128 *n) {
+
+    __m128 x = _mm_loadu_ps(&batch->qx[i]), y = _mm_loadu_ps(&batch->qy[i]);
+    __m128 z = _mm_loadu_ps(&batch->qz[i]), w = _mm_loadu_ps(&batch->qw[i]);
+    __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+
+    // Doubled products of the quaternion components
+    __m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+    __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+    __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+    __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+    // Rotation, column by column
+    __m128 r[9] = {
+        _mm_sub_ps(one, _mm_add_ps(yy, zz)), _mm_add_ps(xy, wz), _mm_sub_ps(xz, wy),
+        _mm_sub_ps(xy, wz), _mm_sub_ps(one, _mm_add_ps(xx, zz)), _mm_add_ps(yz, wx),
+        _mm_add_ps(xz, wy), _mm_sub_ps(yz, wx), _mm_sub_ps(one, _mm_add_ps(xx, yy)) };
+    __m128 s[3] = { _mm_loadu_ps(&batch->sx[i]), _mm_loadu_ps(&batch->sy[i]), _mm_loadu_ps(&batch->sz[i]) };
+
+    __m128 zero = _mm_setzero_ps();
+    for (int c=0; c<3; ++c) {
+        __m128 inverseScale = _mm_div_ps(one, s[c]);
+        for (int e=0; e<3; ++e) {
+            m[c * 4 + e] = _mm_mul_ps(r[c * 3 + e], s[c]);
+            n[c * 3 + e] = _mm_mul_ps(r[c * 3 + e], inverseScale);
+        }
+        m[c * 4 + 3] = zero;
+    }
+    m[12] = _mm_loadu_ps(&batch->tx[i]);
+    m[13] = _mm_loadu_ps(&batch->ty[i]);
+    m[14] = _mm_loadu_ps(&batch->tz[i]);
+    m[15] = one;
+
+}
+
+#endif
+
+#ifdef BATCH_TRANSFORM_AVX
+
+/*
+ * Compose 8 transforms starting at index i with AVX, each element of the matrices in a register
+ */
+BATCH_TRANSFORM_TARGET_AVX inline void composeBatchAVX(const TransformBatch *batch, int i, __m256 *m, __m256 *n) {
+
+    __m256 x = _mm256_loadu_ps(&batch->qx[i]), y = _mm256_loadu_ps(&batch->qy[i]);
+    __m256 z = _mm256_loadu_ps(&batch->qz[i]), w = _mm256_loadu_ps(&batch->qw[i]);
+    __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f);
+
+    // Doubled products of the quaternion components
+    __m256 x2 = _mm256_mul_ps(x, two), y2 = _mm256_mul_ps(y, two), z2 = _mm256_mul_ps(z, two);
+    __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+    __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+    __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+    // Rotation, column by column
+    __m256 r[9] = {
+        _mm256_sub_ps(one, _mm256_add_ps(yy, zz)), _mm256_add_ps(xy, wz), _mm256_sub_ps(xz, wy),
+        _mm256_sub_ps(xy, wz), _mm256_sub_ps(one, _mm256_add_ps(xx, zz)), _mm256_add_ps(yz, wx),
+        _mm256_add_ps(xz, wy), _mm256_sub_ps(yz, wx), _mm256_sub_ps(one, _mm256_add_ps(xx, yy)) };
+    __m256 s[3] = { _mm256_loadu_ps(&batch->sx[i]), _mm256_loadu_ps(&batch->sy[i]), _mm256_loadu_ps(&batch->sz[i]) };
+
+    __m256 zero = _mm256_setzero_ps();
+    for (int c=0; c<3; ++c) {
+        __m256 inverseScale = _mm256_div_ps(one, s[c]);
+        for (int e=0; e<3; ++e) {
+            m[c * 4 + e] = _mm256_mul_ps(r[c * 3 + e], s[c]);
+            n[c * 3 + e] = _mm256_mul_ps(r[c * 3 + e], inverseScale);
+        }
+        m[c * 4 + 3] = zero;
+    }
+    m[12] = _mm256_loadu_ps(&batch->tx[i]);
+    m[13] = _mm256_loadu_ps(&batch->ty[i]);
+    m[14] = _mm256_loadu_ps(&batch->tz[i]);
+    m[15] = one;
+
+}
+
+/*
+ * Compose the transforms from begin to end of a batch with AVX, see composeBatchTransforms. Returns
+ * the index after the last transform composed.
+ */
+BATCH_TRANSFORM_TARGET_AVX inline int composeBatchTransformsAVX(const TransformBatch *batch, int begin, int end, float *model, float *normal,
+        size_t stride, int streaming) {
+
+    __m256 m[16], n[9];
+    __m128 low[16], high[16];
+    int i = begin;
+    for (; i < end; i += 8) {
+        composeBatchAVX(batch, i, m, n);
+        int count = end - i < 8 ? end - i : 8;
+        // The records are only 16-byte aligned, so the halves are written as with SSE
+        for (int e=0; e<16; ++e) {
+            low[e] = _mm256_castps256_ps128(m[e]);
+            high[e] = _mm256_extractf128_ps(m[e], 1);
+        }
+        __m128 normalLow[9], normalHigh[9];
+        for (int e=0; e<9; ++e) {
+            normalLow[e] = _mm256_castps256_ps128(n[e]);
+            normalHigh[e] = _mm256_extractf128_ps(n[e], 1);
+        }
+        float *lowModel = model + (size_t)(i - begin) * stride;
+        float *lowNormal = normal ? normal + (size_t)(i - begin) * stride : NULL;
+        storeBatchMatrices(low, normalLow, count < 4 ? count : 4, lowModel, lowNormal, stride, streaming);
+        if (count > 4)
+            storeBatchMatrices(high, normalHigh, count - 4, lowModel + 4 * stride, lowNormal ? lowNormal + 4 * stride : NULL, stride, streaming);
+    }
+
+    return i;
+
+}
+
+#endif
+
+/*
+ * Compose the transforms from begin to end of a batch with the given path, writing the model and,
+ * unless normal is NULL, the normal matrix of each to a record. The records are stride floats
+ * apart, and the non-temporal stores are used when every matrix is aligned to 16 bytes.
+ */
+inline void composeBatchTransforms(const TransformBatch *batch, int begin, int end, float *model, float *normal, size_t stride, int path) {
+
+    int i = begin;
+
+#ifdef BATCH_TRANSFORM_SSE
+    int streaming = ((uintptr_t)model & 15) == 0 && ((uintptr_t)normal & 15) == 0 && stride % 4 == 0;
+
+#ifdef BATCH_TRANSFORM_AVX
+    if (path == TRANSFORM_PATH_AVX)
+        i = composeBatchTransformsAVX(batch, begin, end, model, normal, stride, streaming);
+#endif
+
+    if (path == TRANSFORM_PATH_SSE) {
+        __m128 m[16], n[9];
+        for (; i < end; i += 4) {
+            composeBatchSSE(batch, i, m, n);
+            storeBatchMatrices(m, n, end - i < 4 ? end - i : 4, model + (size_t)(i - begin) * stride,
+                    normal ? normal + (size_t)(i - begin) * stride : NULL, stride, streaming);
+        }
+    }
+
+    // Order the non-temporal stores before anything written after them
+    if (streaming && path != TRANSFORM_PATH_SCALAR)
+        _mm_sfence();
+#endif
+
+    for (; i < end; ++i)
+        composeTransform(batch, i, model + (size_t)(i - begin) * stride, normal ? normal + (size_t)(i - begin) * stride : NULL);
+
+}
+
+#endif
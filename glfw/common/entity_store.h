@@ -0,0 +1,378 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/*
+ * Entity store keeping the components of the entities in chunks, instead of a structure per object
+ * holding every field. Every combination of components, an archetype, has chunks of its own, and
+ * a chunk holds an array per component for a fixed number of entities. A system iterating over
+ * some of the components walks the chunks of the archetypes that have them, reading the arrays of
+ * those components from start to end and never touching the others.
+ *
+ * The chunks of an archetype are kept full except the last, by moving the last entity of the
+ * archetype into the hole left by a removed one. An entity is referred to by a handle, which stays
+ * valid when the entity moves, and which is mapped to where the entity is stored.
+ */
+
+// Kinds of components a store can hold
+#define MAX_COMPONENT_TYPES 32
+
+// Entities per chunk
+#define ENTITY_CHUNK_CAPACITY 256
+
+// Alignment of the chunks and of the arrays in them
+#define ENTITY_CHUNK_ALIGNMENT 64
+
+// A set of component types, bit c standing for component type c
+typedef unsigned int ComponentMask;
+
+/*
+ * A structure for storing a chunk of entities of an archetype
+ */
+typedef struct {
+    int count;
+    // The handles of the entities followed by the array of every component of the archetype
+    unsigned char *data;
+} EntityChunk;
+
+/*
+ * A structure for storing the components and chunks of an archetype
+ */
+typedef struct {
+    ComponentMask mask;
+    // Offset of the array of every component in a chunk, -1 for the components it does not have
+    int offsets[MAX_COMPONENT_TYPES];
+    size_t chunkSize;
+    std::vector<EntityChunk> chunks;
+} Archetype;
+
+/*
+ * A structure for storing where an entity is stored, the archetype being -1 for a free handle
+ */
+typedef struct {
+    int archetype;
+    int chunk;
+    int index;
+} EntityLocation;
+
+/*
+ * A structure for storing a chunk found by a query
+ */
+typedef struct {
+    int archetype;
+    int chunk;
+} ChunkReference;
+
+/*
+ * A structure for storing the entities of every archetype
+ */
+typedef struct {
+    int numComponentTypes;
+    size_t componentSizes[MAX_COMPONENT_TYPES];
+    std::vector<Archetype> archetypes;
+    // Location of every entity by handle, and the handles of removed entities for reuse
+    std::vector<EntityLocation> locations;
+    std::vector<int> freeHandles;
+    int numEntities;
+} EntityStore;
+
+/*
+ * Initialize an empty entity store
+ */
+inline void initEntityStore(EntityStore *store) {
+
+    store->numComponentTypes = 0;
+    store->numEntities = 0;
+
+}
+
+/*
+ * Register a component type with the size of a component, returning the type. Should be called
+ * before any entity is created.
+ */
+inline int registerComponentType(EntityStore *store, size_t size) {
+
+    if (store->numComponentTypes == MAX_COMPONENT_TYPES) {
+        printf("ERROR Too many component types\n");
+        return -1;
+    }
+
+    store->componentSizes[store->numComponentTypes] = size;
+    return store->numComponentTypes++;
+
+}
+
+/*
+ * Get the archetype with the given components, creating it if there is none
+ */
+inline int getArchetype(EntityStore *store, ComponentMask mask) {
+
+    for (int a=0; a<(int)store->archetypes.size(); ++a)
+        if (store->archetypes[a].mask == mask)
+            return a;
+
+    // The handles come first, then the array of every component, each starting at a multiple of
+    // the alignment
+    Archetype archetype;
+    archetype.mask = mask;
+    size_t offset = ENTITY_CHUNK_CAPACITY * sizeof(int);
+    for (int c=0; c<MAX_COMPONENT_TYPES; ++c) {
+        archetype.offsets[c] = -1;
+        if (c >= store->numComponentTypes || !(mask & (1u << c)))
+            continue;
+        offset = (offset + ENTITY_CHUNK_ALIGNMENT - 1) / ENTITY_CHUNK_ALIGNMENT * ENTITY_CHUNK_ALIGNMENT;
+        archetype.offsets[c] = (int)offset;
+        offset += ENTITY_CHUNK_CAPACITY * store->componentSizes[c];
+    }
+    archetype.chunkSize = (offset + ENTITY_CHUNK_ALIGNMENT - 1) / ENTITY_CHUNK_ALIGNMENT * ENTITY_CHUNK_ALIGNMENT;
+
+    store->archetypes.push_back(archetype);
+    return (int)store->archetypes.size() - 1;
+
+}
+
+/*
+ * Get the handles of the entities of a chunk
+ */
+inline int *getChunkEntities(EntityChunk *chunk) {
+
+    return (int *)chunk->data;
+
+}
+
+/*
+ * Get the array of a component in a chunk of an archetype, NULL if the archetype does not have it
+ */
+template <typename T>
+inline T *getChunkComponents(Archetype *archetype, EntityChunk *chunk, int component) {
+
+    if (archetype->offsets[component] < 0)
+        return NULL;
+    return (T *)(chunk->data + archetype->offsets[component]);
+
+}
+
+/*
+ * Get the array of a component in a chunk found by a query
+ */
+template <typename T>
+inline T *getChunkComponents(EntityStore *store, const ChunkReference &reference, int component) {
+
+    Archetype *archetype = &store->archetypes[reference.archetype];
+    return getChunkComponents<T>(archetype, &archetype->chunks[reference.chunk], component);
+
+}
+
+/*
+ * Get the number of entities in a chunk found by a query
+ */
+inline int getChunkCount(const EntityStore *store, const ChunkReference &reference) {
+
+    return store->archetypes[reference.archetype].chunks[reference.chunk].count;
+
+}
+
+/*
+ * Add an entity to the end of an archetype, starting a new chunk if the last one is full. Returns
+ * the location of the entity, the chunk being -1 if a new chunk could not be allocated.
+ */
+inline EntityLocation appendEntity(EntityStore *store, int archetypeIndex, int handle) {
+
+    Archetype *archetype = &store->archetypes[archetypeIndex];
+
+    if (archetype->chunks.empty() || archetype->chunks.back().count == ENTITY_CHUNK_CAPACITY) {
+        EntityChunk chunk;
+        chunk.count = 0;
+        size_t size = archetype->chunkSize;
+#ifdef _WIN32
+        chunk.data = (unsigned char *)_aligned_malloc(size, ENTITY_CHUNK_ALIGNMENT);
+#else
+        chunk.data = (unsigned char *)aligned_alloc(ENTITY_CHUNK_ALIGNMENT, size);
+#endif
+        if (!chunk.data) {
+            printf("ERROR Could not allocate an entity chunk\n");
+            EntityLocation location = { archetypeIndex, -1, -1 };
+            return location;
+        }
+        memset(chunk.data, 0, size);
+        archetype->chunks.push_back(chunk);
+    }
+
+    EntityLocation location;
+    location.archetype = archetypeIndex;
+    location.chunk = (int)archetype->chunks.size() - 1;
+    EntityChunk *chunk = &archetype->chunks[location.chunk];
+    location.index = chunk->count++;
+    getChunkEntities(chunk)[location.index] = handle;
+
+    return location;
+
+}
+
+/*
+ * Free a chunk
+ */
+inline void freeEntityChunk(EntityChunk *chunk) {
+
+#ifdef _WIN32
+    _aligned_free(chunk->data);
+#else
+    free(chunk->data);
+#endif
+    chunk->data = NULL;
+
+}
+
+/*
+ * Remove an entity from its archetype, moving the last entity of the archetype into its place and
+ * freeing the last chunk if it becomes empty. The handle itself is left to the caller.
+ */
+inline void detachEntity(EntityStore *store, int handle) {
+
+    EntityLocation location = store->locations[handle];
+    Archetype *archetype = &store->archetypes[location.archetype];
+    EntityChunk *chunk = &archetype->chunks[location.chunk];
+    EntityChunk *lastChunk = &archetype->chunks.back();
+    int last = lastChunk->count - 1;
+
+    if (chunk != lastChunk || location.index != last) {
+        int movedHandle = getChunkEntities(lastChunk)[last];
+        getChunkEntities(chunk)[location.index] = movedHandle;
+        for (int c=0; c<store->numComponentTypes; ++c) {
+            if (archetype->offsets[c] < 0)
+                continue;
+            size_t size = store->componentSizes[c];
+            memcpy(chunk->data + archetype->offsets[c] + location.index * size, lastChunk->data + archetype->offsets[c] + last * size, size);
+        }
+        store->locations[movedHandle] = location;
+    }
+
+    if (--lastChunk->count == 0) {
+        freeEntityChunk(lastChunk);
+        archetype->chunks.pop_back();
+    }
+
+}
+
+/*
+ * Create an entity with the given components, zeroed. Returns the handle of the entity, or -1 if
+ * it could not be stored.
+ */
+inline int createEntity(EntityStore *store, ComponentMask mask) {
+
+    int handle;
+    if (!store->freeHandles.empty()) {
+        handle = store->freeHandles.back();
+        store->freeHandles.pop_back();
+    } else {
+        handle = (int)store->locations.size();
+        store->locations.push_back(EntityLocation());
+    }
+
+    EntityLocation location = appendEntity(store, getArchetype(store, mask), handle);
+    if (location.chunk < 0) {
+        store->locations[handle].archetype = -1;
+        store->freeHandles.push_back(handle);
+        return -1;
+    }
+    store->locations[handle] = location;
+    store->numEntities++;
+
+    return handle;
+
+}
+
+/*
+ * Destroy an entity, its handle being reused by a later entity
+ */
+inline void destroyEntity(EntityStore *store, int handle) {
+
+    detachEntity(store, handle);
+    store->locations[handle].archetype = -1;
+    store->freeHandles.push_back(handle);
+    store->numEntities--;
+
+}
+
+/*
+ * Get a component of an entity, NULL if it does not have it. The pointer is only valid until
+ * entities are created, destroyed or change their components.
+ */
+template <typename T>
+inline T *getEntityComponent(EntityStore *store, int handle, int component) {
+
+    const EntityLocation &location = store->locations[handle];
+    Archetype *archetype = &store->archetypes[location.archetype];
+    T *components = getChunkComponents<T>(archetype, &archetype->chunks[location.chunk], component);
+    return components ? components + location.index : NULL;
+
+}
+
+/*
+ * Change the components of an entity, moving it to the archetype with the new components. The
+ * components it keeps are copied, the ones it gets are zeroed. Returns FALSE if it could not be
+ * moved, the entity keeping its components.
+ */
+inline int setEntityComponents(EntityStore *store, int handle, ComponentMask mask) {
+
+    EntityLocation from = store->locations[handle];
+    if (store->archetypes[from.archetype].mask == mask)
+        return 1;
+
+    EntityLocation to = appendEntity(store, getArchetype(store, mask), handle);
+    if (to.chunk < 0)
+        return 0;
+
+    Archetype *fromArchetype = &store->archetypes[from.archetype];
+    Archetype *toArchetype = &store->archetypes[to.archetype];
+    EntityChunk *fromChunk = &fromArchetype->chunks[from.chunk];
+    EntityChunk *toChunk = &toArchetype->chunks[to.chunk];
+    for (int c=0; c<store->numComponentTypes; ++c) {
+        if (fromArchetype->offsets[c] < 0 || toArchetype->offsets[c] < 0)
+            continue;
+        size_t size = store->componentSizes[c];
+        memcpy(toChunk->data + toArchetype->offsets[c] + to.index * size, fromChunk->data + fromArchetype->offsets[c] + from.index * size, size);
+    }
+
+    detachEntity(store, handle);
+    store->locations[handle] = to;
+
+    return 1;
+
+}
+
+/*
+ * Find the chunks of every archetype having at least the given components
+ */
+inline void queryChunks(EntityStore *store, ComponentMask mask, std::vector<ChunkReference> *chunks) {
+
+    chunks->clear();
+    for (int a=0; a<(int)store->archetypes.size(); ++a) {
+        if ((store->archetypes[a].mask & mask) != mask)
+            continue;
+        for (int c=0; c<(int)store->archetypes[a].chunks.size(); ++c)
+            chunks->push_back({ a, c });
+    }
+
+}
+
+/*
+ * Free the chunks of every archetype
+ */
+inline void destroyEntityStore(EntityStore *store) {
+
+    for (int a=0; a<(int)store->archetypes.size(); ++a)
+        for (int c=0; c<(int)store->archetypes[a].chunks.size(); ++c)
+            freeEntityChunk(&store->archetypes[a].chunks[c]);
+    store->archetypes.clear();
+    store->locations.clear();
+    store->freeHandles.clear();
+    store->numEntities = 0;
+
+}
+
+#endif
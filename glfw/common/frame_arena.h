@@ -0,0 +1,290 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <algorithm>
+#include <new>
+
+/*
+ * Linear arenas for data that only lives for a frame or while something is loaded. An allocation
+ * moves an offset forward in the current block of the arena and nothing is freed on its own. A frame
+ * arena is reset as a whole at the end of the frame, a load arena is rewound by a scope to where it
+ * was when the scope was entered.
+ *
+ * When the current block is full, a block at least twice as large is added. A reset folds the
+ * blocks into a single block of their total size, so after the first frames every allocation of a
+ * frame is served from one block without calling malloc. Containers take memory from an arena
+ * through ArenaAllocator, whose deallocation does nothing, so a container that grows should reserve
+ * its size first, as every buffer it outgrows stays in the arena until the reset.
+ */
+
+// Alignment of the allocations that do not ask for more
+#define ARENA_ALIGNMENT 16
+
+/*
+ * A structure for storing a block of an arena
+ */
+typedef struct {
+    char *data;
+    size_t size;
+} ArenaBlock;
+
+/*
+ * A structure for storing a position in an arena to rewind to, the block being -1 before the first
+ * block is added
+ */
+typedef struct {
+    int block;
+    size_t offset;
+} ArenaMarker;
+
+/*
+ * A structure for storing the blocks of an arena and its statistics
+ */
+typedef struct {
+    std::vector<ArenaBlock> blocks;
+    // Block being allocated from, and the bytes used in it and in the blocks before it
+    int block;
+    size_t offset;
+    size_t base;
+    // Size of the next block added
+    size_t blockSize;
+    // Largest number of bytes in use, the allocations served and the blocks allocated with malloc
+    size_t peakBytes;
+    long long allocations;
+    long long mallocs;
+} MemoryArena;
+
+/*
+ * Initialize an empty arena, the first block being of the given size
+ */
+inline void initMemoryArena(MemoryArena *arena, size_t blockSize) {
+
+    arena->block = -1;
+    arena->offset = arena->base = 0;
+    arena->blockSize = blockSize;
+    arena->peakBytes = 0;
+    arena->allocations = arena->mallocs = 0;
+
+}
+
+/*
+ * Add a block of the given size after the current one
+ */
+inline int addArenaBlock(MemoryArena *arena, size_t size) {
+
+    ArenaBlock block;
+    block.data = (char *)malloc(size);
+    block.size = size;
+    if (!block.data) {
+        printf("ERROR Could not allocate an arena block of %zu bytes\n", size);
+        return 0;
+    }
+    arena->mallocs++;
+
+    if (arena->block >= 0)
+        arena->base += arena->blocks[arena->block].size;
+    arena->blocks.push_back(block);
+    arena->block = (int)arena->blocks.size() - 1;
+    arena->offset = 0;
+
+    return 1;
+
+}
+
+/*
+ * Get the offset in a block from which an allocation with the given alignment, a power of two, can
+ * start
+ */
+inline size_t alignArenaOffset(const char *data, size_t offset, size_t alignment) {
+
+    uintptr_t address = (uintptr_t)(data + offset);
+    return offset + (size_t)((alignment - address % alignment) % alignment);
+
+}
+
+/*
+ * Allocate memory from an arena with the given alignment, a power of two. Returns NULL if a block
+ * could not be added.
+ */
+inline void *allocateFromArena(MemoryArena *arena, size_t size, size_t alignment = ARENA_ALIGNMENT) {
+
+    arena->allocations++;
+
+    size_t offset = 0;
+    if (arena->block >= 0)
+        offset = alignArenaOffset(arena->blocks[arena->block].data, arena->offset, alignment);
+
+    // Add a block with room for the allocation if the current one is full
+    if (arena->block < 0 || offset + size > arena->blocks[arena->block].size) {
+        size_t blockSize = std::max(arena->blockSize, size + alignment);
+        if (!addArenaBlock(arena, blockSize))
+            return NULL;
+        arena->blockSize = blockSize * 2;
+        offset = alignArenaOffset(arena->blocks[arena->block].data, 0, alignment);
+    }
+
+    void *memory = arena->blocks[arena->block].data + offset;
+    arena->offset = offset + size;
+    arena->peakBytes = std::max(arena->peakBytes, arena->base + arena->offset);
+
+    return memory;
+
+}
+
+/*
+ * Get the current position of an arena
+ */
+inline ArenaMarker getArenaMarker(const MemoryArena *arena) {
+
+    ArenaMarker marker = { arena->block, arena->offset };
+    return marker;
+
+}
+
+/*
+ * Free the blocks of an arena after the given one, or every block if it is -1
+ */
+inline void freeArenaBlocks(MemoryArena *arena, int lastBlock) {
+
+    while ((int)arena->blocks.size() > lastBlock + 1) {
+        free(arena->blocks.back().data);
+        arena->blocks.pop_back();
+    }
+
+}
+
+/*
+ * Rewind an arena to a marker taken earlier, freeing the blocks added since. The memory allocated
+ * after the marker must no longer be used.
+ */
+inline void rewindMemoryArena(MemoryArena *arena, ArenaMarker marker) {
+
+    freeArenaBlocks(arena, marker.block);
+    arena->block = marker.block;
+    arena->offset = marker.offset;
+    arena->base = 0;
+    for (int b=0; b<marker.block; ++b)
+        arena->base += arena->blocks[b].size;
+
+}
+
+/*
+ * Reset an arena at the end of a frame, keeping its memory. Should the frame have needed more than
+ * one block, they are replaced by a single block of their total size for the next frame.
+ */
+inline void resetMemoryArena(MemoryArena *arena) {
+
+    if (arena->blocks.size() > 1) {
+        size_t size = 0;
+        for (int b=0; b<(int)arena->blocks.size(); ++b)
+            size += arena->blocks[b].size;
+        freeArenaBlocks(arena, -1);
+        arena->block = -1;
+        arena->base = 0;
+        addArenaBlock(arena, size);
+        arena->blockSize = size * 2;
+    }
+
+    arena->block = arena->blocks.empty() ? -1 : 0;
+    arena->offset = arena->base = 0;
+
+}
+
+/*
+ * Free every block of an arena, keeping its statistics
+ */
+inline void releaseMemoryArena(MemoryArena *arena) {
+
+    freeArenaBlocks(arena, -1);
+    arena->block = -1;
+    arena->offset = arena->base = 0;
+
+}
+
+/*
+ * Get the number of allocations an arena served without calling malloc
+ */
+inline long long getAvoidedMallocs(const MemoryArena *arena) {
+
+    return std::max(arena->allocations - arena->mallocs, 0LL);
+
+}
+
+/*
+ * Print the statistics of an arena
+ */
+inline void printArenaStatistics(const char *name, const MemoryArena *arena) {
+
+    printf("%s arena: peak %.1f KiB, %lld allocations, %lld mallocs avoided\n", name, arena->peakBytes / 1024.0,
+            arena->allocations, getAvoidedMallocs(arena));
+
+}
+
+/*
+ * Allocator for standard containers taking their memory from an arena. Deallocation does nothing,
+ * the memory is returned when the arena is reset or rewound.
+ */
+template <typename T>
+struct ArenaAllocator {
+
+    typedef T value_type;
+
+    MemoryArena *arena;
+
+    ArenaAllocator(MemoryArena *arena) : arena(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t count) {
+        void *memory = allocateFromArena(arena, count * sizeof(T), alignof(T));
+        if (!memory)
+            throw std::bad_alloc();
+        return (T *)memory;
+    }
+
+    void deallocate(T *memory, size_t count) {}
+
+};
+
+template <typename T, typename U>
+inline bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+    return a.arena != b.arena;
+}
+
+// Vector taking its memory from an arena
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+/*
+ * Scope rewinding an arena to where it was when the scope was entered, however the scope is left.
+ * Containers using the arena must be declared after the scope, so they are destroyed before it.
+ */
+class ArenaScope {
+
+public:
+
+    ArenaScope(MemoryArena *arena) : arena(arena), marker(getArenaMarker(arena)) {}
+
+    ~ArenaScope() {
+        rewindMemoryArena(arena, marker);
+    }
+
+private:
+
+    MemoryArena *arena;
+    ArenaMarker marker;
+
+};
+
+#endif
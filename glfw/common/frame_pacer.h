@@ -0,0 +1,332 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <stdio.h>
+#include <thread>
+#include <chrono>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/*
+ * Frame pacer replacing the loop that swaps as fast as it can. Without a limit the driver queues
+ * several frames ahead of the GPU, so every frame shows input that was sampled several frames
+ * earlier, and the CPU spins a whole core doing it. The pacer combines three measures:
+ *
+ * - A frame rate cap. The thread sleeps until shortly before the frame is due and spins for the
+ *   rest, as sleeping alone overshoots by the granularity of the scheduler.
+ * - A limit on the frames in flight. A fence is inserted after every swap, and a frame does not
+ *   start before the fence of the frame the limit back has been signaled.
+ * - Just-in-time input. The input events are polled after waiting instead of before, so the frame
+ *   is drawn with input that is as fresh as possible.
+ *
+ * The latency from polling the input to the GPU finishing the frame is measured with a timestamp
+ * query after the swap, which is when an unsynchronized swap presents the frame. Together with the
+ * share of a processor core used by the process, the averages of a mode are printed when leaving
+ * it.
+ */
+
+// Pacing modes, each adding a measure to the previous
+#define PACING_UNCAPPED 0
+#define PACING_CAPPED 1
+#define PACING_LIMITED 2
+#define PACING_JUST_IN_TIME 3
+#define NUM_PACING_MODES 4
+
+// Size of the rings of fences and queries, the frames in flight must be fewer
+#define FRAME_PACER_MAX_FRAMES 8
+
+// Frames in flight allowed by the limited modes
+#define FRAME_PACER_FRAMES_IN_FLIGHT 1
+
+// Part of the wait for the next frame spent spinning instead of sleeping, in seconds
+#define FRAME_PACER_SPIN_TIME 0.002
+
+/*
+ * A structure for storing the state of the frame pacer
+ */
+typedef struct {
+    int mode;
+    // Frame rate cap of the capped modes
+    double targetFps;
+    int maxFramesInFlight;
+    int justInTimeInput;
+    // Whether the pacer polls the input events, cleared when another thread handles them
+    int pollEvents;
+    // Time the next frame is due when capped
+    double nextFrameTime;
+    // Fence and timestamp query issued after the swap of the last frames, with the time the input
+    // of the frame was polled
+    long long frame;
+    long long firstPendingFrame;
+    GLsync fences[FRAME_PACER_MAX_FRAMES];
+    GLuint queryNames[FRAME_PACER_MAX_FRAMES];
+    double inputTimes[FRAME_PACER_MAX_FRAMES];
+    // Difference between the CPU time of glfwGetTime and the GPU timestamps, in seconds
+    double timestampOffset;
+    // Statistics of the current mode
+    double modeStartTime, modeStartCpuTime;
+    long long modeFrames, latencyFrames;
+    double latencySum, latencyMax;
+} FramePacer;
+
+/*
+ * Get the processor time used by all the threads of the process, in seconds
+ */
+inline double getProcessCpuTime() {
+
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime);
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+    return (kernel.QuadPart + user.QuadPart) * 1e-7;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+
+}
+
+/*
+ * Get the name of a pacing mode for printing
+ */
+inline const char *getPacingModeName(int mode) {
+
+    switch (mode) {
+    case PACING_CAPPED:
+        return "capped";
+    case PACING_LIMITED:
+        return "capped, frames in flight limited";
+    case PACING_JUST_IN_TIME:
+        return "capped, frames in flight limited, just-in-time input";
+    default:
+        return "uncapped";
+    }
+
+}
+
+/*
+ * Measure the difference between the CPU and GPU clocks
+ */
+inline void syncFramePacerClock(FramePacer *pacer) {
+
+    GLint64 gpuTime;
+    glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+    pacer->timestampOffset = glfwGetTime() - gpuTime * 1e-9;
+
+}
+
+/*
+ * Print the averages measured since the mode was selected
+ */
+inline void printFramePacerStatistics(FramePacer *pacer) {
+
+    double elapsed = glfwGetTime() - pacer->modeStartTime;
+    if (pacer->modeFrames == 0 || elapsed <= 0.0)
+        return;
+
+    double cpu = (getProcessCpuTime() - pacer->modeStartCpuTime) / elapsed;
+    printf("Pacing %s: %.1f fps, ", getPacingModeName(pacer->mode), pacer->modeFrames / elapsed);
+    if (pacer->latencyFrames)
+        printf("input to present %.2f ms (max %.2f ms), ", pacer->latencySum / pacer->latencyFrames * 1000.0, pacer->latencyMax * 1000.0);
+    printf("CPU %.0f%% of a core\n", cpu * 100.0);
+
+}
+
+/*
+ * Select a pacing mode, printing the statistics of the previous one. The cap is the target frame
+ * rate, usually the refresh rate of the monitor.
+ */
+inline void setFramePacingMode(FramePacer *pacer, int mode) {
+
+    printFramePacerStatistics(pacer);
+
+    pacer->mode = mode;
+    pacer->maxFramesInFlight = mode >= PACING_LIMITED ? FRAME_PACER_FRAMES_IN_FLIGHT : 0;
+    pacer->justInTimeInput = mode == PACING_JUST_IN_TIME;
+
+    pacer->nextFrameTime = pacer->modeStartTime = glfwGetTime();
+    pacer->modeStartCpuTime = getProcessCpuTime();
+    pacer->modeFrames = pacer->latencyFrames = 0;
+    pacer->latencySum = pacer->latencyMax = 0.0;
+
+}
+
+/*
+ * Initialize a frame pacer with a frame rate cap in the given mode. Must be called with a current
+ * context.
+ */
+inline void initFramePacer(FramePacer *pacer, double targetFps, int mode) {
+
+    pacer->frame = pacer->firstPendingFrame = 0;
+    for (int f=0; f<FRAME_PACER_MAX_FRAMES; ++f)
+        pacer->fences[f] = 0;
+    glCreateQueries(GL_TIMESTAMP, FRAME_PACER_MAX_FRAMES, pacer->queryNames);
+    syncFramePacerClock(pacer);
+
+    pacer->modeFrames = 0;
+    pacer->targetFps = targetFps;
+    pacer->pollEvents = 1;
+    setFramePacingMode(pacer, mode);
+
+}
+
+/*
+ * Initialize a frame pacer capped at the refresh rate of the primary monitor, or 60 frames per
+ * second if it is unknown
+ */
+inline void initFramePacer(FramePacer *pacer, int mode) {
+
+    const GLFWvidmode *videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    initFramePacer(pacer, videoMode && videoMode->refreshRate > 0 ? videoMode->refreshRate : 60.0, mode);
+
+}
+
+/*
+ * Select the next pacing mode
+ */
+inline void cycleFramePacingMode(FramePacer *pacer) {
+
+    setFramePacingMode(pacer, (pacer->mode + 1) % NUM_PACING_MODES);
+    printf("Frame pacing: %s\n", getPacingModeName(pacer->mode));
+
+}
+
+/*
+ * Collect the timestamps of the frames the GPU has finished, without waiting for any of them
+ */
+inline void collectFramePacerQueries(FramePacer *pacer) {
+
+    while (pacer->firstPendingFrame < pacer->frame) {
+
+        int slot = pacer->firstPendingFrame % FRAME_PACER_MAX_FRAMES;
+        GLuint available = 0;
+        glGetQueryObjectuiv(pacer->queryNames[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 timestamp;
+        glGetQueryObjectui64v(pacer->queryNames[slot], GL_QUERY_RESULT, &timestamp);
+        double latency = timestamp * 1e-9 + pacer->timestampOffset - pacer->inputTimes[slot];
+        if (latency >= 0.0) {
+            pacer->latencySum += latency;
+            pacer->latencyMax = latency > pacer->latencyMax ? latency : pacer->latencyMax;
+            pacer->latencyFrames++;
+        }
+        pacer->firstPendingFrame++;
+
+    }
+
+}
+
+/*
+ * Wait until the next frame may start, for the frame in flight the limit back to finish and for
+ * the frame to be due
+ */
+inline void waitForFrame(FramePacer *pacer) {
+
+    if (pacer->maxFramesInFlight > 0 && pacer->frame >= pacer->maxFramesInFlight) {
+        GLsync fence = pacer->fences[(pacer->frame - pacer->maxFramesInFlight) % FRAME_PACER_MAX_FRAMES];
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+            ;
+    }
+
+    if (pacer->mode != PACING_UNCAPPED) {
+
+        // Start over from the current time after falling more than a frame behind, instead of
+        // drawing the missed frames as fast as possible
+        double frameTime = 1.0 / pacer->targetFps;
+        double now = glfwGetTime();
+        if (now - pacer->nextFrameTime > frameTime)
+            pacer->nextFrameTime = now;
+
+        double sleepTime = pacer->nextFrameTime - now - FRAME_PACER_SPIN_TIME;
+        if (sleepTime > 0.0)
+            std::this_thread::sleep_for(std::chrono::duration<double>(sleepTime));
+        while (glfwGetTime() < pacer->nextFrameTime)
+            ;
+        pacer->nextFrameTime += frameTime;
+
+    }
+
+}
+
+/*
+ * Start a frame, waiting until it may start and polling the input events either before or after
+ * the wait. When the events are handled by another thread, the time after the wait is still taken
+ * as the input time in the just-in-time mode, the caller sampling its input right after.
+ */
+inline void beginPacedFrame(FramePacer *pacer) {
+
+    if (pacer->pollEvents && !pacer->justInTimeInput)
+        glfwPollEvents();
+    double inputTime = glfwGetTime();
+
+    waitForFrame(pacer);
+
+    if (pacer->justInTimeInput) {
+        if (pacer->pollEvents)
+            glfwPollEvents();
+        inputTime = glfwGetTime();
+    }
+    pacer->inputTimes[pacer->frame % FRAME_PACER_MAX_FRAMES] = inputTime;
+
+}
+
+/*
+ * End a frame after the buffers have been swapped, issuing the fence and the timestamp query of
+ * the frame
+ */
+inline void endPacedFrame(FramePacer *pacer) {
+
+    // The slot of the oldest frame is reused, so its timestamp is waited for if still pending
+    if (pacer->frame - pacer->firstPendingFrame >= FRAME_PACER_MAX_FRAMES) {
+        GLuint64 timestamp;
+        glGetQueryObjectui64v(pacer->queryNames[pacer->firstPendingFrame % FRAME_PACER_MAX_FRAMES], GL_QUERY_RESULT, &timestamp);
+        collectFramePacerQueries(pacer);
+    }
+
+    int slot = pacer->frame % FRAME_PACER_MAX_FRAMES;
+    if (pacer->fences[slot])
+        glDeleteSync(pacer->fences[slot]);
+    pacer->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glQueryCounter(pacer->queryNames[slot], GL_TIMESTAMP);
+    pacer->frame++;
+    pacer->modeFrames++;
+
+    collectFramePacerQueries(pacer);
+
+    // The clocks drift apart slowly
+    if (pacer->modeFrames % 1000 == 0)
+        syncFramePacerClock(pacer);
+
+}
+
+/*
+ * Print the statistics of the current mode and delete the fences and queries
+ */
+inline void destroyFramePacer(FramePacer *pacer) {
+
+    printFramePacerStatistics(pacer);
+
+    for (int f=0; f<FRAME_PACER_MAX_FRAMES; ++f)
+        if (pacer->fences[f])
+            glDeleteSync(pacer->fences[f]);
+    glDeleteQueries(FRAME_PACER_MAX_FRAMES, pacer->queryNames);
+
+}
+
+#endif
@@ -0,0 +1,642 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <GL/glew.h>
+
+/*
+ * Accounting of the memory of the buffers and textures on the GPU, kept within a budget.
+ *
+ * Buffers are sub-allocated from pools. A pool is a list of large blocks created with
+ * glNamedBufferStorage, handed out in aligned ranges by a first fit free list, so many small buffers
+ * cost the driver a single allocation and their memory is reused when they are freed. Buffers and
+ * textures created elsewhere can be registered to be counted as well.
+ *
+ * The textures created by the manager are tracked by their size in bytes and the frame they were
+ * last used. When the memory in use exceeds the budget, the texture used the longest ago loses its
+ * most detailed level, the remaining levels being copied into a smaller texture, until the memory
+ * fits. A reduced texture is read from its source again once its full size fits in the budget.
+ */
+
+// Size of the blocks of a buffer pool, larger buffers getting a block of their own
+#define GPU_BUFFER_BLOCK_SIZE (16 * 1024 * 1024)
+
+// Textures are not reduced below this size
+#define GPU_TEXTURE_MIN_SIZE 64
+
+/*
+ * A structure for storing a free range of a buffer block
+ */
+typedef struct {
+    GLintptr offset;
+    GLsizeiptr size;
+} GpuRange;
+
+/*
+ * A structure for storing a block of a buffer pool and its free ranges, sorted by offset
+ */
+typedef struct {
+    GLuint bufferName;
+    GLsizeiptr size;
+    std::vector<GpuRange> freeRanges;
+} GpuBufferBlock;
+
+/*
+ * A structure for storing the blocks of a buffer pool. The blocks are created with the given flags,
+ * which must include GL_DYNAMIC_STORAGE_BIT for the buffers to be given data.
+ */
+typedef struct {
+    const char *name;
+    GLbitfield flags;
+    GLsizeiptr blockSize;
+    GLsizeiptr alignment;
+    std::vector<GpuBufferBlock> blocks;
+    // Bytes handed out and the number of buffers
+    GLsizeiptr usedBytes;
+    int numBuffers;
+} GpuBufferPool;
+
+/*
+ * A structure for storing a buffer allocated from a pool, a range of one of its blocks
+ */
+typedef struct {
+    GLuint bufferName;
+    GLintptr offset;
+    GLsizeiptr size;
+    int pool;
+} GpuBuffer;
+
+/*
+ * A structure for storing a texture created by the manager. The size and levels are those of the
+ * full texture, of which the most detailed levels may have been dropped. A texture with layers is a
+ * GL_TEXTURE_2D_ARRAY, the levels of every layer being dropped together.
+ */
+typedef struct {
+    std::string source;
+    GLuint textureName;
+    GLenum internalFormat;
+    int width, height;
+    int layers;
+    int levels;
+    int droppedLevels;
+    GLsizeiptr bytes;
+    long long lastUsed;
+} GpuTexture;
+
+/*
+ * A structure for storing a buffer or texture created elsewhere and registered to be counted
+ */
+typedef struct {
+    GLenum type;
+    GLuint name;
+    GLsizeiptr bytes;
+} GpuResource;
+
+// Function reading the source of a texture into level 0 of the given texture of its full size and
+// filling the other levels. Returns FALSE if the source could not be read.
+typedef int (*GpuTextureReader)(const char *source, GLuint textureName, void *data);
+
+/*
+ * A structure for storing the buffer pools and textures of the GPU, and the budget they are kept in
+ */
+typedef struct {
+    // Largest number of bytes in use, 0 for no limit
+    GLsizeiptr budget;
+    std::vector<GpuBufferPool> pools;
+    // The textures by handle, the name being 0 for a destroyed texture
+    std::vector<GpuTexture> textures;
+    std::vector<GpuResource> resources;
+    // Function reading the textures back to their full size
+    GpuTextureReader reader;
+    void *readerData;
+    // Frames updated, and the levels dropped and textures restored since the start
+    long long frame;
+    int droppedLevels;
+    int restoredTextures;
+} GpuMemory;
+
+/*
+ * Initialize the manager with a budget in bytes, 0 for no limit. The reader is used to restore
+ * reduced textures, which stay reduced if it is NULL.
+ */
+inline void initGpuMemory(GpuMemory *memory, GLsizeiptr budget, GpuTextureReader reader, void *readerData) {
+
+    memory->budget = budget;
+    memory->reader = reader;
+    memory->readerData = readerData;
+    memory->frame = 0;
+    memory->droppedLevels = memory->restoredTextures = 0;
+
+}
+
+/*
+ * Create an empty buffer pool whose buffers start at multiples of the alignment. Returns the pool.
+ */
+inline int createGpuBufferPool(GpuMemory *memory, const char *name, GLbitfield flags, GLsizeiptr alignment, GLsizeiptr blockSize = GPU_BUFFER_BLOCK_SIZE) {
+
+    GpuBufferPool pool;
+    pool.name = name;
+    pool.flags = flags;
+    pool.blockSize = blockSize;
+    pool.alignment = std::max(alignment, (GLsizeiptr)4);
+    pool.usedBytes = 0;
+    pool.numBuffers = 0;
+    memory->pools.push_back(pool);
+
+    return (int)memory->pools.size() - 1;
+
+}
+
+/*
+ * Take an aligned range of the given size from the free ranges of a block. Returns FALSE if none of
+ * them is large enough.
+ */
+inline int takeGpuRange(GpuBufferBlock *block, GLsizeiptr size, GLsizeiptr alignment, GLintptr *offset) {
+
+    for (int r=0; r<(int)block->freeRanges.size(); ++r) {
+
+        GpuRange range = block->freeRanges[r];
+        GLintptr start = (range.offset + alignment - 1) / alignment * alignment;
+        if (start + size > range.offset + range.size)
+            continue;
+
+        // The parts before and after the buffer stay free
+        GpuRange before = { range.offset, start - range.offset };
+        GpuRange after = { start + size, range.offset + range.size - start - size };
+        block->freeRanges.erase(block->freeRanges.begin() + r);
+        if (after.size > 0)
+            block->freeRanges.insert(block->freeRanges.begin() + r, after);
+        if (before.size > 0)
+            block->freeRanges.insert(block->freeRanges.begin() + r, before);
+
+        *offset = start;
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/*
+ * Allocate a buffer of the given size from a pool, adding a block if none has room, and fill it
+ * with the data unless it is NULL. Returns FALSE if a block could not be created.
+ */
+inline int allocateGpuBuffer(GpuMemory *memory, int poolIndex, GLsizeiptr size, const void *data, GpuBuffer *buffer) {
+
+    GpuBufferPool *pool = &memory->pools[poolIndex];
+    size = std::max(size, (GLsizeiptr)1);
+
+    int b = 0;
+    GLintptr offset = 0;
+    while (b < (int)pool->blocks.size() && !takeGpuRange(&pool->blocks[b], size, pool->alignment, &offset))
+        b++;
+
+    if (b == (int)pool->blocks.size()) {
+        GpuBufferBlock block;
+        block.size = std::max(pool->blockSize, (size + pool->alignment - 1) / pool->alignment * pool->alignment);
+        // Errors left by earlier calls are cleared, so only a failure of the storage is reported
+        while (glGetError() != GL_NO_ERROR)
+            ;
+        glCreateBuffers(1, &block.bufferName);
+        glNamedBufferStorage(block.bufferName, block.size, NULL, pool->flags);
+        if (glGetError() != GL_NO_ERROR) {
+            printf("ERROR Could not create a block of %.1f MiB for the %s buffer pool\n", block.size / 1048576.0, pool->name);
+            glDeleteBuffers(1, &block.bufferName);
+            return 0;
+        }
+        GpuRange range = { 0, block.size };
+        block.freeRanges.push_back(range);
+        pool->blocks.push_back(block);
+        takeGpuRange(&pool->blocks[b], size, pool->alignment, &offset);
+    }
+
+    buffer->bufferName = pool->blocks[b].bufferName;
+    buffer->offset = offset;
+    buffer->size = size;
+    buffer->pool = poolIndex;
+    pool->usedBytes += size;
+    pool->numBuffers++;
+
+    if (data)
+        glNamedBufferSubData(buffer->bufferName, buffer->offset, size, data);
+
+    return 1;
+
+}
+
+/*
+ * Bind the range of a buffer to an indexed target
+ */
+inline void bindGpuBuffer(GLenum target, GLuint index, const GpuBuffer *buffer) {
+
+    glBindBufferRange(target, index, buffer->bufferName, buffer->offset, buffer->size);
+
+}
+
+/*
+ * Return a buffer to its pool, merging its range with the free ranges next to it. A block left
+ * without buffers is deleted.
+ */
+inline void freeGpuBuffer(GpuMemory *memory, GpuBuffer *buffer) {
+
+    if (!buffer->bufferName)
+        return;
+
+    GpuBufferPool *pool = &memory->pools[buffer->pool];
+    int b = 0;
+    while (pool->blocks[b].bufferName != buffer->bufferName)
+        b++;
+    GpuBufferBlock *block = &pool->blocks[b];
+
+    // Insert the range in offset order and merge it with its neighbours
+    std::vector<GpuRange> &ranges = block->freeRanges;
+    GpuRange freed = { buffer->offset, buffer->size };
+    int r = 0;
+    while (r < (int)ranges.size() && ranges[r].offset < freed.offset)
+        r++;
+    ranges.insert(ranges.begin() + r, freed);
+    if (r + 1 < (int)ranges.size() && ranges[r].offset + ranges[r].size == ranges[r+1].offset) {
+        ranges[r].size += ranges[r+1].size;
+        ranges.erase(ranges.begin() + r + 1);
+    }
+    if (r > 0 && ranges[r-1].offset + ranges[r-1].size == ranges[r].offset) {
+        ranges[r-1].size += ranges[r].size;
+        ranges.erase(ranges.begin() + r);
+    }
+
+    pool->usedBytes -= buffer->size;
+    pool->numBuffers--;
+    buffer->bufferName = 0;
+
+    // The alignment padding is part of the free ranges, so an empty block is a single range
+    if (ranges.size() == 1 && ranges[0].size == block->size) {
+        glDeleteBuffers(1, &block->bufferName);
+        pool->blocks.erase(pool->blocks.begin() + b);
+    }
+
+}
+
+/*
+ * Register a buffer created elsewhere to be counted
+ */
+inline void trackGpuBuffer(GpuMemory *memory, GLuint bufferName) {
+
+    GLint64 size = 0;
+    glGetNamedBufferParameteri64v(bufferName, GL_BUFFER_SIZE, &size);
+    GpuResource resource = { GL_BUFFER, bufferName, (GLsizeiptr)size };
+    memory->resources.push_back(resource);
+
+}
+
+/*
+ * Register a texture created elsewhere, of the given size in bytes, to be counted
+ */
+inline void trackGpuTexture(GpuMemory *memory, GLuint textureName, GLsizeiptr bytes) {
+
+    GpuResource resource = { GL_TEXTURE, textureName, bytes };
+    memory->resources.push_back(resource);
+
+}
+
+/*
+ * Get the number of bytes a texel of a format takes. Three component formats are counted as four,
+ * the way they are stored by most drivers.
+ */
+inline int getTexelBytes(GLenum internalFormat) {
+
+    switch (internalFormat) {
+        case GL_R8:
+            return 1;
+        case GL_RG8:
+            return 2;
+        case GL_RGBA16F:
+            return 8;
+        case GL_RGBA32F:
+            return 16;
+        default:
+            return 4;
+    }
+
+}
+
+/*
+ * Get the number of levels of a complete mipmap chain
+ */
+inline int getTextureLevels(int width, int height) {
+
+    int levels = 1;
+    while ((width | height) >> levels)
+        levels++;
+    return levels;
+
+}
+
+/*
+ * Get the number of bytes of the levels of a texture from the given level to the last
+ */
+inline GLsizeiptr getTextureBytes(const GpuTexture *texture, int firstLevel) {
+
+    GLsizeiptr bytes = 0;
+    for (int l=firstLevel; l<texture->levels; ++l)
+        bytes += (GLsizeiptr)std::max(texture->width >> l, 1) * std::max(texture->height >> l, 1) * getTexelBytes(texture->internalFormat);
+    return bytes * std::max(texture->layers, 1);
+
+}
+
+/*
+ * Create the storage of a texture from the given level of its full size to the last, sampled with
+ * trilinear filtering and repeated
+ */
+inline GLuint createGpuTextureStorage(const GpuTexture *texture, int firstLevel) {
+
+    GLuint textureName;
+    int width = std::max(texture->width >> firstLevel, 1), height = std::max(texture->height >> firstLevel, 1);
+    if (texture->layers) {
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &textureName);
+        glTextureStorage3D(textureName, texture->levels - firstLevel, texture->internalFormat, width, height, texture->layers);
+    } else {
+        glCreateTextures(GL_TEXTURE_2D, 1, &textureName);
+        glTextureStorage2D(textureName, texture->levels - firstLevel, texture->internalFormat, width, height);
+    }
+    glTextureParameteri(textureName, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(textureName, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(textureName, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(textureName, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    return textureName;
+
+}
+
+/*
+ * Create a texture with a complete mipmap chain, read from the given source, or a texture array if
+ * it has layers. The caller fills the levels, through the name returned by getGpuTexture. Returns
+ * the handle of the texture.
+ */
+inline int createGpuTexture(GpuMemory *memory, const char *source, int width, int height, GLenum internalFormat, int layers = 0) {
+
+    GpuTexture texture;
+    texture.source = source;
+    texture.internalFormat = internalFormat;
+    texture.width = width;
+    texture.height = height;
+    texture.layers = layers;
+    texture.levels = getTextureLevels(width, height);
+    texture.droppedLevels = 0;
+    texture.bytes = getTextureBytes(&texture, 0);
+    texture.lastUsed = memory->frame;
+    texture.textureName = createGpuTextureStorage(&texture, 0);
+    memory->textures.push_back(texture);
+
+    return (int)memory->textures.size() - 1;
+
+}
+
+/*
+ * Get the name of a texture, 0 for the handle -1
+ */
+inline GLuint getGpuTexture(const GpuMemory *memory, int handle) {
+
+    return handle < 0 ? 0 : memory->textures[handle].textureName;
+
+}
+
+/*
+ * Get the name of a texture to bind it, marking it as used in the current frame
+ */
+inline GLuint useGpuTexture(GpuMemory *memory, int handle) {
+
+    if (handle < 0)
+        return 0;
+    memory->textures[handle].lastUsed = memory->frame;
+    return memory->textures[handle].textureName;
+
+}
+
+/*
+ * Destroy a texture, its handle is not reused
+ */
+inline void destroyGpuTexture(GpuMemory *memory, int handle) {
+
+    GpuTexture *texture = &memory->textures[handle];
+    glDeleteTextures(1, &texture->textureName);
+    texture->textureName = 0;
+    texture->bytes = 0;
+
+}
+
+/*
+ * Get the number of bytes in use, the blocks of the pools counted whole
+ */
+inline GLsizeiptr getGpuMemoryUsage(const GpuMemory *memory) {
+
+    GLsizeiptr bytes = 0;
+    for (int p=0; p<(int)memory->pools.size(); ++p)
+        for (int b=0; b<(int)memory->pools[p].blocks.size(); ++b)
+            bytes += memory->pools[p].blocks[b].size;
+    for (int t=0; t<(int)memory->textures.size(); ++t)
+        bytes += memory->textures[t].bytes;
+    for (int r=0; r<(int)memory->resources.size(); ++r)
+        bytes += memory->resources[r].bytes;
+
+    return bytes;
+
+}
+
+/*
+ * Drop the most detailed level of a texture, copying the other levels into a texture of half the
+ * size
+ */
+inline void reduceGpuTexture(GpuMemory *memory, GpuTexture *texture) {
+
+    int firstLevel = texture->droppedLevels + 1;
+    GLenum target = texture->layers ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    GLuint textureName = createGpuTextureStorage(texture, firstLevel);
+    for (int l=firstLevel; l<texture->levels; ++l)
+        glCopyImageSubData(texture->textureName, target, l - texture->droppedLevels, 0, 0, 0, textureName, target, l - firstLevel, 0, 0, 0,
+                std::max(texture->width >> l, 1), std::max(texture->height >> l, 1), std::max(texture->layers, 1));
+
+    glDeleteTextures(1, &texture->textureName);
+    texture->textureName = textureName;
+    texture->droppedLevels = firstLevel;
+    texture->bytes = getTextureBytes(texture, firstLevel);
+    memory->droppedLevels++;
+
+}
+
+/*
+ * Read a reduced texture back to its full size. Returns FALSE if its source could not be read, the
+ * texture staying reduced.
+ */
+inline int restoreGpuTexture(GpuMemory *memory, GpuTexture *texture) {
+
+    GLuint textureName = createGpuTextureStorage(texture, 0);
+    if (!memory->reader(texture->source.c_str(), textureName, memory->readerData)) {
+        glDeleteTextures(1, &textureName);
+        return 0;
+    }
+
+    glDeleteTextures(1, &texture->textureName);
+    texture->textureName = textureName;
+    texture->droppedLevels = 0;
+    texture->bytes = getTextureBytes(texture, 0);
+    memory->restoredTextures++;
+
+    return 1;
+
+}
+
+/*
+ * Keep the memory within the budget at the end of a frame. Textures lose a level at a time, the one
+ * used the longest ago first and the largest of those used as long ago, until the memory fits or
+ * every texture has its smallest size. Otherwise the reduced texture used last is restored if its
+ * full size fits, one texture per frame to spread the cost of reading them.
+ */
+inline void updateGpuMemory(GpuMemory *memory) {
+
+    GLsizeiptr usage = getGpuMemoryUsage(memory);
+
+    while (memory->budget > 0 && usage > memory->budget) {
+
+        GpuTexture *victim = NULL;
+        for (int t=0; t<(int)memory->textures.size(); ++t) {
+            GpuTexture *texture = &memory->textures[t];
+            int firstLevel = texture->droppedLevels + 1;
+            if (!texture->textureName || std::max(texture->width >> firstLevel, texture->height >> firstLevel) < GPU_TEXTURE_MIN_SIZE)
+                continue;
+            if (!victim || texture->lastUsed < victim->lastUsed || (texture->lastUsed == victim->lastUsed && texture->bytes > victim->bytes))
+                victim = texture;
+        }
+        if (!victim)
+            break;
+
+        usage -= victim->bytes;
+        reduceGpuTexture(memory, victim);
+        usage += victim->bytes;
+
+    }
+
+    if (memory->reader && (memory->budget == 0 || usage <= memory->budget)) {
+
+        GpuTexture *candidate = NULL;
+        for (int t=0; t<(int)memory->textures.size(); ++t) {
+            GpuTexture *texture = &memory->textures[t];
+            if (!texture->textureName || !texture->droppedLevels)
+                continue;
+            if (memory->budget > 0 && usage + getTextureBytes(texture, 0) - texture->bytes > memory->budget)
+                continue;
+            if (!candidate || texture->lastUsed > candidate->lastUsed)
+                candidate = texture;
+        }
+        if (candidate)
+            restoreGpuTexture(memory, candidate);
+
+    }
+
+    memory->frame++;
+
+}
+
+/*
+ * Print the memory in use on one line, followed by what the driver reports if it supports
+ * GL_NVX_gpu_memory_info or GL_ATI_meminfo
+ */
+inline void printGpuMemorySummary(const GpuMemory *memory) {
+
+    GLsizeiptr poolBytes = 0, usedBytes = 0, textureBytes = 0, otherBytes = 0;
+    int numBlocks = 0, numReduced = 0;
+    for (int p=0; p<(int)memory->pools.size(); ++p) {
+        for (int b=0; b<(int)memory->pools[p].blocks.size(); ++b)
+            poolBytes += memory->pools[p].blocks[b].size;
+        numBlocks += memory->pools[p].blocks.size();
+        usedBytes += memory->pools[p].usedBytes;
+    }
+    for (int t=0; t<(int)memory->textures.size(); ++t) {
+        textureBytes += memory->textures[t].bytes;
+        if (memory->textures[t].droppedLevels)
+            numReduced++;
+    }
+    for (int r=0; r<(int)memory->resources.size(); ++r)
+        otherBytes += memory->resources[r].bytes;
+
+    printf("GPU memory: %.1f MiB", (poolBytes + textureBytes + otherBytes) / 1048576.0);
+    if (memory->budget > 0)
+        printf(" of %.1f MiB budget", memory->budget / 1048576.0);
+    printf(" (pools %.1f MiB in %d blocks, %.1f MiB used, textures %.1f MiB, %d reduced, other %.1f MiB)\n", poolBytes / 1048576.0,
+            numBlocks, usedBytes / 1048576.0, textureBytes / 1048576.0, numReduced, otherBytes / 1048576.0);
+
+    // The extensions report kilobytes
+    if (GLEW_NVX_gpu_memory_info) {
+        GLint dedicated = 0, available = 0, evictions = 0;
+        glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &dedicated);
+        glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+        glGetIntegerv(GL_GPU_MEMORY_INFO_EVICTION_COUNT_NVX, &evictions);
+        printf("Driver: %.1f of %.1f MiB video memory available, %d evictions\n", available / 1024.0, dedicated / 1024.0, evictions);
+    } else if (GLEW_ATI_meminfo) {
+        GLint textureFree[4] = { 0 }, bufferFree[4] = { 0 };
+        glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, textureFree);
+        glGetIntegerv(GL_VBO_FREE_MEMORY_ATI, bufferFree);
+        printf("Driver: %.1f MiB free for textures, %.1f MiB for buffers\n", textureFree[0] / 1024.0, bufferFree[0] / 1024.0);
+    }
+
+}
+
+/*
+ * Print the blocks of every pool and the size of every texture
+ */
+inline void printGpuMemoryReport(const GpuMemory *memory) {
+
+    printGpuMemorySummary(memory);
+
+    for (int p=0; p<(int)memory->pools.size(); ++p) {
+        const GpuBufferPool *pool = &memory->pools[p];
+        printf("Pool %s: %d buffers, %.1f KiB used\n", pool->name, pool->numBuffers, pool->usedBytes / 1024.0);
+        for (int b=0; b<(int)pool->blocks.size(); ++b) {
+            GLsizeiptr freeBytes = 0;
+            for (int r=0; r<(int)pool->blocks[b].freeRanges.size(); ++r)
+                freeBytes += pool->blocks[b].freeRanges[r].size;
+            printf("  Block %d: %.1f KiB, %.1f KiB free in %d ranges\n", b, pool->blocks[b].size / 1024.0, freeBytes / 1024.0,
+                    (int)pool->blocks[b].freeRanges.size());
+        }
+    }
+
+    for (int t=0; t<(int)memory->textures.size(); ++t) {
+        const GpuTexture *texture = &memory->textures[t];
+        if (!texture->textureName)
+            continue;
+        printf("Texture %s: %dx%d of %dx%d, %d layers, %.1f KiB, used %lld frames ago\n", texture->source.c_str(),
+                std::max(texture->width >> texture->droppedLevels, 1), std::max(texture->height >> texture->droppedLevels, 1), texture->width,
+                texture->height, std::max(texture->layers, 1), texture->bytes / 1024.0, memory->frame - texture->lastUsed);
+    }
+
+}
+
+/*
+ * Delete every buffer block and texture, those registered included
+ */
+inline void destroyGpuMemory(GpuMemory *memory) {
+
+    for (int p=0; p<(int)memory->pools.size(); ++p)
+        for (int b=0; b<(int)memory->pools[p].blocks.size(); ++b)
+            glDeleteBuffers(1, &memory->pools[p].blocks[b].bufferName);
+    memory->pools.clear();
+
+    for (int t=0; t<(int)memory->textures.size(); ++t)
+        if (memory->textures[t].textureName)
+            glDeleteTextures(1, &memory->textures[t].textureName);
+    memory->textures.clear();
+
+    for (int r=0; r<(int)memory->resources.size(); ++r) {
+        if (memory->resources[r].type == GL_BUFFER)
+            glDeleteBuffers(1, &memory->resources[r].name);
+        else
+            glDeleteTextures(1, &memory->resources[r].name);
+    }
+    memory->resources.clear();
+
+}
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ * Job system running parallel loops over a range of items on a fixed set of workers, the thread
+ * submitting the loop being the first worker. A job is a range of items, and a worker executing a
+ * range larger than the grain splits it in half, pushing one half onto its own deque and continuing
+ * with the other. Workers take jobs from the bottom of their own deque, so a worker keeps to the
+ * items next to the ones it just processed, and idle workers steal from the top of the deques of
+ * the others, taking the largest jobs that are left. Ranges are split at multiples of the grain,
+ * so every item belongs to exactly one grain-sized chunk, which lets the loop body write the output
+ * of a chunk to a region of its own.
+ *
+ * Each deque is the lock-free deque of Chase and Lev, with a fixed capacity as the splitting never
+ * leaves more than one job per level of the split on a deque. The jobs are packed into a single
+ * 64-bit value, so they are read and written atomically.
+ */
+
+// Capacity of the deque of a worker, more than the number of times a range can be halved
+#define JOB_DEQUE_CAPACITY 64
+
+// Maximum number of workers
+#define MAX_JOB_WORKERS 64
+
+// Function executing the items from begin to end of a loop on the given worker
+typedef void (*JobFunction)(void *data, int begin, int end, int worker);
+
+/*
+ * A structure for storing the deque of jobs of a worker
+ */
+typedef struct {
+    // The owner pushes and pops at the bottom, thieves steal from the top
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+    std::atomic<uint64_t> jobs[JOB_DEQUE_CAPACITY];
+} JobDeque;
+
+/*
+ * A structure for storing the workers and the loop being run
+ */
+typedef struct {
+    int numWorkers;
+    JobDeque deques[MAX_JOB_WORKERS];
+    std::vector<std::thread> threads;
+    // Loop being run
+    JobFunction function;
+    void *data;
+    int grain;
+    // Items of the loop not yet executed
+    std::atomic<int> remaining;
+    // Incremented for every loop, the workers sleep until it changes
+    std::mutex mutex;
+    std::condition_variable condition;
+    int64_t generation;
+    int running;
+    // Number of jobs executed by each worker and taken from another worker in the last loop
+    std::atomic<int> executedJobs[MAX_JOB_WORKERS];
+    std::atomic<int> stolenJobs[MAX_JOB_WORKERS];
+} JobSystem;
+
+/*
+ * Pack the range of a job into a deque entry
+ */
+inline uint64_t packJob(int begin, int end) {
+
+    return (uint64_t)(uint32_t)begin << 32 | (uint32_t)end;
+
+}
+
+/*
+ * Unpack the range of a job from a deque entry
+ */
+inline void unpackJob(uint64_t job, int *begin, int *end) {
+
+    *begin = (int)(job >> 32);
+    *end = (int)(job & 0xffffffff);
+
+}
+
+/*
+ * Push a job onto the bottom of the deque, only called by the owner. Returns FALSE if it is full.
+ */
+inline int pushJob(JobDeque *deque, uint64_t job) {
+
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed);
+    int64_t top = deque->top.load(std::memory_order_acquire);
+    if (bottom - top >= JOB_DEQUE_CAPACITY)
+        return 0;
+
+    deque->jobs[bottom % JOB_DEQUE_CAPACITY].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+
+    return 1;
+
+}
+
+/*
+ * Pop a job from the bottom of the deque, only called by the owner. Returns FALSE if it is empty or
+ * the last job was stolen.
+ */
+inline int popJob(JobDeque *deque, uint64_t *job) {
+
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+    deque->bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = deque->top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    *job = deque->jobs[bottom % JOB_DEQUE_CAPACITY].load(std::memory_order_relaxed);
+    if (top < bottom)
+        return 1;
+
+    // The last job, which a thief may be taking at the same time
+    int taken = deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+    return taken;
+
+}
+
+/*
+ * Steal a job from the top of the deque of another worker. Returns FALSE if it is empty or another
+ * thread took the job first.
+ */
+inline int stealJob(JobDeque *deque, uint64_t *job) {
+
+    int64_t top = deque->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = deque->bottom.load(std::memory_order_acquire);
+    if (top >= bottom)
+        return 0;
+
+    *job = deque->jobs[top % JOB_DEQUE_CAPACITY].load(std::memory_order_relaxed);
+    return deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+
+}
+
+/*
+ * Execute a job on a worker, splitting it at a multiple of the grain until it is no larger than the
+ * grain. The halves that are split off are left for this worker or a thief. Should the deque be
+ * full, the function is given the remaining chunks of the job at once.
+ */
+inline void executeJob(JobSystem *system, int worker, int begin, int end) {
+
+    while (end - begin > system->grain) {
+        int middle = begin + (end - begin) / system->grain / 2 * system->grain;
+        if (middle == begin)
+            middle += system->grain;
+        if (!pushJob(&system->deques[worker], packJob(middle, end)))
+            break;
+        end = middle;
+    }
+
+    system->function(system->data, begin, end, worker);
+    system->executedJobs[worker]++;
+    system->remaining.fetch_sub(end - begin, std::memory_order_acq_rel);
+
+}
+
+/*
+ * Run jobs on a worker until every item of the loop has been executed
+ */
+inline void runJobs(JobSystem *system, int worker) {
+
+    uint64_t job;
+    int begin, end;
+    unsigned int victim = worker;
+
+    while (system->remaining.load(std::memory_order_acquire) > 0) {
+
+        // Own jobs first, then the oldest job of the other workers
+        if (popJob(&system->deques[worker], &job)) {
+            unpackJob(job, &begin, &end);
+            executeJob(system, worker, begin, end);
+            continue;
+        }
+
+        int stolen = 0;
+        for (int w=1; w<system->numWorkers && !stolen; ++w) {
+            victim = (victim + 1) % system->numWorkers;
+            if (victim != (unsigned int)worker && stealJob(&system->deques[victim], &job))
+                stolen = 1;
+        }
+        if (stolen) {
+            system->stolenJobs[worker]++;
+            unpackJob(job, &begin, &end);
+            executeJob(system, worker, begin, end);
+        } else
+            std::this_thread::yield();
+
+    }
+
+}
+
+/*
+ * Worker thread, sleeping until a loop is submitted and then helping to run it
+ */
+inline void jobWorkerThread(JobSystem *system, int worker) {
+
+    int64_t generation = 0;
+
+    while (1) {
+
+        {
+            std::unique_lock<std::mutex> lock(system->mutex);
+            system->condition.wait(lock, [&]() { return !system->running || system->generation != generation; });
+            if (!system->running)
+                return;
+            generation = system->generation;
+        }
+
+        runJobs(system, worker);
+
+    }
+
+}
+
+/*
+ * Initialize a job system with the given number of workers, the calling thread included, or one per
+ * processor core if it is 0
+ */
+inline void initJobSystem(JobSystem *system, int numWorkers) {
+
+    if (numWorkers <= 0)
+        numWorkers = (int)std::thread::hardware_concurrency();
+    system->numWorkers = numWorkers < 1 ? 1 : (numWorkers > MAX_JOB_WORKERS ? MAX_JOB_WORKERS : numWorkers);
+
+    for (int w=0; w<system->numWorkers; ++w) {
+        system->deques[w].top.store(0);
+        system->deques[w].bottom.store(0);
+        system->executedJobs[w].store(0);
+        system->stolenJobs[w].store(0);
+    }
+    system->remaining.store(0);
+    system->generation = 0;
+    system->running = 1;
+
+    for (int w=1; w<system->numWorkers; ++w)
+        system->threads.push_back(std::thread(jobWorkerThread, system, w));
+
+}
+
+/*
+ * Run a function over the items from 0 to count in jobs of at most grain items, returning when all
+ * of them have been executed
+ */
+inline void parallelFor(JobSystem *system, int count, int grain, JobFunction function, void *data) {
+
+    if (count <= 0)
+        return;
+
+    system->function = function;
+    system->data = data;
+    system->grain = grain < 1 ? 1 : grain;
+    for (int w=0; w<system->numWorkers; ++w) {
+        system->executedJobs[w].store(0, std::memory_order_relaxed);
+        system->stolenJobs[w].store(0, std::memory_order_relaxed);
+    }
+
+    // A loop of a single job is run directly, without waking the workers
+    if (count <= system->grain) {
+        function(data, 0, count, 0);
+        system->executedJobs[0].store(1, std::memory_order_relaxed);
+        return;
+    }
+
+    system->remaining.store(count, std::memory_order_release);
+
+    // The whole range starts on the deque of the calling thread, the others steal from it
+    pushJob(&system->deques[0], packJob(0, count));
+    if (system->numWorkers > 1) {
+        std::lock_guard<std::mutex> lock(system->mutex);
+        system->generation++;
+        system->condition.notify_all();
+    }
+
+    runJobs(system, 0);
+
+}
+
+/*
+ * Print the number of jobs each worker executed in the last loop, and how many of them it stole
+ */
+inline void printJobStatistics(JobSystem *system) {
+
+    for (int w=0; w<system->numWorkers; ++w)
+        printf("Worker %d: %d jobs, %d stolen\n", w, system->executedJobs[w].load(), system->stolenJobs[w].load());
+
+}
+
+/*
+ * Stop and join the workers
+ */
+inline void destroyJobSystem(JobSystem *system) {
+
+    {
+        std::lock_guard<std::mutex> lock(system->mutex);
+        system->running = 0;
+        system->condition.notify_all();
+    }
+
+    for (int t=0; t<(int)system->threads.size(); ++t)
+        system->threads[t].join();
+    system->threads.clear();
+
+}
+
+#endif
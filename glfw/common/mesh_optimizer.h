@@ -0,0 +1,322 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <GL/glew.h>
+
+/*
+ * Triangle and vertex reordering for indexed triangle lists. The passes are meant to be run in
+ * order: optimizeVertexCache reorders the triangles so recently transformed vertices are reused
+ * from the post-transform cache (Tipsify, Sander et al. 2007) and reports where the order jumps to
+ * an unrelated part of the mesh, optimizeOverdraw reorders those clusters so triangles facing
+ * outwards are drawn first without losing much cache efficiency, and optimizeVertexFetch renumbers
+ * the vertices in the order they are first used so the vertex data is read linearly.
+ *
+ * The vertices are interleaved floats with the position in the first three.
+ */
+
+// Size of the simulated FIFO post-transform cache
+#define MESH_CACHE_SIZE 16
+
+// How much worse than the cluster average the cache miss ratio of a split cluster may become
+#define MESH_OVERDRAW_THRESHOLD 1.05f
+
+/*
+ * A structure for storing the cache statistics of an index buffer
+ */
+typedef struct {
+    // Average cache miss ratio, transformed vertices per triangle (0.5 is ideal, 3 is worst)
+    float acmr;
+    // Average transformed vertex ratio, transformed vertices per unique vertex (1 is ideal)
+    float atvr;
+} VertexCacheStatistics;
+
+/*
+ * Simulate a FIFO post-transform cache of the given size and count the transformed vertices
+ */
+inline VertexCacheStatistics analyzeVertexCache(const std::vector<GLuint> &indices, int numVertices, int cacheSize = MESH_CACHE_SIZE) {
+
+    // A vertex is in the cache if it was inserted less than cacheSize insertions ago
+    std::vector<unsigned int> cacheTime(numVertices, 0);
+    unsigned int time = cacheSize + 1;
+    int misses = 0;
+    std::vector<char> used(numVertices, 0);
+    int numUsed = 0;
+
+    for (size_t i=0; i<indices.size(); ++i) {
+        GLuint v = indices[i];
+        if (time - cacheTime[v] > (unsigned int)cacheSize) {
+            cacheTime[v] = time++;
+            misses++;
+        }
+        if (!used[v]) {
+            used[v] = 1;
+            numUsed++;
+        }
+    }
+
+    VertexCacheStatistics statistics;
+    statistics.acmr = indices.empty() ? 0.0f : (float)misses / (indices.size() / 3);
+    statistics.atvr = numUsed == 0 ? 0.0f : (float)misses / numUsed;
+    return statistics;
+
+}
+
+/*
+ * Reorder the triangles for the post-transform cache. The triangles adjacent to the current vertex
+ * are emitted, and the next vertex is the one among those just emitted that will stay longest in
+ * the cache while still having triangles left. When there is none the order restarts elsewhere,
+ * and the first triangle after each restart is stored in clusters.
+ */
+inline void optimizeVertexCache(std::vector<GLuint> &indices, int numVertices, std::vector<int> &clusters, int cacheSize = MESH_CACHE_SIZE) {
+
+    int numTriangles = indices.size() / 3;
+
+    // Find the triangles adjacent to every vertex
+    std::vector<int> liveTriangles(numVertices, 0);
+    for (size_t i=0; i<indices.size(); ++i)
+        liveTriangles[indices[i]]++;
+    std::vector<int> adjacencyOffsets(numVertices + 1, 0);
+    for (int v=0; v<numVertices; ++v)
+        adjacencyOffsets[v+1] = adjacencyOffsets[v] + liveTriangles[v];
+    std::vector<int> adjacency(indices.size());
+    std::vector<int> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (int t=0; t<numTriangles; ++t)
+        for (int c=0; c<3; ++c)
+            adjacency[adjacencyFill[indices[t*3+c]]++] = t;
+
+    std::vector<unsigned int> cacheTime(numVertices, 0);
+    unsigned int time = cacheSize + 1;
+    std::vector<char> emitted(numTriangles, 0);
+    std::vector<GLuint> deadEnds;
+    std::vector<GLuint> candidates;
+    std::vector<GLuint> output;
+    output.reserve(indices.size());
+    clusters.clear();
+
+    int cursor = 0;
+    int vertex = numVertices > 0 ? 0 : -1;
+    if (numTriangles > 0)
+        clusters.push_back(0);
+
+    while (vertex >= 0) {
+
+        // Emit the remaining triangles of the vertex
+        candidates.clear();
+        for (int a=adjacencyOffsets[vertex]; a<adjacencyOffsets[vertex+1]; ++a) {
+            int t = adjacency[a];
+            if (emitted[t])
+                continue;
+            for (int c=0; c<3; ++c) {
+                GLuint v = indices[t*3+c];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > (unsigned int)cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[t] = 1;
+        }
+
+        // Prefer the candidate that stays in the cache while its remaining triangles are emitted
+        int next = -1, bestPriority = -1;
+        for (size_t c=0; c<candidates.size(); ++c) {
+            GLuint v = candidates[c];
+            if (liveTriangles[v] <= 0)
+                continue;
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= (unsigned int)cacheSize)
+                priority = time - cacheTime[v];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        // Restart from a recently used vertex, or from the next vertex in input order
+        if (next < 0) {
+            while (!deadEnds.empty() && next < 0) {
+                GLuint v = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[v] > 0)
+                    next = v;
+            }
+            while (next < 0 && cursor < numVertices) {
+                if (liveTriangles[cursor] > 0)
+                    next = cursor;
+                cursor++;
+            }
+            if (next >= 0 && output.size() < indices.size())
+                clusters.push_back(output.size() / 3);
+        }
+
+        vertex = next;
+
+    }
+
+    indices.swap(output);
+
+}
+
+/*
+ * Count the cache misses of a range of triangles with a shared cache state
+ */
+inline int countCacheMisses(const std::vector<GLuint> &indices, int firstTriangle, int endTriangle, std::vector<unsigned int> &cacheTime,
+        unsigned int &time, int cacheSize) {
+
+    int misses = 0;
+    for (int i=firstTriangle*3; i<endTriangle*3; ++i) {
+        GLuint v = indices[i];
+        if (time - cacheTime[v] > (unsigned int)cacheSize) {
+            cacheTime[v] = time++;
+            misses++;
+        }
+    }
+
+    return misses;
+
+}
+
+/*
+ * Reorder the clusters found by optimizeVertexCache to reduce overdraw. The clusters are first
+ * split wherever the cache miss ratio of the part so far is close to that of the whole cluster,
+ * which gives smaller clusters at little cost. The clusters are then sorted so those facing away
+ * from the center of the mesh come first, as they are the most likely to occlude the others.
+ */
+inline void optimizeOverdraw(std::vector<GLuint> &indices, const std::vector<GLfloat> &vertices, int stride, const std::vector<int> &clusters,
+        float threshold = MESH_OVERDRAW_THRESHOLD, int cacheSize = MESH_CACHE_SIZE) {
+
+    int numTriangles = indices.size() / 3;
+    int numVertices = vertices.size() / stride;
+    if (numTriangles == 0)
+        return;
+
+    // Split the clusters
+    std::vector<unsigned int> cacheTime(numVertices, 0);
+    unsigned int time = cacheSize + 1;
+    std::vector<int> splitClusters;
+    for (size_t c=0; c<clusters.size(); ++c) {
+
+        int first = clusters[c];
+        int end = c + 1 < clusters.size() ? clusters[c+1] : numTriangles;
+
+        // The cache is flushed by advancing the time past the cache size
+        time += cacheSize + 1;
+        float clusterThreshold = threshold * countCacheMisses(indices, first, end, cacheTime, time, cacheSize) / (end - first);
+
+        time += cacheSize + 1;
+        splitClusters.push_back(first);
+        int misses = 0, triangles = 0;
+        for (int t=first; t<end; ++t) {
+            misses += countCacheMisses(indices, t, t + 1, cacheTime, time, cacheSize);
+            triangles++;
+            if (t + 1 < end && (float)misses / triangles <= clusterThreshold) {
+                splitClusters.push_back(t + 1);
+                time += cacheSize + 1;
+                misses = triangles = 0;
+            }
+        }
+
+    }
+
+    // Find the area weighted centroid and normal of every cluster and of the whole mesh
+    int numClusters = splitClusters.size();
+    std::vector<float> clusterData(numClusters * 6, 0.0f);
+    float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+    float meshArea = 0.0f;
+    for (int c=0; c<numClusters; ++c) {
+
+        int first = splitClusters[c];
+        int end = c + 1 < numClusters ? splitClusters[c+1] : numTriangles;
+        float *centroid = &clusterData[c*6];
+        float *normal = &clusterData[c*6+3];
+        float clusterArea = 0.0f;
+
+        for (int t=first; t<end; ++t) {
+
+            const GLfloat *p0 = &vertices[indices[t*3] * stride];
+            const GLfloat *p1 = &vertices[indices[t*3+1] * stride];
+            const GLfloat *p2 = &vertices[indices[t*3+2] * stride];
+            float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (int k=0; k<3; ++k) {
+                centroid[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * area;
+                normal[k] += n[k];
+            }
+            clusterArea += area;
+
+        }
+
+        for (int k=0; k<3; ++k)
+            meshCentroid[k] += centroid[k];
+        meshArea += clusterArea;
+
+        if (clusterArea > 0.0f)
+            for (int k=0; k<3; ++k)
+                centroid[k] /= clusterArea;
+        float normalLength = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (normalLength > 0.0f)
+            for (int k=0; k<3; ++k)
+                normal[k] /= normalLength;
+
+    }
+    if (meshArea > 0.0f)
+        for (int k=0; k<3; ++k)
+            meshCentroid[k] /= meshArea;
+
+    // Sort the clusters by how much they face away from the center
+    std::vector<float> sortKeys(numClusters);
+    std::vector<int> order(numClusters);
+    for (int c=0; c<numClusters; ++c) {
+        const float *centroid = &clusterData[c*6];
+        const float *normal = &clusterData[c*6+3];
+        sortKeys[c] = (centroid[0] - meshCentroid[0]) * normal[0] + (centroid[1] - meshCentroid[1]) * normal[1] +
+                (centroid[2] - meshCentroid[2]) * normal[2];
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sortKeys](int a, int b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<GLuint> output;
+    output.reserve(indices.size());
+    for (int c=0; c<numClusters; ++c) {
+        int first = splitClusters[order[c]];
+        int end = order[c] + 1 < numClusters ? splitClusters[order[c]+1] : numTriangles;
+        output.insert(output.end(), indices.begin() + first * 3, indices.begin() + end * 3);
+    }
+
+    indices.swap(output);
+
+}
+
+/*
+ * Renumber the vertices in the order they are first referenced by the indices, so the vertex
+ * data is fetched close to linearly. Unreferenced vertices are removed.
+ */
+inline void optimizeVertexFetch(std::vector<GLuint> &indices, std::vector<GLfloat> &vertices, int stride) {
+
+    int numVertices = vertices.size() / stride;
+    std::vector<GLuint> remap(numVertices, (GLuint)-1);
+    std::vector<GLfloat> output;
+    output.reserve(vertices.size());
+
+    GLuint nextVertex = 0;
+    for (size_t i=0; i<indices.size(); ++i) {
+        GLuint v = indices[i];
+        if (remap[v] == (GLuint)-1) {
+            remap[v] = nextVertex++;
+            output.insert(output.end(), vertices.begin() + v * stride, vertices.begin() + (v + 1) * stride);
+        }
+        indices[i] = remap[v];
+    }
+
+    vertices.swap(output);
+
+}
+
+#endif
@@ -0,0 +1,410 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
+#include <GL/glew.h>
+
+/*
+ * Simplification of indexed triangle lists by edge collapses ordered by the quadric error metric
+ * (Garland and Heckbert 1997). Vertices are only ever moved onto one of their neighbours, so the
+ * simplified indices reference the original vertex data and can share its vertex buffer.
+ *
+ * The collapses are done at the level of positions. Vertices sharing a position but not the other
+ * attributes, found along UV seams and normal discontinuities, are collapsed together and each of
+ * them must have a neighbour at the target position, so a seam can only move along itself. Open
+ * borders can likewise only be collapsed along the border.
+ *
+ * The vertices are interleaved floats with the position in the first three.
+ */
+
+// Weight of the quadrics keeping open borders in place, relative to the surface quadrics
+#define SIMPLIFIER_BORDER_WEIGHT 10.0
+
+// Part of the cheapest collapses considered in every pass, the remaining are reevaluated in the
+// next pass as the collapses change their cost
+#define SIMPLIFIER_PASS_FRACTION 3
+
+/*
+ * A structure for storing the sum of squared distances to a set of planes, the symmetric matrix of
+ * the plane equation ax + by + cz + d and the sum of the weights of the planes
+ */
+typedef struct {
+    double aa, ab, ac, ad, bb, bc, bd, cc, cd, dd;
+    double weight;
+} Quadric;
+
+/*
+ * A structure for storing a possible collapse of one position onto another
+ */
+typedef struct {
+    float error;
+    int from;
+    int to;
+} Collapse;
+
+/*
+ * Add the plane with the given unit normal and distance to a quadric
+ */
+inline void addPlaneQuadric(Quadric *quadric, const double normal[3], double distance, double weight) {
+
+    quadric->aa += weight * normal[0] * normal[0];
+    quadric->ab += weight * normal[0] * normal[1];
+    quadric->ac += weight * normal[0] * normal[2];
+    quadric->ad += weight * normal[0] * distance;
+    quadric->bb += weight * normal[1] * normal[1];
+    quadric->bc += weight * normal[1] * normal[2];
+    quadric->bd += weight * normal[1] * distance;
+    quadric->cc += weight * normal[2] * normal[2];
+    quadric->cd += weight * normal[2] * distance;
+    quadric->dd += weight * distance * distance;
+    quadric->weight += weight;
+
+}
+
+/*
+ * Add one quadric to another
+ */
+inline void addQuadric(Quadric *quadric, const Quadric *other) {
+
+    quadric->aa += other->aa;
+    quadric->ab += other->ab;
+    quadric->ac += other->ac;
+    quadric->ad += other->ad;
+    quadric->bb += other->bb;
+    quadric->bc += other->bc;
+    quadric->bd += other->bd;
+    quadric->cc += other->cc;
+    quadric->cd += other->cd;
+    quadric->dd += other->dd;
+    quadric->weight += other->weight;
+
+}
+
+/*
+ * Get the weighted mean squared distance from a point to the planes of a quadric
+ */
+inline double evaluateQuadric(const Quadric *quadric, const GLfloat *point) {
+
+    double x = point[0], y = point[1], z = point[2];
+    double error = quadric->aa * x * x + 2.0 * quadric->ab * x * y + 2.0 * quadric->ac * x * z + 2.0 * quadric->ad * x +
+            quadric->bb * y * y + 2.0 * quadric->bc * y * z + 2.0 * quadric->bd * y +
+            quadric->cc * z * z + 2.0 * quadric->cd * z + quadric->dd;
+
+    return quadric->weight > 0.0 ? fabs(error) / quadric->weight : 0.0;
+
+}
+
+/*
+ * Calculate the unnormalized normal of a triangle
+ */
+inline void getTriangleNormal(const GLfloat *p0, const GLfloat *p1, const GLfloat *p2, double normal[3]) {
+
+    double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+    double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+}
+
+/*
+ * Get the key of a directed edge between two positions
+ */
+inline uint64_t getEdgeKey(int from, int to) {
+
+    return (uint64_t)(uint32_t)from << 32 | (uint32_t)to;
+
+}
+
+/*
+ * Find the vertex every vertex at the position from is moved to when collapsing onto the position
+ * to, checking that no remaining triangle is flipped. Returns FALSE if the collapse is not allowed.
+ */
+inline int findCollapseTargets(int from, int to, const std::vector<GLuint> &indices, const std::vector<GLfloat> &vertices, int stride,
+        const std::vector<int> &positions, const std::vector<int> &triangleOffsets, const std::vector<int> &triangles,
+        std::vector<std::pair<GLuint, GLuint> > &targets) {
+
+    targets.clear();
+    const GLfloat *target = NULL;
+
+    // Triangles shared by both positions are removed, and pair every vertex at the position with a
+    // vertex at the target position
+    for (int a=triangleOffsets[from]; a<triangleOffsets[from+1]; ++a) {
+        const GLuint *triangle = &indices[triangles[a] * 3];
+        for (int c=0; c<3; ++c)
+            if (positions[triangle[c]] == to) {
+                target = &vertices[triangle[c] * stride];
+                for (int k=0; k<3; ++k)
+                    if (positions[triangle[k]] == from)
+                        targets.push_back(std::make_pair(triangle[k], triangle[c]));
+            }
+    }
+    if (!target)
+        return 0;
+
+    // Pairs must agree, a vertex adjacent to two vertices at the target position is ambiguous
+    std::sort(targets.begin(), targets.end());
+    for (size_t t=1; t<targets.size(); ++t)
+        if (targets[t].first == targets[t-1].first && targets[t].second != targets[t-1].second)
+            return 0;
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+    for (int a=triangleOffsets[from]; a<triangleOffsets[from+1]; ++a) {
+
+        const GLuint *triangle = &indices[triangles[a] * 3];
+        int shared = 0;
+        for (int c=0; c<3; ++c)
+            shared |= positions[triangle[c]] == to;
+        if (shared)
+            continue;
+
+        // Every vertex at the position must have been paired
+        const GLfloat *moved[3];
+        for (int c=0; c<3; ++c) {
+            moved[c] = &vertices[triangle[c] * stride];
+            if (positions[triangle[c]] != from)
+                continue;
+            std::vector<std::pair<GLuint, GLuint> >::iterator pair = std::lower_bound(targets.begin(), targets.end(),
+                    std::make_pair(triangle[c], (GLuint)0));
+            if (pair == targets.end() || pair->first != triangle[c])
+                return 0;
+            moved[c] = target;
+        }
+
+        // The triangle must keep its orientation
+        double before[3], after[3];
+        getTriangleNormal(&vertices[triangle[0] * stride], &vertices[triangle[1] * stride], &vertices[triangle[2] * stride], before);
+        getTriangleNormal(moved[0], moved[1], moved[2], after);
+        if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0)
+            return 0;
+
+    }
+
+    return 1;
+
+}
+
+/*
+ * Simplify a triangle list to a chain of levels with at most the given, decreasing, numbers of
+ * indices. A level is left with more indices when no further collapses are allowed. The error of
+ * every level is the largest error of the collapses leading to it, as an estimated distance from
+ * the original surface in the units of the positions.
+ */
+inline void simplifyMesh(const std::vector<GLuint> &indices, const std::vector<GLfloat> &vertices, int stride,
+        const std::vector<size_t> &targetIndexCounts, std::vector<std::vector<GLuint> > &levels, std::vector<float> &errors) {
+
+    int numVertices = vertices.size() / stride;
+
+    // Identify the vertices sharing a position
+    std::map<std::tuple<float, float, float>, int> positionIds;
+    std::vector<int> positions(numVertices);
+    for (int v=0; v<numVertices; ++v) {
+        const GLfloat *p = &vertices[v * stride];
+        std::tuple<float, float, float> key(p[0], p[1], p[2]);
+        std::map<std::tuple<float, float, float>, int>::iterator entry = positionIds.find(key);
+        if (entry == positionIds.end())
+            entry = positionIds.insert(std::make_pair(key, (int)positionIds.size())).first;
+        positions[v] = entry->second;
+    }
+    int numPositions = positionIds.size();
+
+    // Keep the triangles with three distinct positions
+    std::vector<GLuint> result;
+    for (size_t i=0; i<indices.size(); i+=3) {
+        int p0 = positions[indices[i]], p1 = positions[indices[i+1]], p2 = positions[indices[i+2]];
+        if (p0 != p1 && p1 != p2 && p2 != p0)
+            result.insert(result.end(), indices.begin() + i, indices.begin() + i + 3);
+    }
+
+    // Sum the planes of the triangles around every position, weighted by area
+    Quadric zero = {};
+    std::vector<Quadric> quadrics(numPositions, zero);
+    std::vector<uint64_t> edges;
+    for (size_t i=0; i<result.size(); i+=3) {
+        double normal[3];
+        const GLfloat *p0 = &vertices[result[i] * stride];
+        getTriangleNormal(p0, &vertices[result[i+1] * stride], &vertices[result[i+2] * stride], normal);
+        double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length == 0.0)
+            continue;
+        for (int k=0; k<3; ++k)
+            normal[k] /= length;
+        double distance = -(normal[0] * p0[0] + normal[1] * p0[1] + normal[2] * p0[2]);
+        for (int c=0; c<3; ++c)
+            addPlaneQuadric(&quadrics[positions[result[i+c]]], normal, distance, length * 0.5);
+        for (int c=0; c<3; ++c)
+            edges.push_back(getEdgeKey(positions[result[i+c]], positions[result[i+(c+1)%3]]));
+    }
+    std::sort(edges.begin(), edges.end());
+
+    // Add planes perpendicular to the open borders, which only have a triangle on one side
+    for (size_t i=0; i<result.size(); i+=3) {
+        double normal[3];
+        getTriangleNormal(&vertices[result[i] * stride], &vertices[result[i+1] * stride], &vertices[result[i+2] * stride], normal);
+        for (int c=0; c<3; ++c) {
+            int from = positions[result[i+c]], to = positions[result[i+(c+1)%3]];
+            if (std::binary_search(edges.begin(), edges.end(), getEdgeKey(to, from)))
+                continue;
+            const GLfloat *p0 = &vertices[result[i+c] * stride];
+            const GLfloat *p1 = &vertices[result[i+(c+1)%3] * stride];
+            double edge[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+            double borderNormal[3] = { edge[1] * normal[2] - edge[2] * normal[1], edge[2] * normal[0] - edge[0] * normal[2],
+                    edge[0] * normal[1] - edge[1] * normal[0] };
+            double length = sqrt(borderNormal[0] * borderNormal[0] + borderNormal[1] * borderNormal[1] + borderNormal[2] * borderNormal[2]);
+            if (length == 0.0)
+                continue;
+            for (int k=0; k<3; ++k)
+                borderNormal[k] /= length;
+            double distance = -(borderNormal[0] * p0[0] + borderNormal[1] * p0[1] + borderNormal[2] * p0[2]);
+            double weight = SIMPLIFIER_BORDER_WEIGHT * (edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+            addPlaneQuadric(&quadrics[from], borderNormal, distance, weight);
+            addPlaneQuadric(&quadrics[to], borderNormal, distance, weight);
+        }
+    }
+
+    float maxError = 0.0f;
+    std::vector<int> triangleOffsets, triangles, fill;
+    std::vector<char> border, locked;
+    std::vector<Collapse> collapses;
+    std::vector<std::pair<GLuint, GLuint> > targets;
+    std::vector<GLuint> remap(numVertices);
+
+    levels.clear();
+    errors.clear();
+    while (levels.size() < targetIndexCounts.size()) {
+
+        // Store the level once reached, all quadrics are kept so the errors are relative to the
+        // original triangles
+        size_t targetIndexCount = targetIndexCounts[levels.size()];
+        if (result.size() <= targetIndexCount) {
+            levels.push_back(result);
+            errors.push_back(sqrtf(maxError));
+            continue;
+        }
+
+        int numTriangles = result.size() / 3;
+
+        // Find the triangles around every position
+        triangleOffsets.assign(numPositions + 1, 0);
+        for (size_t i=0; i<result.size(); ++i)
+            triangleOffsets[positions[result[i]] + 1]++;
+        for (int p=0; p<numPositions; ++p)
+            triangleOffsets[p+1] += triangleOffsets[p];
+        triangles.resize(result.size());
+        fill.assign(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for (size_t i=0; i<result.size(); ++i)
+            triangles[fill[positions[result[i]]]++] = i / 3;
+
+        // Find the positions on open borders of the current triangles
+        edges.clear();
+        for (size_t i=0; i<result.size(); i+=3)
+            for (int c=0; c<3; ++c)
+                edges.push_back(getEdgeKey(positions[result[i+c]], positions[result[i+(c+1)%3]]));
+        std::sort(edges.begin(), edges.end());
+        border.assign(numPositions, 0);
+        for (size_t e=0; e<edges.size(); ++e) {
+            int from = edges[e] >> 32, to = edges[e] & 0xffffffff;
+            if (!std::binary_search(edges.begin(), edges.end(), getEdgeKey(to, from)))
+                border[from] = border[to] = 1;
+        }
+
+        // Find the cheapest allowed collapse of every position
+        collapses.clear();
+        for (int p=0; p<numPositions; ++p) {
+
+            Collapse best = { INFINITY, p, -1 };
+            for (int a=triangleOffsets[p]; a<triangleOffsets[p+1]; ++a)
+                for (int c=0; c<3; ++c) {
+
+                    GLuint vertex = result[triangles[a] * 3 + c];
+                    int q = positions[vertex];
+                    if (q == p)
+                        continue;
+
+                    // Border positions move along the border only
+                    if (border[p] && std::binary_search(edges.begin(), edges.end(), getEdgeKey(p, q)) ==
+                            std::binary_search(edges.begin(), edges.end(), getEdgeKey(q, p)))
+                        continue;
+
+                    Quadric quadric = quadrics[p];
+                    addQuadric(&quadric, &quadrics[q]);
+                    float error = evaluateQuadric(&quadric, &vertices[vertex * stride]);
+                    if (error >= best.error)
+                        continue;
+
+                    if (!findCollapseTargets(p, q, result, vertices, stride, positions, triangleOffsets, triangles, targets))
+                        continue;
+
+                    best.error = error;
+                    best.to = q;
+
+                }
+            if (best.to >= 0)
+                collapses.push_back(best);
+
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+        // Collapse the cheapest positions. The neighbours of a collapsed position are locked until
+        // the next pass, as the checks of their collapses assumed the previous triangles.
+        for (int v=0; v<numVertices; ++v)
+            remap[v] = v;
+        locked.assign(numPositions, 0);
+        int trianglesToRemove = (result.size() - targetIndexCount) / 3;
+        int removed = 0, numCollapsed = 0;
+        size_t passCollapses = std::min(std::max(collapses.size() / SIMPLIFIER_PASS_FRACTION, (size_t)1), collapses.size());
+        for (size_t c=0; c<passCollapses && removed < trianglesToRemove; ++c) {
+
+            int from = collapses[c].from, to = collapses[c].to;
+            if (locked[from] || locked[to])
+                continue;
+
+            findCollapseTargets(from, to, result, vertices, stride, positions, triangleOffsets, triangles, targets);
+            for (size_t t=0; t<targets.size(); ++t)
+                remap[targets[t].first] = targets[t].second;
+
+            for (int a=triangleOffsets[from]; a<triangleOffsets[from+1]; ++a) {
+                const GLuint *triangle = &result[triangles[a] * 3];
+                int shared = 0;
+                for (int k=0; k<3; ++k) {
+                    locked[positions[triangle[k]]] = 1;
+                    shared |= positions[triangle[k]] == to;
+                }
+                removed += shared;
+            }
+
+            addQuadric(&quadrics[to], &quadrics[from]);
+            maxError = std::max(maxError, collapses[c].error);
+            numCollapsed++;
+
+        }
+        if (numCollapsed == 0) {
+            while (levels.size() < targetIndexCounts.size()) {
+                levels.push_back(result);
+                errors.push_back(sqrtf(maxError));
+            }
+            break;
+        }
+
+        // Move the vertices and remove the triangles that have collapsed
+        size_t kept = 0;
+        for (int t=0; t<numTriangles; ++t) {
+            GLuint v0 = remap[result[t*3]], v1 = remap[result[t*3+1]], v2 = remap[result[t*3+2]];
+            if (positions[v0] == positions[v1] || positions[v1] == positions[v2] || positions[v2] == positions[v0])
+                continue;
+            result[kept++] = v0;
+            result[kept++] = v1;
+            result[kept++] = v2;
+        }
+        result.resize(kept);
+
+    }
+
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef MESHLET_BUILDER_H
+#define MESHLET_BUILDER_H
+
+#include <math.h>
+#include <vector>
+#include <GL/glew.h>
+
+/*
+ * Splitting of indexed triangle lists into meshlets, small clusters of triangles that can be culled
+ * individually. The triangles are taken in index order, so the index buffer should be optimized for
+ * the vertex cache first (see mesh_optimizer.h) to give compact meshlets. Every meshlet stores its
+ * unique vertices as indices into the vertex buffer, and its triangles as three 8-bit indices into
+ * those packed in a single integer.
+ *
+ * The vertices are interleaved floats with the position in the first three.
+ */
+
+// Limits of a single meshlet, the sizes commonly used for mesh shader hardware
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// Meshlets whose triangle normals spread further than this from the cone axis are never cone culled
+#define MESHLET_MIN_CONE_DOT 0.1f
+
+/*
+ * A structure for storing a meshlet (std430, see meshlet_cull.comp)
+ */
+typedef struct {
+    // Bounding sphere
+    GLfloat center[3];
+    GLfloat radius;
+    // Normal cone. Every triangle is back facing when seen from a point p for which
+    // dot(normalize(coneApex - p), coneAxis) >= coneCutoff.
+    GLfloat coneApex[3];
+    GLfloat coneCutoff;
+    GLfloat coneAxis[3];
+    // Offsets into the meshlet vertex and triangle arrays
+    GLuint vertexOffset;
+    GLuint triangleOffset;
+    GLuint vertexCount;
+    GLuint triangleCount;
+    GLuint padding;
+} Meshlet;
+
+/*
+ * Calculate the bounding sphere and normal cone of a meshlet
+ */
+inline void computeMeshletBounds(Meshlet *meshlet, const std::vector<GLuint> &meshletVertices, const std::vector<GLuint> &meshletTriangles,
+        const std::vector<GLfloat> &vertices, int stride) {
+
+    const GLuint *localVertices = &meshletVertices[meshlet->vertexOffset];
+
+    // Bounding sphere centered in the bounding box
+    float boxMin[3] = { INFINITY, INFINITY, INFINITY };
+    float boxMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (GLuint v=0; v<meshlet->vertexCount; ++v)
+        for (int k=0; k<3; ++k) {
+            boxMin[k] = fminf(boxMin[k], vertices[localVertices[v] * stride + k]);
+            boxMax[k] = fmaxf(boxMax[k], vertices[localVertices[v] * stride + k]);
+        }
+    float *center = meshlet->center;
+    for (int k=0; k<3; ++k)
+        center[k] = (boxMin[k] + boxMax[k]) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (GLuint v=0; v<meshlet->vertexCount; ++v) {
+        const GLfloat *p = &vertices[localVertices[v] * stride];
+        float d[3] = { p[0] - center[0], p[1] - center[1], p[2] - center[2] };
+        radiusSquared = fmaxf(radiusSquared, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+    meshlet->radius = sqrtf(radiusSquared);
+
+    // Triangle normals, degenerate triangles do not restrict the cone
+    std::vector<float> normals(meshlet->triangleCount * 3, 0.0f);
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    for (GLuint t=0; t<meshlet->triangleCount; ++t) {
+        GLuint triangle = meshletTriangles[meshlet->triangleOffset + t];
+        const GLfloat *p0 = &vertices[localVertices[triangle & 0xff] * stride];
+        const GLfloat *p1 = &vertices[localVertices[(triangle >> 8) & 0xff] * stride];
+        const GLfloat *p2 = &vertices[localVertices[(triangle >> 16) & 0xff] * stride];
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float *n = &normals[t*3];
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0f)
+            for (int k=0; k<3; ++k) {
+                n[k] /= length;
+                axis[k] += n[k];
+            }
+    }
+
+    // The cone is disabled by an axis of zero, for which the cull test always fails
+    for (int k=0; k<3; ++k) {
+        meshlet->coneApex[k] = center[k];
+        meshlet->coneAxis[k] = 0.0f;
+    }
+    meshlet->coneCutoff = 1.0f;
+
+    float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (axisLength == 0.0f)
+        return;
+    for (int k=0; k<3; ++k)
+        axis[k] /= axisLength;
+
+    // The smallest cosine between a triangle normal and the axis gives the width of the cone
+    float minDot = 1.0f;
+    for (GLuint t=0; t<meshlet->triangleCount; ++t) {
+        const float *n = &normals[t*3];
+        if (n[0] != 0.0f || n[1] != 0.0f || n[2] != 0.0f)
+            minDot = fminf(minDot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+    }
+    if (minDot <= MESHLET_MIN_CONE_DOT)
+        return;
+
+    // Move the apex back along the axis until it is behind the plane of every triangle
+    float maxT = 0.0f;
+    for (GLuint t=0; t<meshlet->triangleCount; ++t) {
+        const float *n = &normals[t*3];
+        GLuint triangle = meshletTriangles[meshlet->triangleOffset + t];
+        const GLfloat *p0 = &vertices[localVertices[triangle & 0xff] * stride];
+        float distance = (center[0] - p0[0]) * n[0] + (center[1] - p0[1]) * n[1] + (center[2] - p0[2]) * n[2];
+        float cosine = n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2];
+        if (cosine > 0.0f)
+            maxT = fmaxf(maxT, distance / cosine);
+    }
+
+    for (int k=0; k<3; ++k) {
+        meshlet->coneApex[k] = center[k] - axis[k] * maxT;
+        meshlet->coneAxis[k] = axis[k];
+    }
+    meshlet->coneCutoff = sqrtf(1.0f - minDot * minDot);
+
+}
+
+/*
+ * Split an indexed triangle list into meshlets. A new meshlet is started whenever the next triangle
+ * would exceed one of the limits.
+ */
+inline void buildMeshlets(const std::vector<GLuint> &indices, const std::vector<GLfloat> &vertices, int stride, std::vector<Meshlet> &meshlets,
+        std::vector<GLuint> &meshletVertices, std::vector<GLuint> &meshletTriangles) {
+
+    meshlets.clear();
+    meshletVertices.clear();
+    meshletTriangles.clear();
+
+    // Index of every vertex within the current meshlet, or -1
+    std::vector<int> localIndices(vertices.size() / stride, -1);
+
+    Meshlet meshlet = {};
+    for (size_t i=0; i<indices.size(); i+=3) {
+
+        // Count the vertices of the triangle that are not yet in the meshlet
+        int newVertices = 0;
+        for (int c=0; c<3; ++c)
+            if (localIndices[indices[i+c]] < 0)
+                newVertices++;
+
+        // Finish the meshlet if the triangle does not fit
+        if (meshlet.vertexCount + newVertices > MESHLET_MAX_VERTICES || meshlet.triangleCount == MESHLET_MAX_TRIANGLES) {
+            for (GLuint v=0; v<meshlet.vertexCount; ++v)
+                localIndices[meshletVertices[meshlet.vertexOffset + v]] = -1;
+            meshlets.push_back(meshlet);
+            meshlet = Meshlet();
+            meshlet.vertexOffset = meshletVertices.size();
+            meshlet.triangleOffset = meshletTriangles.size();
+        }
+
+        // Add the triangle, packing the local indices of its vertices
+        GLuint triangle = 0;
+        for (int c=0; c<3; ++c) {
+            GLuint v = indices[i+c];
+            if (localIndices[v] < 0) {
+                localIndices[v] = meshlet.vertexCount++;
+                meshletVertices.push_back(v);
+            }
+            triangle |= (GLuint)localIndices[v] << (c * 8);
+        }
+        meshletTriangles.push_back(triangle);
+        meshlet.triangleCount++;
+
+    }
+    if (meshlet.triangleCount > 0)
+        meshlets.push_back(meshlet);
+
+    for (size_t m=0; m<meshlets.size(); ++m)
+        computeMeshletBounds(&meshlets[m], meshletVertices, meshletTriangles, vertices, stride);
+
+}
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef PROGRAM_BUILDER_H
+#define PROGRAM_BUILDER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <GL/glew.h>
+
+/*
+ * Program builder that issues every shader compile and program link up front and only asks the
+ * driver for the result when the program is actually needed. Querying GL_COMPILE_STATUS right
+ * after glCompileShader forces the driver to finish the compile before returning, so the
+ * application can not do anything useful in the meantime. With GL_KHR_parallel_shader_compile
+ * (or the ARB variant) the driver compiles on its own threads and GL_COMPLETION_STATUS_KHR can be
+ * polled without blocking, which lets the caller load meshes and textures while shaders compile.
+ */
+
+// Maximum number of shader stages attached to a single program
+#define PROGRAM_MAX_SHADERS 5
+
+// Status of a program build
+#define PROGRAM_PENDING 0
+#define PROGRAM_READY 1
+#define PROGRAM_FAILED 2
+
+/*
+ * A structure describing the source of a single shader stage
+ */
+typedef struct {
+    GLenum type;
+    const char *source;
+    GLint length;
+} ShaderSource;
+
+/*
+ * A structure for storing the state of a single program build
+ */
+typedef struct {
+    GLuint programName;
+    GLuint shaderNames[PROGRAM_MAX_SHADERS];
+    GLenum shaderTypes[PROGRAM_MAX_SHADERS];
+    int numShaders;
+    int status;
+} ProgramBuild;
+
+/*
+ * A structure for storing the programs issued through the builder
+ */
+typedef struct {
+    std::vector<ProgramBuild> programs;
+    int parallel;
+} ProgramBuilder;
+
+/*
+ * Initialize the builder and ask the driver to use as many compiler threads as it likes. Must be
+ * called with a current context after GLEW has been initialized.
+ */
+inline void initProgramBuilder(ProgramBuilder *builder) {
+
+    builder->programs.clear();
+    builder->parallel = 0;
+
+    // Let the driver pick the number of compiler threads (0xFFFFFFFF means implementation defined)
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        builder->parallel = 1;
+    } else if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        builder->parallel = 1;
+    }
+
+}
+
+/*
+ * Return a printable name of a shader stage
+ */
+inline const char *shaderTypeName(GLenum type) {
+
+    switch (type) {
+        case GL_VERTEX_SHADER: return "VERTEX";
+        case GL_TESS_CONTROL_SHADER: return "TESS CONTROL";
+        case GL_TESS_EVALUATION_SHADER: return "TESS EVALUATION";
+        case GL_GEOMETRY_SHADER: return "GEOMETRY";
+        case GL_FRAGMENT_SHADER: return "FRAGMENT";
+        case GL_COMPUTE_SHADER: return "COMPUTE";
+    }
+
+    return "SHADER";
+
+}
+
+/*
+ * Issue the compilation of all the shader stages of a program followed by the link. Neither the
+ * compile status nor the link status is queried here, so the call returns as soon as the driver
+ * has accepted the work. The shader sources may be freed when the function returns. Returns the
+ * index used to refer to the program, or -1 if too many stages are specified.
+ */
+inline int addProgram(ProgramBuilder *builder, const ShaderSource *sources, int numSources) {
+
+    if (numSources > PROGRAM_MAX_SHADERS)
+        return -1;
+
+    ProgramBuild build;
+    build.programName = glCreateProgram();
+    build.numShaders = numSources;
+    build.status = PROGRAM_PENDING;
+
+    // Issue the compilation of every stage and attach it to the program
+    for (int s=0; s<numSources; ++s) {
+        build.shaderTypes[s] = sources[s].type;
+        build.shaderNames[s] = glCreateShader(sources[s].type);
+        glShaderSource(build.shaderNames[s], 1, &sources[s].source, &sources[s].length);
+        glCompileShader(build.shaderNames[s]);
+        glAttachShader(build.programName, build.shaderNames[s]);
+    }
+
+    // The link is queued behind the compiles and does not wait for them either
+    glLinkProgram(build.programName);
+
+    builder->programs.push_back(build);
+    return builder->programs.size() - 1;
+
+}
+
+/*
+ * Check whether all issued programs have finished compiling and linking without blocking. When
+ * parallel compilation is unavailable any status query would stall, so the programs are reported
+ * as complete and the actual wait happens in finishPrograms.
+ */
+inline int pollPrograms(ProgramBuilder *builder) {
+
+    if (!builder->parallel)
+        return 1;
+
+    int complete = 1;
+    for (int p=0; p<builder->programs.size(); ++p) {
+
+        ProgramBuild *build = &builder->programs[p];
+        if (build->status != PROGRAM_PENDING)
+            continue;
+
+        // Querying the completion status never waits for the driver
+        GLint completionStatus = GL_FALSE;
+        glGetProgramiv(build->programName, GL_COMPLETION_STATUS_KHR, &completionStatus);
+        if (!completionStatus)
+            complete = 0;
+
+    }
+
+    return complete;
+
+}
+
+/*
+ * Collect the result of a single program build, printing the info log of any failing stage or
+ * link. The shader objects are deleted since they are no longer needed after linking.
+ */
+inline int finishProgram(ProgramBuild *build) {
+
+    if (build->status != PROGRAM_PENDING)
+        return build->status == PROGRAM_READY;
+
+    // Report compile errors first as they are more helpful than the resulting link error
+    int compiled = 1;
+    for (int s=0; s<build->numShaders; ++s) {
+
+        GLint compileStatus;
+        glGetShaderiv(build->shaderNames[s], GL_COMPILE_STATUS, &compileStatus);
+        if (!compileStatus) {
+            GLint logSize = 0;
+            glGetShaderiv(build->shaderNames[s], GL_INFO_LOG_LENGTH, &logSize);
+            char *errorLog = (char *)malloc(sizeof(char) * (logSize + 1));
+            errorLog[0] = 0;
+            glGetShaderInfoLog(build->shaderNames[s], logSize, &logSize, errorLog);
+            printf("%s ERROR %s\n", shaderTypeName(build->shaderTypes[s]), errorLog);
+            free(errorLog);
+            compiled = 0;
+        }
+
+        glDetachShader(build->programName, build->shaderNames[s]);
+        glDeleteShader(build->shaderNames[s]);
+
+    }
+
+    GLint linkStatus = GL_FALSE;
+    if (compiled)
+        glGetProgramiv(build->programName, GL_LINK_STATUS, &linkStatus);
+    if (compiled && !linkStatus) {
+        GLint logSize = 0;
+        glGetProgramiv(build->programName, GL_INFO_LOG_LENGTH, &logSize);
+        char *errorLog = (char *)malloc(sizeof(char) * (logSize + 1));
+        errorLog[0] = 0;
+        glGetProgramInfoLog(build->programName, logSize, &logSize, errorLog);
+        printf("LINK ERROR %s\n", errorLog);
+        free(errorLog);
+    }
+
+    if (!compiled || !linkStatus) {
+        glDeleteProgram(build->programName);
+        build->programName = 0;
+        build->status = PROGRAM_FAILED;
+        return 0;
+    }
+
+    build->status = PROGRAM_READY;
+    return 1;
+
+}
+
+/*
+ * Wait for all issued programs and check their results. Returns FALSE if any program failed.
+ */
+inline int finishPrograms(ProgramBuilder *builder) {
+
+    int success = 1;
+    for (int p=0; p<builder->programs.size(); ++p)
+        if (!finishProgram(&builder->programs[p]))
+            success = 0;
+
+    return success;
+
+}
+
+/*
+ * Get the program name of a finished build, or 0 if it failed or has not been finished
+ */
+inline GLuint getProgram(ProgramBuilder *builder, int index) {
+
+    if (index < 0 || index >= builder->programs.size() || builder->programs[index].status != PROGRAM_READY)
+        return 0;
+
+    return builder->programs[index].programName;
+
+}
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include "job_system.h"
+
+/*
+ * Scene graph stored as flat arrays, one entry per node, instead of a tree of node objects. The
+ * nodes are sorted breadth first, so the nodes of a depth are contiguous and come after their
+ * parents, and the children of a node are contiguous and follow the children of the node before
+ * it. The children of a range of nodes are therefore a single range of the next depth.
+ *
+ * Changing the local transform of a node marks it dirty. An update walks the depths from the top,
+ * recomputing the world matrix of the dirty nodes and of every node below them, and nothing else,
+ * so a mostly static scene costs as much as what moved. The nodes of a depth only depend on the
+ * depth above, so each depth is computed in parallel. The ranges of world matrices that changed
+ * are kept, so the copy on the GPU can be updated by uploading only those.
+ */
+
+// Nodes computed by a job
+#define SCENE_GRAPH_GRAIN 1024
+
+/*
+ * A structure for storing a range of nodes, from begin up to end
+ */
+typedef struct {
+    int begin, end;
+} NodeRange;
+
+/*
+ * A structure for storing the nodes of a scene graph
+ */
+typedef struct {
+    int numNodes;
+    int numLevels;
+    // Parent of every node, -1 for the roots, and the depth of every node
+    std::vector<int> parents;
+    std::vector<int> depths;
+    // First child of every node, where its children would start if it has none, and their number
+    std::vector<int> firstChildren;
+    std::vector<int> numChildren;
+    // Local transform of every node
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    // World matrix of every node
+    std::vector<glm::mat4> worldMatrices;
+    // Set when the local transform of a node has changed since the last update
+    std::vector<unsigned char> dirty;
+    // First node of every depth, followed by the number of nodes
+    std::vector<int> levelStarts;
+    // Nodes marked dirty at every depth
+    std::vector<std::vector<int> > dirtyNodes;
+    // Ranges of world matrices changed by the last update, and the number of nodes in them
+    std::vector<NodeRange> changedRanges;
+    int changedNodes;
+    // Ranges of the depth being updated, and the number of nodes before each of them
+    std::vector<NodeRange> levelRanges;
+    std::vector<int> rangeOffsets;
+} SceneGraph;
+
+/*
+ * Initialize an empty scene graph
+ */
+inline void initSceneGraph(SceneGraph *graph) {
+
+    graph->numNodes = graph->numLevels = 0;
+    graph->changedNodes = 0;
+
+}
+
+/*
+ * Add a node with a local transform below the given parent, or as a root if it is -1. The parent
+ * must have been added before. Returns the index of the node until the graph is finished.
+ */
+inline int addSceneNode(SceneGraph *graph, int parent, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale) {
+
+    graph->parents.push_back(parent);
+    graph->depths.push_back(parent < 0 ? 0 : graph->depths[parent] + 1);
+    graph->translations.push_back(translation);
+    graph->rotations.push_back(rotation);
+    graph->scales.push_back(scale);
+    graph->numLevels = std::max(graph->numLevels, graph->depths.back() + 1);
+
+    return graph->numNodes++;
+
+}
+
+/*
+ * Mark a node dirty, to be recomputed with the nodes below it by the next update
+ */
+inline void markSceneNodeDirty(SceneGraph *graph, int node) {
+
+    if (graph->dirty[node])
+        return;
+    graph->dirty[node] = 1;
+    graph->dirtyNodes[graph->depths[node]].push_back(node);
+
+}
+
+/*
+ * Sort the nodes breadth first once every node has been added, and mark the roots dirty so that the
+ * first update computes every world matrix. The new index of every node added is stored in
+ * newIndices if it is given.
+ */
+inline void finishSceneGraph(SceneGraph *graph, std::vector<int> *newIndices = NULL) {
+
+    int numNodes = graph->numNodes;
+
+    // Children of every node in the order they were added
+    std::vector<int> childStarts(numNodes + 1, 0), children(numNodes);
+    for (int n=0; n<numNodes; ++n)
+        if (graph->parents[n] >= 0)
+            childStarts[graph->parents[n] + 1]++;
+    for (int n=0; n<numNodes; ++n)
+        childStarts[n + 1] += childStarts[n];
+    std::vector<int> childCounts(numNodes, 0);
+    for (int n=0; n<numNodes; ++n)
+        if (graph->parents[n] >= 0)
+            children[childStarts[graph->parents[n]] + childCounts[graph->parents[n]]++] = n;
+
+    // Breadth first order, the roots followed by the children of every node in turn
+    std::vector<int> order;
+    order.reserve(numNodes);
+    for (int n=0; n<numNodes; ++n)
+        if (graph->parents[n] < 0)
+            order.push_back(n);
+    for (int o=0; o<(int)order.size(); ++o)
+        for (int c=childStarts[order[o]]; c<childStarts[order[o] + 1]; ++c)
+            order.push_back(children[c]);
+
+    std::vector<int> indices(numNodes);
+    for (int o=0; o<numNodes; ++o)
+        indices[order[o]] = o;
+
+    // Reorder the nodes
+    std::vector<int> parents(numNodes), depths(numNodes);
+    std::vector<glm::vec3> translations(numNodes), scales(numNodes);
+    std::vector<glm::quat> rotations(numNodes);
+    for (int o=0; o<numNodes; ++o) {
+        int n = order[o];
+        parents[o] = graph->parents[n] < 0 ? -1 : indices[graph->parents[n]];
+        depths[o] = graph->depths[n];
+        translations[o] = graph->translations[n];
+        rotations[o] = graph->rotations[n];
+        scales[o] = graph->scales[n];
+    }
+    graph->parents.swap(parents);
+    graph->depths.swap(depths);
+    graph->translations.swap(translations);
+    graph->rotations.swap(rotations);
+    graph->scales.swap(scales);
+
+    // The children of a node follow those of the nodes before it
+    graph->firstChildren.assign(numNodes, 0);
+    graph->numChildren.assign(numNodes, 0);
+    int nextChild = 0;
+    for (int n=0; n<numNodes; ++n) {
+        while (nextChild < numNodes && graph->parents[nextChild] < 0)
+            nextChild++;
+        graph->firstChildren[n] = nextChild;
+        graph->numChildren[n] = childStarts[order[n] + 1] - childStarts[order[n]];
+        nextChild += graph->numChildren[n];
+    }
+
+    graph->levelStarts.assign(graph->numLevels + 1, numNodes);
+    for (int n=numNodes-1; n>=0; --n)
+        graph->levelStarts[graph->depths[n]] = n;
+
+    graph->worldMatrices.assign(numNodes, glm::mat4(1.0f));
+    graph->dirty.assign(numNodes, 0);
+    graph->dirtyNodes.assign(graph->numLevels, std::vector<int>());
+    for (int n=0; n<numNodes && graph->parents[n] < 0; ++n)
+        markSceneNodeDirty(graph, n);
+
+    if (newIndices)
+        newIndices->swap(indices);
+
+}
+
+/*
+ * Set the local transform of a node, marking it dirty
+ */
+inline void setSceneNodeTransform(SceneGraph *graph, int node, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale) {
+
+    graph->translations[node] = translation;
+    graph->rotations[node] = rotation;
+    graph->scales[node] = scale;
+    markSceneNodeDirty(graph, node);
+
+}
+
+/*
+ * Set the local rotation of a node, marking it dirty
+ */
+inline void setSceneNodeRotation(SceneGraph *graph, int node, const glm::quat &rotation) {
+
+    graph->rotations[node] = rotation;
+    markSceneNodeDirty(graph, node);
+
+}
+
+/*
+ * Job computing the world matrices of the items from begin to end of the ranges of the depth being
+ * updated
+ */
+inline void updateSceneNodes(void *data, int begin, int end, int worker) {
+
+    SceneGraph *graph = (SceneGraph *)data;
+
+    // Find the range holding the first item
+    int r = (int)(std::upper_bound(graph->rangeOffsets.begin(), graph->rangeOffsets.end(), begin) - graph->rangeOffsets.begin()) - 1;
+
+    for (int item = begin; item < end; ++r) {
+
+        const NodeRange &range = graph->levelRanges[r];
+        int first = range.begin + item - graph->rangeOffsets[r];
+        int last = std::min(range.end, first + end - item);
+
+        for (int n = first; n < last; ++n) {
+            glm::mat4 local = glm::translate(glm::mat4(1.0f), graph->translations[n]) * glm::mat4_cast(graph->rotations[n]);
+            local = glm::scale(local, graph->scales[n]);
+            int parent = graph->parents[n];
+            graph->worldMatrices[n] = parent < 0 ? local : graph->worldMatrices[parent] * local;
+            graph->dirty[n] = 0;
+        }
+        item += last - first;
+
+    }
+
+}
+
+/*
+ * Add a range to a sorted list of ranges, merging it with the last one if they touch
+ */
+inline void appendNodeRange(std::vector<NodeRange> *ranges, int begin, int end) {
+
+    if (!ranges->empty() && ranges->back().end >= begin)
+        ranges->back().end = std::max(ranges->back().end, end);
+    else
+        ranges->push_back({ begin, end });
+
+}
+
+/*
+ * Recompute the world matrices of the dirty nodes and of every node below them, a depth at a time
+ * with the workers of the given job system, and record the ranges that changed
+ */
+inline void updateSceneGraph(SceneGraph *graph, JobSystem *system) {
+
+    graph->changedRanges.clear();
+    graph->changedNodes = 0;
+
+    // Children of the nodes recomputed at the depth above, which must be recomputed as well
+    std::vector<NodeRange> inherited, ranges;
+
+    for (int d=0; d<graph->numLevels; ++d) {
+
+        // Merge the inherited ranges with the nodes marked dirty at this depth
+        ranges.swap(inherited);
+        inherited.clear();
+        std::vector<int> &dirtyNodes = graph->dirtyNodes[d];
+        for (int i=0; i<(int)dirtyNodes.size(); ++i)
+            ranges.push_back({ dirtyNodes[i], dirtyNodes[i] + 1 });
+        dirtyNodes.clear();
+        if (ranges.empty())
+            continue;
+
+        std::sort(ranges.begin(), ranges.end(), [](const NodeRange &a, const NodeRange &b) { return a.begin < b.begin; });
+        graph->levelRanges.clear();
+        for (int r=0; r<(int)ranges.size(); ++r)
+            appendNodeRange(&graph->levelRanges, ranges[r].begin, ranges[r].end);
+        ranges.clear();
+
+        int count = 0;
+        graph->rangeOffsets.resize(graph->levelRanges.size());
+        for (int r=0; r<(int)graph->levelRanges.size(); ++r) {
+            const NodeRange &range = graph->levelRanges[r];
+            graph->rangeOffsets[r] = count;
+            count += range.end - range.begin;
+
+            // The children of a range of nodes are a single range
+            int childBegin = graph->firstChildren[range.begin];
+            int childEnd = graph->firstChildren[range.end - 1] + graph->numChildren[range.end - 1];
+            if (childEnd > childBegin)
+                appendNodeRange(&inherited, childBegin, childEnd);
+
+            appendNodeRange(&graph->changedRanges, range.begin, range.end);
+        }
+        graph->changedNodes += count;
+
+        parallelFor(system, count, SCENE_GRAPH_GRAIN, updateSceneNodes, graph);
+
+    }
+
+}
+
+/*
+ * Get the ranges of world matrices to upload after an update, joining ranges separated by fewer
+ * than maxGap unchanged nodes, as uploading a few unchanged matrices costs less than another call
+ */
+inline void getSceneUploadRanges(const SceneGraph *graph, int maxGap, std::vector<NodeRange> *uploadRanges) {
+
+    uploadRanges->clear();
+    for (int r=0; r<(int)graph->changedRanges.size(); ++r) {
+        const NodeRange &range = graph->changedRanges[r];
+        if (!uploadRanges->empty() && range.begin - uploadRanges->back().end < maxGap)
+            uploadRanges->back().end = range.end;
+        else
+            uploadRanges->push_back(range);
+    }
+
+}
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef SHADER_PERMUTATIONS_H
+#define SHADER_PERMUTATIONS_H
+
+#include <string.h>
+#include <map>
+#include <string>
+#include <GL/glew.h>
+
+#include "program_builder.h"
+
+/*
+ * Shader permutations. A permutation set holds the sources of an uber shader together with a
+ * description of its features. Every permutation is identified by a bitmask of the enabled
+ * features, and is built by injecting the matching #define lines directly after the #version
+ * directive. Permutations are compiled the first time they are requested and cached by bitmask,
+ * so only the combinations actually used by the materials are ever built.
+ */
+
+// Maximum number of features described by a permutation set
+#define PERMUTATION_MAX_FEATURES 16
+
+/*
+ * A structure describing a feature. A single bit feature is defined without a value when set,
+ * a wider feature is always defined to the value stored in its bits.
+ */
+typedef struct {
+    const char *name;
+    unsigned int shift;
+    unsigned int bits;
+} PermutationFeature;
+
+/*
+ * A structure for storing a permutation set
+ */
+typedef struct {
+    PermutationFeature features[PERMUTATION_MAX_FEATURES];
+    int numFeatures;
+    GLenum types[PROGRAM_MAX_SHADERS];
+    std::string sources[PROGRAM_MAX_SHADERS];
+    int numSources;
+    ProgramBuilder builder;
+    // Index into the builder of every requested permutation
+    std::map<unsigned int, int> cache;
+} PermutationSet;
+
+/*
+ * Initialize an empty permutation set. Must be called with a current context.
+ */
+inline void initPermutationSet(PermutationSet *set) {
+
+    set->numFeatures = 0;
+    set->numSources = 0;
+    set->cache.clear();
+    initProgramBuilder(&set->builder);
+
+}
+
+/*
+ * Describe a feature occupying the given bits of the permutation mask
+ */
+inline int addPermutationFeature(PermutationSet *set, const char *name, unsigned int shift, unsigned int bits) {
+
+    if (set->numFeatures == PERMUTATION_MAX_FEATURES)
+        return 0;
+
+    PermutationFeature *feature = &set->features[set->numFeatures++];
+    feature->name = name;
+    feature->shift = shift;
+    feature->bits = bits;
+
+    return 1;
+
+}
+
+/*
+ * Set the source of a shader stage. The source is copied.
+ */
+inline int setPermutationSource(PermutationSet *set, GLenum type, const char *source, int length) {
+
+    // Replace the source of an existing stage
+    for (int s=0; s<set->numSources; ++s)
+        if (set->types[s] == type) {
+            set->sources[s].assign(source, length);
+            return 1;
+        }
+
+    if (set->numSources == PROGRAM_MAX_SHADERS)
+        return 0;
+
+    set->types[set->numSources] = type;
+    set->sources[set->numSources].assign(source, length);
+    set->numSources++;
+
+    return 1;
+
+}
+
+/*
+ * Create the source of a permutation by inserting the feature defines after the #version line. A
+ * #line directive keeps the line numbers in the info log identical to those of the file.
+ */
+inline std::string createPermutationSource(PermutationSet *set, const std::string &source, unsigned int mask) {
+
+    std::string defines = "#define PERMUTATION\n";
+    for (int f=0; f<set->numFeatures; ++f) {
+
+        PermutationFeature *feature = &set->features[f];
+        unsigned int value = (mask >> feature->shift) & ((1u << feature->bits) - 1);
+
+        if (feature->bits > 1)
+            defines += "#define " + std::string(feature->name) + " " + std::to_string(value) + "\n";
+        else if (value)
+            defines += "#define " + std::string(feature->name) + "\n";
+
+    }
+
+    // Find the line following the #version directive
+    size_t version = source.find("#version");
+    if (version == std::string::npos)
+        return defines + "#line 1\n" + source;
+    // A #version line ending the source without a newline is given one, so the defines are
+    // inserted after it like for any other source
+    std::string text = source;
+    size_t lineEnd = text.find('\n', version);
+    if (lineEnd == std::string::npos) {
+        text += '\n';
+        lineEnd = text.length() - 1;
+    }
+
+    // Count the lines up to and including the #version line
+    int line = 2;
+    for (size_t c = 0; c < version; ++c)
+        if (source[c] == '\n')
+            line++;
+
+    return text.substr(0, lineEnd + 1) + defines + "#line " + std::to_string(line) + "\n" + text.substr(lineEnd + 1);
+
+}
+
+/*
+ * Issue the build of a permutation without waiting for it. Requesting the permutations known to be
+ * needed up front lets the driver compile them in parallel.
+ */
+inline void requestPermutation(PermutationSet *set, unsigned int mask) {
+
+    if (set->cache.count(mask))
+        return;
+
+    std::string sources[PROGRAM_MAX_SHADERS];
+    ShaderSource shaderSources[PROGRAM_MAX_SHADERS];
+    for (int s=0; s<set->numSources; ++s) {
+        sources[s] = createPermutationSource(set, set->sources[s], mask);
+        shaderSources[s].type = set->types[s];
+        shaderSources[s].source = sources[s].c_str();
+        shaderSources[s].length = sources[s].size();
+    }
+
+    set->cache[mask] = addProgram(&set->builder, shaderSources, set->numSources);
+
+}
+
+/*
+ * Get the program of a permutation, building it if it has not been requested before. Returns 0 if
+ * the permutation failed to build.
+ */
+inline GLuint getPermutation(PermutationSet *set, unsigned int mask) {
+
+    std::map<unsigned int, int>::iterator entry = set->cache.find(mask);
+    if (entry == set->cache.end()) {
+        requestPermutation(set, mask);
+        entry = set->cache.find(mask);
+    }
+
+    // Wait for the build if it is still pending
+    if (!finishProgram(&set->builder.programs[entry->second]))
+        return 0;
+
+    return set->builder.programs[entry->second].programName;
+
+}
+
+/*
+ * Delete all the permutations built so far, for instance after the sources have changed
+ */
+inline void clearPermutations(PermutationSet *set) {
+
+    for (int p=0; p<(int)set->builder.programs.size(); ++p) {
+        finishProgram(&set->builder.programs[p]);
+        if (set->builder.programs[p].programName)
+            glDeleteProgram(set->builder.programs[p].programName);
+    }
+
+    set->builder.programs.clear();
+    set->cache.clear();
+
+}
+
+#endif
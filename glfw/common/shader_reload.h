@@ -0,0 +1,377 @@
+#ifndef SHADER_RELOAD_H
+#define SHADER_RELOAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "program_builder.h"
+#include "asset_io.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#else
+#include <sys/stat.h>
+#endif
+
+/*
+ * Hot-reload of GLSL programs. A worker thread owns a hidden window whose context shares objects
+ * with the main context. On Linux the directory containing the shader sources is watched with
+ * inotify, elsewhere the modification times are polled. When a source changes the whole program
+ * is rebuilt on the worker context and handed over to the main thread, which swaps the program
+ * name at a frame boundary. A program that fails to build is discarded after printing the info
+ * log, so the previous program stays in use. Meshes and textures are never touched.
+ */
+
+// Maximum number of programs watched by a single reloader
+#define RELOADER_MAX_PROGRAMS 16
+
+// Time in seconds to wait for further changes before rebuilding, editors often write in bursts
+#define RELOADER_SETTLE_TIME 0.05
+
+// Polling interval in seconds when waiting for changes
+#define RELOADER_POLL_INTERVAL 0.1
+
+/*
+ * A structure describing a shader stage loaded from file
+ */
+typedef struct {
+    GLenum type;
+    const char *filename;
+} ShaderFile;
+
+/*
+ * A structure for storing a watched program
+ */
+typedef struct {
+    ShaderFile files[PROGRAM_MAX_SHADERS];
+    int numFiles;
+    // The program name used by the main thread
+    GLuint *programName;
+    // A rebuilt program waiting to be swapped in, or 0
+    std::atomic<GLuint> pendingName;
+    // Set by the watcher when one of the files has changed
+    int dirty;
+#ifndef __linux__
+    // Modification times polled as inotify is unavailable
+    long modified[PROGRAM_MAX_SHADERS];
+#endif
+} WatchedProgram;
+
+/*
+ * A structure for storing the state of the reloader
+ */
+typedef struct {
+    GLFWwindow *workerWindow;
+    std::thread workerThread;
+    std::atomic<int> running;
+    WatchedProgram programs[RELOADER_MAX_PROGRAMS];
+    int numPrograms;
+    int inotifyFd;
+} ShaderReloader;
+
+#ifndef __linux__
+/*
+ * Get the modification time of a file, or 0 if it does not exist. Only polled where inotify is
+ * unavailable.
+ */
+inline long getModifiedTime(const char *filename) {
+
+    struct stat fileStat;
+    if (stat(filename, &fileStat) != 0)
+        return 0;
+    return (long)fileStat.st_mtime;
+
+}
+#endif
+
+/*
+ * Get the part of a path following the last directory separator
+ */
+inline const char *getBaseName(const char *filename) {
+
+    const char *baseName = filename;
+    for (const char *c = filename; *c; ++c)
+        if (*c == '/' || *c == '\\')
+            baseName = c + 1;
+
+    return baseName;
+
+}
+
+/*
+ * Create the shared worker context. Must be called from the main thread after the main window has
+ * been created, using the same context version hints.
+ */
+inline int initShaderReloader(ShaderReloader *reloader, GLFWwindow *mainWindow, int majorVersion, int minorVersion) {
+
+    reloader->numPrograms = 0;
+    reloader->running = 0;
+    reloader->inotifyFd = -1;
+
+    // Create an invisible window sharing objects with the main context
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, majorVersion);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minorVersion);
+    reloader->workerWindow = glfwCreateWindow(1, 1, "Shader reloader", NULL, mainWindow);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!reloader->workerWindow)
+        return 0;
+
+#ifdef __linux__
+    // Watch the working directory, where the examples keep their shader sources. Watching the
+    // directory rather than the files catches editors that save by renaming a new file in place.
+    reloader->inotifyFd = inotify_init1(IN_NONBLOCK);
+    if (reloader->inotifyFd < 0 || inotify_add_watch(reloader->inotifyFd, ".", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        glfwDestroyWindow(reloader->workerWindow);
+        reloader->workerWindow = NULL;
+        return 0;
+    }
+#endif
+
+    return 1;
+
+}
+
+/*
+ * Register a program for reloading. The program name is replaced by updateShaderReloader when a
+ * rebuild succeeds. All programs must be watched before the reloader is started.
+ */
+inline int watchProgram(ShaderReloader *reloader, GLuint *programName, const ShaderFile *files, int numFiles) {
+
+    if (reloader->numPrograms == RELOADER_MAX_PROGRAMS || numFiles > PROGRAM_MAX_SHADERS)
+        return 0;
+
+    WatchedProgram *program = &reloader->programs[reloader->numPrograms++];
+    program->numFiles = numFiles;
+    program->programName = programName;
+    program->pendingName = 0;
+    program->dirty = 0;
+    for (int f=0; f<numFiles; ++f) {
+        program->files[f] = files[f];
+#ifndef __linux__
+        program->modified[f] = getModifiedTime(files[f].filename);
+#endif
+    }
+
+    return 1;
+
+}
+
+/*
+ * Mark the watched programs using a changed file. Returns TRUE if any program was marked.
+ */
+inline int markChangedFile(ShaderReloader *reloader, const char *name) {
+
+    int marked = 0;
+    for (int p=0; p<reloader->numPrograms; ++p)
+        for (int f=0; f<reloader->programs[p].numFiles; ++f)
+            if (strcmp(getBaseName(reloader->programs[p].files[f].filename), name) == 0) {
+                reloader->programs[p].dirty = 1;
+                marked = 1;
+            }
+
+    return marked;
+
+}
+
+/*
+ * Wait for at most the given time for changes to the watched files, marking the programs that
+ * need to be rebuilt. Returns TRUE if any program was marked.
+ */
+inline int waitForChanges(ShaderReloader *reloader, double timeout) {
+
+    int marked = 0;
+
+#ifdef __linux__
+    struct pollfd pollFd = { reloader->inotifyFd, POLLIN, 0 };
+    if (poll(&pollFd, 1, (int)(timeout * 1000.0)) <= 0)
+        return 0;
+
+    // Drain all queued events
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(reloader->inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + length; ) {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+            if (event->len > 0 && markChangedFile(reloader, event->name))
+                marked = 1;
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+#else
+    std::this_thread::sleep_for(std::chrono::duration<double>(timeout));
+    for (int p=0; p<reloader->numPrograms; ++p)
+        for (int f=0; f<reloader->programs[p].numFiles; ++f) {
+            long modified = getModifiedTime(reloader->programs[p].files[f].filename);
+            if (modified != reloader->programs[p].modified[f]) {
+                reloader->programs[p].modified[f] = modified;
+                reloader->programs[p].dirty = 1;
+                marked = 1;
+            }
+        }
+#endif
+
+    return marked;
+
+}
+
+/*
+ * Rebuild a watched program on the worker context. Returns the new program name or 0 if the
+ * sources could not be read or the build failed.
+ */
+inline GLuint rebuildProgram(WatchedProgram *program) {
+
+    ShaderSource sources[PROGRAM_MAX_SHADERS];
+    AssetView views[PROGRAM_MAX_SHADERS];
+
+    // A source that can not be opened is expected while an editor is in the middle of replacing it
+    int success = 1;
+    int numOpened = 0;
+    for (int f=0; f<program->numFiles; ++f) {
+        if (!openAssetFile(program->files[f].filename, &views[numOpened])) {
+            printf("RELOAD ERROR Unable to read %s\n", program->files[f].filename);
+            success = 0;
+            continue;
+        }
+        sources[numOpened].type = program->files[f].type;
+        sources[numOpened].source = views[numOpened].data;
+        sources[numOpened].length = (GLint)views[numOpened].size;
+        numOpened++;
+    }
+
+    GLuint programName = 0;
+    if (success) {
+
+        // The worker thread has nothing else to do, so the build is simply waited for
+        ProgramBuilder builder;
+        initProgramBuilder(&builder);
+        int index = addProgram(&builder, sources, program->numFiles);
+        finishPrograms(&builder);
+        programName = getProgram(&builder, index);
+
+    }
+
+    for (int f=0; f<numOpened; ++f)
+        closeAsset(&views[f]);
+
+    return programName;
+
+}
+
+/*
+ * Worker thread function
+ */
+inline void shaderReloaderThread(ShaderReloader *reloader) {
+
+    glfwMakeContextCurrent(reloader->workerWindow);
+
+    while (reloader->running) {
+
+        if (!waitForChanges(reloader, RELOADER_POLL_INTERVAL))
+            continue;
+
+        // Let a burst of writes settle before reading the files
+        while (waitForChanges(reloader, RELOADER_SETTLE_TIME))
+            ;
+
+        for (int p=0; p<reloader->numPrograms; ++p) {
+
+            WatchedProgram *program = &reloader->programs[p];
+            if (!program->dirty)
+                continue;
+            program->dirty = 0;
+
+            double startTime = glfwGetTime();
+            GLuint programName = rebuildProgram(program);
+            if (!programName) {
+                printf("Reload of %s failed, keeping the previous program\n", program->files[program->numFiles-1].filename);
+                continue;
+            }
+
+            // Ensure the program is complete before the main context can see it
+            glFinish();
+
+            // Hand the program over, deleting any program the main thread never picked up
+            GLuint previousName = program->pendingName.exchange(programName);
+            if (previousName)
+                glDeleteProgram(previousName);
+
+            printf("Reloaded %s in %.1f ms\n", program->files[program->numFiles-1].filename, (glfwGetTime() - startTime) * 1000.0);
+
+        }
+
+    }
+
+    glfwMakeContextCurrent(NULL);
+
+}
+
+/*
+ * Start watching for changes
+ */
+inline void startShaderReloader(ShaderReloader *reloader) {
+
+    reloader->running = 1;
+    reloader->workerThread = std::thread(shaderReloaderThread, reloader);
+
+}
+
+/*
+ * Swap in rebuilt programs. Must be called by the main thread at a frame boundary, when no draw
+ * call of the current frame still needs to be issued with the old program. Returns the number of
+ * programs that were replaced.
+ */
+inline int updateShaderReloader(ShaderReloader *reloader) {
+
+    int numReloaded = 0;
+    for (int p=0; p<reloader->numPrograms; ++p) {
+
+        GLuint programName = reloader->programs[p].pendingName.exchange(0);
+        if (!programName)
+            continue;
+
+        // The old program is only flagged for deletion, the driver keeps it alive while in use
+        glDeleteProgram(*reloader->programs[p].programName);
+        *reloader->programs[p].programName = programName;
+        numReloaded++;
+
+    }
+
+    return numReloaded;
+
+}
+
+/*
+ * Stop the worker thread and release the resources of the reloader
+ */
+inline void destroyShaderReloader(ShaderReloader *reloader) {
+
+    if (reloader->running) {
+        reloader->running = 0;
+        reloader->workerThread.join();
+    }
+
+    for (int p=0; p<reloader->numPrograms; ++p) {
+        GLuint programName = reloader->programs[p].pendingName.exchange(0);
+        if (programName)
+            glDeleteProgram(programName);
+    }
+
+#ifdef __linux__
+    if (reloader->inotifyFd >= 0)
+        close(reloader->inotifyFd);
+#endif
+
+    glfwDestroyWindow(reloader->workerWindow);
+
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef TEXTURE_PACKER_H
+#define TEXTURE_PACKER_H
+
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+/*
+ * Packing of many textures into the layers of a single texture array, so everything using them can
+ * be drawn with one texture binding. The layers are the largest width by the largest height of the
+ * textures, and the textures of exactly that size take a layer of their own, the way they would be
+ * as separate textures.
+ *
+ * Smaller textures share atlas layers, every texture in a square cell of the next power of two of
+ * its size, aligned to a multiple of that size. The cells are placed from the largest in Morton
+ * order within blocks of the layer, which leaves no gaps between cells of power of two sizes. A
+ * level of the mipmap chain then never mixes a cell with its neighbours, down to the level where the
+ * cell is a single texel and the texture has its complete chain. The layer sizes must be multiples
+ * of the cell sizes for the levels to line up, so only cells up to the largest power of two dividing
+ * both fit in an atlas. Textures with larger cells take a layer of their own without filling it.
+ *
+ * The texture is centered in its cell, and the rest of the cell repeats the texture, so the texels
+ * around it are those the repeat mode would give. Sampling must keep within the cell, which at the
+ * finer levels never reaches past those texels.
+ */
+
+/*
+ * A structure for storing where a texture is placed, the rectangle of the texture and the cell
+ * holding it. A texture taking a whole layer of its size is its own cell.
+ */
+typedef struct {
+    int layer;
+    int x, y;
+    int width, height;
+    int cellX, cellY;
+    int cellWidth, cellHeight;
+} TexturePlacement;
+
+/*
+ * Get the smallest power of two at least the given size
+ */
+inline int getTextureCellSize(int size) {
+
+    int cellSize = 1;
+    while (cellSize < size)
+        cellSize *= 2;
+    return cellSize;
+
+}
+
+/*
+ * Get the size of the layers holding every texture of the given sizes, the largest width and height
+ */
+inline void getTextureLayerSize(const std::vector<int> &widths, const std::vector<int> &heights, int *layerWidth, int *layerHeight) {
+
+    *layerWidth = *layerHeight = 0;
+    for (int t=0; t<(int)widths.size(); ++t) {
+        *layerWidth = std::max(*layerWidth, widths[t]);
+        *layerHeight = std::max(*layerHeight, heights[t]);
+    }
+
+}
+
+/*
+ * Get the size of the blocks of an atlas layer, the largest power of two dividing both sizes of the
+ * layer. It is the largest cell of the atlas layers.
+ */
+inline int getTextureBlockSize(int layerWidth, int layerHeight) {
+
+    int blockSize = 1;
+    while (layerWidth % (blockSize * 2) == 0 && layerHeight % (blockSize * 2) == 0)
+        blockSize *= 2;
+    return blockSize;
+
+}
+
+/*
+ * Get the position of the cell with the given index in Morton order, interleaving the bits of x and y
+ */
+inline void getMortonPosition(int index, int *x, int *y) {
+
+    *x = *y = 0;
+    for (int bit=0; index >> (2 * bit); ++bit) {
+        *x |= ((index >> (2 * bit)) & 1) << bit;
+        *y |= ((index >> (2 * bit + 1)) & 1) << bit;
+    }
+
+}
+
+/*
+ * Place textures of the given sizes into layers of the given size, as found by getTextureLayerSize.
+ * Returns the number of layers.
+ */
+inline int packTextures(const std::vector<int> &widths, const std::vector<int> &heights, int layerWidth, int layerHeight,
+        std::vector<TexturePlacement> *placements) {
+
+    int numTextures = (int)widths.size();
+    placements->resize(numTextures);
+    int blockSize = getTextureBlockSize(layerWidth, layerHeight);
+
+    // Textures of the size of a layer, or with cells too large for the atlas, get a layer of their
+    // own. The others are placed from the largest cell.
+    int numLayers = 0;
+    std::vector<int> order;
+    for (int t=0; t<numTextures; ++t) {
+        TexturePlacement *placement = &(*placements)[t];
+        if ((widths[t] != layerWidth || heights[t] != layerHeight) && getTextureCellSize(std::max(widths[t], heights[t])) <= blockSize) {
+            order.push_back(t);
+            continue;
+        }
+        placement->layer = numLayers++;
+        placement->cellX = placement->cellY = 0;
+        placement->cellWidth = layerWidth;
+        placement->cellHeight = layerHeight;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return std::max(widths[a], heights[a]) > std::max(widths[b], heights[b]);
+    });
+
+    // The cells fill the blocks of an atlas layer one after the other, a new layer is started when
+    // they are full. The area used is always a multiple of the area of the next cell, as the cells
+    // are powers of two from the largest.
+    int blocksPerRow = layerWidth / blockSize;
+    long long blockArea = (long long)blockSize * blockSize;
+    long long layerArea = blockArea * blocksPerRow * (layerHeight / blockSize);
+    long long used = layerArea;
+    int atlasLayer = -1;
+    for (int o=0; o<(int)order.size(); ++o) {
+
+        int t = order[o];
+        int cellSize = getTextureCellSize(std::max(widths[t], heights[t]));
+        if (used + (long long)cellSize * cellSize > layerArea) {
+            atlasLayer = numLayers++;
+            used = 0;
+        }
+
+        int block = (int)(used / blockArea), x, y;
+        getMortonPosition((int)(used % blockArea / ((long long)cellSize * cellSize)), &x, &y);
+        used += (long long)cellSize * cellSize;
+
+        TexturePlacement *placement = &(*placements)[t];
+        placement->layer = atlasLayer;
+        placement->cellX = block % blocksPerRow * blockSize + x * cellSize;
+        placement->cellY = block / blocksPerRow * blockSize + y * cellSize;
+        placement->cellWidth = placement->cellHeight = cellSize;
+
+    }
+
+    for (int t=0; t<numTextures; ++t) {
+        TexturePlacement *placement = &(*placements)[t];
+        placement->width = widths[t];
+        placement->height = heights[t];
+        placement->x = placement->cellX + (placement->cellWidth - widths[t]) / 2;
+        placement->y = placement->cellY + (placement->cellHeight - heights[t]) / 2;
+    }
+
+    return numLayers;
+
+}
+
+/*
+ * Fill the cell of a placement with an image with the given number of bytes per texel, repeating
+ * the image around its rectangle. The cell holds cellWidth by cellHeight texels.
+ */
+inline void fillTextureCell(const unsigned char *image, const TexturePlacement *placement, int texelSize, unsigned char *cell) {
+
+    int width = placement->width, height = placement->height;
+
+    for (int y=0; y<placement->cellHeight; ++y) {
+        int sourceY = ((placement->cellY + y - placement->y) % height + height) % height;
+        unsigned char *row = cell + (size_t)y * placement->cellWidth * texelSize;
+        for (int x=0; x<placement->cellWidth; ++x) {
+            int sourceX = ((placement->cellX + x - placement->x) % width + width) % width;
+            memcpy(row + (size_t)x * texelSize, image + ((size_t)sourceY * width + sourceX) * texelSize, texelSize);
+        }
+    }
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/*
+ * Lock-free triple buffer for handing the latest state from one producer thread to one consumer
+ * thread. The states themselves are stored by the caller in an array of three, the triple buffer
+ * only tracks which of them is being written, which is being read and which holds the most
+ * recently published state. Neither thread ever waits for the other: the producer always has a
+ * slot to write to, and the consumer always reads a complete state, skipping the states that were
+ * replaced before it got to them.
+ */
+
+// The index of the shared slot is kept in the low bits, the flag tells if it has been published
+// since the consumer last took it
+#define TRIPLE_BUFFER_INDEX_MASK 0x3
+#define TRIPLE_BUFFER_FRESH 0x4
+
+/*
+ * A structure for storing the slot of each side of a triple buffer
+ */
+typedef struct {
+    // Slot written by the producer and slot read by the consumer, only used by their own thread
+    int writeIndex;
+    int readIndex;
+    // Slot in between, exchanged atomically by both threads
+    std::atomic<int> shared;
+} TripleBuffer;
+
+/*
+ * Initialize a triple buffer. The consumer starts with slot 0, which should hold a valid state
+ * until the first one is published.
+ */
+inline void initTripleBuffer(TripleBuffer *buffer) {
+
+    buffer->readIndex = 0;
+    buffer->shared.store(1);
+    buffer->writeIndex = 2;
+
+}
+
+/*
+ * Get the slot the producer writes the next state to
+ */
+inline int getTripleBufferWriteIndex(const TripleBuffer *buffer) {
+
+    return buffer->writeIndex;
+
+}
+
+/*
+ * Publish the state written by the producer. The slot it replaces, which the consumer did not take
+ * if it is still marked fresh, becomes the next one written.
+ */
+inline void publishTripleBuffer(TripleBuffer *buffer) {
+
+    int previous = buffer->shared.exchange(buffer->writeIndex | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel);
+    buffer->writeIndex = previous & TRIPLE_BUFFER_INDEX_MASK;
+
+}
+
+/*
+ * Take the most recently published state, if there is a newer one than the consumer already has.
+ * Returns the slot the consumer reads until the next call.
+ */
+inline int acquireTripleBuffer(TripleBuffer *buffer) {
+
+    if (buffer->shared.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH) {
+        int previous = buffer->shared.exchange(buffer->readIndex, std::memory_order_acq_rel);
+        buffer->readIndex = previous & TRIPLE_BUFFER_INDEX_MASK;
+    }
+
+    return buffer->readIndex;
+
+}
+
+#endif
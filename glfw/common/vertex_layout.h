@@ -0,0 +1,251 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <string.h>
+#include <vector>
+#include <GL/glew.h>
+
+/*
+ * Vertex layouts built from the same interleaved vertex data. The interleaved layout stores every
+ * vertex as one record in a single stream, so a pass reading all the attributes fetches each vertex
+ * with one contiguous read. The split layout stores the positions in a stream of their own and the
+ * remaining attributes in a second stream, so passes only needing the position (depth pre-pass,
+ * shadow maps) fetch a fraction of the bytes, at the cost of two reads per vertex for the passes
+ * reading everything.
+ *
+ * Every layout has a vertex array with all the attributes and one with only the position, the first
+ * attribute of the format. The vertex arrays use the binding points VERTEX_STREAM_POSITION and
+ * VERTEX_STREAM_ATTRIBUTES, the interleaved layout only the first.
+ */
+
+// Layouts
+#define VERTEX_LAYOUT_INTERLEAVED 0
+#define VERTEX_LAYOUT_SPLIT 1
+#define NUM_VERTEX_LAYOUTS 2
+
+// Vertex array binding points
+#define VERTEX_STREAM_POSITION 0
+#define VERTEX_STREAM_ATTRIBUTES 1
+
+// Maximum number of attributes of a vertex format
+#define VERTEX_MAX_ATTRIBUTES 8
+
+/*
+ * A structure describing an attribute within the interleaved source vertex
+ */
+typedef struct {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+    GLuint bytes;
+} VertexAttribute;
+
+/*
+ * A structure describing the interleaved source vertex, the position being the first attribute
+ */
+typedef struct {
+    VertexAttribute attributes[VERTEX_MAX_ATTRIBUTES];
+    int numAttributes;
+    GLsizei vertexSize;
+} VertexFormat;
+
+/*
+ * A structure for storing the buffers and vertex arrays of a layout
+ */
+typedef struct {
+    int layout;
+    // Buffer and stride of every stream, the interleaved layout only uses the first
+    GLuint bufferNames[2];
+    GLsizei strides[2];
+    int numStreams;
+    // Vertex arrays with all the attributes and with the position only
+    GLuint arrayName;
+    GLuint positionArrayName;
+    // Offset of every attribute within the stream holding it
+    GLuint offsets[VERTEX_MAX_ATTRIBUTES];
+} VertexLayout;
+
+/*
+ * Get the name of a layout for printing
+ */
+inline const char *getVertexLayoutName(int layout) {
+
+    return layout == VERTEX_LAYOUT_SPLIT ? "split" : "interleaved";
+
+}
+
+/*
+ * Get the layout with the given name. Returns -1 if there is no such layout.
+ */
+inline int findVertexLayout(const char *name) {
+
+    for (int l=0; l<NUM_VERTEX_LAYOUTS; ++l)
+        if (strcmp(name, getVertexLayoutName(l)) == 0)
+            return l;
+
+    return -1;
+
+}
+
+/*
+ * Initialize an empty vertex format for source vertices of the given size in bytes
+ */
+inline void initVertexFormat(VertexFormat *format, GLsizei vertexSize) {
+
+    format->numAttributes = 0;
+    format->vertexSize = vertexSize;
+
+}
+
+/*
+ * Add an attribute to a vertex format. The size in bytes is derived from the type, packed types
+ * counting as a single value. Returns FALSE if the format is full or the type is not supported.
+ */
+inline int addVertexAttribute(VertexFormat *format, GLuint location, GLint size, GLenum type, GLboolean normalized, GLuint offset) {
+
+    if (format->numAttributes == VERTEX_MAX_ATTRIBUTES)
+        return 0;
+
+    GLuint bytes;
+    switch (type) {
+    case GL_FLOAT:
+    case GL_INT:
+    case GL_UNSIGNED_INT:
+        bytes = size * 4;
+        break;
+    case GL_HALF_FLOAT:
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+        bytes = size * 2;
+        break;
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        bytes = size;
+        break;
+    case GL_INT_2_10_10_10_REV:
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+        bytes = 4;
+        break;
+    default:
+        return 0;
+    }
+
+    VertexAttribute *attribute = &format->attributes[format->numAttributes++];
+    attribute->location = location;
+    attribute->size = size;
+    attribute->type = type;
+    attribute->normalized = normalized;
+    attribute->offset = offset;
+    attribute->bytes = bytes;
+
+    return 1;
+
+}
+
+/*
+ * Specify the format of an attribute of a vertex array and associate it with a binding point
+ */
+inline void setVertexArrayAttribute(GLuint arrayName, const VertexAttribute *attribute, GLuint offset, GLuint binding) {
+
+    glVertexArrayAttribBinding(arrayName, attribute->location, binding);
+    glEnableVertexArrayAttrib(arrayName, attribute->location);
+    glVertexArrayAttribFormat(arrayName, attribute->location, attribute->size, attribute->type, attribute->normalized, offset);
+
+}
+
+/*
+ * Create the buffers and vertex arrays of a layout from interleaved source vertices. In the split
+ * layout the attributes after the position are packed in their original order, each starting at a
+ * multiple of four bytes as required by the vertex fetch.
+ */
+inline void createVertexLayout(VertexLayout *layout, int type, const VertexFormat *format, const GLubyte *vertices, GLsizei numVertices) {
+
+    layout->layout = type;
+    layout->bufferNames[0] = layout->bufferNames[1] = 0;
+    layout->strides[0] = layout->strides[1] = 0;
+
+    if (type == VERTEX_LAYOUT_INTERLEAVED) {
+
+        // The source vertices are used as they are
+        layout->numStreams = 1;
+        layout->strides[0] = format->vertexSize;
+        for (int a=0; a<format->numAttributes; ++a)
+            layout->offsets[a] = format->attributes[a].offset;
+        glCreateBuffers(1, &layout->bufferNames[0]);
+        glNamedBufferStorage(layout->bufferNames[0], (GLsizeiptr)numVertices * format->vertexSize, vertices, 0);
+
+    } else {
+
+        // Find the offsets of the attributes within their streams
+        layout->numStreams = format->numAttributes > 1 ? 2 : 1;
+        layout->offsets[0] = 0;
+        layout->strides[0] = (format->attributes[0].bytes + 3) & ~3;
+        for (int a=1; a<format->numAttributes; ++a) {
+            layout->offsets[a] = layout->strides[1];
+            layout->strides[1] += (format->attributes[a].bytes + 3) & ~3;
+        }
+
+        // Gather the attributes of every vertex into the streams
+        for (int s=0; s<layout->numStreams; ++s) {
+            std::vector<GLubyte> stream((size_t)numVertices * layout->strides[s], 0);
+            for (GLsizei v=0; v<numVertices; ++v) {
+                const GLubyte *vertex = vertices + (size_t)v * format->vertexSize;
+                GLubyte *streamVertex = &stream[(size_t)v * layout->strides[s]];
+                for (int a = s == 0 ? 0 : 1; a < (s == 0 ? 1 : format->numAttributes); ++a)
+                    memcpy(streamVertex + layout->offsets[a], vertex + format->attributes[a].offset, format->attributes[a].bytes);
+            }
+            glCreateBuffers(1, &layout->bufferNames[s]);
+            glNamedBufferStorage(layout->bufferNames[s], stream.size(), stream.empty() ? NULL : &stream[0], 0);
+        }
+
+    }
+
+    // The vertex array with every attribute, the attributes after the position are read from the
+    // second stream in the split layout
+    glCreateVertexArrays(1, &layout->arrayName);
+    for (int a=0; a<format->numAttributes; ++a) {
+        GLuint binding = a > 0 && layout->numStreams == 2 ? VERTEX_STREAM_ATTRIBUTES : VERTEX_STREAM_POSITION;
+        setVertexArrayAttribute(layout->arrayName, &format->attributes[a], layout->offsets[a], binding);
+    }
+    glVertexArrayVertexBuffer(layout->arrayName, VERTEX_STREAM_POSITION, layout->bufferNames[0], 0, layout->strides[0]);
+    if (layout->numStreams == 2)
+        glVertexArrayVertexBuffer(layout->arrayName, VERTEX_STREAM_ATTRIBUTES, layout->bufferNames[1], 0, layout->strides[1]);
+
+    // The vertex array with the position only. In the interleaved layout it steps over the whole
+    // vertex, so the other attributes are still brought into the caches.
+    glCreateVertexArrays(1, &layout->positionArrayName);
+    setVertexArrayAttribute(layout->positionArrayName, &format->attributes[0], layout->offsets[0], VERTEX_STREAM_POSITION);
+    glVertexArrayVertexBuffer(layout->positionArrayName, VERTEX_STREAM_POSITION, layout->bufferNames[0], 0, layout->strides[0]);
+
+}
+
+/*
+ * Get the number of bytes per vertex in the streams read through the vertex array with all the
+ * attributes, or through the one with the position only
+ */
+inline GLsizei getVertexLayoutFetchSize(const VertexLayout *layout, int positionOnly) {
+
+    if (positionOnly)
+        return layout->strides[0];
+
+    return layout->strides[0] + layout->strides[1];
+
+}
+
+/*
+ * Delete the buffers and vertex arrays of a layout
+ */
+inline void destroyVertexLayout(VertexLayout *layout) {
+
+    glDeleteVertexArrays(1, &layout->arrayName);
+    glDeleteVertexArrays(1, &layout->positionArrayName);
+    glDeleteBuffers(layout->numStreams, layout->bufferNames);
+    layout->arrayName = layout->positionArrayName = 0;
+    layout->bufferNames[0] = layout->bufferNames[1] = 0;
+    layout->numStreams = 0;
+
+}
+
+#endif
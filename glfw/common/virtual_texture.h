@@ -0,0 +1,725 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <GL/glew.h>
+#include "virtual_texture_file.h"
+
+/*
+ * Virtual texturing of textures too large to be decoded and kept in memory. Only the tiles of the
+ * mipmap chain that are seen are loaded, from a file pre-tiled by asset_pack -tile. Every frame the
+ * meshes using the texture are drawn at a reduced resolution into a feedback buffer, recording the
+ * tile and level every fragment would sample. The buffer is read back a frame later without
+ * stalling, and the missing tiles are queued for the loader threads, coarsest first. The main thread
+ * uploads a few of the loaded tiles per frame, replacing the tiles seen the longest ago, so the
+ * memory is bounded by the number of tile slots whatever the size of the texture.
+ *
+ * With GL_ARB_sparse_texture and pages of the size of a tile, the texture is a sparse texture of its
+ * full size, of which only the pages holding a loaded tile are committed. Otherwise the tiles are
+ * kept with their borders in the slots of a cache texture and the shader finds them through an
+ * indirection. In both cases a page table texture, with a texel per tile in a mipmap chain like that
+ * of the texture, holds the slot and level of every tile, a missing tile falling back to its nearest
+ * loaded ancestor. A tile is only used once its parent is, so the shader always finds the coarser
+ * level it filters towards. The coarsest level is loaded at the start and never replaced.
+ */
+
+// Tiles along a side of the cache, the number of tile slots being its square
+#define VIRTUAL_TEXTURE_CACHE_TILES 16
+
+// Tiles uploaded per frame at most
+#define VIRTUAL_TEXTURE_UPLOADS 16
+
+// Threads reading tiles from the file
+#define VIRTUAL_TEXTURE_LOADERS 2
+
+// Reduction of the resolution of the feedback pass, a power of two
+#define VIRTUAL_TEXTURE_FEEDBACK_SCALE 8
+
+// Feedback buffers being read back, so the buffer read was written this many frames earlier
+#define VIRTUAL_TEXTURE_FEEDBACK_BUFFERS 2
+
+// Feedback value of the pixels without a fragment using the texture
+#define VIRTUAL_TILE_NONE 0xFFFFFFFFu
+
+// States of a tile
+#define VIRTUAL_TILE_MISSING 0
+#define VIRTUAL_TILE_QUEUED 1
+#define VIRTUAL_TILE_LOADING 2
+#define VIRTUAL_TILE_LOADED 3
+#define VIRTUAL_TILE_RESIDENT 4
+
+/*
+ * A structure for storing a tile read by a loader thread, waiting to be uploaded
+ */
+typedef struct {
+    int tile;
+    std::vector<uint8_t> pixels;
+} VirtualTileData;
+
+/*
+ * A structure for storing a virtual texture, its tiles and the threads loading them
+ */
+typedef struct {
+    std::string filename;
+    VirtualTextureHeader header;
+    std::vector<VirtualTileEntry> entries;
+    // The sparse texture or the cache, the page table and the parameters of the shaders
+    int sparse;
+    GLuint textureName;
+    GLuint pageTableName;
+    GLuint parameterBufferName;
+    // Tile in every slot, -1 for a free slot, and the levels loaded at the start and kept
+    int numSlots;
+    std::vector<int> slotTiles;
+    int pinnedLevel;
+    // Slot, state and the frame last requested of every tile. The states are shared with the loader
+    // threads and only accessed with the mutex locked.
+    std::vector<int> tileSlots;
+    std::vector<unsigned char> tileStates;
+    std::vector<long long> tileLastUsed;
+    // Entries of the page table, the levels one after the other
+    std::vector<GLubyte> pageTable;
+    int pageTableDirty;
+    // Feedback framebuffer with its tile and depth textures, and the buffers it is read back into
+    GLuint feedbackFramebufferName;
+    GLuint feedbackTextureNames[2];
+    int feedbackWidth, feedbackHeight;
+    GLuint feedbackBufferNames[VIRTUAL_TEXTURE_FEEDBACK_BUFFERS];
+    GLsync feedbackFences[VIRTUAL_TEXTURE_FEEDBACK_BUFFERS];
+    std::vector<GLuint> feedback;
+    std::vector<int> requestedTiles;
+    // Tiles to be loaded, the next one last, the tiles loaded and the loader threads
+    std::vector<int> queue;
+    std::vector<VirtualTileData> loaded;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable condition;
+    int quit;
+    // Frames updated, tiles read and uploaded, tiles replaced and bytes read since the start
+    long long frame;
+    long long tilesRead;
+    long long tilesUploaded;
+    long long tilesEvicted;
+    long long bytesRead;
+} VirtualTexture;
+
+/*
+ * Get the index of the tile of a level
+ */
+inline int getVirtualTile(const VirtualTexture *texture, int level, int x, int y) {
+
+    return getVirtualLevelFirstTile(texture->header.size, level) + y * getVirtualTilesPerSide(texture->header.size, level) + x;
+
+}
+
+/*
+ * Get the level and position of a tile
+ */
+inline void getVirtualTilePosition(const VirtualTexture *texture, int tile, int *level, int *x, int *y) {
+
+    int l = 0, first = 0;
+    while (first + getVirtualTilesPerSide(texture->header.size, l) * getVirtualTilesPerSide(texture->header.size, l) <= tile) {
+        first += getVirtualTilesPerSide(texture->header.size, l) * getVirtualTilesPerSide(texture->header.size, l);
+        l++;
+    }
+    int tiles = getVirtualTilesPerSide(texture->header.size, l);
+    *level = l;
+    *x = (tile - first) % tiles;
+    *y = (tile - first) / tiles;
+
+}
+
+/*
+ * Get the parent of a tile in the next level, -1 for the tile of the last level
+ */
+inline int getVirtualTileParent(const VirtualTexture *texture, int tile) {
+
+    int level, x, y;
+    getVirtualTilePosition(texture, tile, &level, &x, &y);
+    if (level + 1 == (int)texture->header.levels)
+        return -1;
+    return getVirtualTile(texture, level + 1, x / 2, y / 2);
+
+}
+
+/*
+ * Read a tile from an open file into VIRTUAL_TILE_BYTES of pixels, the stored data going through
+ * the given buffer. Returns FALSE if it can not be read.
+ */
+inline int readVirtualTile(FILE *file, const VirtualTileEntry *entry, std::vector<uint8_t> &stored, uint8_t *pixels) {
+
+    stored.resize(entry->storedSize);
+#ifdef _WIN32
+    int seek = _fseeki64(file, (long long)entry->offset, SEEK_SET);
+#else
+    int seek = fseeko(file, (off_t)entry->offset, SEEK_SET);
+#endif
+    if (seek != 0 || fread(stored.data(), 1, stored.size(), file) != stored.size())
+        return 0;
+
+    return decodeVirtualTile(entry, stored.data(), pixels);
+
+}
+
+/*
+ * Loader thread function, reading the queued tiles until the texture is destroyed
+ */
+inline void virtualTextureLoaderThread(VirtualTexture *texture) {
+
+    FILE *file = fopen(texture->filename.c_str(), "rb");
+    std::vector<uint8_t> stored;
+
+    std::unique_lock<std::mutex> lock(texture->mutex);
+    while (!texture->quit) {
+
+        if (texture->queue.empty()) {
+            texture->condition.wait(lock);
+            continue;
+        }
+        int tile = texture->queue.back();
+        texture->queue.pop_back();
+        texture->tileStates[tile] = VIRTUAL_TILE_LOADING;
+
+        // The file is read with the lock released, the main thread only replacing the queue
+        lock.unlock();
+        VirtualTileData data;
+        data.tile = tile;
+        data.pixels.resize(VIRTUAL_TILE_BYTES);
+        int success = file && readVirtualTile(file, &texture->entries[tile], stored, data.pixels.data());
+        lock.lock();
+
+        if (success) {
+            texture->tileStates[tile] = VIRTUAL_TILE_LOADED;
+            texture->loaded.push_back(std::move(data));
+            texture->tilesRead++;
+            texture->bytesRead += texture->entries[tile].storedSize;
+        } else {
+            printf("ERROR Could not read tile %d of %s\n", tile, texture->filename.c_str());
+            texture->tileStates[tile] = VIRTUAL_TILE_MISSING;
+        }
+
+    }
+
+    if (file)
+        fclose(file);
+
+}
+
+/*
+ * Find the virtual page size of sparse RGBA8 textures that is the size of a tile. Returns its index,
+ * or -1 if sparse textures are not supported or have other page sizes.
+ */
+inline int findVirtualPageSize() {
+
+    if (!GLEW_ARB_sparse_texture)
+        return -1;
+
+    GLint numSizes = 0;
+    glGetInternalformativ(GL_TEXTURE_2D, GL_RGBA8, GL_NUM_VIRTUAL_PAGE_SIZES_ARB, 1, &numSizes);
+    if (numSizes <= 0)
+        return -1;
+    std::vector<GLint> widths(numSizes), heights(numSizes);
+    glGetInternalformativ(GL_TEXTURE_2D, GL_RGBA8, GL_VIRTUAL_PAGE_SIZE_X_ARB, numSizes, widths.data());
+    glGetInternalformativ(GL_TEXTURE_2D, GL_RGBA8, GL_VIRTUAL_PAGE_SIZE_Y_ARB, numSizes, heights.data());
+    for (int s=0; s<numSizes; ++s)
+        if (widths[s] == VIRTUAL_TILE_SIZE && heights[s] == VIRTUAL_TILE_SIZE)
+            return s;
+
+    return -1;
+
+}
+
+/*
+ * Commit or release the page of a level of the sparse texture, or the whole level if it is smaller
+ * than a page
+ */
+inline void commitVirtualPage(VirtualTexture *texture, int level, int x, int y, GLboolean commit) {
+
+    int size = std::min((int)texture->header.size >> level, VIRTUAL_TILE_SIZE);
+    glBindTexture(GL_TEXTURE_2D, texture->textureName);
+    glTexPageCommitmentARB(GL_TEXTURE_2D, level, x * VIRTUAL_TILE_SIZE, y * VIRTUAL_TILE_SIZE, 0, size, size, 1, commit);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+}
+
+/*
+ * Upload the pixels of a tile into its slot in the cache or its page of the sparse texture
+ */
+inline void uploadVirtualTile(VirtualTexture *texture, int tile, int slot, const uint8_t *pixels) {
+
+    if (texture->sparse) {
+        int level, x, y;
+        getVirtualTilePosition(texture, tile, &level, &x, &y);
+        int size = std::min((int)texture->header.size >> level, VIRTUAL_TILE_SIZE);
+        commitVirtualPage(texture, level, x, y, GL_TRUE);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, VIRTUAL_TILE_STRIDE);
+        glTextureSubImage2D(texture->textureName, level, x * VIRTUAL_TILE_SIZE, y * VIRTUAL_TILE_SIZE, size, size, GL_RGBA, GL_UNSIGNED_BYTE,
+                pixels + (VIRTUAL_TILE_BORDER * VIRTUAL_TILE_STRIDE + VIRTUAL_TILE_BORDER) * 4);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    } else
+        glTextureSubImage2D(texture->textureName, 0, slot % VIRTUAL_TEXTURE_CACHE_TILES * VIRTUAL_TILE_STRIDE,
+                slot / VIRTUAL_TEXTURE_CACHE_TILES * VIRTUAL_TILE_STRIDE, VIRTUAL_TILE_STRIDE, VIRTUAL_TILE_STRIDE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+    {
+        std::lock_guard<std::mutex> lock(texture->mutex);
+        texture->tileStates[tile] = VIRTUAL_TILE_RESIDENT;
+    }
+    texture->tileSlots[tile] = slot;
+    if (slot >= 0)
+        texture->slotTiles[slot] = tile;
+    texture->pageTableDirty = 1;
+    texture->tilesUploaded++;
+
+}
+
+/*
+ * Rebuild the page table from the coarsest level, every tile pointing at itself if it is resident
+ * and its parent is used, and at the tile its parent points at otherwise. The states are read with
+ * the loader threads locked out, which only hold the lock briefly.
+ */
+inline void updateVirtualPageTable(VirtualTexture *texture) {
+
+    int size = texture->header.size;
+    std::unique_lock<std::mutex> lock(texture->mutex);
+    for (int l=(int)texture->header.levels - 1; l>=0; --l) {
+
+        int tiles = getVirtualTilesPerSide(size, l);
+        GLubyte *entries = &texture->pageTable[getVirtualLevelFirstTile(size, l) * 4];
+        const GLubyte *parents = l + 1 < (int)texture->header.levels ? &texture->pageTable[getVirtualLevelFirstTile(size, l + 1) * 4] : NULL;
+
+        for (int y=0; y<tiles; ++y)
+            for (int x=0; x<tiles; ++x) {
+                int tile = getVirtualLevelFirstTile(size, l) + y * tiles + x;
+                GLubyte *entry = &entries[(y * tiles + x) * 4];
+                const GLubyte *parent = parents ? &parents[((y / 2) * getVirtualTilesPerSide(size, l + 1) + x / 2) * 4] : NULL;
+                if (texture->tileStates[tile] == VIRTUAL_TILE_RESIDENT && (!parent || parent[2] == l + 1)) {
+                    int slot = std::max(texture->tileSlots[tile], 0);
+                    entry[0] = (GLubyte)(slot % VIRTUAL_TEXTURE_CACHE_TILES);
+                    entry[1] = (GLubyte)(slot / VIRTUAL_TEXTURE_CACHE_TILES);
+                    entry[2] = (GLubyte)l;
+                    entry[3] = 255;
+                } else if (parent)
+                    memcpy(entry, parent, 4);
+            }
+
+    }
+    lock.unlock();
+
+    for (int l=0; l<(int)texture->header.levels; ++l) {
+        int tiles = getVirtualTilesPerSide(size, l);
+        glTextureSubImage2D(texture->pageTableName, l, 0, 0, tiles, tiles, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                &texture->pageTable[getVirtualLevelFirstTile(size, l) * 4]);
+    }
+
+    texture->pageTableDirty = 0;
+
+}
+
+/*
+ * Create the feedback framebuffer and the buffers it is read back into for a viewport of the given
+ * size, deleting the previous ones
+ */
+inline void resizeVirtualTextureFeedback(VirtualTexture *texture, int width, int height) {
+
+    if (texture->feedbackFramebufferName) {
+        glDeleteFramebuffers(1, &texture->feedbackFramebufferName);
+        glDeleteTextures(2, texture->feedbackTextureNames);
+        glDeleteBuffers(VIRTUAL_TEXTURE_FEEDBACK_BUFFERS, texture->feedbackBufferNames);
+        for (int b=0; b<VIRTUAL_TEXTURE_FEEDBACK_BUFFERS; ++b)
+            if (texture->feedbackFences[b])
+                glDeleteSync(texture->feedbackFences[b]);
+    }
+
+    texture->feedbackWidth = std::max(width / VIRTUAL_TEXTURE_FEEDBACK_SCALE, 1);
+    texture->feedbackHeight = std::max(height / VIRTUAL_TEXTURE_FEEDBACK_SCALE, 1);
+
+    glCreateTextures(GL_TEXTURE_2D, 2, texture->feedbackTextureNames);
+    glTextureStorage2D(texture->feedbackTextureNames[0], 1, GL_R32UI, texture->feedbackWidth, texture->feedbackHeight);
+    glTextureStorage2D(texture->feedbackTextureNames[1], 1, GL_DEPTH_COMPONENT24, texture->feedbackWidth, texture->feedbackHeight);
+    glCreateFramebuffers(1, &texture->feedbackFramebufferName);
+    glNamedFramebufferTexture(texture->feedbackFramebufferName, GL_COLOR_ATTACHMENT0, texture->feedbackTextureNames[0], 0);
+    glNamedFramebufferTexture(texture->feedbackFramebufferName, GL_DEPTH_ATTACHMENT, texture->feedbackTextureNames[1], 0);
+    glNamedFramebufferReadBuffer(texture->feedbackFramebufferName, GL_COLOR_ATTACHMENT0);
+
+    GLsizeiptr size = (GLsizeiptr)texture->feedbackWidth * texture->feedbackHeight * sizeof(GLuint);
+    glCreateBuffers(VIRTUAL_TEXTURE_FEEDBACK_BUFFERS, texture->feedbackBufferNames);
+    for (int b=0; b<VIRTUAL_TEXTURE_FEEDBACK_BUFFERS; ++b) {
+        glNamedBufferStorage(texture->feedbackBufferNames[b], size, NULL, GL_CLIENT_STORAGE_BIT);
+        texture->feedbackFences[b] = 0;
+    }
+    texture->feedback.resize(texture->feedbackWidth * texture->feedbackHeight);
+
+}
+
+/*
+ * Open a pre-tiled file and create the textures, with the coarsest levels loaded, and start the
+ * loader threads. The feedback pass is sized for the given viewport. Returns FALSE if the file can
+ * not be read.
+ */
+inline int initVirtualTexture(VirtualTexture *texture, const char *filename, int width, int height) {
+
+    texture->filename = filename;
+    texture->frame = 0;
+    texture->tilesRead = texture->tilesUploaded = texture->tilesEvicted = texture->bytesRead = 0;
+    texture->quit = 0;
+    texture->feedbackFramebufferName = 0;
+
+    // Read the header and the table of the tiles
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        printf("ERROR Could not open %s\n", filename);
+        return 0;
+    }
+    if (fread(&texture->header, sizeof(VirtualTextureHeader), 1, file) != 1 || !validateVirtualTexture(&texture->header)) {
+        printf("ERROR %s is not a virtual texture\n", filename);
+        fclose(file);
+        return 0;
+    }
+    int numTiles = texture->header.numTiles, levels = texture->header.levels, size = texture->header.size;
+    texture->entries.resize(numTiles);
+    if (fread(texture->entries.data(), sizeof(VirtualTileEntry), numTiles, file) != (size_t)numTiles) {
+        printf("ERROR Could not read the tiles of %s\n", filename);
+        fclose(file);
+        return 0;
+    }
+
+    // The loader threads trust the table, so a truncated or corrupt file is rejected here
+#ifdef _WIN32
+    int seek = _fseeki64(file, 0, SEEK_END);
+    long long fileSize = _ftelli64(file);
+#else
+    int seek = fseeko(file, 0, SEEK_END);
+    long long fileSize = (long long)ftello(file);
+#endif
+    if (seek != 0 || fileSize < 0 || !validateVirtualTiles(&texture->header, texture->entries.data(), (uint64_t)fileSize)) {
+        printf("ERROR The tiles of %s are corrupt\n", filename);
+        fclose(file);
+        return 0;
+    }
+
+    texture->numSlots = VIRTUAL_TEXTURE_CACHE_TILES * VIRTUAL_TEXTURE_CACHE_TILES;
+    texture->slotTiles.assign(texture->numSlots, -1);
+    texture->tileSlots.assign(numTiles, -1);
+    texture->tileStates.assign(numTiles, VIRTUAL_TILE_MISSING);
+    texture->tileLastUsed.assign(numTiles, 0);
+    texture->pageTable.assign(numTiles * 4, 0);
+
+    // A sparse texture of the full size with the levels smaller than a page, which are committed
+    // as a whole, kept. Otherwise a cache texture of the slots with the last level kept in the first.
+    int pageSize = findVirtualPageSize();
+    texture->sparse = pageSize >= 0;
+    if (texture->sparse) {
+        glCreateTextures(GL_TEXTURE_2D, 1, &texture->textureName);
+        glTextureParameteri(texture->textureName, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+        glTextureParameteri(texture->textureName, GL_VIRTUAL_PAGE_SIZE_INDEX_ARB, pageSize);
+        glTextureStorage2D(texture->textureName, levels, GL_RGBA8, size, size);
+        glTextureParameteri(texture->textureName, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(texture->textureName, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(texture->textureName, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        GLint sparseLevels;
+        glGetTextureParameteriv(texture->textureName, GL_NUM_SPARSE_LEVELS_ARB, &sparseLevels);
+        texture->pinnedLevel = std::min(sparseLevels, levels - 1);
+    } else {
+        glCreateTextures(GL_TEXTURE_2D, 1, &texture->textureName);
+        glTextureStorage2D(texture->textureName, 1, GL_RGBA8, VIRTUAL_TEXTURE_CACHE_TILES * VIRTUAL_TILE_STRIDE,
+                VIRTUAL_TEXTURE_CACHE_TILES * VIRTUAL_TILE_STRIDE);
+        glTextureParameteri(texture->textureName, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(texture->textureName, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture->textureName, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        texture->pinnedLevel = levels - 1;
+    }
+    glTextureParameteri(texture->textureName, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // The page table has a texel per tile, read without filtering
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture->pageTableName);
+    glTextureStorage2D(texture->pageTableName, levels, GL_RGBA8UI, getVirtualTilesPerSide(size, 0), getVirtualTilesPerSide(size, 0));
+    glTextureParameteri(texture->pageTableName, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTextureParameteri(texture->pageTableName, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Load the kept levels, the cache keeping them in the first slots
+    std::vector<uint8_t> stored, pixels(VIRTUAL_TILE_BYTES);
+    int slot = 0;
+    for (int tile=getVirtualLevelFirstTile(size, texture->pinnedLevel); tile<numTiles; ++tile) {
+        if (!readVirtualTile(file, &texture->entries[tile], stored, pixels.data())) {
+            printf("ERROR Could not read tile %d of %s\n", tile, filename);
+            fclose(file);
+            return 0;
+        }
+        uploadVirtualTile(texture, tile, texture->sparse ? -1 : slot++, pixels.data());
+    }
+    fclose(file);
+    updateVirtualPageTable(texture);
+
+    // The size of level 0, the number of levels, the size of a tile and its border, followed by the
+    // size of the cache, whether the texture is sparse and the log2 of the feedback reduction
+    GLfloat parameters[] = {
+        (GLfloat)size, (GLfloat)levels, (GLfloat)VIRTUAL_TILE_SIZE, (GLfloat)VIRTUAL_TILE_BORDER,
+        (GLfloat)(VIRTUAL_TEXTURE_CACHE_TILES * VIRTUAL_TILE_STRIDE), texture->sparse ? 1.0f : 0.0f, log2f((float)VIRTUAL_TEXTURE_FEEDBACK_SCALE), 0.0f
+    };
+    glCreateBuffers(1, &texture->parameterBufferName);
+    glNamedBufferStorage(texture->parameterBufferName, sizeof(parameters), parameters, 0);
+
+    resizeVirtualTextureFeedback(texture, width, height);
+
+    for (int t=0; t<VIRTUAL_TEXTURE_LOADERS; ++t)
+        texture->threads.push_back(std::thread(virtualTextureLoaderThread, texture));
+
+    printf("Virtual texture %s: %dx%d, %d levels, %d tiles, %s\n", filename, size, size, levels, numTiles,
+            texture->sparse ? "sparse texture" : "tile cache");
+
+    return 1;
+
+}
+
+/*
+ * Get the bytes of texture memory of a virtual texture, at most the slots and the kept levels
+ */
+inline GLsizeiptr getVirtualTextureBytes(const VirtualTexture *texture) {
+
+    GLsizeiptr tileBytes = texture->sparse ? VIRTUAL_TILE_SIZE * VIRTUAL_TILE_SIZE * 4 : VIRTUAL_TILE_BYTES;
+    GLsizeiptr pinned = texture->sparse ? texture->header.numTiles - getVirtualLevelFirstTile(texture->header.size, texture->pinnedLevel) : 0;
+    return (texture->numSlots + pinned) * tileBytes + (GLsizeiptr)texture->header.numTiles * 4;
+
+}
+
+/*
+ * Start the feedback pass, drawing into the feedback framebuffer. The meshes using the virtual
+ * texture are then drawn with a program writing the tile every fragment samples.
+ */
+inline void beginVirtualTextureFeedback(VirtualTexture *texture) {
+
+    GLuint none = VIRTUAL_TILE_NONE;
+    GLfloat depth = 1.0f;
+    glBindFramebuffer(GL_FRAMEBUFFER, texture->feedbackFramebufferName);
+    glViewport(0, 0, texture->feedbackWidth, texture->feedbackHeight);
+    glClearNamedFramebufferuiv(texture->feedbackFramebufferName, GL_COLOR, 0, &none);
+    glClearNamedFramebufferfv(texture->feedbackFramebufferName, GL_DEPTH, 0, &depth);
+
+}
+
+/*
+ * End the feedback pass, starting the read back of the feedback and restoring the default
+ * framebuffer with the given viewport
+ */
+inline void endVirtualTextureFeedback(VirtualTexture *texture, int width, int height) {
+
+    int b = (int)(texture->frame % VIRTUAL_TEXTURE_FEEDBACK_BUFFERS);
+    if (texture->feedbackFences[b])
+        glDeleteSync(texture->feedbackFences[b]);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, texture->feedbackBufferNames[b]);
+    glReadPixels(0, 0, texture->feedbackWidth, texture->feedbackHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    texture->feedbackFences[b] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width, height);
+
+}
+
+/*
+ * Read the oldest feedback if the GPU has written it, marking the tiles requested and their ancestors
+ * as used in this frame. Returns FALSE if there is no feedback to read.
+ */
+inline int readVirtualTextureFeedback(VirtualTexture *texture) {
+
+    // The frame was counted after the feedback of the current frame was written, so this is the
+    // buffer written the longest ago
+    int b = (int)(texture->frame % VIRTUAL_TEXTURE_FEEDBACK_BUFFERS);
+    if (!texture->feedbackFences[b])
+        return 0;
+    GLenum status = glClientWaitSync(texture->feedbackFences[b], 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return 0;
+    glDeleteSync(texture->feedbackFences[b]);
+    texture->feedbackFences[b] = 0;
+
+    glGetNamedBufferSubData(texture->feedbackBufferNames[b], 0, texture->feedback.size() * sizeof(GLuint), texture->feedback.data());
+
+    // A tile is level << 24 | y << 12 | x, its ancestors being requested with it
+    texture->requestedTiles.clear();
+    for (size_t p=0; p<texture->feedback.size(); ++p) {
+        GLuint value = texture->feedback[p];
+        if (value == VIRTUAL_TILE_NONE || (p > 0 && value == texture->feedback[p-1]))
+            continue;
+        int level = value >> 24, y = (value >> 12) & 0xFFF, x = value & 0xFFF;
+        if (level >= (int)texture->header.levels || x >= getVirtualTilesPerSide(texture->header.size, level) ||
+                y >= getVirtualTilesPerSide(texture->header.size, level))
+            continue;
+        for (int tile = getVirtualTile(texture, level, x, y); tile >= 0 && texture->tileLastUsed[tile] != texture->frame;
+                tile = getVirtualTileParent(texture, tile)) {
+            texture->tileLastUsed[tile] = texture->frame;
+            texture->requestedTiles.push_back(tile);
+        }
+    }
+
+    return 1;
+
+}
+
+/*
+ * Find a slot for a tile, a free one or the one of the tile requested the longest ago, which is
+ * released. Returns -1 if every slot holds a tile requested in the current frame.
+ */
+inline int findVirtualTileSlot(VirtualTexture *texture) {
+
+    int best = -1;
+    for (int s=0; s<texture->numSlots; ++s) {
+        int tile = texture->slotTiles[s];
+        if (tile < 0)
+            return s;
+        int level, x, y;
+        getVirtualTilePosition(texture, tile, &level, &x, &y);
+        if (level >= texture->pinnedLevel || texture->tileLastUsed[tile] == texture->frame)
+            continue;
+        if (best < 0 || texture->tileLastUsed[tile] < texture->tileLastUsed[texture->slotTiles[best]])
+            best = s;
+    }
+    if (best < 0)
+        return -1;
+
+    int tile = texture->slotTiles[best];
+    if (texture->sparse) {
+        int level, x, y;
+        getVirtualTilePosition(texture, tile, &level, &x, &y);
+        commitVirtualPage(texture, level, x, y, GL_FALSE);
+    }
+    {
+        std::lock_guard<std::mutex> lock(texture->mutex);
+        texture->tileStates[tile] = VIRTUAL_TILE_MISSING;
+    }
+    texture->tileSlots[tile] = -1;
+    texture->slotTiles[best] = -1;
+    texture->pageTableDirty = 1;
+    texture->tilesEvicted++;
+
+    return best;
+
+}
+
+/*
+ * Update the tiles at the end of a frame. The missing tiles of the latest feedback replace the
+ * queue of the loaders, the coarsest last so they are read first, and the tiles read since the
+ * previous frame are uploaded.
+ */
+inline void updateVirtualTexture(VirtualTexture *texture) {
+
+    texture->frame++;
+
+    std::vector<VirtualTileData> uploads;
+    {
+        std::lock_guard<std::mutex> lock(texture->mutex);
+
+        if (readVirtualTextureFeedback(texture)) {
+
+            // Tiles no longer requested are dropped from the queue
+            for (size_t q=0; q<texture->queue.size(); ++q)
+                texture->tileStates[texture->queue[q]] = VIRTUAL_TILE_MISSING;
+            texture->queue.clear();
+            for (size_t r=0; r<texture->requestedTiles.size(); ++r) {
+                int tile = texture->requestedTiles[r];
+                if (texture->tileStates[tile] == VIRTUAL_TILE_MISSING) {
+                    texture->tileStates[tile] = VIRTUAL_TILE_QUEUED;
+                    texture->queue.push_back(tile);
+                }
+            }
+
+            // More tiles than fit in the slots would replace each other, so the finest are left out
+            std::sort(texture->queue.begin(), texture->queue.end());
+            if ((int)texture->queue.size() > texture->numSlots) {
+                for (int q=0; q<(int)texture->queue.size() - texture->numSlots; ++q)
+                    texture->tileStates[texture->queue[q]] = VIRTUAL_TILE_MISSING;
+                texture->queue.erase(texture->queue.begin(), texture->queue.end() - texture->numSlots);
+            }
+            texture->condition.notify_all();
+
+        }
+
+        int count = std::min((int)texture->loaded.size(), VIRTUAL_TEXTURE_UPLOADS);
+        for (int t=0; t<count; ++t)
+            uploads.push_back(std::move(texture->loaded[t]));
+        texture->loaded.erase(texture->loaded.begin(), texture->loaded.begin() + count);
+    }
+
+    // Upload the tiles, dropping those for which there is no slot until they are requested again
+    for (size_t u=0; u<uploads.size(); ++u) {
+        int slot = findVirtualTileSlot(texture);
+        if (slot >= 0)
+            uploadVirtualTile(texture, uploads[u].tile, slot, uploads[u].pixels.data());
+        else {
+            std::lock_guard<std::mutex> lock(texture->mutex);
+            texture->tileStates[uploads[u].tile] = VIRTUAL_TILE_MISSING;
+        }
+    }
+
+    if (texture->pageTableDirty)
+        updateVirtualPageTable(texture);
+
+}
+
+/*
+ * Bind the texture, the page table and the parameters to the given texture units and uniform
+ * buffer binding
+ */
+inline void bindVirtualTexture(const VirtualTexture *texture, GLuint textureUnit, GLuint pageTableUnit, GLuint uniformBinding) {
+
+    glBindTextureUnit(textureUnit, texture->textureName);
+    glBindTextureUnit(pageTableUnit, texture->pageTableName);
+    glBindBufferBase(GL_UNIFORM_BUFFER, uniformBinding, texture->parameterBufferName);
+
+}
+
+/*
+ * Print the tiles in use and the tiles read and replaced since the start
+ */
+inline void printVirtualTextureStatistics(VirtualTexture *texture) {
+
+    int used = 0;
+    for (int s=0; s<texture->numSlots; ++s)
+        if (texture->slotTiles[s] >= 0)
+            used++;
+
+    // The loader threads count the tiles read
+    std::lock_guard<std::mutex> lock(texture->mutex);
+    printf("Virtual texture: %d of %d slots used, %zu tiles requested, %lld read (%.1f MiB), %lld uploaded, %lld replaced\n", used,
+            texture->numSlots, texture->requestedTiles.size(), texture->tilesRead, texture->bytesRead / 1048576.0, texture->tilesUploaded,
+            texture->tilesEvicted);
+
+}
+
+/*
+ * Stop the loader threads and delete the textures and buffers
+ */
+inline void destroyVirtualTexture(VirtualTexture *texture) {
+
+    {
+        std::lock_guard<std::mutex> lock(texture->mutex);
+        texture->quit = 1;
+        texture->condition.notify_all();
+    }
+    for (size_t t=0; t<texture->threads.size(); ++t)
+        texture->threads[t].join();
+    texture->threads.clear();
+
+    glDeleteTextures(1, &texture->textureName);
+    glDeleteTextures(1, &texture->pageTableName);
+    glDeleteBuffers(1, &texture->parameterBufferName);
+    glDeleteFramebuffers(1, &texture->feedbackFramebufferName);
+    glDeleteTextures(2, texture->feedbackTextureNames);
+    glDeleteBuffers(VIRTUAL_TEXTURE_FEEDBACK_BUFFERS, texture->feedbackBufferNames);
+    for (int b=0; b<VIRTUAL_TEXTURE_FEEDBACK_BUFFERS; ++b)
+        if (texture->feedbackFences[b])
+            glDeleteSync(texture->feedbackFences[b]);
+
+}
+
+#endif
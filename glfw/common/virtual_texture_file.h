@@ -0,0 +1,147 @@
+#ifndef VIRTUAL_TEXTURE_FILE_H
+#define VIRTUAL_TEXTURE_FILE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "asset_archive.h"
+
+/*
+ * Pre-tiled file of a virtual texture, from which single tiles are read without decoding the whole
+ * image. The texture is square with a power of two size, and every level of its mipmap chain is cut
+ * into tiles of 128x128 texels, down to the level that is a single tile. Every tile is stored with a
+ * border of 4 texels from its neighbours, repeating around the edges of the texture, so a tile in a
+ * cache of tiles is filtered like the full texture. The tiles are RGBA, stored level by level and row
+ * by row, each optionally compressed with LZ4, and found through the table following the header.
+ *
+ * The files are written by asset_pack -tile and read through virtual_texture.h. All values are
+ * little endian.
+ */
+
+// "ITFV" read as a little endian integer
+#define VIRTUAL_TEXTURE_MAGIC 0x56465449
+#define VIRTUAL_TEXTURE_VERSION 1
+
+// Size of a tile and of its border in texels, and the size and bytes of a tile stored with the border
+#define VIRTUAL_TILE_SIZE 128
+#define VIRTUAL_TILE_BORDER 4
+#define VIRTUAL_TILE_STRIDE (VIRTUAL_TILE_SIZE + 2 * VIRTUAL_TILE_BORDER)
+#define VIRTUAL_TILE_BYTES (VIRTUAL_TILE_STRIDE * VIRTUAL_TILE_STRIDE * 4)
+
+// Largest number of tiles along a side of level 0, so a tile fits in 12 bits of the feedback
+#define VIRTUAL_TEXTURE_MAX_TILES 4096
+
+/*
+ * A structure for storing the file header, followed by an entry for every tile
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    // Size of level 0 in texels, the number of levels and tiles
+    uint32_t size;
+    uint32_t levels;
+    uint32_t numTiles;
+    uint32_t tileSize;
+    uint32_t border;
+    uint32_t padding;
+} VirtualTextureHeader;
+
+/*
+ * A structure for storing where a tile is stored in the file and how
+ */
+typedef struct {
+    uint64_t offset;
+    uint32_t storedSize;
+    uint32_t compression;
+} VirtualTileEntry;
+
+/*
+ * Get the number of levels of a virtual texture of the given size, the last being a single tile
+ */
+inline int getVirtualTextureLevels(int size) {
+
+    int levels = 1;
+    while ((size >> levels) >= VIRTUAL_TILE_SIZE)
+        levels++;
+    return levels;
+
+}
+
+/*
+ * Get the number of tiles along a side of a level
+ */
+inline int getVirtualTilesPerSide(int size, int level) {
+
+    return std::max((size >> level) / VIRTUAL_TILE_SIZE, 1);
+
+}
+
+/*
+ * Get the index of the first tile of a level, or the total number of tiles for the level after the
+ * last
+ */
+inline int getVirtualLevelFirstTile(int size, int level) {
+
+    int first = 0;
+    for (int l=0; l<level; ++l)
+        first += getVirtualTilesPerSide(size, l) * getVirtualTilesPerSide(size, l);
+    return first;
+
+}
+
+/*
+ * Check that a header describes a file this version can read, the size being a power of two of at
+ * least a tile. Returns FALSE otherwise.
+ */
+inline int validateVirtualTexture(const VirtualTextureHeader *header) {
+
+    if (header->magic != VIRTUAL_TEXTURE_MAGIC || header->version != VIRTUAL_TEXTURE_VERSION)
+        return 0;
+    if (header->tileSize != VIRTUAL_TILE_SIZE || header->border != VIRTUAL_TILE_BORDER)
+        return 0;
+    if (header->size < VIRTUAL_TILE_SIZE || (header->size & (header->size - 1)) || header->size / VIRTUAL_TILE_SIZE > VIRTUAL_TEXTURE_MAX_TILES)
+        return 0;
+
+    return (int)header->levels == getVirtualTextureLevels(header->size) &&
+            (int)header->numTiles == getVirtualLevelFirstTile(header->size, header->levels);
+
+}
+
+/*
+ * Check that every tile of a file of the given size is stored within the file, after the table,
+ * in a way this version can decode and in no more bytes than the tile has. Returns FALSE otherwise.
+ */
+inline int validateVirtualTiles(const VirtualTextureHeader *header, const VirtualTileEntry *entries, uint64_t size) {
+
+    uint64_t tableSize = sizeof(VirtualTextureHeader) + (uint64_t)header->numTiles * sizeof(VirtualTileEntry);
+    for (uint32_t t=0; t<header->numTiles; ++t) {
+        const VirtualTileEntry *entry = &entries[t];
+        if (entry->offset < tableSize || entry->offset > size || entry->storedSize > size - entry->offset)
+            return 0;
+        if (entry->compression != ASSET_STORED && entry->compression != ASSET_LZ4)
+            return 0;
+        if (entry->storedSize > VIRTUAL_TILE_BYTES || (entry->compression == ASSET_STORED && entry->storedSize != VIRTUAL_TILE_BYTES))
+            return 0;
+    }
+
+    return 1;
+
+}
+
+/*
+ * Decode a tile as read from the file into VIRTUAL_TILE_BYTES of pixels. Returns FALSE if the stored
+ * data is corrupt.
+ */
+inline int decodeVirtualTile(const VirtualTileEntry *entry, const uint8_t *stored, uint8_t *pixels) {
+
+    if (entry->compression == ASSET_LZ4)
+        return decompressLz4(stored, entry->storedSize, pixels, VIRTUAL_TILE_BYTES);
+    if (entry->compression != ASSET_STORED || entry->storedSize != VIRTUAL_TILE_BYTES)
+        return 0;
+
+    memcpy(pixels, stored, VIRTUAL_TILE_BYTES);
+    return 1;
+
+}
+
+#endif
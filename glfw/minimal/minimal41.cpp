@@ -17,6 +17,8 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include "../common/asset_io.h"
+
 #define DEFAULT_WIDTH 1024
 #define DEFAULT_HEIGHT 768
 
@@ -51,39 +53,6 @@ GLuint programName;
 GLuint vertexArrayName;
 GLuint vertexBufferNames[4];
 
-/*
- * Read shader source file from disk
- */
-char *readSourceFile(const char *filename, int *size) {
-
-    // Open the file as read only
-    FILE *file = fopen(filename, "r");
-
-    // Find the end of the file to determine the file size
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
-
-    // Rewind
-    fseek(file, 0, SEEK_SET); 
-
-    // Allocate memory for the source and initialize it to 0
-    char *source = (char *)malloc(fileSize + 1);
-    for (int i = 0; i <= fileSize; i++) source[i] = 0;
-
-    // Read the source
-    fread(source, fileSize, 1, file);
-
-    // Close the file
-    fclose(file);
-
-    // Store the size of the file in the output variable
-    *size = fileSize-1;
-
-    // Return the shader source
-    return source;
-
-}
-
 /*
  * Initialize OpenGL
  */
@@ -133,9 +102,14 @@ int initGL() {
 
     // Load and compile vertex shader
     GLuint vertexName = glCreateShader(GL_VERTEX_SHADER); // 2.0
-    int vertexLength = 0;
-    char *vertexSource = readSourceFile("minimal.vert", &vertexLength);
-    glShaderSource(vertexName, 1, (const char * const *)&vertexSource, &vertexLength); // 2.0
+    AssetView vertexSource;
+    if (!openAsset("minimal.vert", &vertexSource)) {
+        printf("ERROR Unable to read minimal.vert\n");
+        return 0;
+    }
+    GLint vertexLength = (GLint)vertexSource.size;
+    glShaderSource(vertexName, 1, &vertexSource.data, &vertexLength); // 2.0
+    closeAsset(&vertexSource);
     GLint compileStatus;
     glCompileShader(vertexName); // 2.0
     glGetShaderiv(vertexName, GL_COMPILE_STATUS, &compileStatus); // 2.0
@@ -146,15 +120,20 @@ int initGL() {
         glGetShaderInfoLog(vertexName, logSize, &logSize, errorLog); // 2.0
         glDeleteShader(vertexName); // 2.0 
         printf("VERTEX ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(vertexSource);
 
     // Load and compile fragment shader
     GLuint fragmentName = glCreateShader(GL_FRAGMENT_SHADER);
-    int fragmentLength = 0;
-    char *fragmentSource = readSourceFile("minimal.frag", &fragmentLength);
-    glShaderSource(fragmentName, 1, (const char * const *)&fragmentSource, &fragmentLength);
+    AssetView fragmentSource;
+    if (!openAsset("minimal.frag", &fragmentSource)) {
+        printf("ERROR Unable to read minimal.frag\n");
+        return 0;
+    }
+    GLint fragmentLength = (GLint)fragmentSource.size;
+    glShaderSource(fragmentName, 1, &fragmentSource.data, &fragmentLength);
+    closeAsset(&fragmentSource);
     glCompileShader(fragmentName);
     glGetShaderiv(fragmentName, GL_COMPILE_STATUS, &compileStatus);
     if (!compileStatus) {
@@ -165,9 +144,9 @@ int initGL() {
         glDeleteShader(fragmentName);
 
         printf("FRAGMENT ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(fragmentSource);
 
     // Create and link vertex program
     programName = glCreateProgram(); // 2.0
@@ -183,6 +162,7 @@ int initGL() {
         glGetProgramInfoLog(programName, logSize, &logSize, errorLog); // 2.0
 
         printf("LINK ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
 
@@ -1,11 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include "../common/asset_io.h"
+#include "../common/frame_pacer.h"
+#include "../common/job_system.h"
+#include "../common/batch_transform.h"
+#include "../common/entity_store.h"
+
 #define DEFAULT_WIDTH 1024
 #define DEFAULT_HEIGHT 768
 
@@ -13,29 +21,59 @@
 #define VERTICES 0
 #define INDICES 1
 #define GLOBAL_MATRICES 2
-#define MODEL_MATRIX1 3
-#define MODEL_MATRIX2 4
-#define LIGHT_PROPERTIES 5
-#define MATERIAL_PROPERTIES 6
-#define CAMERA_PROPERTIES 7
+#define OBJECT_RECORDS 3
+#define LIGHT_PROPERTIES 4
+#define MATERIAL_PROPERTIES 5
+#define CAMERA_PROPERTIES 6
+#define OBJECT_INDICES 7
+#define DRAW_COMMANDS 8
+#define MATERIAL_PALETTE 9
 
 // Vertex Array attributes
 #define POSITION 0
 #define COLOR 1
 #define NORMAL 2
+#define OBJECT_INDEX 3
 
 // Vertex Array binding points
 #define STREAM0 0
+#define STREAM1 1
 
 // GLSL Uniform indices
 #define TRANSFORM0 0
-#define TRANSFORM1 1
 #define LIGHT 2
 #define MATERIAL 3
 #define CAMERA 4
+#define PALETTE 5
+
+// GLSL Shader storage indices
+#define OBJECT_STORAGE 0
+
+// Meshes sharing the vertex and index buffers
+#define MESH_CUBE 0
+#define MESH_PYRAMID 1
+#define NUM_MESHES 2
+
+// Colors the materials tint the meshes with
+#define NUM_MATERIALS 4
+
+// Number of objects in the scene unless given on the command line, and the distance between them
+#define DEFAULT_OBJECTS 100000
+#define OBJECT_SPACING 4.0f
+
+// One object in this many does not spin
+#define STATIC_OBJECT_INTERVAL 4
+
+// Regions of the record and command buffers, written in turn so the frames in flight keep theirs
+#define FRAME_REGIONS 3
+
+// Updates measured for every path and number of workers when benchmarking
+#define BENCHMARK_UPDATES 50
+#define BENCHMARK_WARMUP_UPDATES 5
 
 // Vertices
 GLfloat vertices[] = {
+    // Cube
     // Front
     -1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
     -1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
@@ -65,10 +103,33 @@ GLfloat vertices[] = {
     -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f,
     -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f,
     1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f,
-    1.0f, -1.0f, 1.0f,  0.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f
+    1.0f, -1.0f, 1.0f,  0.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f,
+    // Pyramid
+    // Front
+    -1.0f, -1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.447f, 0.894f,
+    1.0f, -1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.447f, 0.894f,
+    0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.447f, 0.894f,
+    // Right
+    1.0f, -1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.894f, 0.447f, 0.0f,
+    1.0f, -1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 0.894f, 0.447f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.894f, 0.447f, 0.0f,
+    // Back
+    1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.447f, -0.894f,
+    -1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.447f, -0.894f,
+    0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.447f, -0.894f,
+    // Left
+    -1.0f, -1.0f, -1.0f, 0.0f, 1.0f, 1.0f, -0.894f, 0.447f, 0.0f,
+    -1.0f, -1.0f, 1.0f, 0.0f, 1.0f, 1.0f, -0.894f, 0.447f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, -0.894f, 0.447f, 0.0f,
+    // Bottom
+    -1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f,
+    -1.0f, -1.0f, -1.0f, 1.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f,
+    1.0f, -1.0f, -1.0f, 1.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f,
+    1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f
 };
 
 GLushort indices[] {
+    // Cube
     // Front
     0, 1, 2, 2, 3, 0,
     // Back
@@ -80,7 +141,15 @@ GLushort indices[] {
     // Top
     16, 17, 18, 18, 19, 16,
     // Bottom
-    20, 21, 22, 22, 23, 20
+    20, 21, 22, 22, 23, 20,
+    // Pyramid, relative to its first vertex
+    // Sides
+    0, 1, 2,
+    3, 4, 5,
+    6, 7, 8,
+    9, 10, 11,
+    // Bottom
+    12, 13, 14, 14, 15, 12
 };
 
 // Light properties (4 valued vectors due to std140 see OpenGL 4.5 reference)
@@ -102,54 +171,151 @@ GLfloat materialProperties[] = {
     32.0f
 };
 
+// Color of every material, multiplied with the vertex colors
+GLfloat materialPalette[] = {
+    1.0f, 1.0f, 1.0f, 1.0f,
+    1.0f, 0.7f, 0.4f, 1.0f,
+    0.4f, 0.7f, 1.0f, 1.0f,
+    0.5f, 0.5f, 0.5f, 1.0f
+};
+
 // Camera properties 
 GLfloat cameraProperties[] {
     0.0f, 0.0f, 4.0f
 };
 
-// Pointers for updating GPU data
-GLfloat *projectionMatrixPtr;
-GLfloat *viewMatrixPtr;
-GLfloat *modelMatrix1Ptr;
-GLfloat *modelMatrix2Ptr;
+/*
+ * A structure for storing where a mesh is in the vertex and index buffers, and the radius of its
+ * bounding sphere
+ */
+typedef struct {
+    GLuint numIndices;
+    GLuint firstIndex;
+    GLint baseVertex;
+    float radius;
+} SceneMesh;
+
+SceneMesh meshes[NUM_MESHES] = {
+    { 36, 0, 0, 1.733f },
+    { 18, 36, 24, 1.733f }
+};
 
-// Names
-GLuint programName;
-GLuint vertexArrayName;
-GLuint vertexBufferNames[8];
+/*
+ * A structure for storing an indirect draw command (see glMultiDrawElementsIndirect)
+ */
+typedef struct {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+} DrawCommand;
 
 /*
- * Read shader source file from disk
+ * Components of the entities. The position and scale place an entity, the rotation turns it, and
+ * the entities that spin have the spin component the rotation is computed from. The mesh and
+ * material are indices into the meshes and the palette, and the bounds are the radius of the
+ * bounding sphere in model space.
  */
-char *readSourceFile(const char *filename, int *size) {
+typedef struct {
+    glm::vec3 position;
+    float scale;
+} TransformComponent;
 
-    // Open the file as read only
-    FILE *file = fopen(filename, "r");
+typedef struct {
+    glm::vec3 axis;
+    float speed;
+    float phase;
+} SpinComponent;
+
+typedef struct {
+    float radius;
+} BoundsComponent;
+
+/*
+ * A structure for storing every field of an object in one place, the layout the entities replace.
+ * Used to create the entities and as the baseline when benchmarking.
+ */
+typedef struct {
+    glm::vec3 position;
+    float scale;
+    glm::quat rotation;
+    glm::vec3 axis;
+    float speed;
+    float phase;
+    int mesh;
+    int material;
+    float radius;
+} SceneObject;
 
-    // Find the end of the file to determine the file size
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
+/*
+ * A structure for storing the per-draw record of a visible object, matching the std430 layout of
+ * the records in object_records.vert
+ */
+typedef struct {
+    GLfloat model[16];
+    // Columns of the normal matrix, padded to four values
+    GLfloat normalMatrix[12];
+    GLuint material;
+    GLuint padding[3];
+} ObjectRecord;
 
-    // Rewind
-    fseek(file, 0, SEEK_SET); 
+/*
+ * A structure for storing the state shared by the jobs of a scene update
+ */
+typedef struct {
+    float time;
+    glm::vec4 planes[6];
+    // Regions of the record and command buffers written in this frame
+    ObjectRecord *records;
+    DrawCommand *commands;
+} SceneUpdate;
+
+// Component types, and the components the systems iterate over
+int transformComponent, rotationComponent, spinComponent, meshComponent, materialComponent, boundsComponent;
+ComponentMask spinMask, renderMask;
+
+// Entities of the scene, and the chunks each system iterates over. Every chunk the renderer
+// iterates over has a slice of records in each region, and a draw command per mesh.
+EntityStore entityStore;
+std::vector<ChunkReference> spinChunks, renderChunks;
+int numChunks;
+
+// Transforms of the visible objects of the chunk a worker is updating, and the path composing them
+TransformBatch transformBatches[MAX_JOB_WORKERS];
+int transformPath = getDefaultTransformPath();
+
+// Far plane, placed behind the farthest object
+float zFar = 100.0f;
+
+// Projection matrix, kept for the frustum culling
+glm::mat4 projectionMatrix;
 
-    // Allocate memory for the source and initialize it to 0
-    char *source = (char *)malloc(fileSize + 1);
-    for (int i = 0; i <= fileSize; i++) source[i] = 0;
+// Pointers for updating GPU data
+GLfloat *projectionMatrixPtr;
+GLfloat *viewMatrixPtr;
+ObjectRecord *objectRecordsPtr;
+DrawCommand *drawCommandsPtr;
 
-    // Read the source
-    fread(source, fileSize, 1, file);
+// Records and commands in the region of a frame
+GLsizeiptr regionRecords, regionCommands;
+GLsync regionFences[FRAME_REGIONS];
+int frame;
 
-    // Close the file
-    fclose(file);
+// Names
+GLuint programName;
+GLuint vertexArrayName;
+GLuint vertexBufferNames[10];
 
-    // Store the size of the file in the output variable
-    *size = fileSize-1;
+// Workers updating the scene
+JobSystem jobSystem;
 
-    // Return the shader source
-    return source;
+// Time spent updating the scene since the statistics were last printed
+double updateTime, statisticsTime;
+int statisticsFrames;
 
-}
+// Pacer of the main loop
+FramePacer framePacer;
 
 /*
  * Callback function for OpenGL debug messages 
@@ -168,24 +334,40 @@ int initGL() {
     glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 
-    // Create and initialize 4 buffer names
-    glCreateBuffers(8, vertexBufferNames);
+    // Create and initialize 10 buffer names
+    glCreateBuffers(10, vertexBufferNames);
 
     // Allocate storage for the vertex array buffers
-    glNamedBufferStorage(vertexBufferNames[VERTICES], 6 * 4 * 9 * sizeof(GLfloat), vertices, 0);
+    glNamedBufferStorage(vertexBufferNames[VERTICES], sizeof(vertices), vertices, 0);
 
     // Allocate storage for the triangle indices
-    glNamedBufferStorage(vertexBufferNames[INDICES], 3 * 2 * 6 * sizeof(GLshort), indices, 0);
+    glNamedBufferStorage(vertexBufferNames[INDICES], sizeof(indices), indices, 0);
 
     // Allocate storage for the transformation matrices and retrieve their addresses
     glNamedBufferStorage(vertexBufferNames[GLOBAL_MATRICES], 16 * sizeof(GLfloat) * 2, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
-    glNamedBufferStorage(vertexBufferNames[MODEL_MATRIX1], 16 * sizeof(GLfloat), NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
-    glNamedBufferStorage(vertexBufferNames[MODEL_MATRIX2], 16 * sizeof(GLfloat), NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+
+    // Allocate storage for the object records and draw commands. Every chunk of entities has a
+    // slice of records and a command per mesh in each region, and the regions start at an offset
+    // the records can be bound at.
+    GLint alignment;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    regionRecords = (numChunks * ENTITY_CHUNK_CAPACITY * sizeof(ObjectRecord) + alignment - 1) / alignment * alignment / sizeof(ObjectRecord);
+    regionCommands = numChunks * NUM_MESHES;
+    glNamedBufferStorage(vertexBufferNames[OBJECT_RECORDS], regionRecords * FRAME_REGIONS * sizeof(ObjectRecord), NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    glNamedBufferStorage(vertexBufferNames[DRAW_COMMANDS], regionCommands * FRAME_REGIONS * sizeof(DrawCommand), NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+
+    // Allocate storage for the index of every record, an instanced attribute which the base
+    // instance of a draw command offsets to the first record of the command
+    std::vector<GLuint> objectIndices(regionRecords);
+    for (int i=0; i<(int)regionRecords; ++i)
+        objectIndices[i] = i;
+    glNamedBufferStorage(vertexBufferNames[OBJECT_INDICES], regionRecords * sizeof(GLuint), &objectIndices[0], 0);
 
     // Allocate storage for the buffers used for lighting calculations
     glNamedBufferStorage(vertexBufferNames[LIGHT_PROPERTIES], 16 * sizeof(GLfloat), lightProperties, 0);
     glNamedBufferStorage(vertexBufferNames[MATERIAL_PROPERTIES], 5 * sizeof(GLfloat), materialProperties, 0);
     glNamedBufferStorage(vertexBufferNames[CAMERA_PROPERTIES], 3 * sizeof(GLfloat), cameraProperties, 0);
+    glNamedBufferStorage(vertexBufferNames[MATERIAL_PALETTE], sizeof(materialPalette), materialPalette, 0);
 
     // Get a pointer to the global matrices data
     GLfloat *globalMatricesPtr = (GLfloat *)glMapNamedBufferRange(vertexBufferNames[GLOBAL_MATRICES], 0, 16 * sizeof(GLfloat) * 2, 
@@ -193,11 +375,13 @@ int initGL() {
     projectionMatrixPtr = globalMatricesPtr;
     viewMatrixPtr = globalMatricesPtr + 16;
 
-    // Get a pointer to the model matrix data
-    modelMatrix1Ptr = (GLfloat *)glMapNamedBufferRange(vertexBufferNames[MODEL_MATRIX1], 0, 16 * sizeof(GLfloat), 
+    // Get pointers to the object records and draw commands, written by the workers
+    objectRecordsPtr = (ObjectRecord *)glMapNamedBufferRange(vertexBufferNames[OBJECT_RECORDS], 0, regionRecords * FRAME_REGIONS * sizeof(ObjectRecord),
             GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-    modelMatrix2Ptr = (GLfloat *)glMapNamedBufferRange(vertexBufferNames[MODEL_MATRIX2], 0, 16 * sizeof(GLfloat), 
+    drawCommandsPtr = (DrawCommand *)glMapNamedBufferRange(vertexBufferNames[DRAW_COMMANDS], 0, regionCommands * FRAME_REGIONS * sizeof(DrawCommand),
             GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    for (int r=0; r<FRAME_REGIONS; ++r)
+        regionFences[r] = 0;
 
     // Create and initialize a vertex array object
     glCreateVertexArrays(1, &vertexArrayName);
@@ -206,28 +390,38 @@ int initGL() {
     glVertexArrayAttribBinding(vertexArrayName, POSITION, STREAM0);
     glVertexArrayAttribBinding(vertexArrayName, COLOR, STREAM0);
     glVertexArrayAttribBinding(vertexArrayName, NORMAL, STREAM0);
+    glVertexArrayAttribBinding(vertexArrayName, OBJECT_INDEX, STREAM1);
 
     // Specify attribute format
     glVertexArrayAttribFormat(vertexArrayName, POSITION, 3, GL_FLOAT, GL_FALSE, 0);
     glVertexArrayAttribFormat(vertexArrayName, COLOR, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GL_FLOAT));
     glVertexArrayAttribFormat(vertexArrayName, NORMAL, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GL_FLOAT));
+    glVertexArrayAttribIFormat(vertexArrayName, OBJECT_INDEX, 1, GL_UNSIGNED_INT, 0);
 
     // Enable the attributes
     glEnableVertexArrayAttrib(vertexArrayName, POSITION);
     glEnableVertexArrayAttrib(vertexArrayName, COLOR);
     glEnableVertexArrayAttrib(vertexArrayName, NORMAL);
+    glEnableVertexArrayAttrib(vertexArrayName, OBJECT_INDEX);
 
     // Bind the indices to the vertex array
     glVertexArrayElementBuffer(vertexArrayName, vertexBufferNames[INDICES]);
 
-    // Bind the vertex buffer to the vertex array
+    // Bind the vertex buffer and the record indices, advancing once per instance, to the vertex array
     glVertexArrayVertexBuffer(vertexArrayName, STREAM0, vertexBufferNames[VERTICES], 0, 9 * sizeof(GLfloat));
+    glVertexArrayVertexBuffer(vertexArrayName, STREAM1, vertexBufferNames[OBJECT_INDICES], 0, sizeof(GLuint));
+    glVertexArrayBindingDivisor(vertexArrayName, STREAM1, 1);
 
     // Load and compile vertex shader
     GLuint vertexName = glCreateShader(GL_VERTEX_SHADER);
-    int vertexLength = 0;
-    char *vertexSource = readSourceFile("simple_lighting.vert", &vertexLength);
-    glShaderSource(vertexName, 1, (const char * const *)&vertexSource, &vertexLength);
+    AssetView vertexSource;
+    if (!openAsset("object_records.vert", &vertexSource)) {
+        printf("ERROR Unable to read object_records.vert\n");
+        return 0;
+    }
+    GLint vertexLength = (GLint)vertexSource.size;
+    glShaderSource(vertexName, 1, &vertexSource.data, &vertexLength);
+    closeAsset(&vertexSource);
     GLint compileStatus;
     glCompileShader(vertexName);
     glGetShaderiv(vertexName, GL_COMPILE_STATUS, &compileStatus);
@@ -238,15 +432,20 @@ int initGL() {
         glGetShaderInfoLog(vertexName, logSize, &logSize, errorLog);
         glDeleteShader(vertexName);
         printf("VERTEX ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(vertexSource);
 
     // Load and compile fragment shader
     GLuint fragmentName = glCreateShader(GL_FRAGMENT_SHADER);
-    int fragmentLength = 0;
-    char *fragmentSource = readSourceFile("simple_lighting.frag", &fragmentLength);
-    glShaderSource(fragmentName, 1, (const char * const *)&fragmentSource, &fragmentLength);
+    AssetView fragmentSource;
+    if (!openAsset("simple_lighting.frag", &fragmentSource)) {
+        printf("ERROR Unable to read simple_lighting.frag\n");
+        return 0;
+    }
+    GLint fragmentLength = (GLint)fragmentSource.size;
+    glShaderSource(fragmentName, 1, &fragmentSource.data, &fragmentLength);
+    closeAsset(&fragmentSource);
     glCompileShader(fragmentName);
     glGetShaderiv(fragmentName, GL_COMPILE_STATUS, &compileStatus);
     if (!compileStatus) {
@@ -257,9 +456,9 @@ int initGL() {
         glDeleteShader(fragmentName);
 
         printf("FRAGMENT ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(fragmentSource);
 
     // Create and link vertex program
     programName = glCreateProgram();
@@ -275,6 +474,7 @@ int initGL() {
         glGetProgramInfoLog(programName, logSize, &logSize, errorLog);
 
         printf("LINK ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
 
@@ -285,31 +485,297 @@ int initGL() {
 
 }
 
+/*
+ * Register the component types of the entities with a store
+ */
+void registerComponentTypes(EntityStore *store) {
+
+    transformComponent = registerComponentType(store, sizeof(TransformComponent));
+    rotationComponent = registerComponentType(store, sizeof(glm::quat));
+    spinComponent = registerComponentType(store, sizeof(SpinComponent));
+    meshComponent = registerComponentType(store, sizeof(int));
+    materialComponent = registerComponentType(store, sizeof(int));
+    boundsComponent = registerComponentType(store, sizeof(BoundsComponent));
+
+    spinMask = 1u << rotationComponent | 1u << spinComponent;
+    renderMask = 1u << transformComponent | 1u << rotationComponent | 1u << meshComponent | 1u << materialComponent | 1u << boundsComponent;
+
+}
+
+/*
+ * Get object number o of a square grid in the xz-plane with the given side, each object with a
+ * random mesh, material, size, axis and speed of rotation
+ */
+SceneObject getGridObject(int o, int side) {
+
+    float extent = side * OBJECT_SPACING;
+
+    SceneObject object;
+    object.position = glm::vec3(((o % side) + 0.5f) * OBJECT_SPACING - extent * 0.5f, 0.0f, ((o / side) + 0.5f) * OBJECT_SPACING - extent * 0.5f);
+    object.axis = glm::normalize(glm::vec3(rand() / (float)RAND_MAX - 0.5f, 1.0f, rand() / (float)RAND_MAX - 0.5f));
+    object.speed = o % STATIC_OBJECT_INTERVAL == 0 ? 0.0f : 0.2f + rand() / (float)RAND_MAX;
+    object.phase = rand() / (float)RAND_MAX * 6.28f;
+    object.scale = 0.5f + rand() / (float)RAND_MAX * 0.8f;
+    object.rotation = glm::angleAxis(object.phase, object.axis);
+    object.mesh = rand() % NUM_MESHES;
+    object.material = rand() % NUM_MATERIALS;
+    object.radius = meshes[object.mesh].radius;
+
+    return object;
+
+}
+
+/*
+ * Create an entity from an object, with the spin component only if the object spins. Returns the
+ * entity, or -1 if it could not be stored.
+ */
+int createObjectEntity(EntityStore *store, const SceneObject *object) {
+
+    int entity = createEntity(store, renderMask | (object->speed != 0.0f ? spinMask : 0));
+    if (entity < 0)
+        return -1;
+
+    TransformComponent *transform = getEntityComponent<TransformComponent>(store, entity, transformComponent);
+    transform->position = object->position;
+    transform->scale = object->scale;
+    *getEntityComponent<glm::quat>(store, entity, rotationComponent) = object->rotation;
+    *getEntityComponent<int>(store, entity, meshComponent) = object->mesh;
+    *getEntityComponent<int>(store, entity, materialComponent) = object->material;
+    getEntityComponent<BoundsComponent>(store, entity, boundsComponent)->radius = object->radius;
+
+    SpinComponent *spin = getEntityComponent<SpinComponent>(store, entity, spinComponent);
+    if (spin) {
+        spin->axis = object->axis;
+        spin->speed = object->speed;
+        spin->phase = object->phase;
+    }
+
+    return entity;
+
+}
+
+/*
+ * Create an entity for every object on a square grid in the xz-plane, and place the camera and
+ * light above the grid
+ */
+void createScene(int numObjects) {
+
+    int side = (int)ceil(sqrt((double)numObjects));
+    float extent = side * OBJECT_SPACING;
+
+    initEntityStore(&entityStore);
+    registerComponentTypes(&entityStore);
+
+    srand(1);
+    // The objects are left out once the entities can not be stored
+    for (int o=0; o<numObjects; ++o) {
+        SceneObject object = getGridObject(o, side);
+        if (createObjectEntity(&entityStore, &object) < 0)
+            break;
+    }
+
+    queryChunks(&entityStore, spinMask, &spinChunks);
+    queryChunks(&entityStore, renderMask, &renderChunks);
+    numChunks = (int)renderChunks.size();
+    for (int w=0; w<MAX_JOB_WORKERS; ++w)
+        initTransformBatch(&transformBatches[w], ENTITY_CHUNK_CAPACITY);
+
+    // Look at the center of the grid from above one of its edges
+    cameraProperties[0] = 0.0f;
+    cameraProperties[1] = extent * 0.3f + 4.0f;
+    cameraProperties[2] = extent * 0.6f + 4.0f;
+    zFar = glm::length(glm::vec3(cameraProperties[0], cameraProperties[1], cameraProperties[2])) + extent;
+    lightProperties[0] = 0.0f;
+    lightProperties[1] = extent * 0.5f + 4.0f;
+    lightProperties[2] = 0.0f;
+
+}
+
+/*
+ * Get the planes of the view frustum from the combined projection and view matrix, the normals
+ * pointing inwards
+ */
+void getFrustumPlanes(const glm::mat4 &viewProjection, glm::vec4 *planes) {
+
+    glm::mat4 m = glm::transpose(viewProjection);
+    planes[0] = m[3] + m[0];
+    planes[1] = m[3] - m[0];
+    planes[2] = m[3] + m[1];
+    planes[3] = m[3] - m[1];
+    planes[4] = m[3] + m[2];
+    planes[5] = m[3] - m[2];
+    for (int p=0; p<6; ++p)
+        planes[p] /= glm::length(glm::vec3(planes[p]));
+
+}
+
+/*
+ * Check if a bounding sphere is at least partly inside the view frustum
+ */
+inline int isSphereVisible(const glm::vec4 *planes, const glm::vec3 &center, float radius) {
+
+    for (int p=0; p<6; ++p)
+        if (glm::dot(glm::vec3(planes[p]), center) + planes[p].w <= -radius)
+            return 0;
+    return 1;
+
+}
+
+/*
+ * Spin the entities of a chunk
+ */
+inline void spinChunk(EntityStore *store, const ChunkReference &chunk, float time) {
+
+    int count = getChunkCount(store, chunk);
+    const SpinComponent *spins = getChunkComponents<SpinComponent>(store, chunk, spinComponent);
+    glm::quat *rotations = getChunkComponents<glm::quat>(store, chunk, rotationComponent);
+
+    for (int e=0; e<count; ++e)
+        rotations[e] = glm::angleAxis(time * spins[e].speed + spins[e].phase, spins[e].axis);
+
+}
+
+/*
+ * Count the visible entities of a chunk
+ */
+inline int countVisibleInChunk(EntityStore *store, const ChunkReference &chunk, const glm::vec4 *planes) {
+
+    int count = getChunkCount(store, chunk), visible = 0;
+    const TransformComponent *transforms = getChunkComponents<TransformComponent>(store, chunk, transformComponent);
+    const BoundsComponent *bounds = getChunkComponents<BoundsComponent>(store, chunk, boundsComponent);
+
+    for (int e=0; e<count; ++e)
+        visible += isSphereVisible(planes, transforms[e].position, bounds[e].radius * transforms[e].scale);
+
+    return visible;
+
+}
+
+/*
+ * Job spinning the entities of the chunks from begin to end
+ */
+void spinEntities(void *data, int begin, int end, int worker) {
+
+    const SceneUpdate *update = (const SceneUpdate *)data;
+
+    for (int c=begin; c<end; ++c)
+        spinChunk(&entityStore, spinChunks[c], update->time);
+
+}
+
+/*
+ * Job writing the records and draw commands of the chunks from begin to end. The entities outside
+ * the view frustum are culled, and the transforms of the others are gathered in the batch of the
+ * worker, ordered by mesh. Their records are composed into the slice of the chunk, followed by a
+ * draw command per mesh covering its part of the slice.
+ */
+void renderEntities(void *data, int begin, int end, int worker) {
+
+    const SceneUpdate *update = (const SceneUpdate *)data;
+    TransformBatch *batch = &transformBatches[worker];
+
+    for (int c=begin; c<end; ++c) {
+
+        const ChunkReference &chunk = renderChunks[c];
+        int count = getChunkCount(&entityStore, chunk);
+        const TransformComponent *transforms = getChunkComponents<TransformComponent>(&entityStore, chunk, transformComponent);
+        const glm::quat *rotations = getChunkComponents<glm::quat>(&entityStore, chunk, rotationComponent);
+        const int *meshIndices = getChunkComponents<int>(&entityStore, chunk, meshComponent);
+        const int *materials = getChunkComponents<int>(&entityStore, chunk, materialComponent);
+        const BoundsComponent *bounds = getChunkComponents<BoundsComponent>(&entityStore, chunk, boundsComponent);
+
+        // Cull the bounding spheres, counting the visible entities of every mesh
+        unsigned short visible[ENTITY_CHUNK_CAPACITY];
+        int numVisible = 0;
+        int meshCounts[NUM_MESHES] = { 0 };
+        for (int e=0; e<count; ++e) {
+            if (!isSphereVisible(update->planes, transforms[e].position, bounds[e].radius * transforms[e].scale))
+                continue;
+            visible[numVisible++] = (unsigned short)e;
+            meshCounts[meshIndices[e]]++;
+        }
+
+        // Gather the transforms and materials, the entities of a mesh after those of the previous
+        int meshStarts[NUM_MESHES], next[NUM_MESHES];
+        for (int m=0, start=0; m<NUM_MESHES; start += meshCounts[m++])
+            meshStarts[m] = next[m] = start;
+        GLuint recordMaterials[ENTITY_CHUNK_CAPACITY];
+        for (int v=0; v<numVisible; ++v) {
+            int e = visible[v];
+            int b = next[meshIndices[e]]++;
+            setBatchTransform(batch, b, transforms[e].position, rotations[e], glm::vec3(transforms[e].scale));
+            recordMaterials[b] = materials[e];
+        }
+
+        // The matrices go straight to the mapped buffer with non-temporal stores
+        ObjectRecord *records = update->records + c * ENTITY_CHUNK_CAPACITY;
+        composeBatchTransforms(batch, 0, numVisible, records[0].model, records[0].normalMatrix, sizeof(ObjectRecord) / sizeof(GLfloat), transformPath);
+        for (int b=0; b<numVisible; ++b)
+            records[b].material = recordMaterials[b];
+
+        for (int m=0; m<NUM_MESHES; ++m) {
+            DrawCommand *command = &update->commands[c * NUM_MESHES + m];
+            command->count = meshes[m].numIndices;
+            command->instanceCount = meshCounts[m];
+            command->firstIndex = meshes[m].firstIndex;
+            command->baseVertex = meshes[m].baseVertex;
+            command->baseInstance = c * ENTITY_CHUNK_CAPACITY + meshStarts[m];
+        }
+
+    }
+
+}
+
+/*
+ * Spin the entities and write the records and draw commands of the visible ones into a region of
+ * the record and command buffers, using the workers of the given job system
+ */
+void updateScene(JobSystem *system, int region, const glm::mat4 &viewProjection, float time) {
+
+    SceneUpdate update;
+    update.time = time;
+    update.records = objectRecordsPtr + region * regionRecords;
+    update.commands = drawCommandsPtr + region * regionCommands;
+    getFrustumPlanes(viewProjection, update.planes);
+
+    parallelFor(system, (int)spinChunks.size(), 1, spinEntities, &update);
+    parallelFor(system, numChunks, 1, renderEntities, &update);
+
+}
+
+/*
+ * Get the view matrix of the camera, looking at the center of the grid
+ */
+glm::mat4 getViewMatrix() {
+
+    return glm::lookAt(glm::vec3(cameraProperties[0], cameraProperties[1], cameraProperties[2]), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+}
 
 /*
  * Draw OpenGL screne
  */
 void drawGLScene() {
 
+    // Wait until the GPU has finished the frame that last used this region of the buffers
+    int region = frame % FRAME_REGIONS;
+    if (regionFences[region]) {
+        glClientWaitSync(regionFences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(regionFences[region]);
+        regionFences[region] = 0;
+    }
+
     // Clear color and depth buffers
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Set the view matrix
-    glm::mat4 view = glm::mat4(1.0f);
-    view = glm::translate(view, glm::vec3(-cameraProperties[0], -cameraProperties[1], -cameraProperties[2]));
+    glm::mat4 view = getViewMatrix();
     memcpy(viewMatrixPtr, &view[0][0], 16 * sizeof(GLfloat));
 
-    // Set the model matrix for the first cube
-    glm::mat4 model1 = glm::mat4(1.0);
-    model1 = glm::translate(model1, glm::vec3(-1.5f, 0.0f, 0.0f));
-    model1 = glm::rotate(model1, (float)glfwGetTime() * 0.3f, glm::vec3(0.0f, 1.0f,  0.0f));
-    memcpy(modelMatrix1Ptr, &model1[0][0], 16 * sizeof(GLfloat));
-
-    // Set the model matrix for the second cube
-    glm::mat4 model2 = glm::mat4(1.0);
-    model2 = glm::translate(model2, glm::vec3(1.5f, 0.0f, 0.0f));
-    model2 = glm::rotate(model2, (float)glfwGetTime() * 0.3f, glm::vec3(0.0f, 1.0f,  0.0f));
-    memcpy(modelMatrix2Ptr, &model2[0][0], 16 * sizeof(GLfloat));
+    // Write the records and draw commands of the visible objects on the workers
+    double startTime = glfwGetTime();
+    updateScene(&jobSystem, region, projectionMatrix * view, (float)glfwGetTime() * 0.3f);
+    updateTime += glfwGetTime() - startTime;
 
     // Activate the program
     glUseProgram(programName);
@@ -322,18 +788,36 @@ void drawGLScene() {
     glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT, vertexBufferNames[LIGHT_PROPERTIES]);
     glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL, vertexBufferNames[MATERIAL_PROPERTIES]);
     glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA, vertexBufferNames[CAMERA_PROPERTIES]);
+    glBindBufferBase(GL_UNIFORM_BUFFER, PALETTE, vertexBufferNames[MATERIAL_PALETTE]);
 
-    // Activate first model matrix and draw cube
-    glBindBufferBase(GL_UNIFORM_BUFFER, TRANSFORM1, vertexBufferNames[MODEL_MATRIX1]);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
+    // Bind the records of the region and draw every chunk and mesh with a single call
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECT_STORAGE, vertexBufferNames[OBJECT_RECORDS], region * regionRecords * sizeof(ObjectRecord),
+            regionRecords * sizeof(ObjectRecord));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, vertexBufferNames[DRAW_COMMANDS]);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void *)(region * regionCommands * sizeof(DrawCommand)), (GLsizei)regionCommands, 0);
 
-    // Activate first model matrix and draw cube
-    glBindBufferBase(GL_UNIFORM_BUFFER, TRANSFORM1, vertexBufferNames[MODEL_MATRIX2]);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
+    // Mark the end of the use of the region
+    regionFences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame++;
 
     // Disable
     glUseProgram(0);
     glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    // Print the average update time once a second
+    statisticsFrames++;
+    double time = glfwGetTime();
+    if (time - statisticsTime >= 1.0) {
+        int visible = 0;
+        for (int c=0; c<regionCommands; ++c)
+            visible += drawCommandsPtr[region * regionCommands + c].instanceCount;
+        printf("Scene update %.3f ms on %d workers, %d of %d objects visible in %d chunks\n", updateTime / statisticsFrames * 1000.0,
+                jobSystem.numWorkers, visible, entityStore.numEntities, numChunks);
+        updateTime = 0.0;
+        statisticsFrames = 0;
+        statisticsTime = time;
+    }
 
 }
 
@@ -343,15 +827,208 @@ void resizeGL(int width, int height) {
     if (height == 0)
         height = 1;										
 
-    // Change the projection matrix
-    glm::mat4 proj = glm::perspective(3.14f/2.0f, (float)width/height, 0.1f, 100.0f);
-    memcpy(projectionMatrixPtr, &proj[0][0], 16 * sizeof(GLfloat));
+    // Change the projection matrix, kept for culling the objects
+    projectionMatrix = glm::perspective(3.14f/2.0f, (float)width/height, 0.1f, zFar);
+    memcpy(projectionMatrixPtr, &projectionMatrix[0][0], 16 * sizeof(GLfloat));
 
     // Set the OpenGL viewport
     glViewport(0, 0, width, height);
 
 }
 
+/*
+ * Measure the time of a scene update with every number of workers up to one per processor core,
+ * writing to the first region of the record and command buffers
+ */
+void runUpdateBenchmark() {
+
+    int maxWorkers = glm::clamp((int)std::thread::hardware_concurrency(), 1, MAX_JOB_WORKERS);
+    glm::mat4 viewProjection = projectionMatrix * getViewMatrix();
+
+    printf("Scene update of %d objects in %d chunks\n", entityStore.numEntities, numChunks);
+    printf("%8s %12s %10s %12s\n", "workers", "time (ms)", "speedup", "efficiency");
+
+    double singleTime = 0.0;
+    for (int w=1; w<=maxWorkers; ++w) {
+
+        JobSystem *system = new JobSystem;
+        initJobSystem(system, w);
+
+        float time = 0.0f;
+        for (int u=0; u<BENCHMARK_WARMUP_UPDATES; ++u)
+            updateScene(system, 0, viewProjection, time += 0.01f);
+
+        double startTime = glfwGetTime();
+        for (int u=0; u<BENCHMARK_UPDATES; ++u)
+            updateScene(system, 0, viewProjection, time += 0.01f);
+        double updateTime = (glfwGetTime() - startTime) / BENCHMARK_UPDATES * 1000.0;
+
+        if (w == 1)
+            singleTime = updateTime;
+        printf("%8d %12.3f %10.2f %11.0f%%\n", w, updateTime, singleTime / updateTime, singleTime / updateTime / w * 100.0);
+
+        destroyJobSystem(system);
+        delete system;
+
+    }
+
+}
+
+/*
+ * Compose the model and normal matrix of every object with chained glm calls, copying them to the
+ * records one at a time
+ */
+void composeWithGlm(const TransformBatch *batch, ObjectRecord *records) {
+
+    for (int o=0; o<batch->count; ++o) {
+
+        glm::quat rotation(batch->qw[o], batch->qx[o], batch->qy[o], batch->qz[o]);
+        glm::vec3 scale(batch->sx[o], batch->sy[o], batch->sz[o]);
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(batch->tx[o], batch->ty[o], batch->tz[o]));
+        model = model * glm::mat4_cast(rotation);
+        model = glm::scale(model, scale);
+        memcpy(records[o].model, &model[0][0], 16 * sizeof(GLfloat));
+
+        glm::mat4 normal = glm::scale(glm::mat4_cast(rotation), 1.0f / scale);
+        for (int c=0; c<3; ++c) {
+            memcpy(&records[o].normalMatrix[c * 4], &normal[c][0], 3 * sizeof(GLfloat));
+            records[o].normalMatrix[c * 4 + 3] = 0.0f;
+        }
+
+    }
+
+}
+
+/*
+ * Measure composing the matrices of every object on a single thread into the first region of the
+ * record buffer, with glm and with every path of the batch composition
+ */
+void runTransformBenchmark() {
+
+    TransformBatch batch;
+    initTransformBatch(&batch, entityStore.numEntities);
+    batch.count = 0;
+    for (int c=0; c<numChunks; ++c) {
+        int count = getChunkCount(&entityStore, renderChunks[c]);
+        const TransformComponent *transforms = getChunkComponents<TransformComponent>(&entityStore, renderChunks[c], transformComponent);
+        const glm::quat *rotations = getChunkComponents<glm::quat>(&entityStore, renderChunks[c], rotationComponent);
+        for (int e=0; e<count; ++e)
+            setBatchTransform(&batch, batch.count++, transforms[e].position, rotations[e], glm::vec3(transforms[e].scale));
+    }
+
+    ObjectRecord *records = objectRecordsPtr;
+    size_t stride = sizeof(ObjectRecord) / sizeof(GLfloat);
+
+    printf("Matrix composition of %d objects on one thread\n", batch.count);
+    printf("%8s %12s %14s %10s\n", "path", "time (ms)", "ns per object", "speedup");
+
+    double glmTime = 0.0;
+    for (int path = -1; path < NUM_TRANSFORM_PATHS; ++path) {
+
+        if (path >= 0 && !isTransformPathAvailable(path))
+            continue;
+
+        double time = 0.0;
+        for (int u = 0; u < BENCHMARK_WARMUP_UPDATES + BENCHMARK_UPDATES; ++u) {
+            double startTime = glfwGetTime();
+            if (path < 0)
+                composeWithGlm(&batch, records);
+            else
+                composeBatchTransforms(&batch, 0, batch.count, records[0].model, records[0].normalMatrix, stride, path);
+            if (u >= BENCHMARK_WARMUP_UPDATES)
+                time += glfwGetTime() - startTime;
+        }
+        time = time / BENCHMARK_UPDATES * 1000.0;
+
+        if (path < 0)
+            glmTime = time;
+        printf("%8s %12.3f %14.2f %10.2f\n", path < 0 ? "glm" : getTransformPathName(path), time, time * 1e6 / batch.count, glmTime / time);
+
+    }
+
+}
+
+/*
+ * Measure spinning the objects and counting the visible ones on a single thread, with the objects
+ * in an array of structures and as entities, for a growing number of objects
+ */
+void runEntityBenchmark() {
+
+    int counts[] = { 10000, 100000, 1000000 };
+    glm::vec4 planes[6];
+    getFrustumPlanes(projectionMatrix * getViewMatrix(), planes);
+
+    printf("Spinning and culling on one thread, array of structures against entities\n");
+    printf("%10s %10s %12s %12s %12s %12s %10s\n", "objects", "layout", "spin (ms)", "spin (M/s)", "cull (ms)", "cull (M/s)", "visible");
+
+    for (int n=0; n<(int)(sizeof(counts) / sizeof(counts[0])); ++n) {
+
+        int numObjects = counts[n];
+        int side = (int)ceil(sqrt((double)numObjects));
+
+        // The same objects in both layouts
+        std::vector<SceneObject> objects(numObjects);
+        EntityStore *store = new EntityStore;
+        initEntityStore(store);
+        registerComponentTypes(store);
+        srand(1);
+        for (int o=0; o<numObjects; ++o) {
+            objects[o] = getGridObject(o, side);
+            createObjectEntity(store, &objects[o]);
+        }
+        std::vector<ChunkReference> spinning, rendered;
+        queryChunks(store, spinMask, &spinning);
+        queryChunks(store, renderMask, &rendered);
+
+        for (int layout=0; layout<2; ++layout) {
+
+            double spinTime = 0.0, cullTime = 0.0;
+            int visible = 0;
+
+            for (int u=0; u<BENCHMARK_WARMUP_UPDATES + BENCHMARK_UPDATES; ++u) {
+
+                float time = u * 0.01f;
+                double startTime = glfwGetTime();
+                if (layout == 0) {
+                    for (int o=0; o<numObjects; ++o)
+                        if (objects[o].speed != 0.0f)
+                            objects[o].rotation = glm::angleAxis(time * objects[o].speed + objects[o].phase, objects[o].axis);
+                } else {
+                    for (int c=0; c<(int)spinning.size(); ++c)
+                        spinChunk(store, spinning[c], time);
+                }
+                double cullStartTime = glfwGetTime();
+
+                visible = 0;
+                if (layout == 0) {
+                    for (int o=0; o<numObjects; ++o)
+                        visible += isSphereVisible(planes, objects[o].position, objects[o].radius * objects[o].scale);
+                } else {
+                    for (int c=0; c<(int)rendered.size(); ++c)
+                        visible += countVisibleInChunk(store, rendered[c], planes);
+                }
+
+                if (u >= BENCHMARK_WARMUP_UPDATES) {
+                    spinTime += cullStartTime - startTime;
+                    cullTime += glfwGetTime() - cullStartTime;
+                }
+
+            }
+            spinTime = spinTime / BENCHMARK_UPDATES * 1000.0;
+            cullTime = cullTime / BENCHMARK_UPDATES * 1000.0;
+
+            printf("%10d %10s %12.3f %12.1f %12.3f %12.1f %10d\n", numObjects, layout == 0 ? "structs" : "entities",
+                    spinTime, numObjects / spinTime / 1000.0, cullTime, numObjects / cullTime / 1000.0, visible);
+
+        }
+
+        destroyEntityStore(store);
+        delete store;
+
+    }
+
+}
+
 /*
  * Error callback function for GLFW
  */
@@ -365,6 +1042,10 @@ static void glfwErrorCallback(int error, const char* description) {
 static void glfwKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+    // Cycle through the frame pacing modes
+    if (key == GLFW_KEY_F && action == GLFW_PRESS)
+        cycleFramePacingMode(&framePacer);
 }
 
 /*
@@ -379,7 +1060,27 @@ void glfwWindowSizeCallback(GLFWwindow* window, int width, int height) {
 /*
  * Program entry function
  */
-int main(void) {
+int main(int nargs, const char **argv) {
+
+    // The number of objects and workers can be given on the command line, a worker per processor
+    // core being used by default, and -benchmark compares the layouts of the objects, measures the
+    // matrix composition with every path and the scene update with every number of workers
+    int numObjects = DEFAULT_OBJECTS, numWorkers = 0, updateBenchmark = 0;
+    for (int a=1; a<nargs; ++a) {
+        if (strcmp(argv[a], "-benchmark") == 0)
+            updateBenchmark = 1;
+        else if (strcmp(argv[a], "-workers") == 0 && a + 1 < nargs && atoi(argv[a+1]) > 0)
+            numWorkers = atoi(argv[++a]);
+        else if (atoi(argv[a]) > 0)
+            numObjects = atoi(argv[a]);
+        else {
+            printf("Usage: %s [objects] [-workers n] [-benchmark]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Create the entities and place the camera and the light before the buffers are created
+    createScene(numObjects);
 
     // Set error callback
     glfwSetErrorCallback(glfwErrorCallback);
@@ -433,20 +1134,48 @@ int main(void) {
     // Initialize OpenGL view
     resizeGL(DEFAULT_WIDTH, DEFAULT_HEIGHT);
 
+    // Compare the layouts, and measure the matrix composition and the scaling of the scene update
+    // instead of running
+    if (updateBenchmark) {
+        runEntityBenchmark();
+        runTransformBenchmark();
+        runUpdateBenchmark();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_SUCCESS);
+    }
+
+    // Start the workers updating the scene
+    initJobSystem(&jobSystem, numWorkers);
+    statisticsTime = glfwGetTime();
+
+    // Pace the frames to the refresh rate of the monitor
+    initFramePacer(&framePacer, PACING_JUST_IN_TIME);
+    printf("F cycles through the frame pacing modes\n");
+
     // Run a loop until the window is closed
     while (!glfwWindowShouldClose(window)) {
 
+        // Wait for the next frame and poll for input events
+        beginPacedFrame(&framePacer);
+
         // Draw OpenGL screne
         drawGLScene();
 
         // Swap buffers
         glfwSwapBuffers(window);
 
-        // Poll fow input events
-        glfwPollEvents();
+        // Issue the fence and timestamp of the frame
+        endPacedFrame(&framePacer);
 
     }
 
+    // Print the statistics of the last pacing mode
+    destroyFramePacer(&framePacer);
+
+    // Stop the workers
+    destroyJobSystem(&jobSystem);
+
     // Shutdown GLFW
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -0,0 +1,66 @@
+#version 450
+
+// Incoming vertex position, Model Space.
+layout (location = 0) in vec3 position;
+
+// Incoming vertex color.
+layout (location = 1) in vec3 color;
+
+// Incoming normal
+layout (location = 2) in vec3 normal;
+
+// Index of the record, an instanced attribute offset by the base instance of the draw command
+layout (location = 3) in uint objectIndex;
+
+// Projection and view matrices.
+layout (binding = 0, std140) uniform Transform0
+{
+    mat4 proj;
+    mat4 view;
+};
+
+// Per-draw record of an object, written by the workers
+struct ObjectRecord
+{
+    mat4 model;
+    mat3x4 normalMatrix;
+    uint material;
+};
+
+// Records of the visible objects of every chunk
+layout (binding = 0, std430) readonly buffer Objects
+{
+    ObjectRecord objects[];
+};
+
+// Color of every material
+layout (binding = 5, std140) uniform Palette
+{
+    vec4 materialColors[4];
+};
+
+// Output
+layout (location = 0) out Block
+{
+    vec3 interpolatedColor;
+    vec3 N;
+    vec3 worldVertex;
+};
+
+void main() {
+
+    mat4 model = objects[objectIndex].model;
+
+    // Normally gl_Position is in Clip Space and we calculate it by multiplying together all the matrices
+    gl_Position = proj * (view * (model * vec4(position, 1)));
+
+    // Set the world vertex for calculating the light direction in the fragment shader
+    worldVertex = vec3(model * vec4(position, 1));
+
+    // Set the transformed normal
+    N = mat3(objects[objectIndex].normalMatrix) * normal;
+
+    // We assign the color, tinted by the material, to the outgoing variable.
+    interpolatedColor = color * materialColors[objects[objectIndex].material].rgb;
+
+}
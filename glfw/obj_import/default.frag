@@ -1,5 +1,20 @@
 #version 450
 
+// Lighting features. obj_import.cpp builds a permutation of this shader for every combination of
+// features used by the materials by defining PERMUTATION together with the enabled features.
+// Compiled as is, every feature is enabled except the virtual texture, which replaces the diffuse
+// texture of the materials using it.
+#ifndef PERMUTATION
+#define USE_TEXTURE
+#define USE_SPECULAR
+#define USE_NORMAL_MAP
+#define USE_SHADOWS
+#define NUM_LIGHTS 1
+#endif
+
+// Number of samples along each axis of the percentage closer filtering of the shadows
+#define PCF_SIZE 3
+
 // Incoming interpolated (between vertices) color.
 layout (location = 0) in Block
 {
@@ -8,18 +23,32 @@ layout (location = 0) in Block
     vec3 worldVertex;
 };
 
+struct LightSource
+{
+    vec3 position;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
 layout (std140, binding = 2) uniform Light
 {
-    vec3 lightPos;
-    vec3 lightAmbient;
-    vec3 lightDiffuse;
-    vec3 lightSpecular;
+    LightSource lights[NUM_LIGHTS];
 };
 
+// The diffuse and normal map images are rectangles in cells of layers of the material texture array
+// (see texture_packer.h). Every rectangle is the offset and scale of the texture coordinates, and the
+// layers of the images are x and y of textureLayers.
 layout (std140, binding = 3) uniform Material
 {
     vec4 shininessColor;
     float shininess;
+    vec4 diffuseColor;
+    vec4 diffuseRect;
+    vec4 normalRect;
+    vec4 diffuseCell;
+    vec4 normalCell;
+    vec4 textureLayers;
 };
 
 layout (std140, binding = 4) uniform Camera
@@ -27,6 +56,24 @@ layout (std140, binding = 4) uniform Camera
     vec3 cameraPos;
 };
 
+// Projection and view matrices, the view depth selects the shadow cascade
+layout (binding = 0, std140) uniform Transform0
+{
+    mat4 proj;
+    mat4 view;
+};
+
+// Directional light casting the shadows. The light projection and view matrix of every cascade and
+// the view depth where each cascade ends (see shadow_depth.vert).
+layout (binding = 5, std140) uniform Shadow
+{
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;
+    vec4 lightDirection;
+    vec4 lightColor;
+    int numCascades;
+};
+
 // Outgoing final color.
 layout (location = 0) out vec4 outputColor;
 
@@ -42,35 +89,195 @@ vec4 ambient;
 vec4 diffuse;
 vec4 specular;
 
-// Texture sampler
-uniform sampler2D textureSampler;
+// Texture samplers
+#if defined(USE_TEXTURE) || defined(USE_NORMAL_MAP)
+layout (binding = 0) uniform sampler2DArray materialSampler;
+
+/*
+ * Sample an image in a rectangle of the material texture array, repeating it within the rectangle.
+ * The level is chosen from the footprint of the fragment, down to the level where the cell of the
+ * image is a single texel. In a cell of an atlas layer the sampling is kept half a texel of the
+ * coarser level filtered within the cell, never reaching the neighbouring images.
+ */
+vec4 sampleMaterial(vec2 uv, vec4 rect, vec4 cell, float layer) {
+
+    vec2 size = vec2(textureSize(materialSampler, 0).xy);
+    vec2 dx = dFdx(uv) * rect.zw * size;
+    vec2 dy = dFdy(uv) * rect.zw * size;
+    float maxLod = log2(max(cell.z * size.x, cell.w * size.y));
+    float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, maxLod);
+
+    vec2 coord = rect.xy + fract(uv) * rect.zw;
+    if (cell.z < 1.0 || cell.w < 1.0) {
+        vec2 margin = 0.5 * exp2(ceil(lod)) / size;
+        coord = clamp(coord, cell.xy + margin, cell.xy + cell.zw - margin);
+    }
+    return textureLod(materialSampler, vec3(coord, layer), lod);
+
+}
+#endif
+#ifdef USE_VIRTUAL_TEXTURE
+// Virtual texture and its page table (see virtual_texture.h). The size of level 0 in texels, the
+// number of levels and the size of a tile and its border, followed by the size of the tile cache,
+// whether the texture is sparse and the log2 of the reduction of the feedback resolution.
+layout (std140, binding = 6) uniform VirtualTexture
+{
+    vec4 virtualLayout;
+    vec4 virtualCache;
+};
+layout (binding = 3) uniform sampler2D virtualSampler;
+layout (binding = 4) uniform usampler2D pageTableSampler;
+
+/*
+ * Sample the tile cache at a level of the virtual texture, or the nearest coarser level that is
+ * loaded. The page table gives the slot of the tile and the level loaded, and the tile is sampled
+ * within its border.
+ */
+vec4 sampleVirtualLevel(vec2 wrapped, int level) {
+
+    int tiles = max(int(virtualLayout.x / virtualLayout.z) >> level, 1);
+    uvec4 entry = texelFetch(pageTableSampler, min(ivec2(wrapped * tiles), tiles - 1), level);
+
+    float residentTiles = float(max(int(virtualLayout.x / virtualLayout.z) >> entry.z, 1));
+    vec2 texel = vec2(entry.xy) * (virtualLayout.z + 2.0 * virtualLayout.w) + virtualLayout.w + fract(wrapped * residentTiles) * virtualLayout.z;
+    return textureLod(virtualSampler, texel / virtualCache.x, 0.0);
+
+}
+
+/*
+ * Sample the virtual texture at the level of the footprint of the fragment, or the nearest coarser
+ * level that is loaded. A sparse texture is filtered between the levels by the hardware, down to
+ * the level loaded as given by the page table. The cache holds single tiles, so the two levels
+ * around the footprint are sampled separately and blended.
+ */
+vec4 sampleVirtualTexture(vec2 uv) {
+
+    vec2 dx = dFdx(uv) * virtualLayout.x;
+    vec2 dy = dFdy(uv) * virtualLayout.x;
+    float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, virtualLayout.y - 1.0);
+
+    vec2 wrapped = fract(uv);
+    int level = int(lod);
+    if (virtualCache.y > 0.0) {
+        int tiles = max(int(virtualLayout.x / virtualLayout.z) >> level, 1);
+        uvec4 entry = texelFetch(pageTableSampler, min(ivec2(wrapped * tiles), tiles - 1), level);
+        return textureLod(virtualSampler, uv, max(lod, float(entry.z)));
+    }
+
+    vec4 color = sampleVirtualLevel(wrapped, level);
+    float blend = lod - float(level);
+    if (blend > 0.0)
+        color = mix(color, sampleVirtualLevel(wrapped, level + 1), blend);
+    return color;
+
+}
+#endif
+#ifdef USE_SHADOWS
+layout (binding = 2) uniform sampler2DArrayShadow shadowSampler;
+
+/*
+ * Get the part of the directional light reaching the fragment. The depth comparisons of the
+ * neighbouring texels in the cascade covering the fragment are averaged, each of them filtered
+ * bilinearly by the hardware.
+ */
+float getShadow() {
+
+    float depth = -(view * vec4(worldVertex, 1)).z;
+    if (depth > cascadeSplits[numCascades - 1])
+        return 1.0;
+
+    int cascade = 0;
+    while (cascade < numCascades - 1 && depth > cascadeSplits[cascade])
+        cascade++;
+
+    vec4 lightPosition = cascadeMatrices[cascade] * vec4(worldVertex, 1);
+    vec3 coord = lightPosition.xyz / lightPosition.w * 0.5 + 0.5;
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowSampler, 0).xy);
+
+    float lit = 0.0;
+    for (int y = 0; y < PCF_SIZE; ++y)
+        for (int x = 0; x < PCF_SIZE; ++x) {
+            vec2 offset = (vec2(x, y) - (PCF_SIZE - 1) * 0.5) * texelSize;
+            lit += texture(shadowSampler, vec4(coord.xy + offset, cascade, coord.z));
+        }
+
+    return lit / (PCF_SIZE * PCF_SIZE);
+
+}
+#endif
 
 void main()
 {
-    color = texture(textureSampler, UV).rgba;
+#if defined(USE_VIRTUAL_TEXTURE)
+    color = sampleVirtualTexture(UV);
+#elif defined(USE_TEXTURE)
+    color = sampleMaterial(UV, diffuseRect, diffuseCell, textureLayers.x);
+#else
+    color = diffuseColor;
+#endif
 
     // Normalize the interpolated normal to ensure unit length
     NN = normalize(N);
-    
-    // Find the unit length normal giving the direction from the vertex to the light
-    L = normalize(lightPos - worldVertex);
 
+#ifdef USE_NORMAL_MAP
+    // Perturb the normal using the normal map. The vertices have no tangents, so the tangent frame
+    // is found from the screen space derivatives of the position and texture coordinates.
+    vec3 dp1 = dFdx(worldVertex);
+    vec3 dp2 = dFdy(worldVertex);
+    vec2 duv1 = dFdx(UV);
+    vec2 duv2 = dFdy(UV);
+    vec3 dp2perp = cross(dp2, NN);
+    vec3 dp1perp = cross(NN, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invmax = inversesqrt(max(dot(T, T), dot(B, B)));
+    NN = normalize(mat3(T * invmax, B * invmax, NN) * (sampleMaterial(UV, normalRect, normalCell, textureLayers.y).xyz * 2.0 - 1.0));
+#endif
+
+#ifdef USE_SPECULAR
     // Find the unit length normal giving the direction from the vertex to the camera
     V = normalize(cameraPos - worldVertex);
+#endif
 
-    // Find the unit length reflection normal
-    R = normalize(reflect(-L, NN));
-    
-    // Calculate the ambient component
-    ambient = vec4(lightAmbient, 1) * color;
+    outputColor = vec4(0.0);
+    for (int l = 0; l < NUM_LIGHTS; ++l) {
+
+        // Find the unit length normal giving the direction from the vertex to the light
+        L = normalize(lights[l].position - worldVertex);
+
+        // Calculate the ambient component
+        ambient = vec4(lights[l].ambient, 1) * color;
+
+        // Calculate the diffuse component
+        diffuse = vec4(max(dot(L, NN), 0.0) * lights[l].diffuse, 1) * color;
 
-    // Calculate the diffuse component
-    diffuse = vec4(max(dot(L, NN), 0.0) * lightDiffuse, 1) * color;
+        outputColor += ambient + diffuse;
 
-    // Calculate the specular component
-    specular = vec4(pow(max(dot(R, V), 0.0), shininess) * lightSpecular, 1) * shininessColor;
+#ifdef USE_SPECULAR
+        // Find the unit length reflection normal
+        R = normalize(reflect(-L, NN));
 
-    // Put it all together
-    outputColor = ambient + diffuse + specular;
+        // Calculate the specular component
+        specular = vec4(pow(max(dot(R, V), 0.0), shininess) * lights[l].specular, 1) * shininessColor;
+
+        outputColor += specular;
+#endif
+
+    }
+
+    // The directional light has no ambient component and is the only one being shadowed
+    float shadow = 1.0;
+#ifdef USE_SHADOWS
+    shadow = getShadow();
+#endif
+    L = lightDirection.xyz;
+    diffuse = vec4(max(dot(L, NN), 0.0) * shadow * lightColor.rgb, 1) * color;
+    outputColor += diffuse;
+
+#ifdef USE_SPECULAR
+    R = normalize(reflect(-L, NN));
+    specular = vec4(pow(max(dot(R, V), 0.0), shininess) * shadow * lightColor.rgb, 1) * shininessColor;
+    outputColor += specular;
+#endif
 
 }
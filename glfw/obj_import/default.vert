@@ -16,10 +16,11 @@ layout (binding = 0, std140) uniform Transform0
     mat4 view;
 };
 
-// model matrix
+// model matrix, and the model matrix combined with the dequantization of the positions
 layout (binding = 1, std140) uniform Transform1
 {
     mat4 model;
+    mat4 positionModel;
 };
 
 // Output
@@ -30,13 +31,16 @@ layout (location = 0) out Block
     vec3 worldVertex;
 };
 
+// Must match depth_only.vert exactly when the depth pre-pass is used
+invariant gl_Position;
+
 void main() {
 
     // Normally gl_Position is in Clip Space and we calculate it by multiplying together all the matrices
-    gl_Position = proj * (view * (model * vec4(position, 1)));
+    gl_Position = proj * (view * (positionModel * vec4(position, 1)));
 
     // Set the world vertex for calculating the light direction in the fragment shader
-    worldVertex = vec3(model * vec4(position, 1));
+    worldVertex = vec3(positionModel * vec4(position, 1));
 
     // Set the transformed normal
     N = mat3(model) * normal;
@@ -0,0 +1,28 @@
+#version 450
+
+// Incoming vertex position, Model Space.
+layout (location = 0) in vec3 position;
+
+// Projection and view matrices.
+layout (binding = 0, std140) uniform Transform0
+{
+    mat4 proj;
+    mat4 view;
+};
+
+// model matrix, and the model matrix combined with the dequantization of the positions
+layout (binding = 1, std140) uniform Transform1
+{
+    mat4 model;
+    mat4 positionModel;
+};
+
+// The depth must match the shading pass exactly for the GL_EQUAL depth test to pass, which
+// requires the same expression in both shaders and the invariant qualifier
+invariant gl_Position;
+
+void main() {
+
+    gl_Position = proj * (view * (positionModel * vec4(position, 1)));
+
+}
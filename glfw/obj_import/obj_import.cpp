@@ -1,8 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <math.h>
 #include <vector>
 #include <string>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -14,45 +21,260 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
+#include "../common/program_builder.h"
+#include "../common/shader_reload.h"
+#include "../common/shader_permutations.h"
+#include "../common/mesh_optimizer.h"
+#include "../common/meshlet_builder.h"
+#include "../common/mesh_simplifier.h"
+#include "../common/asset_io.h"
+#include "../common/vertex_layout.h"
+#include "../common/frame_pacer.h"
+#include "../common/frame_arena.h"
+#include "../common/gpu_memory.h"
+#include "../common/texture_packer.h"
+#include "../common/virtual_texture.h"
+
 #define DEFAULT_WIDTH 1024
 #define DEFAULT_HEIGHT 768
 
+// Projection
+#define FIELD_OF_VIEW (3.14f/2.0f)
+#define Z_NEAR 0.1f
+#define Z_FAR 1000.0f
+
 // Vertex Buffer Identifiers
 #define GLOBAL_MATRICES 0
 #define MODEL_MATRIX 1
 #define LIGHT_PROPERTIES 2
-#define MATERIAL_PROPERTIES 3
-#define CAMERA_PROPERTIES 4
-#define VERTICES 5
+#define CAMERA_PROPERTIES 3
+#define VERTICES 4
+#define CULL_COMMANDS 5
+#define SHADOW_PROPERTIES 6
 
 // Vertex Array attributes
 #define POSITION 0
 #define NORMAL 1
 #define UV 2
 
-// Vertex Array binding points
-#define STREAM0 0
-
 // GLSL Uniform indices
 #define TRANSFORM0 0
 #define TRANSFORM1 1
 #define LIGHT 2
 #define MATERIAL 3
 #define CAMERA 4
+#define SHADOW 5
+#define VIRTUAL_TEXTURE_PARAMETERS 6
+
+// GLSL shader storage indices used by the meshlet culling
+#define MESHLET_STORAGE 0
+#define MESHLET_VERTEX_STORAGE 1
+#define MESHLET_TRIANGLE_STORAGE 2
+#define CULLED_INDEX_STORAGE 3
+#define COMMAND_STORAGE 4
+
+// GLSL uniform locations of the meshlet culling
+#define MESH_INDEX_LOCATION 0
+
+// GLSL uniform locations of the shadow map pass
+#define FIRST_CASCADE_LOCATION 0
+
+// Largest number of work groups dispatched along one dimension
+#define MAX_DISPATCH_GROUPS 65535
+
+// Number of levels of detail of a mesh, including the base mesh
+#define MAX_LODS 6
+
+// Largest error of a level of detail in pixels for it to be selected
+#define LOD_PIXEL_ERROR 1.0f
+
+// Levels keeping more than this part of the triangles of the previous level are dropped
+#define LOD_MIN_REDUCTION 0.9f
+
+// Texture units, the diffuse and normal map textures of every material are layers of one texture
+// array
+#define MATERIAL_TEXTURE 0
+#define SHADOW_TEXTURE 2
+#define VIRTUAL_TILE_TEXTURE 3
+#define PAGE_TABLE_TEXTURE 4
+
+// Cascaded shadow maps of the directional light, the cascades covering the view frustum up to the
+// shadow distance
+#define MAX_CASCADES 4
+#define MIN_CASCADES 2
+#define SHADOW_MAP_SIZE 2048
+#define SHADOW_DISTANCE 300.0f
+
+// Blend between the logarithmic and the uniform split of the shadow distance into cascades
+#define CASCADE_SPLIT_LAMBDA 0.75f
+
+// Depth offset of the shadow casters, against the surfaces shadowing themselves
+#define SHADOW_SLOPE_BIAS 2.0f
+#define SHADOW_CONSTANT_BIAS 4.0f
+
+// Shader permutation features (see default.frag)
+#define FEATURE_TEXTURE 0x1
+#define FEATURE_SPECULAR 0x2
+#define FEATURE_NORMAL_MAP 0x4
+#define FEATURE_NUM_LIGHTS_SHIFT 3
+#define FEATURE_NUM_LIGHTS_BITS 3
+#define FEATURE_SHADOWS 0x40
+#define FEATURE_VIRTUAL_TEXTURE 0x80
+
+// Extension of the pre-tiled file next to a diffuse image, which is then streamed as a virtual
+// texture instead of being decoded (see asset_pack -tile)
+#define VIRTUAL_TEXTURE_EXTENSION ".vtex"
+
+// Number of frames drawn by the layout benchmark for every combination of layout and pass, after
+// the frames warming up
+#define BENCHMARK_FRAMES 300
+#define BENCHMARK_WARMUP_FRAMES 30
+
+// Maximum number of lights in the light buffer
+#define MAX_LIGHTS 4
+
+// Pipeline statistics and timer queries of the shading pass
+#define INVOCATIONS_QUERY 0
+#define TIME_QUERY 1
+#define SHADOW_QUERY 2
+
+// Largest errors accepted for the compact vertex format, in model units, degrees and texture
+// coordinates. Meshes exceeding any of them keep the float format.
+#define MAX_POSITION_ERROR 0.01f
+#define MAX_NORMAL_ERROR 1.0f
+#define MAX_UV_ERROR 0.0005f
+
+// Size of the first block of the arena for the data of a frame, and of the arena for the temporary
+// data of the loading
+#define FRAME_ARENA_SIZE (64 * 1024)
+#define LOAD_ARENA_SIZE (4 * 1024 * 1024)
+
+/*
+ * A structure for storing a level of detail, a range of the index buffer of a mesh
+ */
+typedef struct {
+    GLuint firstIndex;
+    GLsizei numIndices;
+    // Estimated distance from the base mesh, in model units
+    float error;
+} LodLevel;
 
 /*
  * A structure for storing mesh data
  */
 typedef struct {
-    GLuint bufferName;
-    GLuint arrayName;
-    GLuint textureName;
+    // Vertex buffers and arrays of every layout, only the layouts in use are created
+    VertexLayout layouts[NUM_VERTEX_LAYOUTS];
+    // Buffers allocated from the mesh buffer pool
+    GpuBuffer materialBuffer;
+    GpuBuffer indexBuffer;
     GLsizei numVertices;
+    GLsizei numIndices;
+    // Meshlets with their vertices and triangles, and the index buffer written by the culling
+    GpuBuffer meshletBuffer;
+    GpuBuffer meshletVertexBuffer;
+    GpuBuffer meshletTriangleBuffer;
+    GpuBuffer culledIndexBuffer;
+    GLsizei numMeshlets;
+    // Levels of detail sharing the vertex buffer, the first is the base mesh
+    LodLevel lods[MAX_LODS];
+    int numLods;
+    // The level drawn in the current frame
+    int lod;
+    // Bounding sphere in model space (center and radius)
+    GLfloat boundingSphere[4];
+    // The lighting features required by the material of the mesh
+    unsigned int features;
+    // Whether the vertices use the compact format, and the matrix restoring the model space
+    // positions from the quantized ones (identity for the float format)
+    int compact;
+    GLfloat positionMatrix[16];
 } Mesh;
 
+/*
+ * A structure for storing a vertex in the compact format, 16 bytes instead of 32
+ */
+typedef struct {
+    // Position normalized to the bounding box of the mesh, the fourth component is padding
+    GLushort position[4];
+    // Normal in the GL_INT_2_10_10_10_REV format
+    GLuint normal;
+    // Texture coordinates as half floats
+    GLushort uv[2];
+} CompactVertex;
+
+/*
+ * A structure for storing the largest errors introduced by the compact format
+ */
+typedef struct {
+    float position;
+    float normal;
+    float uv;
+} QuantizationError;
+
+/*
+ * A structure for storing the model matrices of a mesh (std140, see default.vert)
+ */
+typedef struct {
+    GLfloat model[16];
+    GLfloat positionModel[16];
+} ModelMatrices;
+
+/*
+ * A structure for storing the directional light and the shadow cascades (std140, see
+ * shadow_depth.vert)
+ */
+typedef struct {
+    // Light projection and view matrix of every cascade
+    GLfloat matrices[MAX_CASCADES][16];
+    // View depth where every cascade ends
+    GLfloat splits[MAX_CASCADES];
+    // Direction towards the light and its color
+    GLfloat direction[4];
+    GLfloat color[4];
+    GLint numCascades;
+    GLint padding[3];
+} ShadowProperties;
+
+/*
+ * A structure for storing the indirect draw command of a mesh followed by the culling statistics
+ * (std430, see meshlet_cull.comp)
+ */
+typedef struct {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+    GLuint visibleMeshlets;
+    GLuint frustumCulled;
+    GLuint coneCulled;
+} CullCommand;
+
+/*
+ * A structure for storing a mesh to shade and the program shading it
+ */
+typedef struct {
+    GLuint program;
+    int mesh;
+} DrawItem;
+
 // A vector of mesh instances
 std::vector<Mesh> meshes;
 
+// Part of the triangles of the base mesh targeted by every level of detail
+float lodRatios[MAX_LODS] = { 1.0f, 0.5f, 0.25f, 0.125f, 0.0625f, 0.03125f };
+
+// Level of detail drawn for every mesh, or -1 to select by distance
+int lodOverride = -1;
+
+// Size of the viewport in pixels, the height is used for the error of the levels of detail
+int viewportWidth = DEFAULT_WIDTH;
+int viewportHeight = DEFAULT_HEIGHT;
+
+// Model matrix of the current frame, shared by every mesh
+glm::mat4 modelMatrix;
+
 // Light properties (4 valued vectors due to std140 see OpenGL 4.5 reference)
 GLfloat lightProperties[] {
     // Position
@@ -62,15 +284,24 @@ GLfloat lightProperties[] {
     // Diffuse Color
     0.7f, 0.5f, 0.5f, 0.0f,
     // Specular Color
-    0.6f, 0.6f, 0.6f, 0.0f
+    0.6f, 0.6f, 0.6f, 0.0f,
+    // Additional lights, only contributing diffuse and specular light
+    -60.0f, 20.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 0.0f,
+    0.2f, 0.2f, 0.4f, 0.0f,
+    0.2f, 0.2f, 0.4f, 0.0f,
+    60.0f, 20.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 0.0f,
+    0.4f, 0.3f, 0.2f, 0.0f,
+    0.4f, 0.3f, 0.2f, 0.0f,
+    0.0f, 60.0f, -60.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 0.0f,
+    0.2f, 0.4f, 0.2f, 0.0f,
+    0.2f, 0.4f, 0.2f, 0.0f
 };
 
-GLfloat materialProperties[] = {
-    // Shininess color
-    1.0f, 1.0f, 1.0f, 1.0f,
-    // Shininess
-    32.0f
-};
+// Number of lights in use
+int numLights = 1;
 
 // Camera properties 
 GLfloat cameraProperties[] {
@@ -78,45 +309,376 @@ GLfloat cameraProperties[] {
     0.0f, 0.0f, 80.0f
 };
 
+// Directional light casting the shadows, the direction pointing towards the light
+GLfloat shadowLightDirection[] = { 0.4f, 0.8f, 0.45f };
+GLfloat shadowLightColor[] = { 0.35f, 0.35f, 0.3f };
+
+// Whether the shadows are drawn, and the number of cascades
+int shadows = 1;
+int numCascades = 3;
+
+// Rotation into light space, and the center and radius of every cascade in light space
+glm::mat4 shadowLightView;
+glm::vec4 cascadeBounds[MAX_CASCADES];
+
+// Whether all the cascades are drawn in one instanced draw, selecting the layer in the vertex
+// shader (GL_ARB_shader_viewport_layer_array)
+int layeredShadows = 0;
+
 // Pointers for updating GPU data
 GLfloat *projectionMatrixPtr;
 GLfloat *viewMatrixPtr;
-GLfloat *modelMatrixPtr;
+GLubyte *modelMatricesPtr;
+ShadowProperties *shadowPropertiesPtr;
+
+// Distance between the model matrices of the meshes, respecting the uniform buffer alignment
+GLint modelMatrixStride;
+
+// Whether loadObj may use the compact vertex format
+int compactVertices = 1;
+
+// Vertex layouts used by the depth pre-pass and the shading pass, and whether the layout benchmark
+// is run instead of the interactive loop
+int depthLayout = VERTEX_LAYOUT_SPLIT;
+int shadingLayout = VERTEX_LAYOUT_INTERLEAVED;
+int layoutBenchmark = 0;
 
 // Names
 GLuint programName;
-GLuint vertexBufferNames[5];
+GLuint depthProgramName;
+GLuint cullProgramName;
+GLuint shadowProgramName;
+GLuint feedbackProgramName;
+GLuint vertexBufferNames[7];
+GLuint queryNames[2][3];
+// Depth texture array with a layer per cascade, and the framebuffers with all the layers attached
+// followed by the ones with a single layer
+GLuint shadowTextureName;
+GLuint shadowFramebufferNames[MAX_CASCADES + 1];
+
+// Whether the depth pre-pass is used, and whether pipeline statistics can be queried
+int depthPrePass = 0;
+int pipelineStatistics = 0;
+
+// Whether the meshes are drawn from the index buffers written by the meshlet culling
+int meshletCulling = 1;
+
+// Shading pass statistics accumulated since last printed
+int frameCount;
+double fragmentInvocations, shadingTime, statisticsTime;
+double shadowTime, shadowCasters[MAX_CASCADES];
+
+// Reloader rebuilding the program when the shader sources change
+ShaderReloader shaderReloader;
+
+// Pacer of the main loop
+FramePacer framePacer;
+
+// Memory of the buffers and textures on the GPU, kept within the budget given in MiB, and the pool
+// the buffers of the meshes are allocated from
+GpuMemory gpuMemory;
+int gpuBudget = 0;
+int meshBufferPool;
+
+// Texture array holding the image files of every material, the handle being -1 if there are none,
+// and where every image file is placed in it
+int materialTexture = -1;
+std::vector<std::string> materialImageFiles;
+std::vector<TexturePlacement> materialPlacements;
+int materialLayerWidth, materialLayerHeight;
+
+// Virtual texture streaming the diffuse image of the materials that has a pre-tiled file, empty if
+// none has
+VirtualTexture virtualTexture;
+std::string virtualImageFile;
+
+// Arena for the data of a frame, reset at the end of every frame, and the arena for the temporary
+// data of the loading, reset for every shape and freed when the loading is done
+MemoryArena frameArena;
+MemoryArena loadArena;
+
+// Permutations of the program specialized for the materials
+PermutationSet permutations;
+
+// Builder for compiling the shader programs in parallel with the loading
+ProgramBuilder programBuilder;
+int programIndex;
+int depthProgramIndex;
+int cullProgramIndex;
+int shadowProgramIndex;
+int feedbackProgramIndex;
 
 /*
- * Read shader source file from disk
+ * Copy an image into its cell in level 0 of the material texture array, the rest of the cell
+ * repeating the image
  */
-char *readSourceFile(const char *filename, int *size) {
+void uploadMaterialImage(GLuint textureName, const GLubyte *imageData, const TexturePlacement *placement) {
 
-    // Open the file as read only
-    FILE *file = fopen(filename, "r");
+    if (placement->cellWidth == placement->width && placement->cellHeight == placement->height) {
+        glTextureSubImage3D(textureName, 0, placement->x, placement->y, placement->layer, placement->width, placement->height, 1, GL_RGBA,
+                GL_UNSIGNED_BYTE, imageData);
+        return;
+    }
 
-    // Find the end of the file to determine the file size
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
+    std::vector<GLubyte> cell((size_t)placement->cellWidth * placement->cellHeight * 4);
+    fillTextureCell(imageData, placement, 4, cell.data());
+    glTextureSubImage3D(textureName, 0, placement->cellX, placement->cellY, placement->layer, placement->cellWidth, placement->cellHeight, 1,
+            GL_RGBA, GL_UNSIGNED_BYTE, cell.data());
 
-    // Rewind
-    fseek(file, 0, SEEK_SET); 
+}
 
-    // Allocate memory for the source and initialize it to 0
-    char *source = (char *)malloc(fileSize + 1);
-    for (int i = 0; i <= fileSize; i++) source[i] = 0;
+/*
+ * Read the material texture array back from the image files after it was reduced to stay within
+ * the GPU memory budget. Returns FALSE if an image could not be read.
+ */
+int readMaterialImages(const char *source, GLuint textureName, void *data) {
 
-    // Read the source
-    fread(source, fileSize, 1, file);
+    for (int i=0; i<(int)materialImageFiles.size(); ++i) {
+        int width, height, channels;
+        GLubyte *imageData = loadImageAsset(materialImageFiles[i].c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!imageData)
+            return 0;
+        uploadMaterialImage(textureName, imageData, &materialPlacements[i]);
+        stbi_image_free(imageData);
+    }
+    glGenerateTextureMipmap(textureName);
 
-    // Close the file
-    fclose(file);
+    return 1;
 
-    // Store the size of the file in the output variable
-    *size = fileSize-1;
+}
+
+/*
+ * Get the index of an image file of the materials, -1 if there is none
+ */
+int getMaterialImage(const std::string &filename) {
+
+    for (int i=0; i<(int)materialImageFiles.size(); ++i)
+        if (materialImageFiles[i] == filename)
+            return i;
+    return -1;
+
+}
+
+/*
+ * Open the pre-tiled file of the first diffuse image of the given materials that has one as the
+ * virtual texture. Only one image is streamed, the others being loaded whole. Returns FALSE if the
+ * file could not be read.
+ */
+int loadVirtualTexture(const std::vector<tinyobj::material_t> &materials) {
+
+    for (int m=0; m<(int)materials.size(); ++m) {
+
+        const std::string &filename = materials[m].diffuse_texname;
+        if (filename.empty() || filename == virtualImageFile)
+            continue;
+        std::string tiledFilename = filename + VIRTUAL_TEXTURE_EXTENSION;
+        FILE *file = fopen(tiledFilename.c_str(), "rb");
+        if (!file)
+            continue;
+        fclose(file);
+
+        if (!virtualImageFile.empty()) {
+            printf("Only one virtual texture is supported, %s is loaded whole\n", filename.c_str());
+            continue;
+        }
+        if (!initVirtualTexture(&virtualTexture, tiledFilename.c_str(), DEFAULT_WIDTH, DEFAULT_HEIGHT))
+            return 0;
+        virtualImageFile = filename;
+        trackGpuTexture(&gpuMemory, virtualTexture.textureName, getVirtualTextureBytes(&virtualTexture));
+
+    }
+
+    return 1;
+
+}
+
+/*
+ * Load the diffuse and normal map images of the given materials into a single texture array. Images
+ * of the size of the layers get a layer of their own, smaller images are packed into atlas layers.
+ * The images are decoded one at a time once they are placed. Returns FALSE if an image could not be
+ * loaded.
+ */
+int loadMaterialTextures(const std::vector<tinyobj::material_t> &materials) {
+
+    // Find every image file used, the images shared by several materials once and the virtual
+    // texture not at all
+    for (int m=0; m<(int)materials.size(); ++m) {
+        const std::string *filenames[] = { &materials[m].diffuse_texname, &materials[m].bump_texname };
+        for (int f=0; f<2; ++f)
+            if (!filenames[f]->empty() && *filenames[f] != virtualImageFile && getMaterialImage(*filenames[f]) < 0)
+                materialImageFiles.push_back(*filenames[f]);
+    }
+    if (materialImageFiles.empty())
+        return 1;
+
+    // Read the size of every image from its header to place them
+    int numImages = (int)materialImageFiles.size();
+    std::vector<int> widths(numImages), heights(numImages);
+    for (int i=0; i<numImages; ++i) {
+        int channels;
+        if (!getImageAssetInfo(materialImageFiles[i].c_str(), &widths[i], &heights[i], &channels)) {
+            printf("ERROR Could not load the image file %s\n", materialImageFiles[i].c_str());
+            return 0;
+        }
+    }
+
+    // Place the images in the layers
+    getTextureLayerSize(widths, heights, &materialLayerWidth, &materialLayerHeight);
+    int numLayers = packTextures(widths, heights, materialLayerWidth, materialLayerHeight, &materialPlacements);
 
-    // Return the shader source
-    return source;
+    // Create the texture array with room for every mip map level, the memory being counted against
+    // the budget, and fill it with the images decoded as RGBA
+    materialTexture = createGpuTexture(&gpuMemory, "materials", materialLayerWidth, materialLayerHeight, GL_RGBA8, numLayers);
+    GLuint textureName = getGpuTexture(&gpuMemory, materialTexture);
+    for (int i=0; i<numImages; ++i) {
+        int width, height, channels;
+        GLubyte *imageData = loadImageAsset(materialImageFiles[i].c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!imageData || width != widths[i] || height != heights[i]) {
+            printf("ERROR Could not load the image file %s\n", materialImageFiles[i].c_str());
+            stbi_image_free(imageData);
+            return 0;
+        }
+        uploadMaterialImage(textureName, imageData, &materialPlacements[i]);
+        stbi_image_free(imageData);
+    }
+    glGenerateTextureMipmap(textureName);
+
+    printf("Material textures: %d images in %d layers of %dx%d\n", numImages, numLayers, materialLayerWidth, materialLayerHeight);
+
+    return 1;
+
+}
+
+/*
+ * Get the rectangle of an image file and of its cell in its layer, as the offset and scale of the
+ * texture coordinates, together with the layer
+ */
+void getMaterialImageRect(const std::string &filename, GLfloat *rect, GLfloat *cell, GLfloat *layer) {
+
+    int i = getMaterialImage(filename);
+    if (i < 0) {
+        rect[0] = rect[1] = cell[0] = cell[1] = 0.0f;
+        rect[2] = rect[3] = cell[2] = cell[3] = 1.0f;
+        *layer = 0.0f;
+        return;
+    }
+
+    const TexturePlacement *placement = &materialPlacements[i];
+    rect[0] = (GLfloat)placement->x / materialLayerWidth;
+    rect[1] = (GLfloat)placement->y / materialLayerHeight;
+    rect[2] = (GLfloat)placement->width / materialLayerWidth;
+    rect[3] = (GLfloat)placement->height / materialLayerHeight;
+    cell[0] = (GLfloat)placement->cellX / materialLayerWidth;
+    cell[1] = (GLfloat)placement->cellY / materialLayerHeight;
+    cell[2] = (GLfloat)placement->cellWidth / materialLayerWidth;
+    cell[3] = (GLfloat)placement->cellHeight / materialLayerHeight;
+    *layer = (GLfloat)placement->layer;
+
+}
+
+/*
+ * Convert interleaved float vertices (POSITION NORMAL UV) to the compact format. The positions are
+ * quantized to 16 bits within the bounding box of the mesh, and the returned position matrix maps
+ * the normalized positions back to model space. Every vertex is decoded again the way the GPU does
+ * it to find the largest errors. Returns TRUE if the errors are within the bounds.
+ */
+int quantizeMesh(const std::vector<GLfloat> &vertices, ArenaVector<CompactVertex> &compactData, glm::mat4 *positionMatrix, QuantizationError *error) {
+
+    int numVertices = vertices.size() / 8;
+
+    // Find the bounding box of the positions
+    glm::vec3 boxMin(1e30f), boxMax(-1e30f);
+    for (int v=0; v<numVertices; ++v) {
+        boxMin = glm::min(boxMin, glm::vec3(vertices[v*8], vertices[v*8+1], vertices[v*8+2]));
+        boxMax = glm::max(boxMax, glm::vec3(vertices[v*8], vertices[v*8+1], vertices[v*8+2]));
+    }
+    glm::vec3 extent = boxMax - boxMin;
+    for (int c=0; c<3; ++c)
+        if (extent[c] <= 0.0f)
+            extent[c] = 1.0f;
+
+    // The normalized positions are scaled by the extent and offset by the minimum of the box
+    *positionMatrix = glm::scale(glm::translate(glm::mat4(1.0f), boxMin), extent);
+
+    compactData.resize(numVertices);
+    error->position = error->normal = error->uv = 0.0f;
+    for (int v=0; v<numVertices; ++v) {
+
+        const GLfloat *vertex = &vertices[v*8];
+        CompactVertex *compact = &compactData[v];
+
+        for (int c=0; c<3; ++c) {
+            compact->position[c] = (GLushort)lroundf((vertex[c] - boxMin[c]) / extent[c] * 65535.0f);
+            float position = boxMin[c] + compact->position[c] / 65535.0f * extent[c];
+            error->position = fmaxf(error->position, fabsf(position - vertex[c]));
+        }
+        compact->position[3] = 0;
+
+        glm::vec3 normal = glm::normalize(glm::vec3(vertex[3], vertex[4], vertex[5]));
+        compact->normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+        glm::vec3 decodedNormal = glm::normalize(glm::vec3(glm::unpackSnorm3x10_1x2(compact->normal)));
+        float angle = acosf(fminf(glm::dot(normal, decodedNormal), 1.0f)) * 180.0f / 3.14159265f;
+        error->normal = fmaxf(error->normal, angle);
+
+        for (int c=0; c<2; ++c) {
+            compact->uv[c] = glm::packHalf1x16(vertex[6+c]);
+            error->uv = fmaxf(error->uv, fabsf(glm::unpackHalf1x16(compact->uv[c]) - vertex[6+c]));
+        }
+
+    }
+
+    return error->position <= MAX_POSITION_ERROR && error->normal <= MAX_NORMAL_ERROR && error->uv <= MAX_UV_ERROR;
+
+}
+
+/*
+ * Calculate a bounding sphere of interleaved float vertices, centered in the bounding box
+ */
+void getBoundingSphere(const std::vector<GLfloat> &vertices, int stride, GLfloat *sphere) {
+
+    glm::vec3 boxMin = glm::vec3(INFINITY), boxMax = glm::vec3(-INFINITY);
+    for (size_t v=0; v<vertices.size(); v+=stride) {
+        boxMin = glm::min(boxMin, glm::make_vec3(&vertices[v]));
+        boxMax = glm::max(boxMax, glm::make_vec3(&vertices[v]));
+    }
+    glm::vec3 center = (boxMin + boxMax) * 0.5f;
+
+    float radius = 0.0f;
+    for (size_t v=0; v<vertices.size(); v+=stride)
+        radius = std::max(radius, glm::length(glm::make_vec3(&vertices[v]) - center));
+
+    sphere[0] = center.x;
+    sphere[1] = center.y;
+    sphere[2] = center.z;
+    sphere[3] = radius;
+
+}
+
+/*
+ * Simplify every shape to the levels of detail targeted by lodRatios. The shapes are distributed
+ * over a thread per processor core, each taking the next shape that has not been started.
+ */
+void simplifyShapes(const std::vector<std::vector<GLfloat> > &shapeVertices, const std::vector<std::vector<GLuint> > &shapeIndices,
+        std::vector<std::vector<std::vector<GLuint> > > &shapeLevels, std::vector<std::vector<float> > &shapeErrors) {
+
+    shapeLevels.resize(shapeIndices.size());
+    shapeErrors.resize(shapeIndices.size());
+
+    std::atomic<int> nextShape(0);
+    int numThreads = std::max(1, std::min((int)std::thread::hardware_concurrency(), (int)shapeIndices.size()));
+    std::vector<std::thread> threads;
+    for (int t=0; t<numThreads; ++t)
+        threads.push_back(std::thread([&]() {
+            for (int s = nextShape++; s < (int)shapeIndices.size(); s = nextShape++) {
+                std::vector<size_t> targets;
+                for (int l=1; l<MAX_LODS; ++l)
+                    targets.push_back((size_t)(shapeIndices[s].size() / 3 * lodRatios[l]) * 3);
+                simplifyMesh(shapeIndices[s], shapeVertices[s], 8, targets, shapeLevels[s], shapeErrors[s]);
+            }
+        }));
+
+    for (int t=0; t<numThreads; ++t)
+        threads[t].join();
 
 }
 
@@ -136,12 +698,30 @@ int loadObj(const char *filename) {
     std::string errorString;
 
     // Load the file, or return FALSE if an error occured
-    if (!tinyobj::LoadObj(&attributes, &shapes, &materials, &errorString, filename, "."))
+    if (!loadObjAsset(&attributes, &shapes, &materials, &errorString, filename, "."))
+        return 0;
+
+    // The image with a pre-tiled file is streamed, the images of all the materials go into one
+    // texture array
+    if (!loadVirtualTexture(materials) || !loadMaterialTextures(materials))
         return 0;
 
+    // The temporary data of the shapes is freed when the loading is done
+    ArenaScope loadScope(&loadArena);
+
+    // Total size of the vertex data, and the size it would have had as floats
+    size_t vertexBytes = 0, floatBytes = 0;
+
+    // The vertices and indices of every shape are kept until the levels of detail have been built
+    std::vector<std::vector<GLfloat> > shapeVertices(shapes.size());
+    std::vector<std::vector<GLuint> > shapeIndices(shapes.size());
+
     // Loop through all the shapes in the OBJ-data
     for(int m=0; m<shapes.size(); ++m) {
 
+        // The temporary data of the previous shape is no longer needed, its memory is reused
+        resetMemoryArena(&loadArena);
+
         // Create a new Mesh instance and store a local ponter for easy access
         meshes.push_back(Mesh());
         Mesh *mesh = &meshes[meshes.size()-1];
@@ -149,109 +729,209 @@ int loadObj(const char *filename) {
         // Store a pointer to the mesh of the current shape
         tinyobj::mesh_t *objMesh = &shapes[m].mesh;
 
-        // Get the texture of the first face in the mesh. This is used for the entire mesh.
-        std::string texture_filename = materials[objMesh->material_ids[0]].diffuse_texname;
-
-        // Read the texture image
-        int width, height, channels;
-        GLubyte *imageData = stbi_load(texture_filename.c_str(), &width, &height, &channels, STBI_default);
-        if (!imageData)
-            return 0;
-
-        // Generate a new texture name and activate it
-        glGenTextures(1, &mesh->textureName);
-        glBindTexture(GL_TEXTURE_2D, mesh->textureName);
-
-        // Set sampler properties
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData);
+        // Get the material of the first face in the mesh. This is used for the entire mesh.
+        tinyobj::material_t material = tinyobj::material_t();
+        if (objMesh->material_ids[0] >= 0)
+            material = materials[objMesh->material_ids[0]];
         else
-            return 0; 
-
-        // Generate mip map images
-        glGenerateMipmap(GL_TEXTURE_2D);
+            material.diffuse[0] = material.diffuse[1] = material.diffuse[2] = 0.6f;
+
+        // Determine the lighting features the material requires
+        mesh->features = 0;
+        if (!material.diffuse_texname.empty())
+            mesh->features |= material.diffuse_texname == virtualImageFile ? FEATURE_VIRTUAL_TEXTURE : FEATURE_TEXTURE;
+        if (!material.bump_texname.empty())
+            mesh->features |= FEATURE_NORMAL_MAP;
+
+        // Illumination models below 2 have no highlights (see the MTL specification)
+        if (material.illum >= 2 && material.specular[0] + material.specular[1] + material.specular[2] > 0.0f)
+            mesh->features |= FEATURE_SPECULAR;
+
+        // Material properties (4 valued vectors due to std140 see OpenGL 4.5 reference)
+        GLfloat materialProperties[] = {
+            // Shininess color
+            material.specular[0], material.specular[1], material.specular[2], 1.0f,
+            // Shininess
+            material.shininess, 0.0f, 0.0f, 0.0f,
+            // Diffuse color, used when there is no texture
+            material.diffuse[0], material.diffuse[1], material.diffuse[2], 1.0f,
+            // Rectangles of the diffuse and normal map images and of their cells in their layers
+            0.0f, 0.0f, 1.0f, 1.0f,
+            0.0f, 0.0f, 1.0f, 1.0f,
+            0.0f, 0.0f, 1.0f, 1.0f,
+            0.0f, 0.0f, 1.0f, 1.0f,
+            // Layers of the images
+            0.0f, 0.0f, 0.0f, 0.0f
+        };
+        getMaterialImageRect(material.diffuse_texname, &materialProperties[12], &materialProperties[20], &materialProperties[28]);
+        getMaterialImageRect(material.bump_texname, &materialProperties[16], &materialProperties[24], &materialProperties[29]);
+        if (!allocateGpuBuffer(&gpuMemory, meshBufferPool, sizeof(materialProperties), materialProperties, &mesh->materialBuffer))
+            return 0;
 
-        // Deactivate the texture and free the image data
-        glBindTexture(GL_TEXTURE_2D, 0);
-        stbi_image_free(imageData);
+        // The unique vertices and the indices of the triangles
+        std::vector<GLfloat> &vertices = shapeVertices[m];
+        std::vector<GLuint> &indices = shapeIndices[m];
+        indices.reserve(objMesh->indices.size());
+
+        // OBJ-faces index positions, normals and texture coordinates separately, so a vertex is
+        // identified by the combination of the three. Equal combinations share a vertex. The map
+        // and the vertices are built in the load arena, and the vertices copied to the mesh once
+        // their number is known. The room reserved is a vertex per position, as a vertex per index
+        // would be several times the number of unique vertices, every vertex being shared by
+        // several triangles.
+        typedef std::tuple<int, int, int> VertexKey;
+        typedef std::map<VertexKey, GLuint, std::less<VertexKey>, ArenaAllocator<std::pair<const VertexKey, GLuint> > > VertexMap;
+        ArenaAllocator<GLfloat> shapeAllocator(&loadArena);
+        VertexMap vertexIndices(std::less<VertexKey>(), shapeAllocator);
+        ArenaVector<GLfloat> uniqueVertices(shapeAllocator);
+        uniqueVertices.reserve(std::min(objMesh->indices.size(), attributes.vertices.size() / 3) * 8);
+        for (int i=0; i<objMesh->indices.size(); ++i) {
+
+            tinyobj::index_t idx = objMesh->indices[i];
+            VertexKey key(idx.vertex_index, idx.normal_index, idx.texcoord_index);
+            VertexMap::iterator entry = vertexIndices.find(key);
+            if (entry != vertexIndices.end()) {
+                indices.push_back(entry->second);
+                continue;
+            }
+
+            // Store the new vertex (POSITION NORMAL UV)
+            GLuint index = uniqueVertices.size() / 8;
+            vertexIndices[key] = index;
+            indices.push_back(index);
+            uniqueVertices.push_back(attributes.vertices[idx.vertex_index*3]);
+            uniqueVertices.push_back(attributes.vertices[idx.vertex_index*3+1]);
+            uniqueVertices.push_back(attributes.vertices[idx.vertex_index*3+2]);
+            uniqueVertices.push_back(attributes.normals[idx.normal_index*3]);
+            uniqueVertices.push_back(attributes.normals[idx.normal_index*3+1]);
+            uniqueVertices.push_back(attributes.normals[idx.normal_index*3+2]);
+            uniqueVertices.push_back(attributes.texcoords[idx.texcoord_index*2]);
+            uniqueVertices.push_back(1.0f - attributes.texcoords[idx.texcoord_index*2+1]);
 
-        // Store the number of uique vertices and faces in the mesh
-        int numVertices = mesh->numVertices = objMesh->indices.size();
-        int numFaces = numVertices / 3;
-
-        // Create a vector for storing the vector data
-        std::vector<GLfloat> vertices; 
-
-        // Loop through all the faces in the mesh
-        for (int f=0; f<numFaces; ++f) {
-
-            // Store the indices of the current triangle
-            tinyobj::index_t idx1 = objMesh->indices[f * 3];
-            tinyobj::index_t idx2 = objMesh->indices[f * 3 + 1];
-            tinyobj::index_t idx3 = objMesh->indices[f * 3 + 2];
-
-            // Store the first vertex (POSITION NORMAL UV)
-            vertices.push_back(attributes.vertices[idx1.vertex_index*3]);
-            vertices.push_back(attributes.vertices[idx1.vertex_index*3+1]);
-            vertices.push_back(attributes.vertices[idx1.vertex_index*3+2]);
-            vertices.push_back(attributes.normals[idx1.normal_index*3]);
-            vertices.push_back(attributes.normals[idx1.normal_index*3+1]);
-            vertices.push_back(attributes.normals[idx1.normal_index*3+2]);
-            vertices.push_back(attributes.texcoords[idx1.texcoord_index*2]);
-            vertices.push_back(1.0f - attributes.texcoords[idx1.texcoord_index*2+1]);
-            // Store the second vertex
-            vertices.push_back(attributes.vertices[idx2.vertex_index*3]);
-            vertices.push_back(attributes.vertices[idx2.vertex_index*3+1]);
-            vertices.push_back(attributes.vertices[idx2.vertex_index*3+2]);
-            vertices.push_back(attributes.normals[idx2.normal_index*3]);
-            vertices.push_back(attributes.normals[idx2.normal_index*3+1]);
-            vertices.push_back(attributes.normals[idx2.normal_index*3+2]);
-            vertices.push_back(attributes.texcoords[idx2.texcoord_index*2]);
-            vertices.push_back(1.0f - attributes.texcoords[idx2.texcoord_index*2+1]);
-            // Store the third vertex
-            vertices.push_back(attributes.vertices[idx3.vertex_index*3]);
-            vertices.push_back(attributes.vertices[idx3.vertex_index*3+1]);
-            vertices.push_back(attributes.vertices[idx3.vertex_index*3+2]);
-            vertices.push_back(attributes.normals[idx3.normal_index*3]);
-            vertices.push_back(attributes.normals[idx3.normal_index*3+1]);
-            vertices.push_back(attributes.normals[idx3.normal_index*3+2]);
-            vertices.push_back(attributes.texcoords[idx3.texcoord_index*2]);
-            vertices.push_back(1.0f - attributes.texcoords[idx3.texcoord_index*2+1]);
+        }
+        vertices.assign(uniqueVertices.begin(), uniqueVertices.end());
+
+        // Reorder the triangles for the post-transform cache and overdraw, then the vertices for
+        // linear fetching
+        VertexCacheStatistics before = analyzeVertexCache(indices, vertices.size() / 8);
+        std::vector<int> clusters;
+        optimizeVertexCache(indices, vertices.size() / 8, clusters);
+        optimizeOverdraw(indices, vertices, 8, clusters);
+        optimizeVertexFetch(indices, vertices, 8);
+        VertexCacheStatistics after = analyzeVertexCache(indices, vertices.size() / 8);
+        printf("Mesh %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%d clusters)\n", shapes[m].name.c_str(), before.acmr, after.acmr,
+                before.atvr, after.atvr, (int)clusters.size());
+
+        // Split the mesh into meshlets that are culled individually
+        std::vector<Meshlet> meshlets;
+        std::vector<GLuint> meshletVertices, meshletTriangles;
+        buildMeshlets(indices, vertices, 8, meshlets, meshletVertices, meshletTriangles);
+        mesh->numMeshlets = meshlets.size();
+        printf("Mesh %s: %d meshlets, %.1f vertices and %.1f triangles on average\n", shapes[m].name.c_str(), mesh->numMeshlets,
+                (float)meshletVertices.size() / std::max(mesh->numMeshlets, 1), (float)meshletTriangles.size() / std::max(mesh->numMeshlets, 1));
+
+        // Store the number of unique vertices and indices in the mesh
+        int numVertices = mesh->numVertices = vertices.size() / 8;
+        mesh->numIndices = indices.size();
+        getBoundingSphere(vertices, 8, mesh->boundingSphere);
+
+        // Use the compact vertex format if the quantization errors are within bounds
+        ArenaVector<CompactVertex> compactData(shapeAllocator);
+        glm::mat4 positionMatrix = glm::mat4(1.0f);
+        QuantizationError error = { 0.0f, 0.0f, 0.0f };
+        mesh->compact = compactVertices && quantizeMesh(vertices, compactData, &positionMatrix, &error);
+        memcpy(mesh->positionMatrix, &positionMatrix[0][0], 16 * sizeof(GLfloat));
+        printf("Mesh %s: %d vertices, %s format, max error position %.5f, normal %.3f degrees, uv %.6f\n", shapes[m].name.c_str(),
+                numVertices, mesh->compact ? "compact" : "float", error.position, error.normal, error.uv);
+
+        // The vertex data and layout of the selected format
+        const GLubyte *vertexData = mesh->compact ? (const GLubyte *)&compactData[0] : (const GLubyte *)&vertices[0];
+        GLsizei vertexStride = mesh->compact ? sizeof(CompactVertex) : 8 * sizeof(GLfloat);
+        floatBytes += numVertices * 8 * sizeof(GLfloat);
+        vertexBytes += numVertices * vertexStride;
+
+        // Describe the vertex of the selected format (POSITION NORMAL UV). The compact positions and
+        // normals are normalized integers, so the shader receives floats in either case.
+        VertexFormat format;
+        initVertexFormat(&format, vertexStride);
+        if (mesh->compact) {
+            addVertexAttribute(&format, POSITION, 4, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(CompactVertex, position));
+            addVertexAttribute(&format, NORMAL, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(CompactVertex, normal));
+            addVertexAttribute(&format, UV, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(CompactVertex, uv));
+        } else {
+            addVertexAttribute(&format, POSITION, 3, GL_FLOAT, GL_FALSE, 0);
+            addVertexAttribute(&format, NORMAL, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat));
+            addVertexAttribute(&format, UV, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat));
+        }
 
+        // Create the vertex buffers and arrays of the layouts used by the passes, or of every
+        // layout for the benchmark. Their buffers are counted by the GPU memory.
+        for (int l=0; l<NUM_VERTEX_LAYOUTS; ++l) {
+            memset(&mesh->layouts[l], 0, sizeof(VertexLayout));
+            if (layoutBenchmark || l == depthLayout || l == shadingLayout) {
+                createVertexLayout(&mesh->layouts[l], l, &format, vertexData, numVertices);
+                for (int s=0; s<mesh->layouts[l].numStreams; ++s)
+                    trackGpuBuffer(&gpuMemory, mesh->layouts[l].bufferNames[s]);
+            }
         }
 
-        // Create a vertex buffer with the vertex data
-        glCreateBuffers(1, &mesh->bufferName);
-        glNamedBufferStorage(mesh->bufferName, vertices.size() * sizeof(GLfloat), &vertices[0], 0);
+        // Allocate the meshlet buffers read by the culling, and the index buffer it writes with
+        // room for every triangle
+        if (!allocateGpuBuffer(&gpuMemory, meshBufferPool, meshlets.size() * sizeof(Meshlet), &meshlets[0], &mesh->meshletBuffer) ||
+                !allocateGpuBuffer(&gpuMemory, meshBufferPool, meshletVertices.size() * sizeof(GLuint), &meshletVertices[0], &mesh->meshletVertexBuffer) ||
+                !allocateGpuBuffer(&gpuMemory, meshBufferPool, meshletTriangles.size() * sizeof(GLuint), &meshletTriangles[0], &mesh->meshletTriangleBuffer) ||
+                !allocateGpuBuffer(&gpuMemory, meshBufferPool, indices.size() * sizeof(GLuint), NULL, &mesh->culledIndexBuffer))
+            return 0;
 
-        // Create and initialize a vertex array object
-        glCreateVertexArrays(1, &mesh->arrayName);
+    }
 
-        // Associate vertex attributes with the binding point (POSITION NORMAL UV)
-        glVertexArrayAttribBinding(mesh->arrayName, POSITION, STREAM0);
-        glVertexArrayAttribBinding(mesh->arrayName, NORMAL, STREAM0);
-        glVertexArrayAttribBinding(mesh->arrayName, UV, STREAM0);
-        // Enable the attributes
-        glEnableVertexArrayAttrib(mesh->arrayName, POSITION);
-        glEnableVertexArrayAttrib(mesh->arrayName, NORMAL);
-        glEnableVertexArrayAttrib(mesh->arrayName, UV);
+    // Build the levels of detail of all shapes
+    double simplifyTime = glfwGetTime();
+    std::vector<std::vector<std::vector<GLuint> > > shapeLevels;
+    std::vector<std::vector<float> > shapeErrors;
+    simplifyShapes(shapeVertices, shapeIndices, shapeLevels, shapeErrors);
+    printf("Simplified %d shapes in %.1f ms\n", (int)shapes.size(), (glfwGetTime() - simplifyTime) * 1000.0);
+
+    // Store the levels after the base mesh in the index buffer of every mesh
+    for (int m=0; m<shapes.size(); ++m) {
+
+        Mesh *mesh = &meshes[meshes.size() - shapes.size() + m];
+        std::vector<GLuint> &indices = shapeIndices[m];
+        mesh->numLods = 1;
+        mesh->lod = 0;
+        mesh->lods[0].firstIndex = 0;
+        mesh->lods[0].numIndices = indices.size();
+        mesh->lods[0].error = 0.0f;
+
+        // The error is reported relative to the size of the mesh as well
+        for (int l=0; l<shapeLevels[m].size(); ++l) {
+
+            const std::vector<GLuint> &level = shapeLevels[m][l];
+            if (level.empty() || level.size() > mesh->lods[mesh->numLods-1].numIndices * LOD_MIN_REDUCTION)
+                continue;
+
+            LodLevel *lod = &mesh->lods[mesh->numLods++];
+            lod->firstIndex = indices.size();
+            lod->numIndices = level.size();
+            lod->error = shapeErrors[m][l];
+            indices.insert(indices.end(), level.begin(), level.end());
 
-        // Specify the format of the attributes
-        glVertexArrayAttribFormat(mesh->arrayName, POSITION, 3, GL_FLOAT, GL_FALSE, 0);
-        glVertexArrayAttribFormat(mesh->arrayName, NORMAL, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GL_FLOAT));
-        glVertexArrayAttribFormat(mesh->arrayName, UV, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GL_FLOAT));
+        }
+        for (int l=0; l<mesh->numLods; ++l)
+            printf("Mesh %s LOD %d: %d triangles (%.1f%%), error %.4f (%.3f%% of the radius)\n", shapes[m].name.c_str(), l,
+                    mesh->lods[l].numIndices / 3, 100.0f * mesh->lods[l].numIndices / mesh->lods[0].numIndices, mesh->lods[l].error,
+                    100.0f * mesh->lods[l].error / mesh->boundingSphere[3]);
 
-        // Bind the vertex data buffer to the vertex array
-        glVertexArrayVertexBuffer(mesh->arrayName, STREAM0, mesh->bufferName, 0, 8 * sizeof(GLfloat));
+        // Allocate an index buffer used by both vertex arrays
+        if (!allocateGpuBuffer(&gpuMemory, meshBufferPool, indices.size() * sizeof(GLuint), &indices[0], &mesh->indexBuffer))
+            return 0;
 
     }
 
+    printf("Vertex memory: %.2f MiB (%.2f MiB as floats, %.2fx smaller)\n", vertexBytes / 1048576.0, floatBytes / 1048576.0,
+            (double)floatBytes / vertexBytes);
+    printArenaStatistics("Load", &loadArena);
+
     return 1;
 
 }
@@ -263,6 +943,64 @@ void glDebugCallback(GLenum sources, GLenum type, GLuint id, GLenum severity, GL
     printf("DEBUG: %s\n", msg);
 }
 
+/*
+ * Create the shadow map array, the framebuffers for drawing into it and the buffer holding the
+ * cascades. Returns FALSE if the framebuffers are incomplete.
+ */
+int initShadows() {
+
+    // The depth is compared to the reference by the sampler, and the results of the four nearest
+    // texels filtered bilinearly
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &shadowTextureName);
+    glTextureStorage3D(shadowTextureName, 1, GL_DEPTH_COMPONENT32F, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, MAX_CASCADES);
+    glTextureParameteri(shadowTextureName, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(shadowTextureName, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(shadowTextureName, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(shadowTextureName, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(shadowTextureName, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTextureParameteri(shadowTextureName, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    trackGpuTexture(&gpuMemory, shadowTextureName, (GLsizeiptr)SHADOW_MAP_SIZE * SHADOW_MAP_SIZE * MAX_CASCADES * sizeof(GLfloat));
+
+    // A framebuffer with every layer attached if the vertex shader can select the layer, otherwise
+    // one framebuffer per cascade
+    layeredShadows = GLEW_ARB_shader_viewport_layer_array;
+    if (!layeredShadows)
+        printf("GL_ARB_shader_viewport_layer_array is not supported, the shadow cascades are drawn one at a time\n");
+    glCreateFramebuffers(MAX_CASCADES + 1, shadowFramebufferNames);
+    glNamedFramebufferTexture(shadowFramebufferNames[0], GL_DEPTH_ATTACHMENT, shadowTextureName, 0);
+    for (int c=0; c<MAX_CASCADES; ++c)
+        glNamedFramebufferTextureLayer(shadowFramebufferNames[c+1], GL_DEPTH_ATTACHMENT, shadowTextureName, 0, c);
+    for (int f=0; f<MAX_CASCADES + 1; ++f) {
+        glNamedFramebufferDrawBuffer(shadowFramebufferNames[f], GL_NONE);
+        if (glCheckNamedFramebufferStatus(shadowFramebufferNames[f], GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            printf("ERROR The shadow map framebuffer is incomplete\n");
+            return 0;
+        }
+    }
+
+    // Allocate storage for the cascades and retrieve the address. The light does not change.
+    glCreateBuffers(1, &vertexBufferNames[SHADOW_PROPERTIES]);
+    glNamedBufferStorage(vertexBufferNames[SHADOW_PROPERTIES], sizeof(ShadowProperties), NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    shadowPropertiesPtr = (ShadowProperties *)glMapNamedBufferRange(vertexBufferNames[SHADOW_PROPERTIES], 0, sizeof(ShadowProperties),
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    memset(shadowPropertiesPtr, 0, sizeof(ShadowProperties));
+    trackGpuBuffer(&gpuMemory, vertexBufferNames[SHADOW_PROPERTIES]);
+    glm::vec3 direction = glm::normalize(glm::make_vec3(shadowLightDirection));
+    for (int c=0; c<3; ++c) {
+        shadowPropertiesPtr->direction[c] = direction[c];
+        shadowPropertiesPtr->color[c] = shadowLightColor[c];
+    }
+    shadowPropertiesPtr->numCascades = numCascades;
+
+    // The light looks along the negative direction, the up vector only has to differ from it
+    glm::vec3 up = fabsf(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    shadowLightView = glm::lookAt(glm::vec3(0.0f), -direction, up);
+
+    return 1;
+
+}
+
+
 /*
  * Initialize OpenGL
  */
@@ -274,95 +1012,672 @@ int initGL() {
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 
     // Create and initialize buffer names
-    glCreateBuffers(5, vertexBufferNames);
+    glCreateBuffers(4, vertexBufferNames);
 
     // Allocate storage for the transformation matrices and retrieve their addresses
     glNamedBufferStorage(vertexBufferNames[GLOBAL_MATRICES], 16 * sizeof(GLfloat) * 2, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
-    glNamedBufferStorage(vertexBufferNames[MODEL_MATRIX], 16 * sizeof(GLfloat), NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
 
     // Allocate storage for the buffers used for lighting calculations
-    glNamedBufferStorage(vertexBufferNames[LIGHT_PROPERTIES], 16 * sizeof(GLfloat), lightProperties, 0);
-    glNamedBufferStorage(vertexBufferNames[MATERIAL_PROPERTIES], 5 * sizeof(GLfloat), materialProperties, 0);
-    glNamedBufferStorage(vertexBufferNames[CAMERA_PROPERTIES], 3 * sizeof(GLfloat), cameraProperties, 0);
+    glNamedBufferStorage(vertexBufferNames[LIGHT_PROPERTIES], MAX_LIGHTS * 16 * sizeof(GLfloat), lightProperties, 0);
+    glNamedBufferStorage(vertexBufferNames[CAMERA_PROPERTIES], 3 * sizeof(GLfloat), cameraProperties, GL_DYNAMIC_STORAGE_BIT);
 
     // Get a pointer to the global matrices data
     GLfloat *globalMatricesPtr = (GLfloat *)glMapNamedBufferRange(vertexBufferNames[GLOBAL_MATRICES], 0, 16 * sizeof(GLfloat) * 2, 
             GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
     projectionMatrixPtr = globalMatricesPtr;
     viewMatrixPtr = globalMatricesPtr + 16;
+    trackGpuBuffer(&gpuMemory, vertexBufferNames[GLOBAL_MATRICES]);
+    trackGpuBuffer(&gpuMemory, vertexBufferNames[LIGHT_PROPERTIES]);
+    trackGpuBuffer(&gpuMemory, vertexBufferNames[CAMERA_PROPERTIES]);
+
+    // The buffers of the meshes are bound as uniform and shader storage buffers, so they start at
+    // offsets aligned for both
+    GLint uniformBufferAlignment, storageBufferAlignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferAlignment);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageBufferAlignment);
+    meshBufferPool = createGpuBufferPool(&gpuMemory, "mesh", GL_DYNAMIC_STORAGE_BIT, std::max(uniformBufferAlignment, storageBufferAlignment));
+
+    // Initialize the program builder
+    initProgramBuilder(&programBuilder);
+
+    // Load the shader sources and issue the compilation and linking of the program. The result is
+    // collected after the OBJ-file has been loaded, allowing the driver to compile in parallel.
+    AssetView vertexSource, fragmentSource, depthSource, cullSource, shadowSource, feedbackSource;
+    if (!openAsset("default.vert", &vertexSource) ||
+            !openAsset("default.frag", &fragmentSource) ||
+            !openAsset("depth_only.vert", &depthSource) ||
+            !openAsset("meshlet_cull.comp", &cullSource) ||
+            !openAsset("shadow_depth.vert", &shadowSource) ||
+            !openAsset("virtual_feedback.frag", &feedbackSource)) {
+        printf("ERROR Unable to read the shader sources\n");
+        return 0;
+    }
+    ShaderSource sources[] = {
+        { GL_VERTEX_SHADER, vertexSource.data, (GLint)vertexSource.size },
+        { GL_FRAGMENT_SHADER, fragmentSource.data, (GLint)fragmentSource.size }
+    };
+    programIndex = addProgram(&programBuilder, sources, 2);
+
+    // The depth pre-pass only needs a vertex shader, the depth is written without any fragment
+    // shader being run
+    ShaderSource depthSources[] = {
+        { GL_VERTEX_SHADER, depthSource.data, (GLint)depthSource.size }
+    };
+    depthProgramIndex = addProgram(&programBuilder, depthSources, 1);
+    closeAsset(&depthSource);
+
+    // The meshlet culling program
+    ShaderSource cullSources[] = {
+        { GL_COMPUTE_SHADER, cullSource.data, (GLint)cullSource.size }
+    };
+    cullProgramIndex = addProgram(&programBuilder, cullSources, 1);
+    closeAsset(&cullSource);
+
+    // The shadow map pass, like the depth pre-pass, only writes depth
+    ShaderSource shadowSources[] = {
+        { GL_VERTEX_SHADER, shadowSource.data, (GLint)shadowSource.size }
+    };
+    shadowProgramIndex = addProgram(&programBuilder, shadowSources, 1);
+    closeAsset(&shadowSource);
+
+    // The feedback pass of the virtual texture writes the tile sampled by every fragment
+    ShaderSource feedbackSources[] = {
+        { GL_VERTEX_SHADER, vertexSource.data, (GLint)vertexSource.size },
+        { GL_FRAGMENT_SHADER, feedbackSource.data, (GLint)feedbackSource.size }
+    };
+    feedbackProgramIndex = addProgram(&programBuilder, feedbackSources, 2);
+    closeAsset(&feedbackSource);
+
+    // The same sources are used for the permutations specialized for the materials
+    initPermutationSet(&permutations);
+    addPermutationFeature(&permutations, "USE_TEXTURE", 0, 1);
+    addPermutationFeature(&permutations, "USE_SPECULAR", 1, 1);
+    addPermutationFeature(&permutations, "USE_NORMAL_MAP", 2, 1);
+    addPermutationFeature(&permutations, "NUM_LIGHTS", FEATURE_NUM_LIGHTS_SHIFT, FEATURE_NUM_LIGHTS_BITS);
+    addPermutationFeature(&permutations, "USE_SHADOWS", 6, 1);
+    addPermutationFeature(&permutations, "USE_VIRTUAL_TEXTURE", 7, 1);
+    setPermutationSource(&permutations, GL_VERTEX_SHADER, vertexSource.data, vertexSource.size);
+    setPermutationSource(&permutations, GL_FRAGMENT_SHADER, fragmentSource.data, fragmentSource.size);
+
+    closeAsset(&vertexSource);
+    closeAsset(&fragmentSource);
+
+    // Create the queries measuring the shading pass of two frames. The number of fragment shader
+    // invocations requires GL_ARB_pipeline_statistics_query.
+    pipelineStatistics = GLEW_ARB_pipeline_statistics_query;
+    if (!pipelineStatistics)
+        printf("GL_ARB_pipeline_statistics_query is not supported, fragment shader invocations are not counted\n");
+    for (int f=0; f<2; ++f) {
+        if (pipelineStatistics)
+            glCreateQueries(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, 1, &queryNames[f][INVOCATIONS_QUERY]);
+        glCreateQueries(GL_TIME_ELAPSED, 1, &queryNames[f][TIME_QUERY]);
+        glCreateQueries(GL_TIME_ELAPSED, 1, &queryNames[f][SHADOW_QUERY]);
+    }
+
+    // Enable depth buffer testing
+    glEnable(GL_DEPTH_TEST);
+
+    return initShadows();
 
-    // Get a pointer to the model matrix data
-    modelMatrixPtr = (GLfloat *)glMapNamedBufferRange(vertexBufferNames[MODEL_MATRIX], 0, 16 * sizeof(GLfloat), 
+}
+
+/*
+ * Allocate the model matrices of the meshes, each mesh has its own matrices as the dequantization
+ * of the positions differs. Must be called after the OBJ-file has been loaded.
+ */
+void initModelMatrices() {
+
+    GLint uniformBufferAlignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferAlignment);
+    modelMatrixStride = (sizeof(ModelMatrices) + uniformBufferAlignment - 1) / uniformBufferAlignment * uniformBufferAlignment;
+
+    // Allocate storage for the matrices and retrieve the address
+    glNamedBufferStorage(vertexBufferNames[MODEL_MATRIX], modelMatrixStride * meshes.size(), NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    modelMatricesPtr = (GLubyte *)glMapNamedBufferRange(vertexBufferNames[MODEL_MATRIX], 0, modelMatrixStride * meshes.size(),
             GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    trackGpuBuffer(&gpuMemory, vertexBufferNames[MODEL_MATRIX]);
 
-    // Load and compile vertex shader
-    GLuint vertexName = glCreateShader(GL_VERTEX_SHADER);
-    int vertexLength = 0;
-    char *vertexSource = readSourceFile("default.vert", &vertexLength);
-    glShaderSource(vertexName, 1, (const char * const *)&vertexSource, &vertexLength);
-    GLint compileStatus;
-    glCompileShader(vertexName);
-    glGetShaderiv(vertexName, GL_COMPILE_STATUS, &compileStatus);
-    if (!compileStatus) {
-        GLint logSize = 0;
-        glGetShaderiv(vertexName, GL_INFO_LOG_LENGTH, &logSize);
-        char *errorLog = (char *)malloc(sizeof(char) * logSize);
-        glGetShaderInfoLog(vertexName, logSize, &logSize, errorLog);
-        glDeleteShader(vertexName);
-        printf("VERTEX ERROR %s\n", errorLog);
-        return 0;
+}
+
+/*
+ * Allocate the indirect draw commands written by the meshlet culling, one for every mesh. Must be
+ * called after the OBJ-file has been loaded.
+ */
+void initCullCommands() {
+
+    glCreateBuffers(1, &vertexBufferNames[CULL_COMMANDS]);
+    glNamedBufferStorage(vertexBufferNames[CULL_COMMANDS], meshes.size() * sizeof(CullCommand), NULL, GL_DYNAMIC_STORAGE_BIT);
+    trackGpuBuffer(&gpuMemory, vertexBufferNames[CULL_COMMANDS]);
+
+}
+
+/*
+ * Switch between drawing the complete index buffers and the ones written by the meshlet culling.
+ * The cone test removes back facing triangles only, so back face culling is enabled along with it
+ * to keep the image the same in both cases.
+ */
+void setMeshletCulling(int enabled) {
+
+    meshletCulling = enabled;
+    if (meshletCulling)
+        glEnable(GL_CULL_FACE);
+    else
+        glDisable(GL_CULL_FACE);
+
+}
+
+/*
+ * Get the permutation mask of the program used for drawing a mesh with the current lights
+ */
+unsigned int getFeatureMask(Mesh *mesh) {
+
+    return mesh->features | (numLights << FEATURE_NUM_LIGHTS_SHIFT) | (shadows ? FEATURE_SHADOWS : 0);
+
+}
+
+/*
+ * Rebuild the permutations from the current shader sources. Called after the program has been
+ * reloaded, meaning that the sources compile.
+ */
+void reloadPermutations() {
+
+    // The program compiled, so the sources are only missing if they are being replaced again
+    AssetView vertexSource, fragmentSource;
+    if (!openAsset("default.vert", &vertexSource))
+        return;
+    if (!openAsset("default.frag", &fragmentSource)) {
+        closeAsset(&vertexSource);
+        return;
     }
-    free(vertexSource);
-
-    // Load and compile fragment shader
-    GLuint fragmentName = glCreateShader(GL_FRAGMENT_SHADER);
-    int fragmentLength = 0;
-    char *fragmentSource = readSourceFile("default.frag", &fragmentLength);
-    glShaderSource(fragmentName, 1, (const char * const *)&fragmentSource, &fragmentLength);
-    glCompileShader(fragmentName);
-    glGetShaderiv(fragmentName, GL_COMPILE_STATUS, &compileStatus);
-    if (!compileStatus) {
-        GLint logSize = 0;
-        glGetShaderiv(fragmentName, GL_INFO_LOG_LENGTH, &logSize);
-        char *errorLog = (char *)malloc(sizeof(char) * logSize);
-        glGetShaderInfoLog(fragmentName, logSize, &logSize, errorLog);
-        glDeleteShader(fragmentName);
-
-        printf("FRAGMENT ERROR %s\n", errorLog);
-        return 0;
+
+    // The permutations are rebuilt when first used
+    clearPermutations(&permutations);
+    setPermutationSource(&permutations, GL_VERTEX_SHADER, vertexSource.data, vertexSource.size);
+    setPermutationSource(&permutations, GL_FRAGMENT_SHADER, fragmentSource.data, fragmentSource.size);
+
+    closeAsset(&vertexSource);
+    closeAsset(&fragmentSource);
+
+}
+
+/*
+ * Accumulate the statistics of the shading pass of a frame and print the averages once every
+ * second
+ */
+void updateStatistics(GLuint *frameQueryNames) {
+
+    GLuint64 invocations = 0, time = 0, castTime = 0;
+    if (pipelineStatistics)
+        glGetQueryObjectui64v(frameQueryNames[INVOCATIONS_QUERY], GL_QUERY_RESULT, &invocations);
+    glGetQueryObjectui64v(frameQueryNames[TIME_QUERY], GL_QUERY_RESULT, &time);
+    glGetQueryObjectui64v(frameQueryNames[SHADOW_QUERY], GL_QUERY_RESULT, &castTime);
+    fragmentInvocations += invocations;
+    shadingTime += time * 1e-6;
+    shadowTime += castTime * 1e-6;
+    frameCount++;
+
+    double currentTime = glfwGetTime();
+    if (currentTime - statisticsTime < 1.0)
+        return;
+
+    if (pipelineStatistics)
+        printf("Depth pre-pass %s: %.0f fragment shader invocations, shading %.3f ms\n", depthPrePass ? "on" : "off",
+                fragmentInvocations / frameCount, shadingTime / frameCount);
+    else
+        printf("Depth pre-pass %s: shading %.3f ms\n", depthPrePass ? "on" : "off", shadingTime / frameCount);
+
+    // The casters are counted when drawn, so they include the frames still in flight
+    if (shadows) {
+        printf("Shadows: %.3f ms, %d cascades, casters per cascade", shadowTime / frameCount, numCascades);
+        for (int c=0; c<numCascades; ++c)
+            printf(" %.1f", shadowCasters[c] / frameCount);
+        printf("\n");
     }
-    free(fragmentSource);
-
-    // Create and link vertex program
-    programName = glCreateProgram();
-    glAttachShader(programName, vertexName);
-    glAttachShader(programName, fragmentName);
-    glLinkProgram(programName);
-    GLint linkStatus;
-    glGetProgramiv(programName, GL_LINK_STATUS, &linkStatus);
-    if (!linkStatus) {
-        GLint logSize = 0;
-        glGetProgramiv(programName, GL_INFO_LOG_LENGTH, &logSize);
-        char *errorLog = (char *)malloc(sizeof(char) * logSize);
-        glGetProgramInfoLog(programName, logSize, &logSize, errorLog);
-
-        printf("LINK ERROR %s\n", errorLog);
-        return 0;
+
+    // The commands of the previous frame are read back, waiting for the culling to finish once
+    // every second is acceptable
+    if (meshletCulling) {
+        ArenaVector<CullCommand> commands(meshes.size(), CullCommand(), ArenaAllocator<CullCommand>(&frameArena));
+        glGetNamedBufferSubData(vertexBufferNames[CULL_COMMANDS], 0, meshes.size() * sizeof(CullCommand), &commands[0]);
+        int meshlets = 0, visibleMeshlets = 0, frustumCulled = 0, coneCulled = 0;
+        GLuint64 triangles = 0, visibleTriangles = 0;
+        for (int m=0; m<meshes.size(); ++m) {
+            triangles += meshes[m].numIndices / 3;
+            if (meshes[m].lod != 0) {
+                visibleTriangles += meshes[m].lods[meshes[m].lod].numIndices / 3;
+                continue;
+            }
+            meshlets += meshes[m].numMeshlets;
+            visibleMeshlets += commands[m].visibleMeshlets;
+            frustumCulled += commands[m].frustumCulled;
+            coneCulled += commands[m].coneCulled;
+            visibleTriangles += commands[m].count / 3;
+        }
+        printf("Meshlets: %d of %d visible (%d frustum culled, %d cone culled), %llu of %llu triangles\n", visibleMeshlets, meshlets,
+                frustumCulled, coneCulled, (unsigned long long)visibleTriangles, (unsigned long long)triangles);
     }
 
-    // Enable depth buffer testing
-    glEnable(GL_DEPTH_TEST);
+    printf("Levels of detail:");
+    for (int m=0; m<meshes.size(); ++m)
+        printf(" %d", meshes[m].lod);
+    printf(" (camera at %.0f)\n", cameraProperties[2]);
 
-    return 1;
+    // The transient data of the frames, and of the loading for comparison
+    printArenaStatistics("Frame", &frameArena);
+    printArenaStatistics("Load", &loadArena);
+    printGpuMemorySummary(&gpuMemory);
+    if (!virtualImageFile.empty())
+        printVirtualTextureStatistics(&virtualTexture);
+
+    fragmentInvocations = shadingTime = shadowTime = 0.0;
+    for (int c=0; c<MAX_CASCADES; ++c)
+        shadowCasters[c] = 0.0;
+    frameCount = 0;
+    statisticsTime = currentTime;
+
+}
+
+/*
+ * Select the coarsest level of detail of a mesh whose error covers at most LOD_PIXEL_ERROR pixels
+ * at the distance of the nearest point of its bounding sphere
+ */
+int selectLod(const Mesh *mesh, const glm::mat4 &model) {
+
+    if (lodOverride >= 0)
+        return std::min(lodOverride, mesh->numLods - 1);
+
+    glm::vec3 center = glm::vec3(model * glm::vec4(glm::make_vec3(mesh->boundingSphere), 1.0f));
+    float distance = glm::length(center - glm::make_vec3(cameraProperties)) - mesh->boundingSphere[3];
+    distance = std::max(distance, Z_NEAR);
+
+    // Pixels covered by a model unit at the distance
+    float pixelsPerUnit = viewportHeight / (2.0f * tanf(FIELD_OF_VIEW * 0.5f) * distance);
+
+    int lod = 0;
+    while (lod + 1 < mesh->numLods && mesh->lods[lod+1].error * pixelsPerUnit <= LOD_PIXEL_ERROR)
+        lod++;
+
+    return lod;
+
+}
+
+/*
+ * Cull the meshlets of every mesh drawn at full detail, writing the triangles of the visible ones
+ * to the culled index buffer of the mesh and their number to its indirect draw command
+ */
+void cullMeshlets() {
+
+    // Reset the commands, the culling adds to the index count. The culled indices are written to
+    // the range of the buffer pool given to the mesh.
+    ArenaVector<CullCommand> commands(meshes.size(), CullCommand(), ArenaAllocator<CullCommand>(&frameArena));
+    for (int m=0; m<meshes.size(); ++m) {
+        CullCommand command = { 0, 1, (GLuint)(meshes[m].culledIndexBuffer.offset / sizeof(GLuint)), 0, 0, 0, 0, 0 };
+        commands[m] = command;
+    }
+    glNamedBufferSubData(vertexBufferNames[CULL_COMMANDS], 0, meshes.size() * sizeof(CullCommand), &commands[0]);
+
+    glUseProgram(cullProgramName);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_STORAGE, vertexBufferNames[CULL_COMMANDS]);
+
+    for (int m=0; m<meshes.size(); ++m) {
+
+        if (meshes[m].numMeshlets == 0 || meshes[m].lod != 0)
+            continue;
+
+        glBindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM1, vertexBufferNames[MODEL_MATRIX], m * modelMatrixStride, sizeof(ModelMatrices));
+        bindGpuBuffer(GL_SHADER_STORAGE_BUFFER, MESHLET_STORAGE, &meshes[m].meshletBuffer);
+        bindGpuBuffer(GL_SHADER_STORAGE_BUFFER, MESHLET_VERTEX_STORAGE, &meshes[m].meshletVertexBuffer);
+        bindGpuBuffer(GL_SHADER_STORAGE_BUFFER, MESHLET_TRIANGLE_STORAGE, &meshes[m].meshletTriangleBuffer);
+        bindGpuBuffer(GL_SHADER_STORAGE_BUFFER, CULLED_INDEX_STORAGE, &meshes[m].culledIndexBuffer);
+        glUniform1ui(MESH_INDEX_LOCATION, m);
+
+        // One work group per meshlet, in rows when there are more than can be dispatched in one
+        int groupsX = std::min(meshes[m].numMeshlets, MAX_DISPATCH_GROUPS);
+        glDispatchCompute(groupsX, (meshes[m].numMeshlets + groupsX - 1) / groupsX, 1);
+
+    }
+
+    // The indices and commands are read by the draw calls
+    glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, vertexBufferNames[CULL_COMMANDS]);
+
+}
+
+/*
+ * Draw the triangles of a mesh with the given vertex array already bound, either the selected level
+ * of detail or the triangles of the base mesh kept by the meshlet culling
+ */
+void drawMeshElements(int m, GLuint arrayName) {
+
+    const Mesh *mesh = &meshes[m];
+    if (meshletCulling && mesh->lod == 0) {
+        glVertexArrayElementBuffer(arrayName, mesh->culledIndexBuffer.bufferName);
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)(m * sizeof(CullCommand)));
+    } else {
+        const LodLevel *lod = &mesh->lods[mesh->lod];
+        glVertexArrayElementBuffer(arrayName, mesh->indexBuffer.bufferName);
+        glDrawElements(GL_TRIANGLES, lod->numIndices, GL_UNSIGNED_INT, (const void *)(mesh->indexBuffer.offset + lod->firstIndex * sizeof(GLuint)));
+    }
+
+}
+
+/*
+ * Fill the depth buffer with the nearest depth of every pixel, without writing any color. Only the
+ * position is read, from the given vertex layout.
+ */
+void drawDepthPrePass(int layout) {
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glUseProgram(depthProgramName);
+
+    for (int m=0; m<meshes.size(); ++m) {
+        GLuint arrayName = meshes[m].layouts[layout].positionArrayName;
+        glBindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM1, vertexBufferNames[MODEL_MATRIX], m * modelMatrixStride, sizeof(ModelMatrices));
+        glBindVertexArray(arrayName);
+        drawMeshElements(m, arrayName);
+    }
+
+    glBindVertexArray(0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+}
+
+/*
+ * Draw the meshes using the virtual texture into its feedback framebuffer, recording the tiles on
+ * screen. Only these meshes are drawn, so the tiles they request include those hidden behind other
+ * meshes.
+ */
+void drawVirtualTextureFeedback(int layout) {
+
+    beginVirtualTextureFeedback(&virtualTexture);
+    glUseProgram(feedbackProgramName);
+    bindVirtualTexture(&virtualTexture, VIRTUAL_TILE_TEXTURE, PAGE_TABLE_TEXTURE, VIRTUAL_TEXTURE_PARAMETERS);
+
+    for (int m=0; m<meshes.size(); ++m) {
+        if (!(meshes[m].features & FEATURE_VIRTUAL_TEXTURE))
+            continue;
+        GLuint arrayName = meshes[m].layouts[layout].arrayName;
+        glBindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM1, vertexBufferNames[MODEL_MATRIX], m * modelMatrixStride, sizeof(ModelMatrices));
+        glBindVertexArray(arrayName);
+        drawMeshElements(m, arrayName);
+    }
+
+    glBindVertexArray(0);
+    endVirtualTextureFeedback(&virtualTexture, viewportWidth, viewportHeight);
+
+}
+
+/*
+ * Split the view frustum up to the shadow distance into the cascades and fit the light projection of
+ * every cascade around its part of the frustum
+ */
+void fitCascades(const glm::mat4 &view) {
+
+    glm::mat4 inverseView = glm::inverse(view);
+    float aspect = (float)viewportWidth / viewportHeight;
+    float shadowDistance = std::min(SHADOW_DISTANCE, Z_FAR);
+
+    float nearSplit = Z_NEAR;
+    for (int c=0; c<numCascades; ++c) {
+
+        // The logarithmic split keeps the texel density even over the depth, the uniform split
+        // keeps the nearest cascade from becoming too small
+        float ratio = (float)(c + 1) / numCascades;
+        float split = CASCADE_SPLIT_LAMBDA * Z_NEAR * powf(shadowDistance / Z_NEAR, ratio) +
+                (1.0f - CASCADE_SPLIT_LAMBDA) * (Z_NEAR + (shadowDistance - Z_NEAR) * ratio);
+
+        // Find the bounding sphere of the corners of the part of the frustum. Its size only depends
+        // on the split distances, so the texels keep their size as the camera turns.
+        glm::mat4 inverseSlice = inverseView * glm::inverse(glm::perspective(FIELD_OF_VIEW, aspect, nearSplit, split));
+        glm::vec3 corners[8];
+        glm::vec3 center = glm::vec3(0.0f);
+        for (int k=0; k<8; ++k) {
+            glm::vec4 corner = inverseSlice * glm::vec4(k & 1 ? 1.0f : -1.0f, k & 2 ? 1.0f : -1.0f, k & 4 ? 1.0f : -1.0f, 1.0f);
+            corners[k] = glm::vec3(corner) / corner.w;
+            center += corners[k] / 8.0f;
+        }
+        float radius = 0.0f;
+        for (int k=0; k<8; ++k)
+            radius = std::max(radius, glm::length(corners[k] - center));
+        radius = ceilf(radius);
+
+        // Move the center in whole texels, so the shadow edges do not shimmer as the camera moves
+        glm::vec3 lightCenter = glm::vec3(shadowLightView * glm::vec4(center, 1.0f));
+        float texelSize = 2.0f * radius / SHADOW_MAP_SIZE;
+        lightCenter.x = floorf(lightCenter.x / texelSize) * texelSize;
+        lightCenter.y = floorf(lightCenter.y / texelSize) * texelSize;
+        cascadeBounds[c] = glm::vec4(lightCenter, radius);
+
+        // The depth range only covers the sphere, the casters between it and the light are clamped
+        // to the near plane by GL_DEPTH_CLAMP
+        glm::mat4 projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius,
+                -lightCenter.z - radius, -lightCenter.z + radius);
+        glm::mat4 matrix = projection * shadowLightView;
+        memcpy(shadowPropertiesPtr->matrices[c], &matrix[0][0], 16 * sizeof(GLfloat));
+        shadowPropertiesPtr->splits[c] = split;
+        nearSplit = split;
+
+    }
+    shadowPropertiesPtr->numCascades = numCascades;
+
+}
+
+/*
+ * Get the cascades a mesh casts shadows into as a bit mask. The bounding sphere has to overlap the
+ * cascade across the light direction and must not lie entirely behind it, anything between the
+ * cascade and the light may cast a shadow into it.
+ */
+unsigned int getShadowCascades(const Mesh *mesh) {
+
+    glm::vec3 center = glm::vec3(shadowLightView * modelMatrix * glm::vec4(glm::make_vec3(mesh->boundingSphere), 1.0f));
+    float radius = mesh->boundingSphere[3];
+
+    unsigned int mask = 0;
+    for (int c=0; c<numCascades; ++c) {
+        const glm::vec4 &bounds = cascadeBounds[c];
+        if (fabsf(center.x - bounds.x) <= bounds.w + radius && fabsf(center.y - bounds.y) <= bounds.w + radius &&
+                center.z + radius >= bounds.z - bounds.w)
+            mask |= 1 << c;
+    }
+
+    return mask;
+
+}
+
+/*
+ * Draw the triangles of the selected level of detail of a mesh into a range of cascades, the first
+ * given by the uniform and one cascade per instance
+ */
+void drawShadowCaster(int m, GLuint arrayName, int firstCascade, int cascadeCount) {
+
+    const Mesh *mesh = &meshes[m];
+    const LodLevel *lod = &mesh->lods[mesh->lod];
+    glUniform1i(FIRST_CASCADE_LOCATION, firstCascade);
+    glVertexArrayElementBuffer(arrayName, mesh->indexBuffer.bufferName);
+    glDrawElementsInstanced(GL_TRIANGLES, lod->numIndices, GL_UNSIGNED_INT, (const void *)(mesh->indexBuffer.offset + lod->firstIndex * sizeof(GLuint)),
+            cascadeCount);
+
+}
+
+/*
+ * Draw the depth of the shadow casters into every cascade. Only the position stream is read, and
+ * every mesh is only drawn into the cascades it casts shadows into. With layered rendering a mesh
+ * is drawn into all its cascades with a single instanced draw, covering the cascades in between as
+ * well.
+ */
+void drawShadowPass() {
+
+    glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(SHADOW_SLOPE_BIAS, SHADOW_CONSTANT_BIAS);
+    glDisable(GL_CULL_FACE);
+    glUseProgram(shadowProgramName);
+
+    ArenaVector<unsigned int> cascadeMasks(meshes.size(), 0, ArenaAllocator<unsigned int>(&frameArena));
+    for (int m=0; m<meshes.size(); ++m) {
+        cascadeMasks[m] = getShadowCascades(&meshes[m]);
+        for (int c=0; c<numCascades; ++c)
+            if (cascadeMasks[m] & (1 << c))
+                shadowCasters[c]++;
+    }
+
+    GLfloat clearDepth = 1.0f;
+    if (layeredShadows) {
+
+        glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebufferNames[0]);
+        glClearNamedFramebufferfv(shadowFramebufferNames[0], GL_DEPTH, 0, &clearDepth);
+
+        for (int m=0; m<meshes.size(); ++m) {
+            if (!cascadeMasks[m])
+                continue;
+            int first = 0, last = numCascades - 1;
+            while (!(cascadeMasks[m] & (1 << first)))
+                first++;
+            while (!(cascadeMasks[m] & (1 << last)))
+                last--;
+            GLuint arrayName = meshes[m].layouts[depthLayout].positionArrayName;
+            glBindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM1, vertexBufferNames[MODEL_MATRIX], m * modelMatrixStride, sizeof(ModelMatrices));
+            glBindVertexArray(arrayName);
+            drawShadowCaster(m, arrayName, first, last - first + 1);
+        }
+
+    } else {
+
+        for (int c=0; c<numCascades; ++c) {
+            glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebufferNames[c+1]);
+            glClearNamedFramebufferfv(shadowFramebufferNames[c+1], GL_DEPTH, 0, &clearDepth);
+            for (int m=0; m<meshes.size(); ++m) {
+                if (!(cascadeMasks[m] & (1 << c)))
+                    continue;
+                GLuint arrayName = meshes[m].layouts[depthLayout].positionArrayName;
+                glBindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM1, vertexBufferNames[MODEL_MATRIX], m * modelMatrixStride, sizeof(ModelMatrices));
+                glBindVertexArray(arrayName);
+                drawShadowCaster(m, arrayName, c, 1);
+            }
+        }
+
+    }
+
+    // Restore the state of the passes drawing to the window
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, viewportWidth, viewportHeight);
+    glDisable(GL_DEPTH_CLAMP);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    setMeshletCulling(meshletCulling);
+
+}
+
+/*
+ * Set the model matrices of every mesh for the given rotation of the model and select the levels of
+ * detail
+ */
+void setModelMatrices(float angle) {
+
+    // Set the model matrix
+    glm::mat4 model = glm::mat4(1.0);
+    model = glm::translate(model, glm::vec3(0.0f, -20.0f, 0.0f));
+    model = glm::rotate(model, angle, glm::vec3(0.0f, 1.0f,  0.0f));
+    modelMatrix = model;
+
+    // The positions of every mesh are dequantized by its own matrix before the model matrix
+    for (int m=0; m<meshes.size(); ++m) {
+        ModelMatrices *matrices = (ModelMatrices *)(modelMatricesPtr + m * modelMatrixStride);
+        glm::mat4 positionModel = model * glm::make_mat4(meshes[m].positionMatrix);
+        memcpy(matrices->model, &model[0][0], 16 * sizeof(GLfloat));
+        memcpy(matrices->positionModel, &positionModel[0][0], 16 * sizeof(GLfloat));
+        meshes[m].lod = selectLod(&meshes[m], model);
+    }
+
+}
+
+/*
+ * Build the list of meshes to shade, sorted by the program shading them so every program is only
+ * activated once. The meshes shaded by the same program keep their order.
+ */
+void buildDrawList(ArenaVector<DrawItem> *drawList) {
+
+    drawList->reserve(meshes.size());
+    for (int m=0; m<meshes.size(); ++m) {
+
+        // The cheapest program providing the features of the material, falling back on the program
+        // with every feature if the permutation failed to build
+        DrawItem item;
+        item.program = getPermutation(&permutations, getFeatureMask(&meshes[m]));
+        if (!item.program)
+            item.program = programName;
+        item.mesh = m;
+        drawList->push_back(item);
+
+    }
+
+    std::sort(drawList->begin(), drawList->end(), [](const DrawItem &a, const DrawItem &b) {
+        return a.program != b.program ? a.program < b.program : a.mesh < b.mesh;
+    });
 
 }
 
+/*
+ * Shade every mesh, reading all the attributes from the given vertex layout
+ */
+void drawShadingPass(int layout) {
+
+    // Every material samples the same texture array, except the ones streaming the virtual texture
+    glBindTextureUnit(MATERIAL_TEXTURE, useGpuTexture(&gpuMemory, materialTexture));
+    if (!virtualImageFile.empty())
+        bindVirtualTexture(&virtualTexture, VIRTUAL_TILE_TEXTURE, PAGE_TABLE_TEXTURE, VIRTUAL_TEXTURE_PARAMETERS);
+    glBindTextureUnit(SHADOW_TEXTURE, shadowTextureName);
+
+    // The draw list of the frame is built in the frame arena
+    ArenaAllocator<DrawItem> frameAllocator(&frameArena);
+    ArenaVector<DrawItem> drawList(frameAllocator);
+    buildDrawList(&drawList);
+
+    // Loop through all the meshes loaded from the OBJ-file
+    GLuint activeProgram = 0;
+    for (int i=0; i<(int)drawList.size(); ++i) {
+
+        // Activate the program of the mesh if the previous mesh used another one
+        int m = drawList[i].mesh;
+        if (drawList[i].program != activeProgram) {
+            glUseProgram(drawList[i].program);
+            activeProgram = drawList[i].program;
+        }
+        
+        // Bind the matrices, vertex array and material of the mesh
+        GLuint arrayName = meshes[m].layouts[layout].arrayName;
+        glBindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM1, vertexBufferNames[MODEL_MATRIX], m * modelMatrixStride, sizeof(ModelMatrices));
+        glBindVertexArray(arrayName);
+        bindGpuBuffer(GL_UNIFORM_BUFFER, MATERIAL, &meshes[m].materialBuffer);
+
+        // Draw the vertex array
+        drawMeshElements(m, arrayName);
+
+        // Disable vertex array
+        glBindVertexArray(0);
+
+    }
+
+    glBindTextureUnit(MATERIAL_TEXTURE, 0);
+    glBindTextureUnit(SHADOW_TEXTURE, 0);
+    glBindTextureUnit(VIRTUAL_TILE_TEXTURE, 0);
+    glBindTextureUnit(PAGE_TABLE_TEXTURE, 0);
+
+}
 
 /*
  * Draw OpenGL screne
  */
 void drawGLScene() {
 
+    // The queries of this frame were last used two frames ago and are read before being reused
+    static int frame = 0;
+    GLuint *frameQueryNames = queryNames[frame % 2];
+    if (frame >= 2)
+        updateStatistics(frameQueryNames);
+    frame++;
+
     // Clear color and depth buffers
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -371,41 +1686,153 @@ void drawGLScene() {
     view = glm::translate(view, glm::vec3(-cameraProperties[0], -cameraProperties[1], -cameraProperties[2]));
     memcpy(viewMatrixPtr, &view[0][0], 16 * sizeof(GLfloat));
 
-    // Set the model matrix
-    glm::mat4 model = glm::mat4(1.0);
-    model = glm::translate(model, glm::vec3(0.0f, -20.0f, 0.0f));
-    model = glm::rotate(model, (float)glfwGetTime() * 0.3f, glm::vec3(0.0f, 1.0f,  0.0f));
-    memcpy(modelMatrixPtr, &model[0][0], 16 * sizeof(GLfloat));
-
-    // Activate the program
-    glUseProgram(programName);
+    // Set the model matrices
+    setModelMatrices((float)glfwGetTime() * 0.3f);
 
     // Bind buffers to GLSL uniform indices
     glBindBufferBase(GL_UNIFORM_BUFFER, TRANSFORM0, vertexBufferNames[GLOBAL_MATRICES]);
-    glBindBufferBase(GL_UNIFORM_BUFFER, TRANSFORM1, vertexBufferNames[MODEL_MATRIX]);
     glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT, vertexBufferNames[LIGHT_PROPERTIES]);
-    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL, vertexBufferNames[MATERIAL_PROPERTIES]);
     glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA, vertexBufferNames[CAMERA_PROPERTIES]);
-    
-    // Loop through all the meshes loaded from the OBJ-file
-    for (int m=0; m<meshes.size(); ++m) {
-        
-        // Bind the vertex array and texture of the mesh
-        glBindVertexArray(meshes[m].arrayName);
-        glBindTexture(GL_TEXTURE_2D, meshes[m].textureName);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW, vertexBufferNames[SHADOW_PROPERTIES]);
 
-        // Draw the vertex array
-        glDrawArrays(GL_TRIANGLES, 0, meshes[m].numVertices);
+    // Draw the shadow maps, measured separately from the shading
+    glBeginQuery(GL_TIME_ELAPSED, frameQueryNames[SHADOW_QUERY]);
+    if (shadows) {
+        fitCascades(view);
+        drawShadowPass();
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+
+    // Find the visible triangles before any of the passes drawing them
+    if (meshletCulling)
+        cullMeshlets();
+
+    // Record the tiles of the virtual texture on screen
+    if (!virtualImageFile.empty())
+        drawVirtualTextureFeedback(shadingLayout);
+
+    // With the depth buffer already filled, only the visible fragments pass the GL_EQUAL test and
+    // are shaded. Depth writes are redundant in the shading pass.
+    if (depthPrePass) {
+        drawDepthPrePass(depthLayout);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
 
-        // Disable vertex array and texture
-        glBindVertexArray(0);
-        glBindTexture(GL_TEXTURE_2D, 0);
+    if (pipelineStatistics)
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, frameQueryNames[INVOCATIONS_QUERY]);
+    glBeginQuery(GL_TIME_ELAPSED, frameQueryNames[TIME_QUERY]);
 
+    drawShadingPass(shadingLayout);
+
+    glEndQuery(GL_TIME_ELAPSED);
+    if (pipelineStatistics)
+        glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+
+    // Restore the depth state
+    if (depthPrePass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
     }
 
     // Disable
     glUseProgram(0);
 
+    // The transient data of the frame is no longer needed
+    resetMemoryArena(&frameArena);
+
+    // Reduce the textures used the longest ago if the memory exceeds the budget
+    updateGpuMemory(&gpuMemory);
+
+    // Queue the tiles missing in the latest feedback and upload the tiles loaded
+    if (!virtualImageFile.empty())
+        updateVirtualTexture(&virtualTexture);
+
+}
+
+/*
+ * Render the model depth only and fully shaded with every vertex layout and print the GPU time of
+ * the passes. The model turns one revolution over the frames of every measurement, the levels of
+ * detail and the meshlet culling are disabled so every vertex of the base meshes is fetched.
+ */
+void runLayoutBenchmark(GLFWwindow *window) {
+
+    // Finish building the permutations without shadows before measuring
+    shadows = 0;
+    for (int m=0; m<meshes.size(); ++m)
+        getPermutation(&permutations, getFeatureMask(&meshes[m]));
+
+    lodOverride = 0;
+    setMeshletCulling(0);
+
+    glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(-cameraProperties[0], -cameraProperties[1], -cameraProperties[2]));
+    memcpy(viewMatrixPtr, &view[0][0], 16 * sizeof(GLfloat));
+    glBindBufferBase(GL_UNIFORM_BUFFER, TRANSFORM0, vertexBufferNames[GLOBAL_MATRICES]);
+    glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT, vertexBufferNames[LIGHT_PROPERTIES]);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA, vertexBufferNames[CAMERA_PROPERTIES]);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW, vertexBufferNames[SHADOW_PROPERTIES]);
+
+    GLsizei numVertices = 0, numIndices = 0;
+    for (int m=0; m<meshes.size(); ++m) {
+        numVertices += meshes[m].numVertices;
+        numIndices += meshes[m].lods[0].numIndices;
+    }
+    printf("Layout benchmark: %d vertices, %d triangles, %d frames per pass\n", numVertices, numIndices / 3, BENCHMARK_FRAMES);
+    printf("%-12s %-8s %10s %10s %12s\n", "Layout", "Pass", "GPU ms", "Bytes/vtx", "Vertex MiB/s");
+
+    // The fastest layout of every pass, 0 being depth only and 1 shaded
+    double bestTimes[2] = { INFINITY, INFINITY };
+    int bestLayouts[2] = { 0, 0 };
+
+    for (int layout=0; layout<NUM_VERTEX_LAYOUTS; ++layout)
+        for (int pass=0; pass<2; ++pass) {
+
+            double totalTime = 0.0;
+            for (int f=0; f<BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES && !glfwWindowShouldClose(window); ++f) {
+
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                setModelMatrices(6.2831853f * f / (BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES));
+
+                // The result is read right away, stalling between the frames is acceptable when
+                // only the time of the pass itself is measured
+                glBeginQuery(GL_TIME_ELAPSED, queryNames[0][TIME_QUERY]);
+                if (pass == 0)
+                    drawDepthPrePass(layout);
+                else
+                    drawShadingPass(layout);
+                glEndQuery(GL_TIME_ELAPSED);
+                glUseProgram(0);
+                resetMemoryArena(&frameArena);
+
+                GLuint64 time;
+                glGetQueryObjectui64v(queryNames[0][TIME_QUERY], GL_QUERY_RESULT, &time);
+                if (f >= BENCHMARK_WARMUP_FRAMES)
+                    totalTime += time * 1e-6;
+
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+
+            }
+
+            // The bytes of the streams read for every vertex by the pass, the same for all meshes
+            // using the same format
+            double bytes = 0.0;
+            for (int m=0; m<meshes.size(); ++m)
+                bytes += (double)meshes[m].numVertices * getVertexLayoutFetchSize(&meshes[m].layouts[layout], pass == 0);
+            double time = totalTime / BENCHMARK_FRAMES;
+            printf("%-12s %-8s %10.3f %10.1f %12.0f\n", getVertexLayoutName(layout), pass == 0 ? "depth" : "shaded", time, bytes / numVertices,
+                    bytes / 1048576.0 / (time * 1e-3));
+
+            if (time < bestTimes[pass]) {
+                bestTimes[pass] = time;
+                bestLayouts[pass] = layout;
+            }
+
+        }
+
+    printf("Fastest layouts: depth %s, shaded %s (use -depth-layout %s -shading-layout %s)\n", getVertexLayoutName(bestLayouts[0]),
+            getVertexLayoutName(bestLayouts[1]), getVertexLayoutName(bestLayouts[0]), getVertexLayoutName(bestLayouts[1]));
+
 }
 
 void resizeGL(int width, int height) {
@@ -415,8 +1842,14 @@ void resizeGL(int width, int height) {
         height = 1;										
 
     // Change the projection matrix
-    glm::mat4 proj = glm::perspective(3.14f/2.0f, (float)width/height, 0.1f, 1000.0f);
+    glm::mat4 proj = glm::perspective(FIELD_OF_VIEW, (float)width/height, Z_NEAR, Z_FAR);
     memcpy(projectionMatrixPtr, &proj[0][0], 16 * sizeof(GLfloat));
+    viewportWidth = width;
+    viewportHeight = height;
+
+    // The feedback pass keeps its reduction of the resolution
+    if (!virtualImageFile.empty())
+        resizeVirtualTextureFeedback(&virtualTexture, width, height);
 
     // Set the OpenGL viewport
     glViewport(0, 0, width, height);
@@ -436,6 +1869,64 @@ static void glfwErrorCallback(int error, const char* description) {
 static void glfwKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+    // Cycle through the number of lights
+    if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        numLights = numLights % MAX_LIGHTS + 1;
+        printf("Lights: %d\n", numLights);
+    }
+
+    // Toggle the depth pre-pass
+    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+        depthPrePass = !depthPrePass;
+
+    // Move the camera towards or away from the model
+    if ((key == GLFW_KEY_UP || key == GLFW_KEY_DOWN) && action != GLFW_RELEASE) {
+        cameraProperties[2] = glm::clamp(cameraProperties[2] * (key == GLFW_KEY_UP ? 0.8f : 1.25f), 20.0f, Z_FAR * 0.5f);
+        glNamedBufferSubData(vertexBufferNames[CAMERA_PROPERTIES], 0, 3 * sizeof(GLfloat), cameraProperties);
+    }
+
+    // Cycle through selecting the level of detail by distance and forcing every level
+    if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+        lodOverride = lodOverride + 1 < MAX_LODS ? lodOverride + 1 : -1;
+        if (lodOverride < 0)
+            printf("Level of detail: by distance\n");
+        else
+            printf("Level of detail: %d\n", lodOverride);
+    }
+
+    // Toggle the meshlet culling
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        setMeshletCulling(!meshletCulling);
+        printf("Meshlet culling: %s\n", meshletCulling ? "on" : "off");
+    }
+
+    // Toggle the shadows
+    if (key == GLFW_KEY_S && action == GLFW_PRESS) {
+        shadows = !shadows;
+        printf("Shadows: %s\n", shadows ? "on" : "off");
+    }
+
+    // Cycle through the number of shadow cascades
+    if (key == GLFW_KEY_K && action == GLFW_PRESS) {
+        numCascades = numCascades < MAX_CASCADES ? numCascades + 1 : MIN_CASCADES;
+        printf("Shadow cascades: %d\n", numCascades);
+    }
+
+    // Cycle through the frame pacing modes
+    if (key == GLFW_KEY_F && action == GLFW_PRESS)
+        cycleFramePacingMode(&framePacer);
+
+    // Print the memory of every buffer pool and texture
+    if (key == GLFW_KEY_M && action == GLFW_PRESS)
+        printGpuMemoryReport(&gpuMemory);
+
+    // Lower or raise the GPU memory budget, starting from the memory in use
+    if ((key == GLFW_KEY_MINUS || key == GLFW_KEY_EQUAL) && action != GLFW_RELEASE) {
+        GLsizeiptr budget = gpuMemory.budget > 0 ? gpuMemory.budget : getGpuMemoryUsage(&gpuMemory);
+        gpuMemory.budget = (GLsizeiptr)(budget * (key == GLFW_KEY_MINUS ? 0.8 : 1.25));
+        printf("GPU memory budget: %.1f MiB\n", gpuMemory.budget / 1048576.0);
+    }
 }
 
 /*
@@ -452,11 +1943,31 @@ void glfwWindowSizeCallback(GLFWwindow* window, int width, int height) {
  */
 int main(int nargs, const char **argv) {
     
-    // Ensure that there is one argument (besides the program name)
-    if (nargs != 2) {
-        printf("Wrong usage\n");
+    // Ensure that there is one argument (besides the program name), optionally followed by -float
+    // to keep the float vertex format for every mesh, the vertex layouts of the passes, -benchmark
+    // to measure the passes with every layout and -gpu-budget to keep the buffers and textures
+    // within the given MiB
+    if (nargs < 2) {
+        printf("Usage: %s <obj> [-float] [-depth-layout interleaved|split] [-shading-layout interleaved|split] [-benchmark] [-gpu-budget <MiB>]\n",
+                argv[0]);
         exit(EXIT_FAILURE);
     }
+    for (int a=2; a<nargs; ++a) {
+        if (strcmp(argv[a], "-float") == 0)
+            compactVertices = 0;
+        else if (strcmp(argv[a], "-benchmark") == 0)
+            layoutBenchmark = 1;
+        else if (strcmp(argv[a], "-depth-layout") == 0 && a + 1 < nargs && findVertexLayout(argv[a+1]) >= 0)
+            depthLayout = findVertexLayout(argv[++a]);
+        else if (strcmp(argv[a], "-shading-layout") == 0 && a + 1 < nargs && findVertexLayout(argv[a+1]) >= 0)
+            shadingLayout = findVertexLayout(argv[++a]);
+        else if (strcmp(argv[a], "-gpu-budget") == 0 && a + 1 < nargs && atoi(argv[a+1]) > 0)
+            gpuBudget = atoi(argv[++a]);
+        else {
+            printf("Wrong usage\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 
     // Set error callback
     glfwSetErrorCallback(glfwErrorCallback);
@@ -499,7 +2010,8 @@ int main(int nargs, const char **argv) {
     // Make GLFW swap buffers directly 
     glfwSwapInterval(0);
 
-    // Initialize OpenGL
+    // Initialize OpenGL, the buffers and textures being counted against the budget
+    initGpuMemory(&gpuMemory, (GLsizeiptr)gpuBudget * 1048576, readMaterialImages, NULL);
     if (!initGL()) {
         printf("Failed to initialize OpenGL\n");  
         glfwDestroyWindow(window);
@@ -508,30 +2020,118 @@ int main(int nargs, const char **argv) {
     }
 
     // Load the OBJ-file
+    initMemoryArena(&frameArena, FRAME_ARENA_SIZE);
+    initMemoryArena(&loadArena, LOAD_ARENA_SIZE);
     if (!loadObj(argv[1])) {
         printf("Failed to load %s.\n", argv[1]);  
         glfwDestroyWindow(window);
         glfwTerminate();
         exit(EXIT_FAILURE);
     }
+    printAssetStatistics();
+    initModelMatrices();
+    initCullCommands();
+    setMeshletCulling(meshletCulling);
+
+    // Start building the permutations needed by the materials
+    for (int m=0; m<meshes.size(); ++m)
+        requestPermutation(&permutations, getFeatureMask(&meshes[m]));
+
+    // Wait for the shader program that has been compiling while the OBJ-file was loaded
+    while (!pollPrograms(&programBuilder))
+        glfwWaitEventsTimeout(0.001);
+    if (!finishPrograms(&programBuilder)) {
+        printf("Failed to build shader program\n");  
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    programName = getProgram(&programBuilder, programIndex);
+    depthProgramName = getProgram(&programBuilder, depthProgramIndex);
+    cullProgramName = getProgram(&programBuilder, cullProgramIndex);
+    shadowProgramName = getProgram(&programBuilder, shadowProgramIndex);
+    feedbackProgramName = getProgram(&programBuilder, feedbackProgramIndex);
 
     // Initialize OpenGL view
     resizeGL(DEFAULT_WIDTH, DEFAULT_HEIGHT);
 
+    // Measure the passes with every layout instead of running interactively
+    if (layoutBenchmark) {
+        runLayoutBenchmark(window);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_SUCCESS);
+    }
+
+    // Start watching the shader sources for changes
+    if (initShaderReloader(&shaderReloader, window, 4, 5)) {
+        ShaderFile shaderFiles[] = {
+            { GL_VERTEX_SHADER, "default.vert" },
+            { GL_FRAGMENT_SHADER, "default.frag" }
+        };
+        watchProgram(&shaderReloader, &programName, shaderFiles, 2);
+        ShaderFile depthShaderFiles[] = {
+            { GL_VERTEX_SHADER, "depth_only.vert" }
+        };
+        watchProgram(&shaderReloader, &depthProgramName, depthShaderFiles, 1);
+        ShaderFile cullShaderFiles[] = {
+            { GL_COMPUTE_SHADER, "meshlet_cull.comp" }
+        };
+        watchProgram(&shaderReloader, &cullProgramName, cullShaderFiles, 1);
+        ShaderFile shadowShaderFiles[] = {
+            { GL_VERTEX_SHADER, "shadow_depth.vert" }
+        };
+        watchProgram(&shaderReloader, &shadowProgramName, shadowShaderFiles, 1);
+        ShaderFile feedbackShaderFiles[] = {
+            { GL_VERTEX_SHADER, "default.vert" },
+            { GL_FRAGMENT_SHADER, "virtual_feedback.frag" }
+        };
+        watchProgram(&shaderReloader, &feedbackProgramName, feedbackShaderFiles, 2);
+        startShaderReloader(&shaderReloader);
+    } else
+        printf("Failed to start shader reloading\n");
+
+    printf("Vertex layouts: %s depth pre-pass, %s shading\n", getVertexLayoutName(depthLayout), getVertexLayoutName(shadingLayout));
+    printf("P toggles the depth pre-pass, C the meshlet culling, S the shadows, K cycles the shadow cascades, V the level of detail and UP/DOWN move the camera\n");
+    printf("F cycles through the frame pacing modes\n");
+    statisticsTime = glfwGetTime();
+
+    // Pace the frames to the refresh rate of the monitor
+    initFramePacer(&framePacer, PACING_JUST_IN_TIME);
+
     // Run a loop until the window is closed
     while (!glfwWindowShouldClose(window)) {
 
+        // Wait for the next frame and poll for input events
+        beginPacedFrame(&framePacer);
+
+        // Swap in programs that have been rebuilt since the previous frame
+        if (updateShaderReloader(&shaderReloader))
+            reloadPermutations();
+
         // Draw OpenGL screne
         drawGLScene();
 
         // Swap buffers
         glfwSwapBuffers(window);
 
-        // Poll fow input events
-        glfwPollEvents();
+        // Issue the fence and timestamp of the frame
+        endPacedFrame(&framePacer);
 
     }
 
+    // Print the statistics of the last pacing mode
+    destroyFramePacer(&framePacer);
+
+    // Stop reloading shaders
+    destroyShaderReloader(&shaderReloader);
+
+    // Stop the loading of tiles, and free the frame arena and the buffers and textures
+    if (!virtualImageFile.empty())
+        destroyVirtualTexture(&virtualTexture);
+    releaseMemoryArena(&frameArena);
+    destroyGpuMemory(&gpuMemory);
+
     // Shutdown GLFW
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -13,6 +13,7 @@
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
+#include "../common/asset_io.h"
 
 #define DEFAULT_WIDTH 1024
 #define DEFAULT_HEIGHT 768
@@ -66,39 +67,6 @@ GLint cameraPositionPos;
 // Names
 GLuint programName;
 
-/*
- * Read shader source file from disk
- */
-char *readSourceFile(const char *filename, int *size) {
-
-    // Open the file as read only
-    FILE *file = fopen(filename, "r");
-
-    // Find the end of the file to determine the file size
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
-
-    // Rewind
-    fseek(file, 0, SEEK_SET); 
-
-    // Allocate memory for the source and initialize it to 0
-    char *source = (char *)malloc(fileSize + 1);
-    for (int i = 0; i <= fileSize; i++) source[i] = 0;
-
-    // Read the source
-    fread(source, fileSize, 1, file);
-
-    // Close the file
-    fclose(file);
-
-    // Store the size of the file in the output variable
-    *size = fileSize-1;
-
-    // Return the shader source
-    return source;
-
-}
-
 /*
  * Load a model from the specified obj-file. This is a highly specialized implementation, meaning
  * that certain shortcuts have been taken. The data is stored in the global variables. 
@@ -115,7 +83,7 @@ int loadObj(const char *filename) {
     std::string errorString;
 
     // Load the file, or return FALSE if an error occured
-    if (!tinyobj::LoadObj(&attributes, &shapes, &materials, &errorString, filename, "."))
+    if (!loadObjAsset(&attributes, &shapes, &materials, &errorString, filename, "."))
         return 0;
 
     // Loop through all the shapes in the OBJ-data
@@ -133,7 +101,7 @@ int loadObj(const char *filename) {
 
         // Read the texture image
         int width, height, channels;
-        GLubyte *imageData = stbi_load(texture_filename.c_str(), &width, &height, &channels, STBI_default);
+        GLubyte *imageData = loadImageAsset(texture_filename.c_str(), &width, &height, &channels, STBI_default);
         if (!imageData)
             return 0;
 
@@ -244,9 +212,14 @@ int initGL() {
 
     // Load and compile vertex shader
     GLuint vertexName = glCreateShader(GL_VERTEX_SHADER); // 2.0
-    int vertexLength = 0;
-    char *vertexSource = readSourceFile("default33.vert", &vertexLength);
-    glShaderSource(vertexName, 1, (const char * const *)&vertexSource, &vertexLength); // 2.0
+    AssetView vertexSource;
+    if (!openAsset("default33.vert", &vertexSource)) {
+        printf("ERROR Unable to read default33.vert\n");
+        return 0;
+    }
+    GLint vertexLength = (GLint)vertexSource.size;
+    glShaderSource(vertexName, 1, &vertexSource.data, &vertexLength); // 2.0
+    closeAsset(&vertexSource);
     GLint compileStatus;
     glCompileShader(vertexName); // 2.0
     glGetShaderiv(vertexName, GL_COMPILE_STATUS, &compileStatus); // 2.0
@@ -257,15 +230,20 @@ int initGL() {
         glGetShaderInfoLog(vertexName, logSize, &logSize, errorLog); // 2.0
         glDeleteShader(vertexName); // 2.0 
         printf("VERTEX ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(vertexSource);
 
     // Load and compile fragment shader
     GLuint fragmentName = glCreateShader(GL_FRAGMENT_SHADER);
-    int fragmentLength = 0;
-    char *fragmentSource = readSourceFile("default33.frag", &fragmentLength);
-    glShaderSource(fragmentName, 1, (const char * const *)&fragmentSource, &fragmentLength);
+    AssetView fragmentSource;
+    if (!openAsset("default33.frag", &fragmentSource)) {
+        printf("ERROR Unable to read default33.frag\n");
+        return 0;
+    }
+    GLint fragmentLength = (GLint)fragmentSource.size;
+    glShaderSource(fragmentName, 1, &fragmentSource.data, &fragmentLength);
+    closeAsset(&fragmentSource);
     glCompileShader(fragmentName);
     glGetShaderiv(fragmentName, GL_COMPILE_STATUS, &compileStatus);
     if (!compileStatus) {
@@ -276,9 +254,9 @@ int initGL() {
         glDeleteShader(fragmentName);
 
         printf("FRAGMENT ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(fragmentSource);
 
     // Create and link vertex program
     programName = glCreateProgram(); // 2.0
@@ -294,6 +272,7 @@ int initGL() {
         glGetProgramInfoLog(programName, logSize, &logSize, errorLog); // 2.0
 
         printf("LINK ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
 
@@ -0,0 +1,39 @@
+#version 450
+
+// Rendering into every layer of the shadow map array in one draw requires writing gl_Layer from
+// the vertex shader. Without the extension the cascades are drawn one at a time into framebuffers
+// with a single layer attached.
+#extension GL_ARB_shader_viewport_layer_array : enable
+
+// Incoming vertex position, Model Space.
+layout (location = 0) in vec3 position;
+
+// model matrix, and the model matrix combined with the dequantization of the positions
+layout (binding = 1, std140) uniform Transform1
+{
+    mat4 model;
+    mat4 positionModel;
+};
+
+// Light projection and view matrix of every cascade, and the view depth where each cascade ends
+layout (binding = 5, std140) uniform Shadow
+{
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;
+    vec4 lightDirection;
+    vec4 lightColor;
+    int numCascades;
+};
+
+// Cascade drawn by the first instance, every following instance draws the next cascade
+layout (location = 0) uniform int firstCascade;
+
+void main() {
+
+    int cascade = firstCascade + gl_InstanceID;
+    gl_Position = cascadeMatrices[cascade] * (positionModel * vec4(position, 1));
+#ifdef GL_ARB_shader_viewport_layer_array
+    gl_Layer = cascade;
+#endif
+
+}
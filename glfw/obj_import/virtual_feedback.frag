@@ -0,0 +1,38 @@
+#version 450
+
+// Feedback pass of the virtual texture, drawn at a reduced resolution. Every fragment writes the
+// tile it samples (see virtual_texture.h), which is read back to load the tiles on screen.
+
+layout (location = 0) in Block
+{
+    vec2 UV;
+    vec3 N;
+    vec3 worldVertex;
+};
+
+// The size of level 0 in texels, the number of levels and the size of a tile and its border,
+// followed by the size of the tile cache, whether the texture is sparse and the log2 of the
+// reduction of the feedback resolution
+layout (std140, binding = 6) uniform VirtualTexture
+{
+    vec4 virtualLayout;
+    vec4 virtualCache;
+};
+
+// The tile as level << 24 | y << 12 | x
+layout (location = 0) out uint outputTile;
+
+void main() {
+
+    // The derivatives are those of the reduced resolution, so the level of the full resolution is
+    // lower by the log2 of the reduction
+    vec2 dx = dFdx(UV) * virtualLayout.x;
+    vec2 dy = dFdy(UV) * virtualLayout.x;
+    float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) - virtualCache.z, 0.0, virtualLayout.y - 1.0);
+
+    int level = int(lod);
+    int tiles = max(int(virtualLayout.x / virtualLayout.z) >> level, 1);
+    uvec2 tile = uvec2(min(ivec2(fract(UV) * tiles), tiles - 1));
+    outputTile = uint(level) << 24 | tile.y << 12 | tile.x;
+
+}
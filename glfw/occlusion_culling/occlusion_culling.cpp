@@ -0,0 +1,822 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include "../common/program_builder.h"
+#include "../common/asset_io.h"
+#include "../common/frame_pacer.h"
+
+#define DEFAULT_WIDTH 1024
+#define DEFAULT_HEIGHT 768
+
+// Vertex Buffer Identifiers
+#define GLOBAL_MATRICES 0
+#define VERTICES 1
+#define OBJECT_INDICES 2
+#define OBJECTS 3
+#define DRAW_COMMANDS 4
+#define VISIBILITY 5
+
+// Vertex Array attributes
+#define POSITION 0
+#define NORMAL 1
+#define UV 2
+#define OBJECT_INDEX 3
+
+// Vertex Array binding points
+#define STREAM0 0
+#define STREAM1 1
+
+// GLSL Uniform indices
+#define TRANSFORM0 0
+
+// GLSL Shader storage indices
+#define OBJECT_STORAGE 0
+#define COMMAND_STORAGE 1
+#define VISIBILITY_STORAGE 2
+#define STATISTICS_STORAGE 3
+
+// Uniform locations of the compute shaders
+#define PHASE_LOCATION 0
+#define OCCLUSION_LOCATION 1
+#define LEVEL_LOCATION 0
+
+// Work group sizes of the compute shaders
+#define CULL_GROUP_SIZE 64
+#define PYRAMID_GROUP_SIZE 8
+
+// The scene is a grid of cabins, each rotated by a multiple of 90 degrees
+#define GRID_SIZE 32
+#define GRID_SPACING 120.0f
+
+// Near and far planes
+#define Z_NEAR 1.0f
+#define Z_FAR 4000.0f
+
+/*
+ * A structure for storing mesh data. All meshes share a single vertex buffer.
+ */
+typedef struct {
+    GLint first;
+    GLsizei numVertices;
+    GLuint textureName;
+    // Model space bounding box
+    GLfloat boxMin[3];
+    GLfloat boxMax[3];
+} Mesh;
+
+/*
+ * A structure for storing an object, a mesh placed in the scene (std430, see occlusion_cull.comp)
+ */
+typedef struct {
+    GLfloat model[16];
+    // World space bounding box
+    GLfloat boxMin[4];
+    GLfloat boxMax[4];
+} Object;
+
+/*
+ * A structure for storing an indirect draw command (see glMultiDrawArraysIndirect)
+ */
+typedef struct {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+} DrawCommand;
+
+/*
+ * A structure for storing the culling statistics of a frame (std430, see occlusion_cull.comp)
+ */
+typedef struct {
+    GLuint frustumCulled;
+    GLuint occlusionCulled;
+    GLuint drawnFirstPhase;
+    GLuint drawnSecondPhase;
+} CullStatistics;
+
+// A vector of mesh instances
+std::vector<Mesh> meshes;
+
+// Number of cabins in the scene, and the number of objects (meshes of all cabins)
+int numInstances;
+int numObjects;
+
+// The vertex data of all the meshes (POSITION NORMAL UV)
+std::vector<GLfloat> vertices;
+
+// Whether the depth pyramid is used, the frustum culling is always done
+int occlusionCulling = 1;
+
+// Pointers for updating GPU data
+GLfloat *projectionMatrixPtr;
+GLfloat *viewMatrixPtr;
+CullStatistics *statisticsPtrs[2];
+
+// Names
+GLuint programName;
+GLuint cullProgramName;
+GLuint pyramidProgramName;
+GLuint vertexBufferNames[6];
+GLuint statisticsBufferNames[2];
+GLuint vertexArrayName;
+GLuint framebufferName;
+GLuint colorTextureName;
+GLuint depthTextureName;
+GLuint pyramidTextureName;
+GLsync frameFences[2];
+
+// Size of the framebuffer and the number of levels in the depth pyramid
+int framebufferWidth, framebufferHeight;
+int pyramidLevels;
+
+// Builder for compiling the shader programs in parallel with the loading
+ProgramBuilder programBuilder;
+int programIndex;
+int cullProgramIndex;
+int pyramidProgramIndex;
+
+// Statistics of the latest completed frame and the frame time
+CullStatistics frameStatistics;
+int frameCount;
+double statisticsTime;
+
+/*
+ * Load a texture from the specified image file. Returns the texture name or 0 if the image could
+ * not be loaded.
+ */
+GLuint loadTexture(const char *filename) {
+
+    // Read the texture image
+    int width, height, channels;
+    GLubyte *imageData = loadImageAsset(filename, &width, &height, &channels, STBI_default);
+    if (!imageData)
+        return 0;
+
+    if (channels != 3 && channels != 4) {
+        stbi_image_free(imageData);
+        return 0;
+    }
+
+    // Generate a new texture name and activate it
+    GLuint textureName;
+    glGenTextures(1, &textureName);
+    glBindTexture(GL_TEXTURE_2D, textureName);
+
+    // Set sampler properties
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    if (channels == 3)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData);
+
+    // Generate mip map images
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    // Deactivate the texture and free the image data
+    glBindTexture(GL_TEXTURE_2D, 0);
+    stbi_image_free(imageData);
+
+    return textureName;
+
+}
+
+/*
+ * Load a model from the specified obj-file into the global vertex data, recording the range and
+ * bounding box of every mesh. The material library and textures are expected in the same directory
+ * as the obj-file.
+ */
+int loadObj(const char *filename) {
+
+    // Variables for storing the data in the OBJ-data
+    tinyobj::attrib_t attributes;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+
+    // String used to return an error message from tiny_obj_loader
+    std::string errorString;
+
+    // Find the directory of the obj-file
+    std::string directory = filename;
+    size_t separator = directory.find_last_of("/\\");
+    directory = separator == std::string::npos ? "./" : directory.substr(0, separator + 1);
+
+    // Load the file, or return FALSE if an error occured
+    if (!loadObjAsset(&attributes, &shapes, &materials, &errorString, filename, directory.c_str()))
+        return 0;
+
+    // Loop through all the shapes in the OBJ-data
+    for(int m=0; m<shapes.size(); ++m) {
+
+        // Create a new Mesh instance and store a local ponter for easy access
+        meshes.push_back(Mesh());
+        Mesh *mesh = &meshes[meshes.size()-1];
+
+        // Store a pointer to the mesh of the current shape
+        tinyobj::mesh_t *objMesh = &shapes[m].mesh;
+
+        // Load the texture of the first face in the mesh. This is used for the entire mesh.
+        mesh->textureName = 0;
+        if (objMesh->material_ids[0] >= 0 && !materials[objMesh->material_ids[0]].diffuse_texname.empty()) {
+            std::string textureFilename = directory + materials[objMesh->material_ids[0]].diffuse_texname;
+            if (!(mesh->textureName = loadTexture(textureFilename.c_str())))
+                return 0;
+        }
+
+        // Store the range of the mesh in the vertex data
+        mesh->first = vertices.size() / 8;
+        int numVertices = mesh->numVertices = objMesh->indices.size();
+
+        // Store the vertices (POSITION NORMAL UV) while finding the bounding box
+        for (int c=0; c<3; ++c) {
+            mesh->boxMin[c] = 1e30f;
+            mesh->boxMax[c] = -1e30f;
+        }
+        for (int v=0; v<numVertices; ++v) {
+            tinyobj::index_t idx = objMesh->indices[v];
+            for (int c=0; c<3; ++c) {
+                GLfloat position = attributes.vertices[idx.vertex_index*3+c];
+                mesh->boxMin[c] = fminf(mesh->boxMin[c], position);
+                mesh->boxMax[c] = fmaxf(mesh->boxMax[c], position);
+                vertices.push_back(position);
+            }
+            vertices.push_back(attributes.normals[idx.normal_index*3]);
+            vertices.push_back(attributes.normals[idx.normal_index*3+1]);
+            vertices.push_back(attributes.normals[idx.normal_index*3+2]);
+            vertices.push_back(attributes.texcoords[idx.texcoord_index*2]);
+            vertices.push_back(1.0f - attributes.texcoords[idx.texcoord_index*2+1]);
+        }
+
+    }
+
+    return 1;
+
+}
+
+/*
+ * Place the cabins in a grid and create the objects, draw commands and visibility of every mesh
+ * of every cabin. The commands are ordered by mesh, so all the commands of a mesh can be drawn
+ * with a single multi draw call.
+ */
+void createScene() {
+
+    numInstances = GRID_SIZE * GRID_SIZE;
+    numObjects = numInstances * meshes.size();
+
+    std::vector<Object> objects(numObjects);
+    std::vector<DrawCommand> commands(numObjects);
+    std::vector<GLuint> objectIndices(numObjects);
+
+    for (int m=0; m<meshes.size(); ++m)
+        for (int i=0; i<numInstances; ++i) {
+
+            int objectIndex = m * numInstances + i;
+
+            // Place the cabin in the grid, rotated by a multiple of 90 degrees
+            float x = ((i % GRID_SIZE) - (GRID_SIZE - 1) * 0.5f) * GRID_SPACING;
+            float z = ((i / GRID_SIZE) - (GRID_SIZE - 1) * 0.5f) * GRID_SPACING;
+            glm::mat4 model = glm::mat4(1.0f);
+            model = glm::translate(model, glm::vec3(x, 0.0f, z));
+            model = glm::rotate(model, (i * 7 % 4) * glm::pi<float>() * 0.5f, glm::vec3(0.0f, 1.0f, 0.0f));
+            memcpy(objects[objectIndex].model, &model[0][0], 16 * sizeof(GLfloat));
+
+            // Find the world space bounding box from the corners of the mesh bounding box
+            Mesh *mesh = &meshes[m];
+            glm::vec3 boxMin(1e30f), boxMax(-1e30f);
+            for (int c=0; c<8; ++c) {
+                glm::vec4 corner = model * glm::vec4(c & 1 ? mesh->boxMax[0] : mesh->boxMin[0], c & 2 ? mesh->boxMax[1] : mesh->boxMin[1],
+                        c & 4 ? mesh->boxMax[2] : mesh->boxMin[2], 1.0f);
+                boxMin = glm::min(boxMin, glm::vec3(corner));
+                boxMax = glm::max(boxMax, glm::vec3(corner));
+            }
+            for (int c=0; c<3; ++c) {
+                objects[objectIndex].boxMin[c] = boxMin[c];
+                objects[objectIndex].boxMax[c] = boxMax[c];
+            }
+            objects[objectIndex].boxMin[3] = objects[objectIndex].boxMax[3] = 1.0f;
+
+            // The base instance offsets the instanced object index attribute
+            commands[objectIndex].count = mesh->numVertices;
+            commands[objectIndex].instanceCount = 1;
+            commands[objectIndex].first = mesh->first;
+            commands[objectIndex].baseInstance = objectIndex;
+            objectIndices[objectIndex] = objectIndex;
+
+        }
+
+    // Everything is drawn in the first phase of the first frame
+    std::vector<GLuint> visibility(numObjects, 1);
+
+    // Create the buffers, only ever accessed by the GPU after this
+    glNamedBufferStorage(vertexBufferNames[VERTICES], vertices.size() * sizeof(GLfloat), &vertices[0], 0);
+    glNamedBufferStorage(vertexBufferNames[OBJECT_INDICES], numObjects * sizeof(GLuint), &objectIndices[0], 0);
+    glNamedBufferStorage(vertexBufferNames[OBJECTS], numObjects * sizeof(Object), &objects[0], 0);
+    glNamedBufferStorage(vertexBufferNames[DRAW_COMMANDS], numObjects * sizeof(DrawCommand), &commands[0], 0);
+    glNamedBufferStorage(vertexBufferNames[VISIBILITY], numObjects * sizeof(GLuint), &visibility[0], 0);
+
+    // Create and initialize a vertex array object
+    glCreateVertexArrays(1, &vertexArrayName);
+
+    // Associate vertex attributes with the binding points (POSITION NORMAL UV) (OBJECT_INDEX)
+    glVertexArrayAttribBinding(vertexArrayName, POSITION, STREAM0);
+    glVertexArrayAttribBinding(vertexArrayName, NORMAL, STREAM0);
+    glVertexArrayAttribBinding(vertexArrayName, UV, STREAM0);
+    glVertexArrayAttribBinding(vertexArrayName, OBJECT_INDEX, STREAM1);
+
+    // Enable the attributes
+    glEnableVertexArrayAttrib(vertexArrayName, POSITION);
+    glEnableVertexArrayAttrib(vertexArrayName, NORMAL);
+    glEnableVertexArrayAttrib(vertexArrayName, UV);
+    glEnableVertexArrayAttrib(vertexArrayName, OBJECT_INDEX);
+
+    // Specify the format of the attributes
+    glVertexArrayAttribFormat(vertexArrayName, POSITION, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribFormat(vertexArrayName, NORMAL, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat));
+    glVertexArrayAttribFormat(vertexArrayName, UV, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat));
+    glVertexArrayAttribIFormat(vertexArrayName, OBJECT_INDEX, 1, GL_UNSIGNED_INT, 0);
+
+    // Bind the buffers to the vertex array, advancing the object index once per instance
+    glVertexArrayVertexBuffer(vertexArrayName, STREAM0, vertexBufferNames[VERTICES], 0, 8 * sizeof(GLfloat));
+    glVertexArrayVertexBuffer(vertexArrayName, STREAM1, vertexBufferNames[OBJECT_INDICES], 0, sizeof(GLuint));
+    glVertexArrayBindingDivisor(vertexArrayName, STREAM1, 1);
+
+    printf("Scene: %d cabins, %d objects, %d vertices per cabin\n", numInstances, numObjects, (int)(vertices.size() / 8));
+
+}
+
+// Pacer of the main loop
+FramePacer framePacer;
+
+/*
+ * Callback function for OpenGL debug messages
+ */
+void glDebugCallback(GLenum sources, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *msg, const void *userParam) {
+    printf("DEBUG: %s\n", msg);
+}
+
+/*
+ * Initialize OpenGL
+ */
+int initGL() {
+
+    // Register the debug callback function
+    glDebugMessageCallback(glDebugCallback, NULL);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+    // Create and initialize buffer names
+    glCreateBuffers(6, vertexBufferNames);
+
+    // Allocate storage for the transformation matrices and retrieve their addresses
+    glNamedBufferStorage(vertexBufferNames[GLOBAL_MATRICES], 16 * sizeof(GLfloat) * 2, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    GLfloat *globalMatricesPtr = (GLfloat *)glMapNamedBufferRange(vertexBufferNames[GLOBAL_MATRICES], 0, 16 * sizeof(GLfloat) * 2,
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    projectionMatrixPtr = globalMatricesPtr;
+    viewMatrixPtr = globalMatricesPtr + 16;
+
+    // The statistics written by the culling shader are read back two frames later, so every frame
+    // in flight has its own buffer
+    glCreateBuffers(2, statisticsBufferNames);
+    for (int f=0; f<2; ++f) {
+        CullStatistics statistics = { 0, 0, 0, 0 };
+        glNamedBufferStorage(statisticsBufferNames[f], sizeof(CullStatistics), &statistics, GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+        statisticsPtrs[f] = (CullStatistics *)glMapNamedBufferRange(statisticsBufferNames[f], 0, sizeof(CullStatistics),
+                GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+        frameFences[f] = 0;
+    }
+
+    // Initialize the program builder
+    initProgramBuilder(&programBuilder);
+
+    // Load the shader sources and issue the compilation and linking of the programs. The results
+    // are collected after the OBJ-file has been loaded, allowing the driver to compile in parallel.
+    AssetView vertexSource, fragmentSource, cullSource, pyramidSource;
+    if (!openAsset("scene.vert", &vertexSource) ||
+            !openAsset("scene.frag", &fragmentSource) ||
+            !openAsset("occlusion_cull.comp", &cullSource) ||
+            !openAsset("depth_pyramid.comp", &pyramidSource)) {
+        printf("ERROR Unable to read the shader sources\n");
+        return 0;
+    }
+    ShaderSource sources[] = {
+        { GL_VERTEX_SHADER, vertexSource.data, (GLint)vertexSource.size },
+        { GL_FRAGMENT_SHADER, fragmentSource.data, (GLint)fragmentSource.size }
+    };
+    ShaderSource cullSources[] = {
+        { GL_COMPUTE_SHADER, cullSource.data, (GLint)cullSource.size }
+    };
+    ShaderSource pyramidSources[] = {
+        { GL_COMPUTE_SHADER, pyramidSource.data, (GLint)pyramidSource.size }
+    };
+    programIndex = addProgram(&programBuilder, sources, 2);
+    cullProgramIndex = addProgram(&programBuilder, cullSources, 1);
+    pyramidProgramIndex = addProgram(&programBuilder, pyramidSources, 1);
+    closeAsset(&vertexSource);
+    closeAsset(&fragmentSource);
+    closeAsset(&cullSource);
+    closeAsset(&pyramidSource);
+
+    // Enable depth buffer testing
+    glEnable(GL_DEPTH_TEST);
+
+    return 1;
+
+}
+
+/*
+ * Create the framebuffer the scene is drawn to and the depth pyramid, replacing any previous ones.
+ * The depth is drawn to a texture so the pyramid can be built from it.
+ */
+int createFramebuffer(int width, int height) {
+
+    glDeleteFramebuffers(1, &framebufferName);
+    glDeleteTextures(1, &colorTextureName);
+    glDeleteTextures(1, &depthTextureName);
+    glDeleteTextures(1, &pyramidTextureName);
+
+    framebufferWidth = width;
+    framebufferHeight = height;
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &colorTextureName);
+    glTextureStorage2D(colorTextureName, 1, GL_RGBA8, width, height);
+    glCreateTextures(GL_TEXTURE_2D, 1, &depthTextureName);
+    glTextureStorage2D(depthTextureName, 1, GL_DEPTH_COMPONENT32F, width, height);
+
+    glCreateFramebuffers(1, &framebufferName);
+    glNamedFramebufferTexture(framebufferName, GL_COLOR_ATTACHMENT0, colorTextureName, 0);
+    glNamedFramebufferTexture(framebufferName, GL_DEPTH_ATTACHMENT, depthTextureName, 0);
+    if (glCheckNamedFramebufferStatus(framebufferName, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Scene framebuffer is incomplete\n");
+        return 0;
+    }
+
+    // The pyramid has the size of the depth buffer at level 0 and is halved down to a single texel
+    pyramidLevels = 1;
+    while ((width | height) >> pyramidLevels)
+        pyramidLevels++;
+    glCreateTextures(GL_TEXTURE_2D, 1, &pyramidTextureName);
+    glTextureStorage2D(pyramidTextureName, pyramidLevels, GL_R32F, width, height);
+    glTextureParameteri(pyramidTextureName, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTextureParameteri(pyramidTextureName, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    return 1;
+
+}
+
+/*
+ * Build the depth pyramid from the depth buffer, one level at a time
+ */
+void buildDepthPyramid() {
+
+    glUseProgram(pyramidProgramName);
+    glBindTextureUnit(0, depthTextureName);
+
+    for (int level=0; level<pyramidLevels; ++level) {
+
+        int width = framebufferWidth >> level, height = framebufferHeight >> level;
+        if (width < 1) width = 1;
+        if (height < 1) height = 1;
+
+        // Read the previous level and write the current one
+        glProgramUniform1i(pyramidProgramName, LEVEL_LOCATION, level);
+        glBindImageTexture(0, pyramidTextureName, level > 0 ? level - 1 : 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, pyramidTextureName, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, (height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+
+        // The next level reads the one just written
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    }
+
+    // The culling shader reads the pyramid through a sampler
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    glBindTextureUnit(0, 0);
+
+}
+
+/*
+ * Run a phase of the culling shader, writing the instance count of every draw command
+ */
+void cullObjects(int phase) {
+
+    glUseProgram(cullProgramName);
+    glProgramUniform1ui(cullProgramName, PHASE_LOCATION, phase);
+    glProgramUniform1i(cullProgramName, OCCLUSION_LOCATION, occlusionCulling);
+    glBindTextureUnit(0, pyramidTextureName);
+
+    glDispatchCompute((numObjects + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // The commands are read by the indirect draws
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindTextureUnit(0, 0);
+
+}
+
+/*
+ * Draw the objects of the current phase, with one multi draw call for the commands of each mesh
+ */
+void drawObjects() {
+
+    glUseProgram(programName);
+    glBindVertexArray(vertexArrayName);
+
+    for (int m=0; m<meshes.size(); ++m) {
+        glBindTextureUnit(0, meshes[m].textureName);
+        glMultiDrawArraysIndirect(GL_TRIANGLES, (void *)(m * numInstances * sizeof(DrawCommand)), numInstances, 0);
+    }
+
+    glBindTextureUnit(0, 0);
+    glBindVertexArray(0);
+
+}
+
+/*
+ * Read the statistics of the frame that last used the buffer and print the counts once every
+ * second
+ */
+void updateStatistics(int frame) {
+
+    // Wait for the GPU to complete the frame
+    if (!frameFences[frame])
+        return;
+    glClientWaitSync(frameFences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync(frameFences[frame]);
+    frameFences[frame] = 0;
+
+    frameStatistics = *statisticsPtrs[frame];
+    frameCount++;
+
+    double time = glfwGetTime();
+    if (time - statisticsTime < 1.0)
+        return;
+
+    printf("%d visible (%d first phase, %d second phase), %d occluded, %d outside frustum, frame %.3f ms\n",
+            frameStatistics.drawnFirstPhase + frameStatistics.drawnSecondPhase, frameStatistics.drawnFirstPhase,
+            frameStatistics.drawnSecondPhase, frameStatistics.occlusionCulled, frameStatistics.frustumCulled,
+            (time - statisticsTime) * 1000.0 / frameCount);
+
+    frameCount = 0;
+    statisticsTime = time;
+
+}
+
+/*
+ * Draw OpenGL screne
+ */
+void drawGLScene() {
+
+    // Read and reset the statistics buffer of this frame
+    static int frame = 0;
+    int statisticsIndex = frame % 2;
+    updateStatistics(statisticsIndex);
+    glClearNamedBufferData(statisticsBufferNames[statisticsIndex], GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    frame++;
+
+    // Walk down the street in the middle of the grid while looking around
+    float time = (float)glfwGetTime();
+    glm::vec3 eye = glm::vec3(0.0f, 15.0f, cosf(time * 0.05f) * GRID_SIZE * GRID_SPACING * 0.45f);
+    float yaw = sinf(time * 0.3f) * 1.2f;
+    glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(sinf(yaw), 0.0f, -cosf(yaw)), glm::vec3(0.0f, 1.0f, 0.0f));
+    memcpy(viewMatrixPtr, &view[0][0], 16 * sizeof(GLfloat));
+
+    // Bind buffers to GLSL uniform and shader storage indices
+    glBindBufferBase(GL_UNIFORM_BUFFER, TRANSFORM0, vertexBufferNames[GLOBAL_MATRICES]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_STORAGE, vertexBufferNames[OBJECTS]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_STORAGE, vertexBufferNames[DRAW_COMMANDS]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBILITY_STORAGE, vertexBufferNames[VISIBILITY]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATISTICS_STORAGE, statisticsBufferNames[statisticsIndex]);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, vertexBufferNames[DRAW_COMMANDS]);
+
+    // Clear color and depth buffers
+    glBindFramebuffer(GL_FRAMEBUFFER, framebufferName);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // First phase, draw the objects that were visible in the previous frame
+    cullObjects(0);
+    drawObjects();
+
+    // Second phase, build the depth pyramid from what has been drawn and draw the objects that are
+    // not hidden behind it and were not drawn in the first phase
+    if (occlusionCulling)
+        buildDepthPyramid();
+    cullObjects(1);
+    drawObjects();
+
+    // Copy the result to the window
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBlitNamedFramebuffer(framebufferName, 0, 0, 0, framebufferWidth, framebufferHeight, 0, 0, framebufferWidth, framebufferHeight,
+            GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    // Make the statistics visible to the mapped pointer and mark the end of the frame
+    glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+    frameFences[statisticsIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    // Disable
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glUseProgram(0);
+
+}
+
+void resizeGL(int width, int height) {
+
+    // Prevent division by zero
+    if (height == 0)
+        height = 1;
+
+    // Change the projection matrix
+    glm::mat4 proj = glm::perspective(3.14f/2.0f, (float)width/height, Z_NEAR, Z_FAR);
+    memcpy(projectionMatrixPtr, &proj[0][0], 16 * sizeof(GLfloat));
+
+    // The framebuffer and depth pyramid follow the size of the window
+    if (width > 0)
+        createFramebuffer(width, height);
+
+    // Set the OpenGL viewport
+    glViewport(0, 0, width, height);
+
+}
+
+/*
+ * Error callback function for GLFW
+ */
+static void glfwErrorCallback(int error, const char* description) {
+    fprintf(stderr, "Error: %s\n", description);
+}
+
+/*
+ * Input event callback function for GLFW
+ */
+static void glfwKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+
+    if (action != GLFW_PRESS)
+        return;
+
+    if (key == GLFW_KEY_ESCAPE)
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+    // Toggle the occlusion culling, the frustum culling stays active
+    else if (key == GLFW_KEY_O) {
+        occlusionCulling = !occlusionCulling;
+        printf("Occlusion culling %s\n", occlusionCulling ? "on" : "off");
+    }
+
+    // Cycle through the frame pacing modes
+    else if (key == GLFW_KEY_F)
+        cycleFramePacingMode(&framePacer);
+
+}
+
+/*
+ * Window size changed callback function for GLFW
+ */
+void glfwWindowSizeCallback(GLFWwindow* window, int width, int height) {
+
+    resizeGL(width, height);
+
+}
+
+/*
+ * Program entry function
+ */
+int main(int nargs, const char **argv) {
+
+    // Ensure that there is one argument (besides the program name)
+    if (nargs != 2) {
+        printf("Usage: %s <obj-file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Set error callback
+    glfwSetErrorCallback(glfwErrorCallback);
+
+    // Initialize GLFW
+    if (!glfwInit()) {
+        printf("Failed to initialize GLFW\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Specify minimum OpenGL version
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+
+    // Create window
+    GLFWwindow* window = glfwCreateWindow(DEFAULT_WIDTH, DEFAULT_HEIGHT, "Occlusion Culling", NULL, NULL);
+    if (!window) {
+        printf("Failed to create GLFW window\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Set input key event callback
+    glfwSetKeyCallback(window, glfwKeyCallback);
+
+    // Set window resize callback
+    glfwSetWindowSizeCallback(window, glfwWindowSizeCallback);
+
+    // Make the context current
+    glfwMakeContextCurrent(window);
+
+    // Initialize GLEW
+    if (glewInit() != GLEW_OK) {
+        printf("Failed to initialize GLEW\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Make GLFW swap buffers directly
+    glfwSwapInterval(0);
+
+    // Initialize OpenGL
+    if (!initGL()) {
+        printf("Failed to initialize OpenGL\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Load the OBJ-file
+    if (!loadObj(argv[1])) {
+        printf("Failed to load %s.\n", argv[1]);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Place the cabins
+    createScene();
+
+    // Wait for the shader programs that have been compiling while the OBJ-file was loaded
+    while (!pollPrograms(&programBuilder))
+        glfwWaitEventsTimeout(0.001);
+    if (!finishPrograms(&programBuilder)) {
+        printf("Failed to build shader programs\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    programName = getProgram(&programBuilder, programIndex);
+    cullProgramName = getProgram(&programBuilder, cullProgramIndex);
+    pyramidProgramName = getProgram(&programBuilder, pyramidProgramIndex);
+
+    // Initialize OpenGL view
+    resizeGL(DEFAULT_WIDTH, DEFAULT_HEIGHT);
+
+    printf("O toggles the occlusion culling\n");
+    statisticsTime = glfwGetTime();
+
+    // Pace the frames to the refresh rate of the monitor
+    initFramePacer(&framePacer, PACING_JUST_IN_TIME);
+    printf("F cycles through the frame pacing modes\n");
+
+    // Run a loop until the window is closed
+    while (!glfwWindowShouldClose(window)) {
+
+        // Wait for the next frame and poll for input events
+        beginPacedFrame(&framePacer);
+
+        // Draw OpenGL screne
+        drawGLScene();
+
+        // Show the counts of the latest completed frame
+        char title[128];
+        snprintf(title, sizeof(title), "Occlusion Culling - %d visible, %d occluded, %d outside frustum",
+                frameStatistics.drawnFirstPhase + frameStatistics.drawnSecondPhase, frameStatistics.occlusionCulled,
+                frameStatistics.frustumCulled);
+        glfwSetWindowTitle(window, title);
+
+        // Swap buffers
+        glfwSwapBuffers(window);
+
+        // Issue the fence and timestamp of the frame
+        endPacedFrame(&framePacer);
+
+    }
+
+    // Print the statistics of the last pacing mode
+    destroyFramePacer(&framePacer);
+
+    // Shutdown GLFW
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    // Exit
+    exit(EXIT_SUCCESS);
+
+}
@@ -0,0 +1,25 @@
+#version 450
+
+// Incoming interpolated (between vertices) values
+layout (location = 0) in Block
+{
+    vec2 UV;
+    vec3 N;
+};
+
+// Outgoing final color.
+layout (location = 0) out vec4 outputColor;
+
+// Texture sampler
+layout (binding = 0) uniform sampler2D textureSampler;
+
+// Direction towards the sun
+const vec3 lightDirection = normalize(vec3(0.4, 1.0, 0.3));
+
+void main()
+{
+    vec4 color = texture(textureSampler, UV);
+
+    float diffuse = max(dot(normalize(N), lightDirection), 0.0);
+    outputColor = vec4(color.rgb * (0.3 + 0.7 * diffuse), color.a);
+}
@@ -0,0 +1,52 @@
+#version 450
+
+// Incoming vertex position, Model Space.
+layout (location = 0) in vec3 position;
+
+// Incoming normal
+layout (location = 1) in vec3 normal;
+
+// Incoming texture coordinates
+layout (location = 2) in vec2 uv;
+
+// Index of the object, an instanced attribute offset by the base instance of the draw command
+layout (location = 3) in uint objectIndex;
+
+struct Object
+{
+    mat4 model;
+    // World space bounding box
+    vec4 boxMin;
+    vec4 boxMax;
+};
+
+// Projection and view matrices.
+layout (binding = 0, std140) uniform Transform0
+{
+    mat4 proj;
+    mat4 view;
+};
+
+layout (binding = 0, std430) readonly buffer Objects
+{
+    Object objects[];
+};
+
+// Output
+layout (location = 0) out Block
+{
+    vec2 UV;
+    vec3 N;
+};
+
+void main() {
+
+    mat4 model = objects[objectIndex].model;
+
+    gl_Position = proj * (view * (model * vec4(position, 1)));
+
+    // Set the transformed normal
+    N = mat3(model) * normal;
+
+    UV = uv;
+}
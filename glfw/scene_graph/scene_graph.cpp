@@ -0,0 +1,721 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include "../common/asset_io.h"
+#include "../common/frame_pacer.h"
+#include "../common/job_system.h"
+#include "../common/scene_graph.h"
+
+#define DEFAULT_WIDTH 1024
+#define DEFAULT_HEIGHT 768
+
+// Vertex Buffer Identifiers
+#define VERTICES 0
+#define INDICES 1
+#define GLOBAL_MATRICES 2
+#define WORLD_MATRICES 3
+#define LIGHT_PROPERTIES 4
+#define MATERIAL_PROPERTIES 5
+#define CAMERA_PROPERTIES 6
+
+// Vertex Array attributes
+#define POSITION 0
+#define COLOR 1
+#define NORMAL 2
+
+// Vertex Array binding points
+#define STREAM0 0
+
+// GLSL Uniform indices
+#define TRANSFORM0 0
+#define LIGHT 2
+#define MATERIAL 3
+#define CAMERA 4
+
+// GLSL Uniform locations
+#define FIRST_NODE_LOCATION 0
+
+// GLSL Shader storage indices
+#define NODE_STORAGE 0
+
+// Children of every node above the cubes unless given on the command line. A district holds
+// buildings and a building holds cubes, so the default scene has just over a million nodes.
+#define DEFAULT_BRANCHING 100
+
+// Distance between the cubes of a building
+#define CUBE_SPACING 2.5f
+
+// Moving districts and cubes at the start
+#define DEFAULT_MOVING_DISTRICTS 1
+#define DEFAULT_MOVING_CUBES 1024
+
+// Step through the cubes when picking the moving ones, a prime so they are spread over the scene
+#define MOVING_CUBE_STRIDE 7919
+
+// Unchanged matrices uploaded rather than starting another upload
+#define UPLOAD_GAP 16
+
+// Updates measured for every case when benchmarking
+#define BENCHMARK_UPDATES 20
+
+// Vertices
+GLfloat vertices[] = {
+    // Front
+    -1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+    -1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+    1.0f, -1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+    1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+    // Back
+    1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f,
+    1.0f, -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f,
+    -1.0f, -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f,
+    -1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f,
+    // Left
+    -1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f,
+    -1.0f, -1.0f, -1.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f,
+    -1.0f, -1.0f, 1.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f,
+    -1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f,
+    // Right
+    1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+    1.0f, -1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+    1.0f, -1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+    1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+    // Top
+    -1.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+    -1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+    1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+    1.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+    // Bottom
+    -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f,
+    -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f,
+    1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f,
+    1.0f, -1.0f, 1.0f,  0.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f
+};
+
+GLushort indices[] {
+    // Front
+    0, 1, 2, 2, 3, 0,
+    // Back
+    4, 5, 6, 6, 7, 4,
+    // Left
+    8, 9, 10, 10, 11, 8,
+    // Right
+    12, 13, 14, 14, 15, 12,
+    // Top
+    16, 17, 18, 18, 19, 16,
+    // Bottom
+    20, 21, 22, 22, 23, 20
+};
+
+// Light properties (4 valued vectors due to std140 see OpenGL 4.5 reference)
+GLfloat lightProperties[] {
+    // Position
+    0.0f, 0.0f, 4.0f, 0.0f,
+    // Ambient Color
+    0.0f, 0.0f, 0.2f, 0.0f,
+    // Diffuse Color
+    0.5f, 0.5f, 0.5f, 0.0f,
+    // Specular Color
+    0.6f, 0.6f, 0.6f, 0.0f
+};
+
+GLfloat materialProperties[] = {
+    // Shininess color
+    1.0f, 1.0f, 1.0f, 1.0f,
+    // Shininess
+    32.0f
+};
+
+// Camera properties
+GLfloat cameraProperties[] {
+    0.0f, 0.0f, 4.0f
+};
+
+// Nodes of the scene, a root holding the districts, and the districts and cubes that move
+SceneGraph sceneGraph;
+std::vector<int> districtNodes;
+int firstCubeNode, numCubes;
+int movingDistricts = DEFAULT_MOVING_DISTRICTS;
+int movingCubes = DEFAULT_MOVING_CUBES;
+int paused;
+
+// Ranges of world matrices uploaded in the current frame
+std::vector<NodeRange> uploadRanges;
+
+// Far plane, placed behind the farthest cube
+float zFar = 100.0f;
+
+// Pointers for updating GPU data
+GLfloat *projectionMatrixPtr;
+GLfloat *viewMatrixPtr;
+
+// Names
+GLuint programName;
+GLuint vertexArrayName;
+GLuint vertexBufferNames[7];
+
+// Workers updating the scene graph
+JobSystem jobSystem;
+
+// Time spent updating and uploading, and the nodes and bytes changed, since the statistics were
+// last printed
+double updateTime, uploadTime, statisticsTime;
+long long changedNodes, uploadedBytes;
+int statisticsFrames;
+
+// Pacer of the main loop
+FramePacer framePacer;
+
+/*
+ * Callback function for OpenGL debug messages
+ */
+void glDebugCallback(GLenum sources, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *msg, const void *userParam) {
+    printf("DEBUG: %s\n", msg);
+}
+
+/*
+ * Initialize OpenGL
+ */
+int initGL() {
+
+    // Register the debug callback function
+    glDebugMessageCallback(glDebugCallback, NULL);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+    // Create and initialize 7 buffer names
+    glCreateBuffers(7, vertexBufferNames);
+
+    // Allocate storage for the vertex array buffers
+    glNamedBufferStorage(vertexBufferNames[VERTICES], 6 * 4 * 9 * sizeof(GLfloat), vertices, 0);
+
+    // Allocate storage for the triangle indices
+    glNamedBufferStorage(vertexBufferNames[INDICES], 3 * 2 * 6 * sizeof(GLshort), indices, 0);
+
+    // Allocate storage for the transformation matrices and retrieve their addresses
+    glNamedBufferStorage(vertexBufferNames[GLOBAL_MATRICES], 16 * sizeof(GLfloat) * 2, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+
+    // Allocate storage for the world matrix of every node, starting with the matrices of the first
+    // update. Later updates only upload the matrices that changed.
+    glNamedBufferStorage(vertexBufferNames[WORLD_MATRICES], sceneGraph.numNodes * sizeof(glm::mat4), &sceneGraph.worldMatrices[0][0][0], GL_DYNAMIC_STORAGE_BIT);
+
+    // Allocate storage for the buffers used for lighting calculations
+    glNamedBufferStorage(vertexBufferNames[LIGHT_PROPERTIES], 16 * sizeof(GLfloat), lightProperties, 0);
+    glNamedBufferStorage(vertexBufferNames[MATERIAL_PROPERTIES], 5 * sizeof(GLfloat), materialProperties, 0);
+    glNamedBufferStorage(vertexBufferNames[CAMERA_PROPERTIES], 3 * sizeof(GLfloat), cameraProperties, 0);
+
+    // Get a pointer to the global matrices data
+    GLfloat *globalMatricesPtr = (GLfloat *)glMapNamedBufferRange(vertexBufferNames[GLOBAL_MATRICES], 0, 16 * sizeof(GLfloat) * 2,
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    projectionMatrixPtr = globalMatricesPtr;
+    viewMatrixPtr = globalMatricesPtr + 16;
+
+    // Create and initialize a vertex array object
+    glCreateVertexArrays(1, &vertexArrayName);
+
+    // Associate attributes with binding points
+    glVertexArrayAttribBinding(vertexArrayName, POSITION, STREAM0);
+    glVertexArrayAttribBinding(vertexArrayName, COLOR, STREAM0);
+    glVertexArrayAttribBinding(vertexArrayName, NORMAL, STREAM0);
+
+    // Specify attribute format
+    glVertexArrayAttribFormat(vertexArrayName, POSITION, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribFormat(vertexArrayName, COLOR, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GL_FLOAT));
+    glVertexArrayAttribFormat(vertexArrayName, NORMAL, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GL_FLOAT));
+
+    // Enable the attributes
+    glEnableVertexArrayAttrib(vertexArrayName, POSITION);
+    glEnableVertexArrayAttrib(vertexArrayName, COLOR);
+    glEnableVertexArrayAttrib(vertexArrayName, NORMAL);
+
+    // Bind the indices to the vertex array
+    glVertexArrayElementBuffer(vertexArrayName, vertexBufferNames[INDICES]);
+
+    // Bind the vertex buffer to the vertex array
+    glVertexArrayVertexBuffer(vertexArrayName, STREAM0, vertexBufferNames[VERTICES], 0, 9 * sizeof(GLfloat));
+
+    // Load and compile vertex shader
+    GLuint vertexName = glCreateShader(GL_VERTEX_SHADER);
+    AssetView vertexSource;
+    if (!openAsset("scene_graph.vert", &vertexSource)) {
+        printf("ERROR Unable to read scene_graph.vert\n");
+        return 0;
+    }
+    GLint vertexLength = (GLint)vertexSource.size;
+    glShaderSource(vertexName, 1, &vertexSource.data, &vertexLength);
+    closeAsset(&vertexSource);
+    GLint compileStatus;
+    glCompileShader(vertexName);
+    glGetShaderiv(vertexName, GL_COMPILE_STATUS, &compileStatus);
+    if (!compileStatus) {
+        GLint logSize = 0;
+        glGetShaderiv(vertexName, GL_INFO_LOG_LENGTH, &logSize);
+        char *errorLog = (char *)malloc(sizeof(char) * logSize);
+        glGetShaderInfoLog(vertexName, logSize, &logSize, errorLog);
+        glDeleteShader(vertexName);
+        printf("VERTEX ERROR %s\n", errorLog);
+        free(errorLog);
+        return 0;
+    }
+
+    // Load and compile fragment shader
+    GLuint fragmentName = glCreateShader(GL_FRAGMENT_SHADER);
+    AssetView fragmentSource;
+    if (!openAsset("simple_lighting.frag", &fragmentSource)) {
+        printf("ERROR Unable to read simple_lighting.frag\n");
+        return 0;
+    }
+    GLint fragmentLength = (GLint)fragmentSource.size;
+    glShaderSource(fragmentName, 1, &fragmentSource.data, &fragmentLength);
+    closeAsset(&fragmentSource);
+    glCompileShader(fragmentName);
+    glGetShaderiv(fragmentName, GL_COMPILE_STATUS, &compileStatus);
+    if (!compileStatus) {
+        GLint logSize = 0;
+        glGetShaderiv(fragmentName, GL_INFO_LOG_LENGTH, &logSize);
+        char *errorLog = (char *)malloc(sizeof(char) * logSize);
+        glGetShaderInfoLog(fragmentName, logSize, &logSize, errorLog);
+        glDeleteShader(fragmentName);
+
+        printf("FRAGMENT ERROR %s\n", errorLog);
+        free(errorLog);
+        return 0;
+    }
+
+    // Create and link vertex program
+    programName = glCreateProgram();
+    glAttachShader(programName, vertexName);
+    glAttachShader(programName, fragmentName);
+    glLinkProgram(programName);
+    GLint linkStatus;
+    glGetProgramiv(programName, GL_LINK_STATUS, &linkStatus);
+    if (!linkStatus) {
+        GLint logSize = 0;
+        glGetProgramiv(programName, GL_INFO_LOG_LENGTH, &logSize);
+        char *errorLog = (char *)malloc(sizeof(char) * logSize);
+        glGetProgramInfoLog(programName, logSize, &logSize, errorLog);
+
+        printf("LINK ERROR %s\n", errorLog);
+        free(errorLog);
+        return 0;
+    }
+
+    // Enable depth buffer testing
+    glEnable(GL_DEPTH_TEST);
+
+    return 1;
+
+}
+
+/*
+ * Get the position of child number i of a node whose children are placed on a square grid with the
+ * given side and spacing, centered on the node
+ */
+glm::vec3 getGridPosition(int i, int side, float spacing) {
+
+    float extent = side * spacing;
+    return glm::vec3(((i % side) + 0.5f) * spacing - extent * 0.5f, 0.0f, ((i / side) + 0.5f) * spacing - extent * 0.5f);
+
+}
+
+/*
+ * Build the scene graph: a root holding a grid of districts, each holding a grid of buildings,
+ * each holding a grid of cubes with random heights. The nodes are added depth first, as a loader
+ * would, and sorted when the graph is finished. The world matrices are computed once, and the
+ * camera and light are placed above the scene.
+ */
+void createScene(int branching) {
+
+    int side = (int)ceil(sqrt((double)branching));
+    float buildingSpacing = (side + 1) * CUBE_SPACING;
+    float districtSpacing = (side + 1) * buildingSpacing;
+    float extent = side * districtSpacing;
+
+    initSceneGraph(&sceneGraph);
+    int root = addSceneNode(&sceneGraph, -1, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+
+    srand(1);
+    for (int d=0; d<branching; ++d) {
+
+        int district = addSceneNode(&sceneGraph, root, getGridPosition(d, side, districtSpacing), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+        districtNodes.push_back(district);
+
+        for (int b=0; b<branching; ++b) {
+
+            int building = addSceneNode(&sceneGraph, district, getGridPosition(b, side, buildingSpacing), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+
+            // The cubes stand on the ground
+            for (int c=0; c<branching; ++c) {
+                float height = 0.5f + rand() / (float)RAND_MAX * 2.5f;
+                addSceneNode(&sceneGraph, building, getGridPosition(c, side, CUBE_SPACING) + glm::vec3(0.0f, height, 0.0f),
+                        glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.5f, height, 0.5f));
+            }
+
+        }
+
+    }
+
+    std::vector<int> newIndices;
+    finishSceneGraph(&sceneGraph, &newIndices);
+    for (int d=0; d<branching; ++d)
+        districtNodes[d] = newIndices[districtNodes[d]];
+
+    // The cubes are the deepest nodes, so they come last
+    firstCubeNode = sceneGraph.levelStarts[sceneGraph.numLevels - 1];
+    numCubes = sceneGraph.numNodes - firstCubeNode;
+    movingCubes = glm::min(movingCubes, numCubes);
+
+    updateSceneGraph(&sceneGraph, &jobSystem);
+
+    // Look at the center of the scene from above one of its edges
+    cameraProperties[0] = 0.0f;
+    cameraProperties[1] = extent * 0.3f + 4.0f;
+    cameraProperties[2] = extent * 0.6f + 4.0f;
+    zFar = glm::length(glm::vec3(cameraProperties[0], cameraProperties[1], cameraProperties[2])) + extent;
+    lightProperties[0] = 0.0f;
+    lightProperties[1] = extent * 0.5f + 4.0f;
+    lightProperties[2] = 0.0f;
+
+}
+
+/*
+ * Move the given number of districts and cubes, turning the districts around their center and
+ * bobbing the cubes up and down. Everything else stays where it is.
+ */
+void animateScene(int numDistricts, int numMovingCubes, float time) {
+
+    for (int d=0; d<numDistricts; ++d)
+        setSceneNodeRotation(&sceneGraph, districtNodes[d], glm::angleAxis(time * 0.5f + d, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+    for (int c=0; c<numMovingCubes; ++c) {
+        int node = firstCubeNode + (int)((long long)c * MOVING_CUBE_STRIDE % numCubes);
+        glm::vec3 translation = sceneGraph.translations[node];
+        translation.y = sceneGraph.scales[node].y * (1.5f + 0.5f * sinf(time * 3.0f + c));
+        setSceneNodeTransform(&sceneGraph, node, translation, sceneGraph.rotations[node], sceneGraph.scales[node]);
+    }
+
+}
+
+/*
+ * Upload the world matrices changed by the last update, returning the number of bytes uploaded
+ */
+long long uploadSceneChanges() {
+
+    long long bytes = 0;
+
+    getSceneUploadRanges(&sceneGraph, UPLOAD_GAP, &uploadRanges);
+    for (int r=0; r<(int)uploadRanges.size(); ++r) {
+        GLsizeiptr size = (uploadRanges[r].end - uploadRanges[r].begin) * sizeof(glm::mat4);
+        glNamedBufferSubData(vertexBufferNames[WORLD_MATRICES], uploadRanges[r].begin * sizeof(glm::mat4), size,
+                &sceneGraph.worldMatrices[uploadRanges[r].begin][0][0]);
+        bytes += size;
+    }
+
+    return bytes;
+
+}
+
+/*
+ * Draw OpenGL screne
+ */
+void drawGLScene() {
+
+    // Clear color and depth buffers
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Set the view matrix
+    glm::mat4 view = glm::lookAt(glm::vec3(cameraProperties[0], cameraProperties[1], cameraProperties[2]), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    memcpy(viewMatrixPtr, &view[0][0], 16 * sizeof(GLfloat));
+
+    // Move what moves and recompute the world matrices below it
+    double startTime = glfwGetTime();
+    if (!paused)
+        animateScene(movingDistricts, movingCubes, (float)glfwGetTime());
+    updateSceneGraph(&sceneGraph, &jobSystem);
+    double uploadStartTime = glfwGetTime();
+    updateTime += uploadStartTime - startTime;
+
+    // Upload the changed matrices
+    uploadedBytes += uploadSceneChanges();
+    uploadTime += glfwGetTime() - uploadStartTime;
+    changedNodes += sceneGraph.changedNodes;
+
+    // Activate the program
+    glUseProgram(programName);
+
+    // Activate the vertex array
+    glBindVertexArray(vertexArrayName);
+
+    // Bind buffers to GLSL uniform indices
+    glBindBufferBase(GL_UNIFORM_BUFFER, TRANSFORM0, vertexBufferNames[GLOBAL_MATRICES]);
+    glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT, vertexBufferNames[LIGHT_PROPERTIES]);
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL, vertexBufferNames[MATERIAL_PROPERTIES]);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA, vertexBufferNames[CAMERA_PROPERTIES]);
+
+    // Bind the world matrices of all the nodes
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, NODE_STORAGE, vertexBufferNames[WORLD_MATRICES]);
+
+    // Draw an instance per cube, the nodes above them only placing them
+    glUniform1i(FIRST_NODE_LOCATION, firstCubeNode);
+    glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, numCubes);
+
+    // Disable
+    glUseProgram(0);
+    glBindVertexArray(0);
+
+    // Print the averages once a second
+    statisticsFrames++;
+    double time = glfwGetTime();
+    if (time - statisticsTime >= 1.0) {
+        printf("Update %.3f ms, upload %.3f ms, %lld of %d nodes changed, %.2f MB uploaded per frame\n",
+                updateTime / statisticsFrames * 1000.0, uploadTime / statisticsFrames * 1000.0,
+                changedNodes / statisticsFrames, sceneGraph.numNodes, uploadedBytes / statisticsFrames / 1048576.0);
+        updateTime = uploadTime = 0.0;
+        changedNodes = uploadedBytes = 0;
+        statisticsFrames = 0;
+        statisticsTime = time;
+    }
+
+}
+
+void resizeGL(int width, int height) {
+
+    // Prevent division by zero
+    if (height == 0)
+        height = 1;
+
+    // Change the projection matrix
+    glm::mat4 proj = glm::perspective(3.14f/2.0f, (float)width/height, 1.0f, zFar);
+    memcpy(projectionMatrixPtr, &proj[0][0], 16 * sizeof(GLfloat));
+
+    // Set the OpenGL viewport
+    glViewport(0, 0, width, height);
+
+}
+
+/*
+ * Measure the update and upload with a growing part of the scene moving, ending with every node
+ * being recomputed
+ */
+void runUpdateBenchmark() {
+
+    int numDistricts = (int)districtNodes.size();
+    int cases[][2] = {
+        { 0, 0 }, { 0, 1 }, { 0, 1024 }, { 0, 65536 }, { 1, 0 }, { numDistricts / 10, 0 }, { numDistricts, 0 }
+    };
+    int numCases = sizeof(cases) / sizeof(cases[0]);
+
+    printf("Scene graph of %d nodes, %d levels, %d workers\n", sceneGraph.numNodes, sceneGraph.numLevels, jobSystem.numWorkers);
+    printf("%10s %8s %10s %8s %12s %12s %14s\n", "districts", "cubes", "changed", "ranges", "update (ms)", "upload (ms)", "ns per change");
+
+    for (int c=0; c<=numCases; ++c) {
+
+        double updateTime = 0.0, uploadTime = 0.0;
+        for (int u=0; u<BENCHMARK_UPDATES; ++u) {
+
+            double startTime = glfwGetTime();
+            if (c < numCases)
+                animateScene(cases[c][0], glm::min(cases[c][1], numCubes), u * 0.01f);
+            else
+                markSceneNodeDirty(&sceneGraph, 0);
+            updateSceneGraph(&sceneGraph, &jobSystem);
+            double uploadStartTime = glfwGetTime();
+            uploadSceneChanges();
+            glFinish();
+            updateTime += uploadStartTime - startTime;
+            uploadTime += glfwGetTime() - uploadStartTime;
+
+        }
+        updateTime = updateTime / BENCHMARK_UPDATES * 1000.0;
+        uploadTime = uploadTime / BENCHMARK_UPDATES * 1000.0;
+
+        if (c < numCases)
+            printf("%10d %8d ", cases[c][0], glm::min(cases[c][1], numCubes));
+        else
+            printf("%19s ", "everything");
+        printf("%10d %8d %12.3f %12.3f %14.1f\n", sceneGraph.changedNodes, (int)uploadRanges.size(), updateTime, uploadTime,
+                sceneGraph.changedNodes ? updateTime * 1e6 / sceneGraph.changedNodes : 0.0);
+
+    }
+
+}
+
+/*
+ * Error callback function for GLFW
+ */
+static void glfwErrorCallback(int error, const char* description) {
+    fprintf(stderr, "Error: %s\n", description);
+}
+
+/*
+ * Input event callback function for GLFW
+ */
+static void glfwKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+    // Cycle through the frame pacing modes
+    if (key == GLFW_KEY_F && action == GLFW_PRESS)
+        cycleFramePacingMode(&framePacer);
+
+    if (action != GLFW_PRESS && action != GLFW_REPEAT)
+        return;
+
+    // Change the number of districts turning
+    if (key == GLFW_KEY_UP || key == GLFW_KEY_DOWN) {
+        movingDistricts = glm::clamp(movingDistricts + (key == GLFW_KEY_UP ? 1 : -1), 0, (int)districtNodes.size());
+        printf("%d districts moving\n", movingDistricts);
+    }
+
+    // Double or halve the number of cubes bobbing
+    if (key == GLFW_KEY_RIGHT || key == GLFW_KEY_LEFT) {
+        movingCubes = key == GLFW_KEY_RIGHT ? glm::min(glm::max(movingCubes * 2, 1), numCubes) : movingCubes / 2;
+        printf("%d cubes moving\n", movingCubes);
+    }
+
+    // Stop everything, leaving nothing to update
+    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
+        paused = !paused;
+}
+
+/*
+ * Window size changed callback function for GLFW
+ */
+void glfwWindowSizeCallback(GLFWwindow* window, int width, int height) {
+
+    resizeGL(width, height);
+
+}
+
+/*
+ * Program entry function
+ */
+int main(int nargs, const char **argv) {
+
+    // The number of children of the nodes above the cubes and the number of workers can be given on
+    // the command line, a worker per processor core being used by default, and -benchmark measures
+    // the update with a growing part of the scene moving
+    int branching = DEFAULT_BRANCHING, numWorkers = 0, updateBenchmark = 0;
+    for (int a=1; a<nargs; ++a) {
+        if (strcmp(argv[a], "-benchmark") == 0)
+            updateBenchmark = 1;
+        else if (strcmp(argv[a], "-workers") == 0 && a + 1 < nargs && atoi(argv[a+1]) > 0)
+            numWorkers = atoi(argv[++a]);
+        else if (atoi(argv[a]) > 0)
+            branching = atoi(argv[a]);
+        else {
+            printf("Usage: %s [branching] [-workers n] [-benchmark]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Start the workers and build the scene before the buffers are created
+    initJobSystem(&jobSystem, numWorkers);
+    createScene(branching);
+
+    // Set error callback
+    glfwSetErrorCallback(glfwErrorCallback);
+
+    // Initialize GLFW
+    if (!glfwInit()) {
+        printf("Failed to initialize GLFW\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Specify minimum OpenGL version
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+
+    // Create window
+    GLFWwindow* window = glfwCreateWindow(DEFAULT_WIDTH, DEFAULT_HEIGHT, "Scene graph", NULL, NULL);
+    if (!window) {
+        printf("Failed to create GLFW window\n");
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Set input key event callback
+    glfwSetKeyCallback(window, glfwKeyCallback);
+
+    // Set window resize callback
+    glfwSetWindowSizeCallback(window, glfwWindowSizeCallback);
+
+    // Make the context current
+    glfwMakeContextCurrent(window);
+
+    // Initialize GLEW
+    if (glewInit() != GLEW_OK) {
+        printf("Failed to initialize GLEW\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Make GLFW swap buffers directly
+    glfwSwapInterval(0);
+
+    // Initialize OpenGL
+    if (!initGL()) {
+        printf("Failed to initialize OpenGL\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+
+    // Initialize OpenGL view
+    resizeGL(DEFAULT_WIDTH, DEFAULT_HEIGHT);
+
+    // Measure the update instead of running
+    if (updateBenchmark) {
+        runUpdateBenchmark();
+        destroyJobSystem(&jobSystem);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        exit(EXIT_SUCCESS);
+    }
+
+    statisticsTime = glfwGetTime();
+
+    // Pace the frames to the refresh rate of the monitor
+    initFramePacer(&framePacer, PACING_JUST_IN_TIME);
+    printf("%d nodes, %d cubes\n", sceneGraph.numNodes, numCubes);
+    printf("UP/DOWN changes the districts moving, RIGHT/LEFT the cubes moving, SPACE stops everything, F cycles through the frame pacing modes\n");
+
+    // Run a loop until the window is closed
+    while (!glfwWindowShouldClose(window)) {
+
+        // Wait for the next frame and poll for input events
+        beginPacedFrame(&framePacer);
+
+        // Draw OpenGL screne
+        drawGLScene();
+
+        // Swap buffers
+        glfwSwapBuffers(window);
+
+        // Issue the fence and timestamp of the frame
+        endPacedFrame(&framePacer);
+
+    }
+
+    // Print the statistics of the last pacing mode
+    destroyFramePacer(&framePacer);
+
+    // Stop the workers
+    destroyJobSystem(&jobSystem);
+
+    // Shutdown GLFW
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    // Exit
+    exit(EXIT_SUCCESS);
+
+}
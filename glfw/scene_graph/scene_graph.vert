@@ -0,0 +1,52 @@
+#version 450
+
+// Incoming vertex position, Model Space.
+layout (location = 0) in vec3 position;
+
+// Incoming vertex color.
+layout (location = 1) in vec3 color;
+
+// Incoming normal
+layout (location = 2) in vec3 normal;
+
+// Projection and view matrices.
+layout (binding = 0, std140) uniform Transform0
+{
+    mat4 proj;
+    mat4 view;
+};
+
+// World matrix of every node of the scene graph
+layout (binding = 0, std430) readonly buffer Nodes
+{
+    mat4 worldMatrices[];
+};
+
+// Node drawn by the first instance, every following instance draws the next node
+layout (location = 0) uniform int firstNode;
+
+// Output
+layout (location = 0) out Block
+{
+    vec3 interpolatedColor;
+    vec3 N;
+    vec3 worldVertex;
+};
+
+void main() {
+
+    mat4 model = worldMatrices[firstNode + gl_InstanceID];
+
+    // Normally gl_Position is in Clip Space and we calculate it by multiplying together all the matrices
+    gl_Position = proj * (view * (model * vec4(position, 1)));
+
+    // Set the world vertex for calculating the light direction in the fragment shader
+    worldVertex = vec3(model * vec4(position, 1));
+
+    // Set the transformed normal, the cubes being scaled differently along each axis
+    N = transpose(inverse(mat3(model))) * normal;
+
+    // We assign the color to the outgoing variable.
+    interpolatedColor = color;
+
+}
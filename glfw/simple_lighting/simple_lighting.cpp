@@ -6,6 +6,10 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include "../common/shader_reload.h"
+#include "../common/asset_io.h"
+#include "../common/frame_pacer.h"
+
 #define DEFAULT_WIDTH 1024
 #define DEFAULT_HEIGHT 768
 
@@ -116,38 +120,11 @@ GLuint programName;
 GLuint vertexArrayName;
 GLuint vertexBufferNames[7];
 
-/*
- * Read shader source file from disk
- */
-char *readSourceFile(const char *filename, int *size) {
-
-    // Open the file as read only
-    FILE *file = fopen(filename, "r");
-
-    // Find the end of the file to determine the file size
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
-
-    // Rewind
-    fseek(file, 0, SEEK_SET); 
-
-    // Allocate memory for the source and initialize it to 0
-    char *source = (char *)malloc(fileSize + 1);
-    for (int i = 0; i <= fileSize; i++) source[i] = 0;
-
-    // Read the source
-    fread(source, fileSize, 1, file);
-
-    // Close the file
-    fclose(file);
-
-    // Store the size of the file in the output variable
-    *size = fileSize-1;
-
-    // Return the shader source
-    return source;
+// Reloader rebuilding the program when the shader sources change
+ShaderReloader shaderReloader;
 
-}
+// Pacer of the main loop
+FramePacer framePacer;
 
 /*
  * Callback function for OpenGL debug messages 
@@ -220,9 +197,14 @@ int initGL() {
 
     // Load and compile vertex shader
     GLuint vertexName = glCreateShader(GL_VERTEX_SHADER);
-    int vertexLength = 0;
-    char *vertexSource = readSourceFile("simple_lighting.vert", &vertexLength);
-    glShaderSource(vertexName, 1, (const char * const *)&vertexSource, &vertexLength);
+    AssetView vertexSource;
+    if (!openAsset("simple_lighting.vert", &vertexSource)) {
+        printf("ERROR Unable to read simple_lighting.vert\n");
+        return 0;
+    }
+    GLint vertexLength = (GLint)vertexSource.size;
+    glShaderSource(vertexName, 1, &vertexSource.data, &vertexLength);
+    closeAsset(&vertexSource);
     GLint compileStatus;
     glCompileShader(vertexName);
     glGetShaderiv(vertexName, GL_COMPILE_STATUS, &compileStatus);
@@ -233,15 +215,20 @@ int initGL() {
         glGetShaderInfoLog(vertexName, logSize, &logSize, errorLog);
         glDeleteShader(vertexName);
         printf("VERTEX ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(vertexSource);
 
     // Load and compile fragment shader
     GLuint fragmentName = glCreateShader(GL_FRAGMENT_SHADER);
-    int fragmentLength = 0;
-    char *fragmentSource = readSourceFile("simple_lighting.frag", &fragmentLength);
-    glShaderSource(fragmentName, 1, (const char * const *)&fragmentSource, &fragmentLength);
+    AssetView fragmentSource;
+    if (!openAsset("simple_lighting.frag", &fragmentSource)) {
+        printf("ERROR Unable to read simple_lighting.frag\n");
+        return 0;
+    }
+    GLint fragmentLength = (GLint)fragmentSource.size;
+    glShaderSource(fragmentName, 1, &fragmentSource.data, &fragmentLength);
+    closeAsset(&fragmentSource);
     glCompileShader(fragmentName);
     glGetShaderiv(fragmentName, GL_COMPILE_STATUS, &compileStatus);
     if (!compileStatus) {
@@ -252,9 +239,9 @@ int initGL() {
         glDeleteShader(fragmentName);
 
         printf("FRAGMENT ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(fragmentSource);
 
     // Create and link vertex program
     programName = glCreateProgram();
@@ -270,6 +257,7 @@ int initGL() {
         glGetProgramInfoLog(programName, logSize, &logSize, errorLog);
 
         printf("LINK ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
 
@@ -349,6 +337,10 @@ static void glfwErrorCallback(int error, const char* description) {
 static void glfwKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+    // Cycle through the frame pacing modes
+    if (key == GLFW_KEY_F && action == GLFW_PRESS)
+        cycleFramePacingMode(&framePacer);
 }
 
 /*
@@ -417,20 +409,47 @@ int main(void) {
     // Initialize OpenGL view
     resizeGL(DEFAULT_WIDTH, DEFAULT_HEIGHT);
 
+    // Start watching the shader sources for changes
+    if (initShaderReloader(&shaderReloader, window, 4, 5)) {
+        ShaderFile shaderFiles[] = {
+            { GL_VERTEX_SHADER, "simple_lighting.vert" },
+            { GL_FRAGMENT_SHADER, "simple_lighting.frag" }
+        };
+        watchProgram(&shaderReloader, &programName, shaderFiles, 2);
+        startShaderReloader(&shaderReloader);
+    } else
+        printf("Failed to start shader reloading\n");
+
+    // Pace the frames to the refresh rate of the monitor
+    initFramePacer(&framePacer, PACING_JUST_IN_TIME);
+    printf("F cycles through the frame pacing modes\n");
+
     // Run a loop until the window is closed
     while (!glfwWindowShouldClose(window)) {
 
+        // Wait for the next frame and poll for input events
+        beginPacedFrame(&framePacer);
+
+        // Swap in programs that have been rebuilt since the previous frame
+        updateShaderReloader(&shaderReloader);
+
         // Draw OpenGL screne
         drawGLScene();
 
         // Swap buffers
         glfwSwapBuffers(window);
 
-        // Poll fow input events
-        glfwPollEvents();
+        // Issue the fence and timestamp of the frame
+        endPacedFrame(&framePacer);
 
     }
 
+    // Stop reloading shaders
+    destroyShaderReloader(&shaderReloader);
+
+    // Print the statistics of the last pacing mode
+    destroyFramePacer(&framePacer);
+
     // Shutdown GLFW
     glfwDestroyWindow(window);
     glfwTerminate();
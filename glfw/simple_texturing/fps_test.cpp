@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -8,6 +11,9 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include "../common/asset_io.h"
+#include "../common/triple_buffer.h"
+#include "../common/frame_pacer.h"
 
 #define DEFAULT_WIDTH 1024
 #define DEFAULT_HEIGHT 768
@@ -30,7 +36,16 @@
 #define TRANSFORM1 1
 
 #define CAMERA_SPEED 5.0f
-#define CAMERA_SENSITITVITY 0.02
+// Radians per pixel of mouse movement
+#define CAMERA_SENSITITVITY 0.002f
+// Largest pitch up or down, just short of looking straight up or down
+#define MAX_PITCH 1.5f
+#define MODEL_SPEED 0.3f
+
+// Number of simulation steps per second, independent of the frame rate
+#define SIMULATION_RATE 120.0
+// The simulation skips ahead instead of catching up when it falls further behind than this
+#define MAX_SIMULATION_LAG 0.25
 
 // Keyboard state names
 #define CONTROL_FORWARD 0
@@ -39,8 +54,30 @@
 #define CONTROL_RIGHT 3
 #define NUM_KEYS 4
 
-// Keyboard state
-int keys[NUM_KEYS];
+// Keyboard state, written by the main thread and read by the simulation
+std::atomic<int> keys[NUM_KEYS];
+
+// Position of the disabled cursor, which keeps moving without bounds
+std::atomic<double> cursorX, cursorY;
+
+/*
+ * A structure for storing the state of the camera and the model
+ */
+typedef struct {
+    glm::vec3 cameraPosition;
+    float yaw;
+    float pitch;
+    float modelAngle;
+} WorldState;
+
+/*
+ * A structure for storing a simulation step, the state before it and the state at its end time
+ */
+typedef struct {
+    WorldState previous;
+    WorldState current;
+    double time;
+} SimulationFrame;
 
 // Vertices
 GLfloat vertices[] = {
@@ -92,8 +129,6 @@ GLshort indices[] {
     20, 21, 22, 22, 23, 20
 };
 
-GLfloat pitch, yaw;
-    
 // Pointers for updating GPU data
 GLfloat *projectionMatrixPtr;
 GLfloat *viewMatrixPtr;
@@ -105,47 +140,19 @@ GLuint vertexArrayName;
 GLuint vertexBufferNames[4];
 GLuint textureName;
 
-double timeDelta;
-double previousTime;
-
-glm::vec3 cameraPosition;
-glm::vec3 cameraForward;
-glm::vec3 cameraRight;
-
-int centerX, centerY;
-
-/*
- * Read shader source file from disk
- */
-char *readSourceFile(const char *filename, int *size) {
-
-    // Open the file as read only
-    FILE *file = fopen(filename, "r");
+// Steps published by the simulation thread to the render thread
+SimulationFrame simulationFrames[3];
+TripleBuffer simulationBuffer;
 
-    // Find the end of the file to determine the file size
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
+// Whether the simulation and render threads keep running
+std::atomic<int> running;
 
-    // Rewind
-    fseek(file, 0, SEEK_SET); 
+// Window size changed by the main thread, applied by the render thread which owns the context
+std::atomic<int> windowWidth, windowHeight, windowResized;
 
-    // Allocate memory for the source and initialize it to 0
-    char *source = (char *)malloc(fileSize + 1);
-    for (int i = 0; i <= fileSize; i++) source[i] = 0;
-
-    // Read the source
-    fread(source, fileSize, 1, file);
-
-    // Close the file
-    fclose(file);
-
-    // Store the size of the file in the output variable
-    *size = fileSize-1;
-
-    // Return the shader source
-    return source;
-
-}
+// Pacer of the render thread, the mode is changed on request from the main thread
+FramePacer framePacer;
+std::atomic<int> pacingModeRequested;
 
 /*
  * Callback function for OpenGL debug messages 
@@ -209,7 +216,7 @@ int initGL() {
 
     // Load image from file
     GLint width, height, numChannels;
-    GLubyte *imageData = stbi_load("texture.png", &width, &height, &numChannels, 3); 
+    GLubyte *imageData = loadImageAsset("texture.png", &width, &height, &numChannels, 3); 
 
     // Generate texture name
     glGenTextures(1, &textureName);
@@ -234,9 +241,14 @@ int initGL() {
 
     // Load and compile vertex shader
     GLuint vertexName = glCreateShader(GL_VERTEX_SHADER);
-    int vertexLength = 0;
-    char *vertexSource = readSourceFile("simple_texturing.vert", &vertexLength);
-    glShaderSource(vertexName, 1, (const char * const *)&vertexSource, &vertexLength);
+    AssetView vertexSource;
+    if (!openAsset("simple_texturing.vert", &vertexSource)) {
+        printf("ERROR Unable to read simple_texturing.vert\n");
+        return 0;
+    }
+    GLint vertexLength = (GLint)vertexSource.size;
+    glShaderSource(vertexName, 1, &vertexSource.data, &vertexLength);
+    closeAsset(&vertexSource);
     GLint compileStatus;
     glCompileShader(vertexName);
     glGetShaderiv(vertexName, GL_COMPILE_STATUS, &compileStatus);
@@ -247,15 +259,20 @@ int initGL() {
         glGetShaderInfoLog(vertexName, logSize, &logSize, errorLog);
         glDeleteShader(vertexName);
         printf("VERTEX ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(vertexSource);
 
     // Load and compile fragment shader
     GLuint fragmentName = glCreateShader(GL_FRAGMENT_SHADER);
-    int fragmentLength = 0;
-    char *fragmentSource = readSourceFile("simple_texturing.frag", &fragmentLength);
-    glShaderSource(fragmentName, 1, (const char * const *)&fragmentSource, &fragmentLength);
+    AssetView fragmentSource;
+    if (!openAsset("simple_texturing.frag", &fragmentSource)) {
+        printf("ERROR Unable to read simple_texturing.frag\n");
+        return 0;
+    }
+    GLint fragmentLength = (GLint)fragmentSource.size;
+    glShaderSource(fragmentName, 1, &fragmentSource.data, &fragmentLength);
+    closeAsset(&fragmentSource);
     glCompileShader(fragmentName);
     glGetShaderiv(fragmentName, GL_COMPILE_STATUS, &compileStatus);
     if (!compileStatus) {
@@ -266,9 +283,9 @@ int initGL() {
         glDeleteShader(fragmentName);
 
         printf("FRAGMENT ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(fragmentSource);
 
     // Create and link vertex program
     programName = glCreateProgram();
@@ -284,6 +301,7 @@ int initGL() {
         glGetProgramInfoLog(programName, logSize, &logSize, errorLog);
 
         printf("LINK ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
 
@@ -294,37 +312,132 @@ int initGL() {
 
 }
 
+void resizeGL(GLFWwindow *window, int width, int height) {
+
+    // Prevent division by zero
+    if (height == 0)
+        height = 1;										
+  
+    // Change the projection matrix
+    glm::mat4 proj = glm::perspective(3.14f/2.0f, (float)width/height, 0.1f, 100.0f);
+    memcpy(projectionMatrixPtr, &proj[0][0], 16 * sizeof(GLfloat));
+
+    // Set the OpenGL viewport
+    glViewport(0, 0, width, height);
+
+
+}
+
+/*
+ * Get the direction the camera looks in, and the direction to its right
+ */
+glm::vec3 getCameraForward(const WorldState *state) {
+
+    return glm::vec3(-sinf(state->yaw) * cosf(state->pitch), sinf(state->pitch), -cosf(state->yaw) * cosf(state->pitch));
+
+}
+
+glm::vec3 getCameraRight(const WorldState *state) {
+
+    return glm::vec3(cosf(state->yaw), 0.0f, -sinf(state->yaw));
+
+}
+
+/*
+ * Advance the world by one simulation step, turning the camera by the mouse movement since the
+ * previous step
+ */
+void stepSimulation(WorldState *state, double lookX, double lookY) {
+
+    state->yaw -= (float)lookX * CAMERA_SENSITITVITY;
+    state->pitch = glm::clamp(state->pitch - (float)lookY * CAMERA_SENSITITVITY, -MAX_PITCH, MAX_PITCH);
+
+    glm::vec3 forward = getCameraForward(state);
+    glm::vec3 right = getCameraRight(state);
+    float distance = (float)(CAMERA_SPEED / SIMULATION_RATE);
+    if (keys[CONTROL_FORWARD])
+        state->cameraPosition += forward * distance;
+    if (keys[CONTROL_BACK])
+        state->cameraPosition -= forward * distance;
+    if (keys[CONTROL_LEFT])
+        state->cameraPosition -= right * distance;
+    if (keys[CONTROL_RIGHT])
+        state->cameraPosition += right * distance;
+
+    state->modelAngle += (float)(MODEL_SPEED / SIMULATION_RATE);
+
+}
+
+/*
+ * Simulation thread. Steps the world at a fixed rate and publishes the state before and after every
+ * step through the triple buffer, so the render thread never waits for it and always has two
+ * states to interpolate between.
+ */
+void runSimulation() {
+
+    WorldState state = simulationFrames[0].current;
+    double step = 1.0 / SIMULATION_RATE;
+    double nextTime = glfwGetTime();
+    double lastX = cursorX, lastY = cursorY;
+
+    while (running) {
+
+        // The input is sampled at the start of the step, so it is never more than one step old
+        double x = cursorX, y = cursorY;
+        WorldState previous = state;
+        stepSimulation(&state, x - lastX, y - lastY);
+        lastX = x;
+        lastY = y;
+        nextTime += step;
+
+        // The new state is the world at the end of the step
+        SimulationFrame *frame = &simulationFrames[getTripleBufferWriteIndex(&simulationBuffer)];
+        frame->previous = previous;
+        frame->current = state;
+        frame->time = nextTime;
+        publishTripleBuffer(&simulationBuffer);
+
+        // Sleep until the next step is due
+        double remaining = nextTime - glfwGetTime();
+        if (remaining > 0.0)
+            std::this_thread::sleep_for(std::chrono::duration<double>(remaining));
+        else if (remaining < -MAX_SIMULATION_LAG)
+            nextTime = glfwGetTime();
+
+    }
+
+}
+
+/*
+ * Interpolate between two world states
+ */
+WorldState interpolateWorldState(const WorldState *a, const WorldState *b, float t) {
+
+    WorldState state;
+    state.cameraPosition = glm::mix(a->cameraPosition, b->cameraPosition, t);
+    state.yaw = glm::mix(a->yaw, b->yaw, t);
+    state.pitch = glm::mix(a->pitch, b->pitch, t);
+    state.modelAngle = glm::mix(a->modelAngle, b->modelAngle, t);
+    return state;
+
+}
+
 /*
  * Draw OpenGL screne
  */
-void drawGLScene() {
+void drawGLScene(const WorldState *state) {
 
     // Clear color and depth buffers
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (keys[CONTROL_FORWARD])
-        cameraPosition = cameraPosition + cameraForward * (float)(timeDelta * CAMERA_SPEED); 
-    else if (keys[CONTROL_LEFT]) 
-        cameraPosition = cameraPosition - cameraRight * (float)(timeDelta * CAMERA_SPEED); 
-    else if (keys[CONTROL_BACK])
-        cameraPosition = cameraPosition - cameraForward * (float)(timeDelta * CAMERA_SPEED); 
-    else if (keys[CONTROL_RIGHT])
-        cameraPosition = cameraPosition + cameraRight * (float)(timeDelta * CAMERA_SPEED); 
     // Change the view matrix
-    glm::mat4 viewRot = glm::mat4(1.0f);
-    viewRot = glm::rotate(viewRot, yaw, glm::vec3(0.0f, 1.0f, 0.0f));
-    viewRot = glm::rotate(viewRot, pitch, glm::vec3(1.0f, 0.0f, 0.0f));
-    cameraForward = viewRot * glm::vec4(cameraForward, 1);
-    cameraRight = viewRot * glm::vec4(cameraRight, 1);
-    glm::mat4 viewTrans = glm::mat4(1.0f);
-    viewTrans = glm::translate(viewTrans, cameraPosition);
-    glm::mat4 view = viewTrans * viewRot;
-    glm::mat4 viewInverse = glm::inverse(view);
-    memcpy(viewMatrixPtr, &viewInverse[0][0], 16 * sizeof(GLfloat));
+    glm::vec3 cameraPosition = state->cameraPosition;
+    glm::mat4 view = glm::lookAt(cameraPosition, cameraPosition + getCameraForward(state), glm::vec3(0.0f, 1.0f, 0.0f));
+    memcpy(viewMatrixPtr, &view[0][0], 16 * sizeof(GLfloat));
 
     // Change the model matrix
     glm::mat4 model = glm::mat4(1.0);
-    model = glm::rotate(model, (float)previousTime * 0.3f, glm::vec3(0.0f, 1.0f,  0.0f));
+    model = glm::rotate(model, state->modelAngle, glm::vec3(0.0f, 1.0f,  0.0f));
     memcpy(modelMatrixPtr, &model[0][0], 16 * sizeof(GLfloat));
 
     // Activate the program, vertex array and texture
@@ -346,19 +459,45 @@ void drawGLScene() {
 
 }
 
-void resizeGL(GLFWwindow *window, int width, int height) {
+/*
+ * Render thread. Draws the world interpolated between the two states of the latest simulation step
+ * at the current time, making the motion smooth at any frame rate.
+ */
+void runRenderer(GLFWwindow *window) {
 
-    // Prevent division by zero
-    if (height == 0)
-        height = 1;										
-  
-    // Change the projection matrix
-    glm::mat4 proj = glm::perspective(3.14f/2.0f, (float)width/height, 0.1f, 100.0f);
-    memcpy(projectionMatrixPtr, &proj[0][0], 16 * sizeof(GLfloat));
+    glfwMakeContextCurrent(window);
 
-    // Set the OpenGL viewport
-    glViewport(0, 0, width, height);
+    while (running) {
+
+        // Wait for the next frame
+        if (pacingModeRequested.exchange(0))
+            cycleFramePacingMode(&framePacer);
+        beginPacedFrame(&framePacer);
+
+        // Apply a window size change
+        if (windowResized.exchange(0))
+            resizeGL(window, windowWidth, windowHeight);
+
+        // The step ends in the future, the time left of it gives the position between the states
+        const SimulationFrame *frame = &simulationFrames[acquireTripleBuffer(&simulationBuffer)];
+        float t = glm::clamp((float)(1.0 - (frame->time - glfwGetTime()) * SIMULATION_RATE), 0.0f, 1.0f);
+        WorldState state = interpolateWorldState(&frame->previous, &frame->current, t);
+
+        // Draw OpenGL screne
+        drawGLScene(&state);
+
+        // Swap buffers
+        glfwSwapBuffers(window);
 
+        // Issue the fence and timestamp of the frame
+        endPacedFrame(&framePacer);
+
+    }
+
+    // Print the statistics of the last pacing mode
+    destroyFramePacer(&framePacer);
+
+    glfwMakeContextCurrent(NULL);
 
 }
 
@@ -377,6 +516,10 @@ static void glfwKeyCallback(GLFWwindow* window, int key, int scancode, int actio
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GLFW_TRUE);
 
+    // Cycle through the frame pacing modes, on the render thread which owns the pacer
+    if (key == GLFW_KEY_F && action == GLFW_PRESS)
+        pacingModeRequested = 1;
+
     int value;
     if (action == GLFW_PRESS)
         value = 1;
@@ -395,12 +538,15 @@ static void glfwKeyCallback(GLFWwindow* window, int key, int scancode, int actio
         keys[CONTROL_RIGHT] = value;
 }
 
+/*
+ * Mouse movement callback function for GLFW. The cursor is disabled, so the position is not bound
+ * by the window and the simulation turns the camera by the change since its previous step.
+ */
 void glfwMouseCallback(GLFWwindow *window, double x, double y) {
-    
-    pitch = (x-centerX) * CAMERA_SENSITITVITY;
-    yaw = (y-centerY) * CAMERA_SENSITITVITY;
 
-    glfwSetCursorPos(window, centerX, centerY);
+    cursorX = x;
+    cursorY = y;
+
 }
 
 /*
@@ -408,10 +554,10 @@ void glfwMouseCallback(GLFWwindow *window, double x, double y) {
  */
 void glfwWindowSizeCallback(GLFWwindow* window, int width, int height) {
 
-    resizeGL(window, width, height);
-
-    centerX = width/2;
-    centerY = height/2;
+    // The render thread owns the context and applies the change before its next frame
+    windowWidth = width;
+    windowHeight = height;
+    windowResized = 1;
 
 }
 
@@ -446,7 +592,7 @@ int main(void) {
     glfwSetKeyCallback(window, glfwKeyCallback);
     glfwSetCursorPosCallback(window, glfwMouseCallback);
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     // Set window resize callback
     glfwSetWindowSizeCallback(window, glfwWindowSizeCallback);
@@ -477,30 +623,41 @@ int main(void) {
     // Initialize OpenGL view
     resizeGL(window, DEFAULT_WIDTH, DEFAULT_HEIGHT);
 
-    pitch = yaw = 0.0f;
-    cameraPosition = glm::vec3(0.0f, 0.0f, 3.0f);
-    cameraForward = glm::vec3(0.0f, 0.0f, -1.0f);
-    cameraRight = glm::vec3(1.0f, 0.0f, 0.0f);
-
-    previousTime = glfwGetTime();
-
-    // Run a loop until the window is closed
-    while (!glfwWindowShouldClose(window)) {
-
-        double timeTotal = glfwGetTime();
-        timeDelta = timeTotal - previousTime;
-        previousTime = timeTotal;
-       
-        // Draw OpenGL screne
-        drawGLScene();
-
-        // Swap buffers
-        glfwSwapBuffers(window);
-
-        // Poll fow input events
-        glfwPollEvents();
-
+    // Every slot of the triple buffer starts with the initial state, looking down the negative z-axis
+    WorldState initialState = { glm::vec3(0.0f, 0.0f, 3.0f), 0.0f, 0.0f, 0.0f };
+    for (int f=0; f<3; ++f) {
+        simulationFrames[f].previous = simulationFrames[f].current = initialState;
+        simulationFrames[f].time = glfwGetTime();
     }
+    initTripleBuffer(&simulationBuffer);
+
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    cursorX = x;
+    cursorY = y;
+
+    // Pace the render thread to the refresh rate of the monitor. The main thread handles the input
+    // events, so the pacer only waits, and in the just-in-time mode the latest simulation step is
+    // taken right after the wait.
+    initFramePacer(&framePacer, PACING_JUST_IN_TIME);
+    framePacer.pollEvents = 0;
+    printf("F cycles through the frame pacing modes\n");
+
+    // Hand the context over to the render thread and start the simulation
+    glfwMakeContextCurrent(NULL);
+    running = 1;
+    std::thread simulationThread(runSimulation);
+    std::thread renderThread(runRenderer, window);
+
+    // Handle input events on the main thread until the window is closed, as GLFW requires. The
+    // events are handled as they arrive instead of once per frame.
+    while (!glfwWindowShouldClose(window))
+        glfwWaitEvents();
+
+    // Stop the threads
+    running = 0;
+    simulationThread.join();
+    renderThread.join();
 
     // Shutdown GLFW
     glfwDestroyWindow(window);
@@ -6,6 +6,9 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include "../common/asset_io.h"
+#include "../common/frame_pacer.h"
+
 #define DEFAULT_WIDTH 1024
 #define DEFAULT_HEIGHT 768
 
@@ -44,38 +47,8 @@ GLuint programName;
 GLuint vertexArrayName;
 GLuint vertexBufferNames[3];
 
-/*
- * Read source file from disk
- */
-char *readSourceFile(const char *filename, int *size) {
-
-    // Open the file
-    FILE *file = fopen(filename, "r");
-
-    // Find the end of the file to know the file size
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
-
-    // Rewind
-    fseek(file, 0, SEEK_SET); 
-
-    // Allocate memory for the source and initialize it to 0
-    char *source = (char *)malloc(fileSize + 1);
-    for (int i = 0; i <= fileSize; i++) source[i] = 0;
-
-    // Read the source
-    fread(source, fileSize, 1, file);
-
-    // Close the file
-    fclose(file);
-
-    // Store the size of the file in the output variable
-    *size = fileSize-1;
-
-    // Return the shader source
-    return source;
-
-}
+// Pacer of the main loop
+FramePacer framePacer;
 
 /*
  * Callback function for OpenGL debug messages 
@@ -119,9 +92,14 @@ int initGL() {
     glVertexArrayVertexBuffer(vertexArrayName, STREAM0, vertexBufferNames[VERTICES], 0, 3 * sizeof(GLfloat));
 
     GLuint vertexName = glCreateShader(GL_VERTEX_SHADER);
-    int vertexLength = 0;
-    char *vertexSource = readSourceFile("tessellation.vert", &vertexLength);
-    glShaderSource(vertexName, 1, (const char * const *)&vertexSource, &vertexLength);
+    AssetView vertexSource;
+    if (!openAsset("tessellation.vert", &vertexSource)) {
+        printf("ERROR Unable to read tessellation.vert\n");
+        return 0;
+    }
+    GLint vertexLength = (GLint)vertexSource.size;
+    glShaderSource(vertexName, 1, &vertexSource.data, &vertexLength);
+    closeAsset(&vertexSource);
     GLint compileStatus;
     glCompileShader(vertexName);
     glGetShaderiv(vertexName, GL_COMPILE_STATUS, &compileStatus);
@@ -132,14 +110,19 @@ int initGL() {
         glGetShaderInfoLog(vertexName, logSize, &logSize, errorLog);
         glDeleteShader(vertexName);
         printf("ERROR VERTEX%s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(vertexSource);
 
     GLuint tessEvalName = glCreateShader(GL_TESS_EVALUATION_SHADER);
-    int tessLength = 0;
-    char *tessSource = readSourceFile("tessellation.tes", &tessLength);
-    glShaderSource(tessEvalName, 1, (const char * const *)&tessSource, &tessLength);
+    AssetView tessSource;
+    if (!openAsset("tessellation.tes", &tessSource)) {
+        printf("ERROR Unable to read tessellation.tes\n");
+        return 0;
+    }
+    GLint tessLength = (GLint)tessSource.size;
+    glShaderSource(tessEvalName, 1, &tessSource.data, &tessLength);
+    closeAsset(&tessSource);
     glCompileShader(tessEvalName);
     glGetShaderiv(tessEvalName, GL_COMPILE_STATUS, &compileStatus);
     if (!compileStatus) {
@@ -149,14 +132,19 @@ int initGL() {
         glGetShaderInfoLog(tessEvalName, logSize, &logSize, errorLog);
         glDeleteShader(tessEvalName);
         printf("ERROR TESSESELATION%s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(tessSource);
 
     GLuint fragmentName = glCreateShader(GL_FRAGMENT_SHADER);
-    int fragmentLength = 0;
-    char *fragmentSource = readSourceFile("tessellation.frag", &fragmentLength);
-    glShaderSource(fragmentName, 1, (const char * const *)&fragmentSource, &fragmentLength);
+    AssetView fragmentSource;
+    if (!openAsset("tessellation.frag", &fragmentSource)) {
+        printf("ERROR Unable to read tessellation.frag\n");
+        return 0;
+    }
+    GLint fragmentLength = (GLint)fragmentSource.size;
+    glShaderSource(fragmentName, 1, &fragmentSource.data, &fragmentLength);
+    closeAsset(&fragmentSource);
     glCompileShader(fragmentName);
     glGetShaderiv(fragmentName, GL_COMPILE_STATUS, &compileStatus);
     if (!compileStatus) {
@@ -167,9 +155,9 @@ int initGL() {
         glDeleteShader(fragmentName);
 
         printf("ERROR FRAGMENT%s\n", errorLog);
+        free(errorLog);
         return 0;
     }
-    free(fragmentSource);
 
     // Create and link vertex program
     programName = glCreateProgram();
@@ -186,6 +174,7 @@ int initGL() {
         glGetProgramInfoLog(programName, logSize, &logSize, errorLog);
 
         printf("LINK ERROR %s\n", errorLog);
+        free(errorLog);
         return 0;
     }
 
@@ -268,6 +257,10 @@ static void glfwErrorCallback(int error, const char* description) {
 static void glfwKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+    // Cycle through the frame pacing modes
+    if (key == GLFW_KEY_F && action == GLFW_PRESS)
+        cycleFramePacingMode(&framePacer);
 }
 
 /*
@@ -336,20 +329,30 @@ int main(void) {
     // Initialize OpenGL view
     resizeGL(DEFAULT_WIDTH, DEFAULT_HEIGHT);
 
+    // Pace the frames to the refresh rate of the monitor
+    initFramePacer(&framePacer, PACING_JUST_IN_TIME);
+    printf("F cycles through the frame pacing modes\n");
+
     // Run a loop until the window is closed
     while (!glfwWindowShouldClose(window)) {
 
+        // Wait for the next frame and poll for input events
+        beginPacedFrame(&framePacer);
+
         // Draw OpenGL screne
         drawGLScene();
 
         // Swap buffers
         glfwSwapBuffers(window);
         
-        // Poll fow input events
-        glfwPollEvents();
+        // Issue the fence and timestamp of the frame
+        endPacedFrame(&framePacer);
 
     }
 
+    // Print the statistics of the last pacing mode
+    destroyFramePacer(&framePacer);
+
     // Shutdown GLFW
     glfwDestroyWindow(window);
     glfwTerminate();